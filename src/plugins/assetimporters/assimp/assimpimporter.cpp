@@ -851,9 +851,11 @@ QString AssimpImporter::generateMeshFile(aiNode *, QFile &file, const AssimpUtil
         return QStringLiteral("Could not open device to write mesh file");
 
     QString errorString;
-    const auto mesh = AssimpUtils::generateMeshData(*m_scene, meshes, m_generateLightmapUV, m_useFloatJointIndices, errorString);
+    auto mesh = AssimpUtils::generateMeshData(*m_scene, meshes, m_generateLightmapUV, m_useFloatJointIndices, errorString);
 
     if (mesh.isValid()) {
+        if (m_generateMeshBVH && !mesh.generateBVH())
+            qWarning("Failed to generate BVH for %s", qPrintable(file.fileName()));
         if (!mesh.save(&file))
             return QString::asprintf("Failed to serialize mesh to %s", qPrintable(file.fileName()));
     } else {
@@ -2122,6 +2124,7 @@ void AssimpImporter::processOptions(const QVariantMap &options)
     m_binaryKeyframes = checkBooleanOption(QStringLiteral("useBinaryKeyframes"), optionsObject);
 
     m_generateLightmapUV = checkBooleanOption(QStringLiteral("generateLightmapUV"), optionsObject);
+    m_generateMeshBVH = checkBooleanOption(QStringLiteral("generateMeshBVH"), optionsObject);
 }
 
 bool AssimpImporter::checkBooleanOption(const QString &optionName, const QJsonObject &options)
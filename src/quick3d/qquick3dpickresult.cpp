@@ -62,6 +62,25 @@ QQuick3DPickResult::QQuick3DPickResult(QQuick3DModel *hitObject,
 {
 }
 
+QQuick3DPickResult::QQuick3DPickResult(QQuick3DModel *hitObject,
+                                       float distanceFromCamera,
+                                       const QVector2D &uvPosition,
+                                       const QVector3D &scenePosition,
+                                       const QVector3D &position,
+                                       const QVector3D &normal,
+                                       int instanceIndex,
+                                       const QVector3D &sceneNormal)
+    : m_objectHit(hitObject)
+    , m_distance(distanceFromCamera)
+    , m_uvPosition(uvPosition)
+    , m_scenePosition(scenePosition)
+    , m_position(position)
+    , m_normal(normal)
+    , m_instanceIndex(instanceIndex)
+    , m_sceneNormal(sceneNormal)
+{
+}
+
 /*!
     \qmlproperty Model PickResult::objectHit
     \readonly
@@ -115,7 +134,8 @@ QVector3D QQuick3DPickResult::scenePosition() const
     \readonly
 
     This property holds the scene position of the hit in local coordinate
-    space.
+    space. For an instanced model, this is the local coordinate space of the
+    instance that was hit.
 */
 QVector3D QQuick3DPickResult::position() const
 {
@@ -147,7 +167,25 @@ QVector3D QQuick3DPickResult::sceneNormal() const
     if (!m_objectHit)
         return QVector3D();
 
+    if (m_instanceIndex >= 0)
+        return m_sceneNormal;
+
     return m_objectHit->mapDirectionToScene(m_normal);
 }
 
+/*!
+    \qmlproperty int PickResult::instanceIndex
+    \readonly
+    \since 6.4
+
+    This property holds the index of the instance that was hit when the model
+    is instanced, and \c -1 otherwise.
+
+    \sa Model::instancing
+*/
+int QQuick3DPickResult::instanceIndex() const
+{
+    return m_instanceIndex;
+}
+
 QT_END_NAMESPACE
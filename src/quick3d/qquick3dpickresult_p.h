@@ -61,6 +61,7 @@ class Q_QUICK3D_EXPORT QQuick3DPickResult
     Q_PROPERTY(QVector3D position READ position CONSTANT)
     Q_PROPERTY(QVector3D normal READ normal CONSTANT)
     Q_PROPERTY(QVector3D sceneNormal READ sceneNormal CONSTANT)
+    Q_PROPERTY(int instanceIndex READ instanceIndex CONSTANT)
 
 public:
 
@@ -71,6 +72,14 @@ public:
                                 const QVector3D &scenePosition,
                                 const QVector3D &position,
                                 const QVector3D &normal);
+    explicit QQuick3DPickResult(QQuick3DModel *hitObject,
+                                float distanceFromCamera,
+                                const QVector2D &uvPosition,
+                                const QVector3D &scenePosition,
+                                const QVector3D &position,
+                                const QVector3D &normal,
+                                int instanceIndex,
+                                const QVector3D &sceneNormal);
     QQuick3DModel *objectHit() const;
     float distance() const;
     QVector2D uvPosition() const;
@@ -78,6 +87,7 @@ public:
     QVector3D position() const;
     QVector3D normal() const;
     QVector3D sceneNormal() const;
+    int instanceIndex() const;
 
 private:
     QQuick3DModel *m_objectHit;
@@ -86,6 +96,9 @@ private:
     QVector3D m_scenePosition;
     QVector3D m_position;
     QVector3D m_normal;
+    int m_instanceIndex = -1;
+    // Only set for instances, whose transform is not known by the model
+    QVector3D m_sceneNormal;
 };
 
 QT_END_NAMESPACE
@@ -120,6 +120,71 @@ float QQuick3DRenderStats::maxFrameTime() const
     return m_maxFrameTime;
 }
 
+/*!
+    \qmlproperty int QtQuick3D::RenderStats::visibleObjectCount
+    \readonly
+
+    This property holds the number of renderable objects, that is model
+    subsets and particle systems, that passed frustum culling and were
+    prepared for rendering in the last frame.
+
+    \sa culledObjectCount, Camera::frustumCullingEnabled
+*/
+int QQuick3DRenderStats::visibleObjectCount() const
+{
+    return m_results.visibleObjectCount;
+}
+
+/*!
+    \qmlproperty int QtQuick3D::RenderStats::culledObjectCount
+    \readonly
+
+    This property holds the number of renderable objects that were skipped in
+    the last frame because they were outside of the camera's view frustum.
+    It is always 0 when frustum culling is not enabled on the camera.
+
+    \sa visibleObjectCount, Camera::frustumCullingEnabled
+*/
+int QQuick3DRenderStats::culledObjectCount() const
+{
+    return m_results.culledObjectCount;
+}
+
+/*!
+    \qmlproperty int QtQuick3D::RenderStats::autoInstancedObjectCount
+    \readonly
+
+    This property holds the number of model subsets that were merged into
+    instanced draw calls in the last frame. It is always 0 unless
+    auto-instancing is enabled by setting the \c QT_QUICK3D_AUTO_INSTANCING
+    environment variable.
+
+    \sa visibleObjectCount
+*/
+int QQuick3DRenderStats::autoInstancedObjectCount() const
+{
+    return m_results.autoInstancedObjectCount;
+}
+
+/*!
+    \qmlproperty int QtQuick3D::RenderStats::pendingShaderCompilations
+    \readonly
+
+    This property holds the number of material shaders that are being compiled
+    in the background. It is always 0 unless asynchronous shader compilation
+    is enabled by setting the \c QT_QUICK3D_ASYNC_SHADER_COMPILATION
+    environment variable. While the shaders of a model are compiling, the
+    model is drawn with the shaders it was rendered with before, or, when
+    there are none or the variable is set to \c skip, not drawn at all.
+
+    Unlike the other properties, the change signal is emitted right away, so
+    it can be used to tell when the compilations have completed.
+*/
+int QQuick3DRenderStats::pendingShaderCompilations() const
+{
+    return m_pendingShaderCompilations;
+}
+
 void QQuick3DRenderStats::startSync()
 {
     m_syncStartTime = timestamp();
@@ -148,6 +213,21 @@ void QQuick3DRenderStats::endRenderPrepare()
     m_results.renderPrepareTime = timestamp() - m_renderPrepareStartTime;
 }
 
+void QQuick3DRenderStats::setObjectCounts(int visible, int culled, int autoInstanced)
+{
+    m_results.visibleObjectCount = visible;
+    m_results.culledObjectCount = culled;
+    m_results.autoInstancedObjectCount = autoInstanced;
+}
+
+void QQuick3DRenderStats::setPendingShaderCompilations(int count)
+{
+    if (m_pendingShaderCompilations == count)
+        return;
+    m_pendingShaderCompilations = count;
+    emit pendingShaderCompilationsChanged();
+}
+
 void QQuick3DRenderStats::endRender(bool dump)
 {
     ++m_frameCount;
@@ -178,6 +258,15 @@ void QQuick3DRenderStats::endRender(bool dump)
             m_notifiedResults.renderPrepareTime = m_results.renderPrepareTime;
             emit renderTimeChanged();
         }
+
+        if (m_results.visibleObjectCount != m_notifiedResults.visibleObjectCount
+                || m_results.culledObjectCount != m_notifiedResults.culledObjectCount
+                || m_results.autoInstancedObjectCount != m_notifiedResults.autoInstancedObjectCount) {
+            m_notifiedResults.visibleObjectCount = m_results.visibleObjectCount;
+            m_notifiedResults.culledObjectCount = m_results.culledObjectCount;
+            m_notifiedResults.autoInstancedObjectCount = m_results.autoInstancedObjectCount;
+            emit objectCountChanged();
+        }
     }
 
     const float fpsInterval = 1000.0f;
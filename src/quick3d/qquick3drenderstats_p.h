@@ -56,6 +56,10 @@ class Q_QUICK3D_EXPORT QQuick3DRenderStats : public QObject
     Q_PROPERTY(float renderPrepareTime READ renderPrepareTime NOTIFY renderTimeChanged)
     Q_PROPERTY(float syncTime READ syncTime NOTIFY syncTimeChanged)
     Q_PROPERTY(float maxFrameTime READ maxFrameTime NOTIFY maxFrameTimeChanged)
+    Q_PROPERTY(int visibleObjectCount READ visibleObjectCount NOTIFY objectCountChanged)
+    Q_PROPERTY(int culledObjectCount READ culledObjectCount NOTIFY objectCountChanged)
+    Q_PROPERTY(int autoInstancedObjectCount READ autoInstancedObjectCount NOTIFY objectCountChanged)
+    Q_PROPERTY(int pendingShaderCompilations READ pendingShaderCompilations NOTIFY pendingShaderCompilationsChanged)
 
 public:
     QQuick3DRenderStats(QObject *parent = nullptr);
@@ -66,6 +70,10 @@ public:
     float renderPrepareTime() const;
     float syncTime() const;
     float maxFrameTime() const;
+    int visibleObjectCount() const;
+    int culledObjectCount() const;
+    int autoInstancedObjectCount() const;
+    int pendingShaderCompilations() const;
 
     void startSync();
     void endSync(bool dump = false);
@@ -73,6 +81,8 @@ public:
     void startRender();
     void startRenderPrepare();
     void endRenderPrepare();
+    void setObjectCounts(int visible, int culled, int autoInstanced);
+    void setPendingShaderCompilations(int count);
     void endRender(bool dump = false);
 
 Q_SIGNALS:
@@ -81,6 +91,8 @@ Q_SIGNALS:
     void renderTimeChanged();
     void syncTimeChanged();
     void maxFrameTimeChanged();
+    void objectCountChanged();
+    void pendingShaderCompilationsChanged();
 
 private:
     float timestamp() const;
@@ -97,12 +109,16 @@ private:
     float m_maxFrameTime = 0;
 
     int m_fps = 0;
+    int m_pendingShaderCompilations = 0;
 
     struct Results {
         float frameTime = 0;
         float renderTime = 0;
         float renderPrepareTime = 0;
         float syncTime = 0;
+        int visibleObjectCount = 0;
+        int culledObjectCount = 0;
+        int autoInstancedObjectCount = 0;
     };
 
     Results m_results;
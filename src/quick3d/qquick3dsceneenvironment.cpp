@@ -565,6 +565,62 @@ float QQuick3DSceneEnvironment::skyboxBlurAmount() const
     return m_skyboxBlurAmount;
 }
 
+/*!
+    \qmlproperty enumeration QtQuick3D::SceneEnvironment::opaqueOrdering
+    \since 6.4
+
+    This property determines the order in which opaque objects are drawn.
+
+    \value SceneEnvironment.OpaqueOrderingFrontToBack
+        Opaque objects are drawn from the nearest to the furthest, so that
+        depth testing can skip the shading of hidden fragments early.
+    \value SceneEnvironment.OpaqueOrderingState
+        Opaque objects are grouped by their shader and material first, and
+        only then drawn from the nearest to the furthest within each group.
+        This minimizes the changes of graphics pipelines and resources
+        between the draw calls, at the expense of more overdraw. It is
+        useful when submitting the draw calls is the bottleneck, such as
+        with many small objects, or on mobile GPUs.
+
+    The default value is \c SceneEnvironment.OpaqueOrderingFrontToBack
+
+    Transparent objects are always drawn from the furthest to the nearest.
+*/
+QQuick3DSceneEnvironment::QQuick3DEnvironmentOpaqueOrderings QQuick3DSceneEnvironment::opaqueOrdering() const
+{
+    return m_opaqueOrdering;
+}
+
+/*!
+    \qmlproperty bool QtQuick3D::SceneEnvironment::clusteredLighting
+    \since 6.4
+
+    When this property is enabled, point and spot lights that do not cast
+    shadows and have no \l{Light::scope}{scope} are not part of the regular,
+    per-object list of lights, which is limited to 15 lights. Instead, they
+    are assigned to the cells of a grid dividing the view frustum, and each
+    fragment only evaluates the lights that reach its cell. This allows
+    scenes with hundreds of such lights, as long as each of them only
+    affects a small part of the view, which requires their brightness to
+    fall off with distance via \l{PointLight::linearFade}{linearFade} or
+    \l{PointLight::quadraticFade}{quadraticFade}. A light is assumed to not
+    reach further than the distance where its contribution drops below 1/256.
+
+    Directional lights, shadow casting lights and scoped lights are not
+    affected. Clustered lights do not light particles and are not visible in
+    reflection probes.
+
+    Clustered lighting requires the graphics API to support fetching
+    texels from 32-bit floating point textures. When this is not the case,
+    the property has no effect.
+
+    The default value is \c false
+*/
+bool QQuick3DSceneEnvironment::clusteredLighting() const
+{
+    return m_clusteredLighting;
+}
+
 void QQuick3DSceneEnvironment::setAntialiasingMode(QQuick3DSceneEnvironment::QQuick3DEnvironmentAAModeValues antialiasingMode)
 {
     if (m_antialiasingMode == antialiasingMode)
@@ -827,4 +883,24 @@ void QQuick3DSceneEnvironment::setSkyboxBlurAmount(float newSkyboxBlurAmount)
     update();
 }
 
+void QQuick3DSceneEnvironment::setOpaqueOrdering(QQuick3DSceneEnvironment::QQuick3DEnvironmentOpaqueOrderings opaqueOrdering)
+{
+    if (m_opaqueOrdering == opaqueOrdering)
+        return;
+
+    m_opaqueOrdering = opaqueOrdering;
+    emit opaqueOrderingChanged();
+    update();
+}
+
+void QQuick3DSceneEnvironment::setClusteredLighting(bool clusteredLighting)
+{
+    if (m_clusteredLighting == clusteredLighting)
+        return;
+
+    m_clusteredLighting = clusteredLighting;
+    emit clusteredLightingChanged();
+    update();
+}
+
 QT_END_NAMESPACE
@@ -85,6 +85,8 @@ class Q_QUICK3D_EXPORT QQuick3DSceneEnvironment : public QQuick3DObject
     Q_PROPERTY(QQmlListProperty<QQuick3DEffect> effects READ effects)
 
     Q_PROPERTY(float skyboxBlurAmount READ skyboxBlurAmount WRITE setSkyboxBlurAmount NOTIFY skyboxBlurAmountChanged REVISION(6, 4))
+    Q_PROPERTY(QQuick3DEnvironmentOpaqueOrderings opaqueOrdering READ opaqueOrdering WRITE setOpaqueOrdering NOTIFY opaqueOrderingChanged REVISION(6, 4))
+    Q_PROPERTY(bool clusteredLighting READ clusteredLighting WRITE setClusteredLighting NOTIFY clusteredLightingChanged REVISION(6, 4))
 
     QML_NAMED_ELEMENT(SceneEnvironment)
 
@@ -122,6 +124,12 @@ public:
     };
     Q_ENUM(QQuick3DEnvironmentTonemapModes)
 
+    enum QQuick3DEnvironmentOpaqueOrderings {
+        OpaqueOrderingFrontToBack = 0,
+        OpaqueOrderingState
+    };
+    Q_ENUM(QQuick3DEnvironmentOpaqueOrderings)
+
     explicit QQuick3DSceneEnvironment(QQuick3DObject *parent = nullptr);
     ~QQuick3DSceneEnvironment() override;
 
@@ -153,6 +161,8 @@ public:
     QQmlListProperty<QQuick3DEffect> effects();
 
     Q_REVISION(6, 4) float skyboxBlurAmount() const;
+    Q_REVISION(6, 4) QQuick3DEnvironmentOpaqueOrderings opaqueOrdering() const;
+    Q_REVISION(6, 4) bool clusteredLighting() const;
 
 public Q_SLOTS:
     void setAntialiasingMode(QQuick3DSceneEnvironment::QQuick3DEnvironmentAAModeValues antialiasingMode);
@@ -181,6 +191,8 @@ public Q_SLOTS:
     void setTonemapMode(QQuick3DSceneEnvironment::QQuick3DEnvironmentTonemapModes tonemapMode);
 
     Q_REVISION(6, 4) void setSkyboxBlurAmount(float newSkyboxBlurAmount);
+    Q_REVISION(6, 4) void setOpaqueOrdering(QQuick3DSceneEnvironment::QQuick3DEnvironmentOpaqueOrderings opaqueOrdering);
+    Q_REVISION(6, 4) void setClusteredLighting(bool clusteredLighting);
 
 Q_SIGNALS:
     void antialiasingModeChanged();
@@ -209,6 +221,8 @@ Q_SIGNALS:
     void tonemapModeChanged();
 
     Q_REVISION(6, 4) void skyboxBlurAmountChanged();
+    Q_REVISION(6, 4) void opaqueOrderingChanged();
+    Q_REVISION(6, 4) void clusteredLightingChanged();
 
 protected:
     QSSGRenderGraphObject *updateSpatialNode(QSSGRenderGraphObject *node) override;
@@ -250,6 +264,8 @@ private:
     bool m_depthPrePassEnabled = false;
     QQuick3DEnvironmentTonemapModes m_tonemapMode = QQuick3DEnvironmentTonemapModes::TonemapModeLinear;
     float m_skyboxBlurAmount = 0.0f;
+    QQuick3DEnvironmentOpaqueOrderings m_opaqueOrdering = OpaqueOrderingFrontToBack;
+    bool m_clusteredLighting = false;
 };
 
 QT_END_NAMESPACE
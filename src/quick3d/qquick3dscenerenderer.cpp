@@ -473,6 +473,13 @@ void QQuick3DSceneRenderer::rhiPrepare(const QRect &viewport, qreal displayPixel
     m_sgContext->prepareLayerForRender(*m_layer);
     m_sgContext->rhiPrepare(*m_layer);
 
+    if (m_renderStats) {
+        const QSSGLayerRenderData *theRenderData = m_sgContext->renderer()->getOrCreateLayerRenderData(*m_layer);
+        m_renderStats->setObjectCounts(theRenderData->visibleObjectCount, theRenderData->culledObjectCount,
+                                       theRenderData->autoInstancedObjectCount);
+        m_renderStats->setPendingShaderCompilations(m_sgContext->shaderCache()->pendingCompilationCount());
+    }
+
     m_prepared = true;
 }
 
@@ -878,6 +885,16 @@ QQuick3DSceneRenderer::PickResultList QQuick3DSceneRenderer::syncPickAll(const Q
                                                 ray);
 }
 
+QVector<QSSGRenderPickResult> QQuick3DSceneRenderer::syncPickMany(const QVector<QSSGRenderRay> &rays)
+{
+    if (!m_layer)
+        return QVector<QSSGRenderPickResult>(rays.size());
+
+    return m_sgContext->renderer()->syncPickMany(*m_layer,
+                                                 m_sgContext->bufferManager(),
+                                                 rays);
+}
+
 void QQuick3DSceneRenderer::setGlobalPickingEnabled(bool isEnabled)
 {
     m_sgContext->renderer()->setGlobalPickingEnabled(isEnabled);
@@ -962,8 +979,13 @@ void QQuick3DRenderLayerHelpers::updateLayerNodeHelper(const QQuick3DViewport &v
 
     layerNode.tonemapMode = QSSGRenderLayer::TonemapMode(view3D.environment()->tonemapMode());
     layerNode.skyboxBlurAmount = view3D.environment()->skyboxBlurAmount();
+    layerNode.opaqueOrdering = QSSGRenderLayer::OpaqueOrdering(view3D.environment()->opaqueOrdering());
+    layerNode.clusteredLighting = view3D.environment()->clusteredLighting();
 
-    layerNode.markDirty(QSSGRenderNode::TransformDirtyFlag::TransformNotDirty);
+    // Not markDirty(), the layer does not affect the global transforms of the
+    // nodes in it, and dirtying all of them throws away what is cached for
+    // the unchanged ones.
+    layerNode.flags.setFlag(QSSGRenderNode::Flag::Dirty, true);
 }
 
 void QQuick3DSceneRenderer::updateLayerNode(QQuick3DViewport *view3D, const QList<QSSGRenderGraphObject *> &resourceLoaders)
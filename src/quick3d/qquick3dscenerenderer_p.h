@@ -82,6 +82,7 @@ protected:
     QSSGRenderPickResult syncPick(const QSSGRenderRay &ray);
     QSSGRenderPickResult syncPickOne(const QSSGRenderRay &ray, QSSGRenderNode *node);
     PickResultList syncPickAll(const QSSGRenderRay &ray);
+    QVector<QSSGRenderPickResult> syncPickMany(const QVector<QSSGRenderRay> &rays);
 
     void setGlobalPickingEnabled(bool isEnabled);
 
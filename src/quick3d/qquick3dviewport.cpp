@@ -42,6 +42,8 @@
 #include "qquick3dprincipledmaterial_p.h"
 #include "qquick3dcustommaterial_p.h"
 #include <QtQuick3DRuntimeRender/private/qssgrenderlayer_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendermodel_p.h>
+#include <QtQuick3DUtils/private/qssgutils_p.h>
 
 #include <qsgtextureprovider.h>
 #include <QSGSimpleTextureNode>
@@ -917,6 +919,46 @@ QList<QQuick3DPickResult> QQuick3DViewport::rayPickAll(const QVector3D &origin,
     return processedResultList;
 }
 
+/*!
+    \qmlmethod List<PickResult> View3D::rayPickMany(list<vector3d> origins, list<vector3d> directions)
+
+    This method will "shoot" a ray for each pair of \a origins and
+    \a directions into the scene and return the nearest intersection of each
+    ray, like rayPick does. The returned list has one result per ray, in the
+    same order as the rays. The \l {PickResult::objectHit}{objectHit} of the
+    result is \c null when the ray hits nothing.
+
+    Casting many rays at once is considerably faster than calling rayPick for
+    each of them, in particular when the rays are coherent, for example when
+    they start at the same point and point in similar directions.
+
+    \since 6.4
+*/
+QList<QQuick3DPickResult> QQuick3DViewport::rayPickMany(const QList<QVector3D> &origins, const QList<QVector3D> &directions) const
+{
+    if (origins.size() != directions.size()) {
+        qWarning("View3D::rayPickMany: The number of origins and directions do not match");
+        return QList<QQuick3DPickResult>();
+    }
+
+    QQuick3DSceneRenderer *renderer = getRenderer();
+    if (!renderer)
+        return QList<QQuick3DPickResult>(origins.size());
+
+    QVector<QSSGRenderRay> rays;
+    rays.reserve(origins.size());
+    for (qsizetype i = 0, end = origins.size(); i < end; ++i)
+        rays.append(QSSGRenderRay(origins.at(i), directions.at(i)));
+
+    const auto resultList = renderer->syncPickMany(rays);
+    QList<QQuick3DPickResult> processedResultList;
+    processedResultList.reserve(resultList.size());
+    for (const auto &result : resultList)
+        processedResultList.append(processPickResult(result));
+
+    return processedResultList;
+}
+
 void QQuick3DViewport::processPointerEventFromRay(const QVector3D &origin, const QVector3D &direction, QPointerEvent *event)
 {
     internalPick(event, origin, direction);
@@ -1251,6 +1293,21 @@ QQuick3DPickResult QQuick3DViewport::processPickResult(const QSSGRenderPickResul
     if (!model)
         return QQuick3DPickResult();
 
+    if (pickResult.m_instanceIndex >= 0) {
+        // The model does not know the transform of the instance, so map the
+        // normal with the one it was picked with
+        const auto *backendModel = static_cast<const QSSGRenderModel *>(backendObject);
+        const QMatrix3x3 normalMatrix = backendModel->instanceGlobalTransform(pickResult.m_instanceIndex).normalMatrix();
+        return QQuick3DPickResult(model,
+                                  ::sqrtf(pickResult.m_distanceSq),
+                                  pickResult.m_localUVCoords,
+                                  pickResult.m_scenePosition,
+                                  pickResult.m_localPosition,
+                                  pickResult.m_faceNormal,
+                                  pickResult.m_instanceIndex,
+                                  mat33::transform(normalMatrix, pickResult.m_faceNormal));
+    }
+
     return QQuick3DPickResult(model,
                               ::sqrtf(pickResult.m_distanceSq),
                               pickResult.m_localUVCoords,
@@ -67,6 +67,17 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderInstanceTable : public QSSGRender
     void setInstanceCountOverride(int count) { instanceCount = count; }
     int serial() const { return instanceSerial; }
     int stride() const { return instanceStride; }
+    // The transform of an instance, applied between the global and the local
+    // instance transform of the model
+    QMatrix4x4 getTransform(int index) const
+    {
+        Q_ASSERT(index >= 0 && qsizetype(index + 1) * instanceStride <= table.size());
+        const auto *entry = reinterpret_cast<const QSSGRenderInstanceTableEntry *>(table.constData() + qsizetype(index) * instanceStride);
+        return QMatrix4x4(entry->row0.x(), entry->row0.y(), entry->row0.z(), entry->row0.w(),
+                          entry->row1.x(), entry->row1.y(), entry->row1.z(), entry->row1.w(),
+                          entry->row2.x(), entry->row2.y(), entry->row2.z(), entry->row2.w(),
+                          0.0f, 0.0f, 0.0f, 1.0f);
+    }
     bool hasTransparency() { return transparency; }
     void setHasTransparency( bool t) { transparency = t; }
     void setDepthSorting(bool enable) { depthSorting = enable; }
@@ -31,6 +31,7 @@
 
 #include <QtQuick3DRuntimeRender/private/qssgrenderlayer_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendereffect_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingbvh_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendererimpllayerrenderdata_p.h>
 
 QT_BEGIN_NAMESPACE
@@ -75,6 +76,7 @@ QSSGRenderLayer::QSSGRenderLayer()
     flags.setFlag(Flag::LayerRenderToTarget);
     flags.setFlag(Flag::LayerEnableDepthTest);
     flags.setFlag(Flag::LayerEnableDepthPrePass);
+    pickingBVH = new QSSGRenderPickingBVH;
 }
 
 QSSGRenderLayer::~QSSGRenderLayer()
@@ -87,6 +89,7 @@ QSSGRenderLayer::~QSSGRenderLayer()
         importSceneNode = nullptr;
     }
     delete renderData;
+    delete pickingBVH;
 }
 
 void QSSGRenderLayer::setProbeOrientation(const QVector3D &angles)
@@ -107,6 +110,8 @@ void QSSGRenderLayer::addEffect(QSSGRenderEffect &inEffect)
 
 void QSSGRenderLayer::setImportScene(QSSGRenderNode &rootNode)
 {
+    markGraphChanged();
+
     // We create a dummy node to represent the imported scene tree, as we
     // do absolutely not want to change the node links in that tree!
     if (importSceneNode == nullptr) {
@@ -127,8 +132,10 @@ void QSSGRenderLayer::setImportScene(QSSGRenderNode &rootNode)
 void QSSGRenderLayer::removeImportScene(QSSGRenderNode &rootNode)
 {
     if (importSceneNode && !importSceneNode->children.isEmpty()) {
-        if (&importSceneNode->children.back() == &rootNode)
+        if (&importSceneNode->children.back() == &rootNode) {
+            markGraphChanged();
             importSceneNode->children.clear();
+        }
     }
 }
 
@@ -52,6 +52,7 @@ struct QSSGRenderPresentation;
 struct QSSGRenderEffect;
 struct QSSGRenderImage;
 struct QSSGLayerRenderData;
+class QSSGRenderPickingBVH;
 struct QSSGRenderResourceLoader;
 
 class QRhiShaderResourceBindings;
@@ -105,6 +106,12 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderLayer : public QSSGRenderNode
         SkyBox
     };
 
+    enum class OpaqueOrdering : quint8
+    {
+        FrontToBack = 0,
+        State
+    };
+
     enum class TonemapMode : quint8
     {
         None = 0, // Bypass mode
@@ -117,6 +124,8 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderLayer : public QSSGRenderNode
     // First effect in a list of effects.
     QSSGRenderEffect *firstEffect;
     QSSGLayerRenderData *renderData = nullptr;
+    // Owned by the layer, updated by the renderer and used when picking
+    QSSGRenderPickingBVH *pickingBVH = nullptr;
 
     // If a layer has a valid texture path (one that resolves to either a
     // an on-disk image or a offscreen renderer), then it does not render its
@@ -182,6 +191,11 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderLayer : public QSSGRenderNode
     // Tonemapping
     TonemapMode tonemapMode;
 
+    OpaqueOrdering opaqueOrdering = OpaqueOrdering::FrontToBack;
+
+    // Unshadowed, unscoped point and spot lights are binned into clusters
+    bool clusteredLighting = false;
+
     // references to objects owned by the QSSGRhiContext
     QRhiShaderResourceBindings *skyBoxSrb = nullptr;
     QVarLengthArray<QRhiShaderResourceBindings *, 4> item2DSrbs;
@@ -32,6 +32,7 @@
 #include <QtQuick3DRuntimeRender/private/qssgrenderbuffermanager_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendermesh_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderdefaultmaterial_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingbvh_p.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -40,4 +41,9 @@ QSSGRenderModel::QSSGRenderModel()
 {
 }
 
+QSSGRenderModel::~QSSGRenderModel()
+{
+    delete instancePickingBVH.loadRelaxed();
+}
+
 QT_END_NAMESPACE
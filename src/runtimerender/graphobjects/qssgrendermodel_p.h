@@ -51,12 +51,14 @@
 
 #include <QtQuick3DUtils/private/qssgbounds3_p.h>
 #include <QtCore/QVector>
+#include <QtCore/QAtomicPointer>
 
 QT_BEGIN_NAMESPACE
 
 struct QSSGRenderDefaultMaterial;
 struct QSSGParticleBuffer;
 class QSSGBufferManager;
+class QSSGRenderInstancePickingBVH;
 
 struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderModel : public QSSGRenderNode
 {
@@ -77,6 +79,13 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderModel : public QSSGRenderNode
     QSSGRenderInstanceTable *instanceTable = nullptr;
     int instanceCount() const { return instanceTable ? instanceTable->count() : 0; }
     bool instancing() const { return instanceTable;}
+    // The global transform an instance is rendered with
+    QMatrix4x4 instanceGlobalTransform(int index) const
+    {
+        return globalInstanceTransform * instanceTable->getTransform(index) * localInstanceTransform;
+    }
+    // Owned by the model, created when an instanced model is first picked
+    mutable QAtomicPointer<QSSGRenderInstancePickingBVH> instancePickingBVH;
 
     QSSGParticleBuffer *particleBuffer = nullptr;
     QMatrix4x4 particleMatrix;
@@ -88,6 +97,7 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderModel : public QSSGRenderNode
     bool receivesReflections = false;
 
     QSSGRenderModel();
+    ~QSSGRenderModel();
 };
 QT_END_NAMESPACE
 
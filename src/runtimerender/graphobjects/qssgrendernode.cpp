@@ -52,6 +52,7 @@ QSSGRenderNode::QSSGRenderNode(Type type)
 // children who are not dirty to be dirty.
 void QSSGRenderNode::markDirty(TransformDirtyFlag inTransformDirty)
 {
+    markSubtreeBoundsDirty();
     if (!flags.testFlag(Flag::TransformDirty))
         flags.setFlag(Flag::TransformDirty, inTransformDirty != TransformDirtyFlag::TransformNotDirty);
     if (!flags.testFlag(Flag::Dirty)) {
@@ -61,6 +62,12 @@ void QSSGRenderNode::markDirty(TransformDirtyFlag inTransformDirty)
     }
 }
 
+void QSSGRenderNode::markSubtreeBoundsDirty()
+{
+    for (QSSGRenderNode *node = this; node && !node->flags.testFlag(Flag::SubtreeBoundsDirty); node = node->parent)
+        node->flags.setFlag(Flag::SubtreeBoundsDirty, true);
+}
+
 // Calculate global transform and opacity
 // Walks up the graph ensure all parents are not dirty so they have
 // valid global transforms.
@@ -209,8 +216,21 @@ void QSSGRenderNode::setLocalTransformFromMatrix(QMatrix4x4 &inTransform)
     rotation = QQuaternion::fromRotationMatrix(theRotationMatrix).normalized();
 }
 
+static QBasicAtomicInteger<quint32> s_graphGeneration = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+quint32 QSSGRenderNode::graphGeneration()
+{
+    return s_graphGeneration.loadAcquire();
+}
+
+void QSSGRenderNode::markGraphChanged()
+{
+    s_graphGeneration.fetchAndAddRelease(1);
+}
+
 void QSSGRenderNode::addChild(QSSGRenderNode &inChild)
 {
+    markGraphChanged();
     // Adding children to a layer does not reset parent
     // because layers can share children over with other layers
     if (type != QSSGRenderNode::Type::Layer) {
@@ -219,6 +239,9 @@ void QSSGRenderNode::addChild(QSSGRenderNode &inChild)
         inChild.parent = this;
     }
     children.push_back(inChild);
+    // The child may come with bounds cached for its old place in the graph
+    inChild.flags.setFlag(Flag::SubtreeBoundsDirty, true);
+    markSubtreeBoundsDirty();
 }
 
 void QSSGRenderNode::removeChild(QSSGRenderNode &inChild)
@@ -228,12 +251,15 @@ void QSSGRenderNode::removeChild(QSSGRenderNode &inChild)
         return;
     }
 
+    markGraphChanged();
     inChild.parent = nullptr;
     children.remove(inChild);
+    markSubtreeBoundsDirty();
 }
 
 void QSSGRenderNode::removeFromGraph()
 {
+    markGraphChanged();
     if (parent)
         parent->removeChild(*this);
 
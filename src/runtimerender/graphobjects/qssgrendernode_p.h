@@ -78,6 +78,9 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderNode : public QSSGRenderGraphObje
         IgnoreParentTransform = 1 << 10,
         LayerEnableDepthPrePass = 1 << 11, ///< True when we render a depth pass before
         CameraDirty = 1 << 12, ///< True when the camera inheriting from this is dirty
+        SubtreeBoundsDirty = 1 << 13, ///< subtreeBounds needs a refit
+        SubtreeUnbounded = 1 << 14, ///< The subtree has content that cannot be culled by its bounds
+        SubtreePickable = 1 << 15, ///< The subtree has locally pickable renderables
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
@@ -104,6 +107,7 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderNode : public QSSGRenderGraphObje
         Flag::Dirty,
         Flag::TransformDirty,
         Flag::Active,
+        Flag::SubtreeBoundsDirty,
     };
     // These end up right handed
     QMatrix4x4 localTransform;
@@ -113,6 +117,12 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderNode : public QSSGRenderGraphObje
     float globalOpacity = 1.0f;
     qint32 skeletonId = -1;
 
+    // World space bounds of the models in this subtree, and the number of
+    // renderable objects (subsets) they have. Maintained by the render system
+    // and only valid when the SubtreeBoundsDirty flag is not set.
+    QSSGBounds3 subtreeBounds;
+    int subtreeObjectCount = 0;
+
     // node graph members.
     QSSGRenderNode *parent = nullptr;
     QSSGRenderNode *nextSibling = nullptr;
@@ -133,6 +143,11 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderNode : public QSSGRenderGraphObje
     // children who are not dirty to be dirty.
     void markDirty(TransformDirtyFlag inTransformDirty = TransformDirtyFlag::TransformNotDirty);
 
+    // Sets SubtreeBoundsDirty on this object and walks up the graph setting
+    // it on all the parents. A node with the flag set always has it set on
+    // its parents as well.
+    void markSubtreeBoundsDirty();
+
     void addChild(QSSGRenderNode &inChild);
     void removeChild(QSSGRenderNode &inChild);
 
@@ -142,6 +157,12 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderNode : public QSSGRenderGraphObje
     // finally they are no longer siblings of each other.
     void removeFromGraph();
 
+    // Incremented whenever nodes are added to or removed from any graph, so
+    // that node lists cached outside of the render thread can detect that they
+    // may refer to removed, or already deleted, nodes.
+    static quint32 graphGeneration();
+    static void markGraphChanged();
+
     // Calculate global transform and opacity
     // Walks up the graph ensure all parents are not dirty so they have
     // valid global transforms.
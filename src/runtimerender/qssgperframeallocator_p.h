@@ -74,6 +74,8 @@ class QSSGPerFrameAllocator
         Slab *first = nullptr;
         Slab *current = nullptr;
         size_t offset = 0;
+        int slabCount = 1;
+        int slabIndex = 0; // of current
 
         FastAllocator()
         {
@@ -97,10 +99,13 @@ class QSSGPerFrameAllocator
 
             size_t amountLeftInSlab = SlabSize - offset;
             if (size > amountLeftInSlab) {
-                if (current->next)
+                if (current->next) {
                     current = current->next;
-                else
+                } else {
                     current = new Slab(current);
+                    ++slabCount;
+                }
+                ++slabIndex;
                 offset = 0;
             }
 
@@ -110,7 +115,7 @@ class QSSGPerFrameAllocator
         }
 
         // only reset, so we can re-use the memory
-        void reset() { current = first; offset = 0; }
+        void reset() { current = first; offset = 0; slabIndex = 0; }
     };
 
     struct LargeAllocator
@@ -145,22 +150,64 @@ class QSSGPerFrameAllocator
         }
     };
 
+public:
+    // Usage since the last reset(), plus the high water marks over all
+    // frames, for sizing the slabs
+    struct Stats
+    {
+        quint64 allocationCount = 0;
+        quint64 allocatedBytes = 0; // Including the alignment padding
+        quint64 largeAllocationCount = 0; // Too big for a slab, in allocationCount too
+        quint64 largeAllocatedBytes = 0; // In allocatedBytes too
+        int slabsInUse = 0;
+        int slabCount = 0; // Kept between frames
+        quint64 peakAllocatedBytes = 0;
+        int peakSlabsInUse = 0;
+    };
+
+private:
     FastAllocator m_fastAllocator;
     LargeAllocator m_largeAllocator;
+    Stats m_stats;
 
 public:
     QSSGPerFrameAllocator() {}
 
+    // Everything allocated here is released at once by reset(), without
+    // running destructors. Only use it for trivially destructible types, or
+    // types that are known to own no other memory.
     inline void *allocate(size_t size)
     {
-        if (size < FastAllocator::MaxAlloc)
+        ++m_stats.allocationCount;
+        if (size < FastAllocator::MaxAlloc) {
+            m_stats.allocatedBytes += (size + FastAllocator::Alignment - 1) & ~(FastAllocator::Alignment - 1);
             return m_fastAllocator.allocate(size);
+        }
 
+        ++m_stats.largeAllocationCount;
+        m_stats.largeAllocatedBytes += size;
+        m_stats.allocatedBytes += size;
         return m_largeAllocator.allocate(size);
     }
 
+    Stats stats() const
+    {
+        Stats result = m_stats;
+        result.slabsInUse = m_fastAllocator.slabIndex + 1;
+        result.slabCount = m_fastAllocator.slabCount;
+        result.peakAllocatedBytes = qMax(result.peakAllocatedBytes, result.allocatedBytes);
+        result.peakSlabsInUse = qMax(result.peakSlabsInUse, result.slabsInUse);
+        return result;
+    }
+
+    // Constant time, apart from freeing the large allocations
     void reset()
     {
+        const Stats current = stats();
+        m_stats = Stats();
+        m_stats.peakAllocatedBytes = current.peakAllocatedBytes;
+        m_stats.peakSlabsInUse = current.peakSlabsInUse;
+
         m_fastAllocator.reset();
         m_largeAllocator.deallocateAll();
     }
@@ -40,6 +40,7 @@
 #include <QtQuick3DRuntimeRender/private/qssgperframeallocator_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderer_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendererutil_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgruntimerenderlogging_p.h>
 
 #include <QtQuick/QQuickWindow>
 
@@ -116,6 +117,15 @@ QSSGRenderContextInterface::QSSGRenderContextInterface(QQuickWindow *window,
     , m_shaderProgramGenerator(new QSSGProgramGenerator)
 {
     init();
+
+    // "skip" to not draw objects while their shaders are compiling, any other
+    // non-empty value to draw them with the shaders they had before, if any
+    const QByteArray asyncShaders = qgetenv("QT_QUICK3D_ASYNC_SHADER_COMPILATION");
+    if (asyncShaders == "skip")
+        m_shaderCache->setAsyncCompilation(QSSGShaderCache::AsyncCompilation::Skip);
+    else if (!asyncShaders.isEmpty() && asyncShaders != "0")
+        m_shaderCache->setAsyncCompilation(QSSGShaderCache::AsyncCompilation::Fallback);
+
     if (window) {
         g_windowReg->append({ window, this });
         QObject::connect(window, &QWindow::destroyed, [&](QObject *o){
@@ -127,6 +137,7 @@ QSSGRenderContextInterface::QSSGRenderContextInterface(QQuickWindow *window,
 QSSGRenderContextInterface::~QSSGRenderContextInterface()
 {
     m_renderer->releaseResources();
+    qDeleteAll(m_workerFrameAllocators);
     g_windowReg->removeIf([this](const Binding &b) { return (b.second == this); });
 }
 
@@ -182,6 +193,13 @@ void QSSGRenderContextInterface::resetResourceCounters(QSSGRenderLayer *inLayer)
     m_bufferManager->resetUsageCounters(m_frameCount, inLayer);
 }
 
+QSSGPerFrameAllocator &QSSGRenderContextInterface::workerFrameAllocator(int index)
+{
+    while (m_workerFrameAllocators.size() <= index)
+        m_workerFrameAllocators.append(new QSSGPerFrameAllocator);
+    return *m_workerFrameAllocators.at(index);
+}
+
 void QSSGRenderContextInterface::beginFrame(QSSGRenderLayer *layer, bool allowRecursion)
 {
     if (allowRecursion) {
@@ -189,7 +207,25 @@ void QSSGRenderContextInterface::beginFrame(QSSGRenderLayer *layer, bool allowRe
             return;
     }
 
+    if (PERF_INFO().isDebugEnabled()) {
+        const QSSGPerFrameAllocator::Stats stats = m_perFrameAllocator.stats();
+        if (stats.peakAllocatedBytes > m_reportedPerFrameAllocatorPeak) {
+            m_reportedPerFrameAllocatorPeak = stats.peakAllocatedBytes;
+            qCDebug(PERF_INFO, "Per-frame allocator peak: %llu bytes, %d of %d slabs; last frame: "
+                               "%llu allocations, %llu large ones (%llu bytes)",
+                    stats.peakAllocatedBytes, stats.peakSlabsInUse, stats.slabCount,
+                    stats.allocationCount, stats.largeAllocationCount, stats.largeAllocatedBytes);
+        }
+    }
     m_perFrameAllocator.reset();
+    for (QSSGPerFrameAllocator *allocator : qAsConst(m_workerFrameAllocators))
+        allocator->reset();
+    if (m_shaderCache->pendingCompilationCount() > 0) {
+        const int completed = m_shaderCache->processCompletedCompilations();
+        if (completed > 0)
+            qCDebug(PERF_INFO, "%d shader compilation(s) finished in the background, %d pending",
+                    completed, m_shaderCache->pendingCompilationCount());
+    }
     m_renderer->beginFrame();
     resetResourceCounters(layer);
 }
@@ -217,8 +253,10 @@ bool QSSGRenderContextInterface::endFrame(QSSGRenderLayer *layer, bool allowRecu
     }
 
     cleanupUnreferencedBuffers(layer);
+    m_bufferManager->publishPickingSnapshot();
 
     m_renderer->endFrame();
+    m_rhiContext->trimCaches();
     ++m_frameCount;
 
     return true;
@@ -94,6 +94,9 @@ public:
     // The memory used for the per frame allocator is released as the first step in BeginFrame.
     // This is useful for short lived objects and datastructures.
     QSSGPerFrameAllocator &perFrameAllocator() { return m_perFrameAllocator; }
+    // Allocators of the worker threads preparing renderables in parallel,
+    // reset together with the per frame allocator. Render thread only.
+    QSSGPerFrameAllocator &workerFrameAllocator(int index);
 
     // Get the number of times EndFrame has been called
     quint32 frameCount() { return m_frameCount; }
@@ -147,6 +150,8 @@ private:
     const QSSGRef<QSSGProgramGenerator> m_shaderProgramGenerator;
 
     QSSGPerFrameAllocator m_perFrameAllocator;
+    QVector<QSSGPerFrameAllocator *> m_workerFrameAllocators;
+    quint64 m_reportedPerFrameAllocatorPeak = 0;
     quint32 m_activeFrameRef = 0;
     quint32 m_frameCount = 0;
 
@@ -43,6 +43,7 @@
 #include <QtQuick3DRuntimeRender/private/qssgrendershaderlibrarymanager_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendershaderkeys_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgshadermaterialadapter_p.h>
+#include <QtQuick3DRuntimeRender/private/qssglightclusters_p.h>
 
 #include <QtCore/QByteArray>
 
@@ -1124,6 +1125,144 @@ static void generateFragmentShader(QSSGStageGeneratorBase &fragmentShader,
             }
         }
 
+        // Point and spot lights, the same for the lights in the lists and the
+        // ones fetched from the light clusters
+        const auto generatePointOrSpotLight = [&](QSSGMaterialShaderGenerator::LightVariableNames &lightVarNames,
+                                                  const QByteArray &lightVarPrefix, qint32 lightIdx,
+                                                  QSSGRenderLight::Type lightType, bool castsShadow) {
+            const bool isSpot = lightType == QSSGRenderLight::Type::SpotLight;
+            vertexShader.generateWorldPosition(inKey);
+
+            lightVarNames.relativeDirection = lightVarPrefix;
+            lightVarNames.relativeDirection.append("_relativeDirection");
+
+            lightVarNames.normalizedDirection = lightVarNames.relativeDirection;
+            lightVarNames.normalizedDirection.append("_normalized");
+
+            lightVarNames.relativeDistance = lightVarPrefix;
+            lightVarNames.relativeDistance.append("_distance");
+
+            fragmentShader << "    vec3 " << lightVarNames.relativeDirection << " = qt_varWorldPos - " << lightVarNames.lightPos << ".xyz;\n"
+                           << "    float " << lightVarNames.relativeDistance << " = length(" << lightVarNames.relativeDirection << ");\n"
+                           << "    vec3 " << lightVarNames.normalizedDirection << " = " << lightVarNames.relativeDirection << " / " << lightVarNames.relativeDistance << ";\n";
+
+            if (isSpot) {
+                lightVarNames.spotAngle = lightVarPrefix;
+                lightVarNames.spotAngle.append("_spotAngle");
+
+                fragmentShader << "    float " << lightVarNames.spotAngle << " = dot(" << lightVarNames.normalizedDirection
+                               << ", normalize(vec3(" << lightVarNames.lightDirection << ")));\n";
+                fragmentShader << "    if (" << lightVarNames.spotAngle << " > " << lightVarNames.lightConeAngle << ") {\n";
+            }
+
+            generateShadowMapOcclusion(fragmentShader, vertexShader, lightIdx, castsShadow, lightType, lightVarNames, inKey);
+
+            fragmentShader.addFunction("calculatePointLightAttenuation");
+
+            fragmentShader << "    qt_lightAttenuation = qt_calculatePointLightAttenuation(vec3("
+                           << lightVarNames.lightConstantAttenuation << ", " << lightVarNames.lightLinearAttenuation << ", "
+                           << lightVarNames.lightQuadraticAttenuation << "), " << lightVarNames.relativeDistance << ");\n";
+
+            addTranslucencyIrradiance(fragmentShader, translucencyImage, lightVarNames);
+            fragmentShader << "    tmp_light_color = " << lightVarNames.lightColor << ".rgb * (1.0 - qt_metalnessAmount);\n";
+
+            if (isSpot) {
+                fragmentShader << "    float spotFactor = smoothstep(" << lightVarNames.lightConeAngle
+                               << ", " << lightVarNames.lightInnerConeAngle << ", " << lightVarNames.spotAngle
+                               << ");\n";
+                if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_spotLightProcessor"))) {
+                    // DIFFUSE, LIGHT_COLOR, LIGHT_ATTENUATION, SPOT_FACTOR, SHADOW_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, VIEW_VECTOR(, SHARED)
+                    fragmentShader << "    qt_spotLightProcessor(global_diffuse_light.rgb, tmp_light_color, qt_lightAttenuation, spotFactor, qt_shadow_map_occl, -"
+                                   << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
+                                   << "qt_metalnessAmount, qt_roughnessAmount, qt_view_vector";
+                    if (usesSharedVar)
+                        fragmentShader << ", qt_customShared);\n";
+                    else
+                        fragmentShader << ");\n";
+                } else {
+                    if (materialAdapter->isPrincipled()) {
+                        fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * spotFactor * qt_lightAttenuation * qt_shadow_map_occl * "
+                                       << "qt_diffuseBurleyBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
+                                       << "tmp_light_color, qt_roughnessAmount).rgb;\n";
+                    } else {
+                        fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * spotFactor * qt_lightAttenuation * qt_shadow_map_occl * "
+                                       << "qt_diffuseReflectionBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, tmp_light_color).rgb;\n";
+                    }
+                }
+                // spotFactor is multipled to qt_lightAttenuation and have an effect on the specularLight.
+                fragmentShader << "    qt_lightAttenuation *= spotFactor;\n";
+            } else {
+                // point light
+                if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_pointLightProcessor"))) {
+                    // DIFFUSE, LIGHT_COLOR, LIGHT_ATTENUATION, SHADOW_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, VIEW_VECTOR(, SHARED)
+                    fragmentShader << "    qt_pointLightProcessor(global_diffuse_light.rgb, tmp_light_color, qt_lightAttenuation, qt_shadow_map_occl, -"
+                                   << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
+                                   << "qt_metalnessAmount, qt_roughnessAmount, qt_view_vector";
+                    if (usesSharedVar)
+                        fragmentShader << ", qt_customShared);\n";
+                    else
+                        fragmentShader << ");\n";
+                } else {
+                    if (materialAdapter->isPrincipled()) {
+                        fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * qt_lightAttenuation * qt_shadow_map_occl * "
+                                       << "qt_diffuseBurleyBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
+                                       << "tmp_light_color, qt_roughnessAmount).rgb;\n";
+                    } else {
+                        fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * qt_lightAttenuation * qt_shadow_map_occl * "
+                                       << "qt_diffuseReflectionBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, tmp_light_color).rgb;\n";
+                    }
+                }
+            }
+
+            if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_specularLightProcessor"))) {
+                // SPECULAR, LIGHT_COLOR, LIGHT_ATTENUATION, SHADOW_CONTRIB, FRESNEL_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, SPECULAR_AMOUNT, VIEW_VECTOR(, SHARED)
+                fragmentShader << "    qt_specularLightProcessor(global_specular_light, " << lightVarNames.lightSpecularColor << ".rgb, qt_lightAttenuation, qt_shadow_map_occl, "
+                               << "qt_specularAmount, -" << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
+                               << "qt_metalnessAmount, qt_roughnessAmount, qt_customSpecularAmount, qt_view_vector";
+                if (usesSharedVar)
+                    fragmentShader << ", qt_customShared);\n";
+                else
+                    fragmentShader << ");\n";
+            } else {
+                if (specularLightingEnabled) {
+                    if (materialAdapter->isPrincipled()) {
+                        // Principled materials (and Custom without a specular processor function) always use GGX SpecularModel
+                        fragmentShader.addFunction("specularGGXBSDF");
+                        fragmentShader << "    global_specular_light += qt_lightAttenuation * qt_shadow_map_occl * qt_specularTint"
+                                          " * qt_specularGGXBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
+                                       << lightVarNames.lightSpecularColor << ".rgb, qt_f0, vec3(1.0), qt_roughnessAmount).rgb;\n";
+                    } else {
+                        outputSpecularEquation(materialAdapter->specularModel(), fragmentShader, lightVarNames.normalizedDirection, lightVarNames.lightSpecularColor);
+                    }
+
+                    if (enableClearcoat) {
+                        fragmentShader.addFunction("specularGGXBSDF");
+                        fragmentShader << "    qt_global_clearcoat += qt_lightAttenuation * qt_shadow_map_occl"
+                                          " * qt_specularGGXBSDF(qt_clearcoatNormal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
+                                       << lightVarNames.lightSpecularColor << ".rgb, qt_clearcoatF0, qt_clearcoatF90, qt_clearcoatRoughness).rgb;\n";
+                    }
+
+                    if (enableTransmission) {
+                        fragmentShader << "    {\n";
+                        fragmentShader << "        vec3 transmissionRay = qt_getVolumeTransmissionRay(qt_world_normal, qt_view_vector, qt_thicknessFactor, qt_material_specular.w);\n";
+                        fragmentShader << "        vec3 pointToLight = -" << lightVarNames.normalizedDirection << ".xyz;\n";
+                        fragmentShader << "        pointToLight -= transmissionRay;\n";
+                        fragmentShader << "        vec3 l = normalize(pointToLight);\n";
+                        fragmentShader << "        vec3 intensity = vec3(1.0);\n"; // Directional light is always 1.0
+                        fragmentShader << "        vec3 transmittedLight = intensity * qt_getPunctualRadianceTransmission(qt_world_normal, "
+                                          "qt_view_vector, l, qt_roughnessAmount, qt_f0, vec3(1.0), qt_diffuseColor.rgb, qt_material_specular.w);\n";
+                        fragmentShader << "        transmittedLight = qt_applyVolumeAttenuation(transmittedLight, length(transmissionRay), "
+                                          "qt_attenuationColor, qt_attenuationDistance);\n";
+                        fragmentShader << "        qt_global_transmission += qt_transmissionFactor * transmittedLight;\n";
+                        fragmentShader << "    }\n";
+                    }
+                }
+            }
+
+            if (isSpot)
+                fragmentShader << "    }\n";
+        };
+
         // Iterate through all lights
         Q_ASSERT(lights.size() < INT32_MAX);
         int shadowMapCount = 0;
@@ -1220,141 +1359,58 @@ static void generateFragmentShader(QSSGStageGeneratorBase &fragmentShader,
                     }
                 }
             } else {
-                vertexShader.generateWorldPosition(inKey);
-
-                lightVarNames.relativeDirection = lightVarPrefix;
-                lightVarNames.relativeDirection.append("_relativeDirection");
-
-                lightVarNames.normalizedDirection = lightVarNames.relativeDirection;
-                lightVarNames.normalizedDirection.append("_normalized");
-
-                lightVarNames.relativeDistance = lightVarPrefix;
-                lightVarNames.relativeDistance.append("_distance");
-
-                fragmentShader << "    vec3 " << lightVarNames.relativeDirection << " = qt_varWorldPos - " << lightVarNames.lightPos << ".xyz;\n"
-                               << "    float " << lightVarNames.relativeDistance << " = length(" << lightVarNames.relativeDirection << ");\n"
-                               << "    vec3 " << lightVarNames.normalizedDirection << " = " << lightVarNames.relativeDirection << " / " << lightVarNames.relativeDistance << ";\n";
-
-                if (isSpot) {
-                    lightVarNames.spotAngle = lightVarPrefix;
-                    lightVarNames.spotAngle.append("_spotAngle");
-
-                    fragmentShader << "    float " << lightVarNames.spotAngle << " = dot(" << lightVarNames.normalizedDirection
-                                   << ", normalize(vec3(" << lightVarNames.lightDirection << ")));\n";
-                    fragmentShader << "    if (" << lightVarNames.spotAngle << " > " << lightVarNames.lightConeAngle << ") {\n";
-                }
-
-                generateShadowMapOcclusion(fragmentShader, vertexShader, lightIdx, castsShadow, lightNode->type, lightVarNames, inKey);
-
-                fragmentShader.addFunction("calculatePointLightAttenuation");
-
-                fragmentShader << "    qt_lightAttenuation = qt_calculatePointLightAttenuation(vec3("
-                               << lightVarNames.lightConstantAttenuation << ", " << lightVarNames.lightLinearAttenuation << ", "
-                               << lightVarNames.lightQuadraticAttenuation << "), " << lightVarNames.relativeDistance << ");\n";
-
-                addTranslucencyIrradiance(fragmentShader, translucencyImage, lightVarNames);
-                fragmentShader << "    tmp_light_color = " << lightVarNames.lightColor << ".rgb * (1.0 - qt_metalnessAmount);\n";
-
-                if (isSpot) {
-                    fragmentShader << "    float spotFactor = smoothstep(" << lightVarNames.lightConeAngle
-                                   << ", " << lightVarNames.lightInnerConeAngle << ", " << lightVarNames.spotAngle
-                                   << ");\n";
-                    if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_spotLightProcessor"))) {
-                        // DIFFUSE, LIGHT_COLOR, LIGHT_ATTENUATION, SPOT_FACTOR, SHADOW_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, VIEW_VECTOR(, SHARED)
-                        fragmentShader << "    qt_spotLightProcessor(global_diffuse_light.rgb, tmp_light_color, qt_lightAttenuation, spotFactor, qt_shadow_map_occl, -"
-                                       << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
-                                       << "qt_metalnessAmount, qt_roughnessAmount, qt_view_vector";
-                        if (usesSharedVar)
-                            fragmentShader << ", qt_customShared);\n";
-                        else
-                            fragmentShader << ");\n";
-                    } else {
-                        if (materialAdapter->isPrincipled()) {
-                            fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * spotFactor * qt_lightAttenuation * qt_shadow_map_occl * "
-                                           << "qt_diffuseBurleyBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
-                                           << "tmp_light_color, qt_roughnessAmount).rgb;\n";
-                        } else {
-                            fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * spotFactor * qt_lightAttenuation * qt_shadow_map_occl * "
-                                           << "qt_diffuseReflectionBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, tmp_light_color).rgb;\n";
-                        }
-                    }
-                    // spotFactor is multipled to qt_lightAttenuation and have an effect on the specularLight.
-                    fragmentShader << "    qt_lightAttenuation *= spotFactor;\n";
-                } else {
-                    // point light
-                    if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_pointLightProcessor"))) {
-                        // DIFFUSE, LIGHT_COLOR, LIGHT_ATTENUATION, SHADOW_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, VIEW_VECTOR(, SHARED)
-                        fragmentShader << "    qt_pointLightProcessor(global_diffuse_light.rgb, tmp_light_color, qt_lightAttenuation, qt_shadow_map_occl, -"
-                                       << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
-                                       << "qt_metalnessAmount, qt_roughnessAmount, qt_view_vector";
-                        if (usesSharedVar)
-                            fragmentShader << ", qt_customShared);\n";
-                        else
-                            fragmentShader << ");\n";
-                    } else {
-                        if (materialAdapter->isPrincipled()) {
-                            fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * qt_lightAttenuation * qt_shadow_map_occl * "
-                                           << "qt_diffuseBurleyBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
-                                           << "tmp_light_color, qt_roughnessAmount).rgb;\n";
-                        } else {
-                            fragmentShader << "    global_diffuse_light.rgb += qt_diffuseColor.rgb * qt_lightAttenuation * qt_shadow_map_occl * "
-                                           << "qt_diffuseReflectionBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, tmp_light_color).rgb;\n";
-                        }
-                    }
-                }
-
-                if (hasCustomFrag && hasCustomFunction(QByteArrayLiteral("qt_specularLightProcessor"))) {
-                    // SPECULAR, LIGHT_COLOR, LIGHT_ATTENUATION, SHADOW_CONTRIB, FRESNEL_CONTRIB, TO_LIGHT_DIR, NORMAL, BASE_COLOR, METALNESS, ROUGHNESS, SPECULAR_AMOUNT, VIEW_VECTOR(, SHARED)
-                    fragmentShader << "    qt_specularLightProcessor(global_specular_light, " << lightVarNames.lightSpecularColor << ".rgb, qt_lightAttenuation, qt_shadow_map_occl, "
-                                   << "qt_specularAmount, -" << lightVarNames.normalizedDirection << ".xyz, qt_world_normal, qt_customBaseColor, "
-                                   << "qt_metalnessAmount, qt_roughnessAmount, qt_customSpecularAmount, qt_view_vector";
-                    if (usesSharedVar)
-                        fragmentShader << ", qt_customShared);\n";
-                    else
-                        fragmentShader << ");\n";
-                } else {
-                    if (specularLightingEnabled) {
-                        if (materialAdapter->isPrincipled()) {
-                            // Principled materials (and Custom without a specular processor function) always use GGX SpecularModel
-                            fragmentShader.addFunction("specularGGXBSDF");
-                            fragmentShader << "    global_specular_light += qt_lightAttenuation * qt_shadow_map_occl * qt_specularTint"
-                                              " * qt_specularGGXBSDF(qt_world_normal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
-                                           << lightVarNames.lightSpecularColor << ".rgb, qt_f0, vec3(1.0), qt_roughnessAmount).rgb;\n";
-                        } else {
-                            outputSpecularEquation(materialAdapter->specularModel(), fragmentShader, lightVarNames.normalizedDirection, lightVarNames.lightSpecularColor);
-                        }
-
-                        if (enableClearcoat) {
-                            fragmentShader.addFunction("specularGGXBSDF");
-                            fragmentShader << "    qt_global_clearcoat += qt_lightAttenuation * qt_shadow_map_occl"
-                                              " * qt_specularGGXBSDF(qt_clearcoatNormal, -" << lightVarNames.normalizedDirection << ".xyz, qt_view_vector, "
-                                           << lightVarNames.lightSpecularColor << ".rgb, qt_clearcoatF0, qt_clearcoatF90, qt_clearcoatRoughness).rgb;\n";
-                        }
-
-                        if (enableTransmission) {
-                            fragmentShader << "    {\n";
-                            fragmentShader << "        vec3 transmissionRay = qt_getVolumeTransmissionRay(qt_world_normal, qt_view_vector, qt_thicknessFactor, qt_material_specular.w);\n";
-                            fragmentShader << "        vec3 pointToLight = -" << lightVarNames.normalizedDirection << ".xyz;\n";
-                            fragmentShader << "        pointToLight -= transmissionRay;\n";
-                            fragmentShader << "        vec3 l = normalize(pointToLight);\n";
-                            fragmentShader << "        vec3 intensity = vec3(1.0);\n"; // Directional light is always 1.0
-                            fragmentShader << "        vec3 transmittedLight = intensity * qt_getPunctualRadianceTransmission(qt_world_normal, "
-                                              "qt_view_vector, l, qt_roughnessAmount, qt_f0, vec3(1.0), qt_diffuseColor.rgb, qt_material_specular.w);\n";
-                            fragmentShader << "        transmittedLight = qt_applyVolumeAttenuation(transmittedLight, length(transmissionRay), "
-                                              "qt_attenuationColor, qt_attenuationDistance);\n";
-                            fragmentShader << "        qt_global_transmission += qt_transmissionFactor * transmittedLight;\n";
-                            fragmentShader << "    }\n";
-                        }
-                    }
-                }
-
-                if (isSpot)
-                    fragmentShader << "    }\n";
+                generatePointOrSpotLight(lightVarNames, lightVarPrefix, lightIdx, lightNode->type, castsShadow);
             }
         }
         if (!lights.isEmpty())
             fragmentShader.append("");
 
+        // The lights of the cluster the fragment is in, with their data read
+        // from the cluster texture (see QSSGLightClusters) instead of ubLights
+        if (featureSet.isSet(QSSGShaderFeatures::Feature::ClusteredLighting)) {
+            vertexShader.generateWorldPosition(inKey);
+            fragmentShader.addUniform("qt_lightClusters", "sampler2D");
+            fragmentShader.addUniform("qt_clusterViewProjection", "mat4");
+            fragmentShader.addUniform("qt_clusterViewDepth", "vec4");
+            fragmentShader.addUniform("qt_clusterDepthParams", "vec4");
+            fragmentShader.addUniform("qt_clusterOffsets", "vec4");
+            fragmentShader.addDefinition("QSSG_LIGHT_CLUSTER_GRID_WIDTH", QByteArray::number(QSSGLightClusters::GridWidth));
+            fragmentShader.addDefinition("QSSG_LIGHT_CLUSTER_GRID_HEIGHT", QByteArray::number(QSSGLightClusters::GridHeight));
+            fragmentShader.addDefinition("QSSG_LIGHT_CLUSTER_GRID_DEPTH", QByteArray::number(QSSGLightClusters::GridDepth));
+            fragmentShader.addDefinition("QSSG_LIGHT_CLUSTER_TEXELS_PER_LIGHT", QByteArray::number(QSSGLightClusters::TexelsPerLight));
+            fragmentShader.addInclude("lightClusters.glsllib");
+
+            QSSGMaterialShaderGenerator::LightVariableNames clusterVarNames;
+            clusterVarNames.lightPos = QByteArrayLiteral("qt_clusterLightPosition");
+            clusterVarNames.lightDirection = QByteArrayLiteral("qt_clusterLightDirection");
+            clusterVarNames.lightColor = QByteArrayLiteral("qt_clusterLightDiffuse");
+            clusterVarNames.lightSpecularColor = QByteArrayLiteral("qt_clusterLightSpecular");
+            clusterVarNames.lightConstantAttenuation = QByteArrayLiteral("qt_clusterLightAttenuation.x");
+            clusterVarNames.lightLinearAttenuation = QByteArrayLiteral("qt_clusterLightAttenuation.y");
+            clusterVarNames.lightQuadraticAttenuation = QByteArrayLiteral("qt_clusterLightAttenuation.z");
+            clusterVarNames.lightConeAngle = QByteArrayLiteral("qt_clusterLightDirection.w");
+            clusterVarNames.lightInnerConeAngle = QByteArrayLiteral("qt_clusterLightDiffuse.w");
+
+            fragmentShader << "    //Clustered lights\n"
+                           << "    ivec2 qt_lightCluster = qt_lightClusterOf(qt_varWorldPos);\n"
+                           << "    for (int qt_clusterIdx = 0; qt_clusterIdx < qt_lightCluster.y; ++qt_clusterIdx) {\n"
+                           << "    int qt_clusterLightTexel = qt_lightClusterLightTexel(qt_lightCluster.x + qt_clusterIdx);\n"
+                           << "    vec4 qt_clusterLightPosition = qt_fetchLightClusterTexel(qt_clusterLightTexel);\n"
+                           << "    vec4 qt_clusterLightDirection = qt_fetchLightClusterTexel(qt_clusterLightTexel + 1);\n"
+                           << "    vec4 qt_clusterLightDiffuse = qt_fetchLightClusterTexel(qt_clusterLightTexel + 2);\n"
+                           << "    vec4 qt_clusterLightSpecular = qt_fetchLightClusterTexel(qt_clusterLightTexel + 3);\n"
+                           << "    vec4 qt_clusterLightAttenuation = qt_fetchLightClusterTexel(qt_clusterLightTexel + 4);\n"
+                           << "    qt_lightAttenuation = 1.0;\n"
+                           << "    if (qt_clusterLightPosition.w > 0.5) {\n";
+            QSSGMaterialShaderGenerator::LightVariableNames spotVarNames = clusterVarNames;
+            generatePointOrSpotLight(spotVarNames, QByteArrayLiteral("qt_clusterSpot"), 0, QSSGRenderLight::Type::SpotLight, false);
+            fragmentShader << "    } else {\n";
+            QSSGMaterialShaderGenerator::LightVariableNames pointVarNames = clusterVarNames;
+            generatePointOrSpotLight(pointVarNames, QByteArrayLiteral("qt_clusterPoint"), 0, QSSGRenderLight::Type::PointLight, false);
+            fragmentShader << "    }\n"
+                           << "    }\n\n";
+        }
+
         // The color in rgb is ready, including shadowing, just need to apply
         // the ambient occlusion factor. The alpha is the model opacity
         // multiplied by the alpha from the material color and/or the vertex colors.
@@ -1620,7 +1676,7 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGMaterialShaderGenerator::generateMaterialRhiS
     vertexPipeline.endVertexGeneration();
     vertexPipeline.endFragmentGeneration();
 
-    return vertexPipeline.programGenerator()->compileGeneratedRhiShader(materialInfoString, inFeatureSet, shaderLibraryManager, theCache, {});
+    return vertexPipeline.programGenerator()->compileGeneratedRhiShader(materialInfoString, inFeatureSet, shaderLibraryManager, theCache, QSSGRhiShaderPipeline::AsyncCompilation);
 }
 
 static float ZERO_MATRIX[16] = {};
@@ -1653,15 +1709,16 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
 {
     QSSGShaderMaterialAdapter *materialAdapter = getMaterialAdapter(inMaterial);
     QSSGRhiShaderPipeline::CommonUniformIndices &cui = shaders->commonUniformIndices;
+    using CommonUniform = QSSGRhiShaderPipeline::CommonUniform;
 
     materialAdapter->setCustomPropertyUniforms(ubufData, shaders, renderContext);
 
     const QVector3D camGlobalPos = inCamera.getGlobalPos();
     const QVector2D camProperties(inCamera.clipNear, inCamera.clipFar);
 
-    shaders->setUniform(ubufData, "qt_cameraPosition", &camGlobalPos, 3 * sizeof(float), &cui.cameraPositionIdx);
-    shaders->setUniform(ubufData, "qt_cameraDirection", &inRenderProperties.cameraDirection, 3 * sizeof(float), &cui.cameraDirectionIdx);
-    shaders->setUniform(ubufData, "qt_cameraProperties", &camProperties, 2 * sizeof(float), &cui.cameraPropertiesIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::CameraPosition, &camGlobalPos, 3 * sizeof(float));
+    shaders->setCommonUniform(ubufData, CommonUniform::CameraDirection, &inRenderProperties.cameraDirection, 3 * sizeof(float));
+    shaders->setCommonUniform(ubufData, CommonUniform::CameraProperties, &camProperties, 2 * sizeof(float));
 
     // Only calculate and update Matrix uniforms if they are needed
     bool usesProjectionMatrix = false;
@@ -1697,36 +1754,36 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
     if (usesProjectionMatrix || usesInvProjectionMatrix) {
         const QMatrix4x4 projection = clipSpaceCorrMatrix * inCamera.projection;
         if (usesProjectionMatrix)
-            shaders->setUniform(ubufData, "qt_projectionMatrix", projection.constData(), 16 * sizeof(float), &cui.projectionMatrixIdx);
+            shaders->setCommonUniform(ubufData, CommonUniform::ProjectionMatrix, projection.constData(), 16 * sizeof(float));
         if (usesInvProjectionMatrix)
-            shaders->setUniform(ubufData, "qt_inverseProjectionMatrix", projection.inverted().constData(), 16 * sizeof (float), &cui.inverseProjectionMatrixIdx);
+            shaders->setCommonUniform(ubufData, CommonUniform::InverseProjectionMatrix, projection.inverted().constData(), 16 * sizeof (float));
     }
     if (usesViewMatrix) {
         const QMatrix4x4 viewMatrix = inCamera.globalTransform.inverted();
-        shaders->setUniform(ubufData, "qt_viewMatrix", viewMatrix.constData(), 16 * sizeof(float), &cui.viewMatrixIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ViewMatrix, viewMatrix.constData(), 16 * sizeof(float));
     }
     if (usesViewProjectionMatrix) {
         QMatrix4x4 viewProj;
         inCamera.calculateViewProjectionMatrix(viewProj);
         viewProj = clipSpaceCorrMatrix * viewProj;
-        shaders->setUniform(ubufData, "qt_viewProjectionMatrix", viewProj.constData(), 16 * sizeof(float), &cui.viewProjectionMatrixIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ViewProjectionMatrix, viewProj.constData(), 16 * sizeof(float));
     }
 
     // qt_modelMatrix is always available, but differnt when using instancing
     if (usesInstancing)
-        shaders->setUniform(ubufData, "qt_modelMatrix", localInstanceTransform.constData(), 16 * sizeof(float), &cui.modelMatrixIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ModelMatrix, localInstanceTransform.constData(), 16 * sizeof(float));
     else
-        shaders->setUniform(ubufData, "qt_modelMatrix", inGlobalTransform.constData(), 16 * sizeof(float), &cui.modelMatrixIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ModelMatrix, inGlobalTransform.constData(), 16 * sizeof(float));
 
     if (usesModelViewProjectionMatrix) {
         const QMatrix4x4 mvp = clipSpaceCorrMatrix * inModelViewProjection;
-        shaders->setUniform(ubufData, "qt_modelViewProjection", mvp.constData(), 16 * sizeof(float), &cui.modelViewProjectionIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ModelViewProjection, mvp.constData(), 16 * sizeof(float));
     }
     if (usesNormalMatrix)
-        shaders->setUniform(ubufData, "qt_normalMatrix", inNormalMatrix.constData(), 12 * sizeof(float), &cui.normalMatrixIdx,
-                            QSSGRhiShaderPipeline::UniformFlag::Mat3); // real size will be 12 floats, setUniform repacks as needed
+        shaders->setCommonUniform(ubufData, CommonUniform::NormalMatrix, inNormalMatrix.constData(), 12 * sizeof(float),
+                                  QSSGRhiShaderPipeline::UniformFlag::Mat3); // real size will be 12 floats, setCommonUniform repacks as needed
     if (usesParentMatrix)
-        shaders->setUniform(ubufData, "qt_parentMatrix", globalInstanceTransform.constData(), 16 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ParentMatrix, globalInstanceTransform.constData(), 16 * sizeof(float));
 
     // Skinning
     const bool hasCustomVert = materialAdapter->hasCustomShaderSnippet(QSSGShaderCache::ShaderType::Vertex);
@@ -1797,9 +1854,9 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
                 theShadowMapProperties.shadowMapTexture = pEntry->m_rhiDepthCube;
                 theShadowMapProperties.shadowMapTextureUniformName = names.shadowCubeStem;
                 if (receivesShadows)
-                    shaders->setUniform(ubufData, names.shadowMatrixStem, pEntry->m_lightView.constData(), 16 * sizeof(float));
+                    QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowMatrixOffset(lightIdx), pEntry->m_lightView.constData(), 16 * sizeof(float));
                 else
-                    shaders->setUniform(ubufData, names.shadowMatrixStem, ZERO_MATRIX, 16 * sizeof(float));
+                    QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowMatrixOffset(lightIdx), ZERO_MATRIX, 16 * sizeof(float));
             } else {
                 theShadowMapProperties.shadowMapTexture = pEntry->m_rhiDepthMap;
                 theShadowMapProperties.shadowMapTextureUniformName = names.shadowMapStem;
@@ -1811,9 +1868,9 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
                         0.0, 0.0, 0.5, 0.5,
                         0.0, 0.0, 0.0, 1.0 };
                     const QMatrix4x4 m = bias * pEntry->m_lightVP;
-                    shaders->setUniform(ubufData, names.shadowMatrixStem, m.constData(), 16 * sizeof(float));
+                    QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowMatrixOffset(lightIdx), m.constData(), 16 * sizeof(float));
                 } else {
-                    shaders->setUniform(ubufData, names.shadowMatrixStem, ZERO_MATRIX, 16 * sizeof(float));
+                    QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowMatrixOffset(lightIdx), ZERO_MATRIX, 16 * sizeof(float));
                 }
             }
 
@@ -1822,9 +1879,9 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
                                               theLight->m_shadowFactor,
                                               theLight->m_shadowMapFar,
                                               inRenderProperties.isYUpInFramebuffer ? 0.0f : 1.0f);
-                shaders->setUniform(ubufData, names.shadowControlStem, &shadowControl, 4 * sizeof(float));
+                QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowControlOffset(lightIdx), &shadowControl, 4 * sizeof(float));
             } else {
-                shaders->setUniform(ubufData, names.shadowControlStem, ZERO_MATRIX, 4 * sizeof(float));
+                QSSGRhiShaderPipeline::setUniformAtOffset(ubufData, shaders->shadowControlOffset(lightIdx), ZERO_MATRIX, 4 * sizeof(float));
             }
         }
 
@@ -1856,6 +1913,20 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
     shaders->setSsaoTexture(inRenderProperties.rhiSsaoTexture);
     shaders->setScreenTexture(inRenderProperties.rhiScreenTexture);
 
+    // The lights binned into clusters, on top of the ones above
+    const QSSGLightClusters *lightClusters = inRenderProperties.lightClusters;
+    if (lightClusters && !lightClusters->isEmpty()) {
+        shaders->setLightClusterTexture(lightClusters->texture());
+        shaders->setCommonUniform(ubufData, CommonUniform::ClusterViewProjection, lightClusters->viewProjection().constData(),
+                                  16 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ClusterViewDepth, &lightClusters->viewDepth(), 4 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ClusterDepthParams, &lightClusters->depthParams(), 4 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ClusterOffsets, &lightClusters->offsets(), 4 * sizeof(float));
+        theLightAmbientTotal += lightClusters->ambientTotal();
+    } else {
+        shaders->setLightClusterTexture(nullptr);
+    }
+
     QSSGRenderImage *theLightProbe = inRenderProperties.lightProbe;
 
     // If the material has its own IBL Override, we should use that image instead.
@@ -1871,33 +1942,33 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         const int maxMipLevel = lightProbeTexture.m_mipmapCount - 1;
 
         if (!materialIblProbe && !inRenderProperties.probeOrientation.isIdentity()) {
-            shaders->setUniform(ubufData, "qt_lightProbeOrientation",
-                                inRenderProperties.probeOrientation.constData(),
-                                12 * sizeof(float), &cui.lightProbeOrientationIdx,
-                                QSSGRhiShaderPipeline::UniformFlag::Mat3);
+            shaders->setCommonUniform(ubufData, CommonUniform::LightProbeOrientation,
+                                      inRenderProperties.probeOrientation.constData(),
+                                      12 * sizeof(float),
+                                      QSSGRhiShaderPipeline::UniformFlag::Mat3);
         }
 
         const float props[4] = { 0.0f, float(maxMipLevel), inRenderProperties.probeHorizon, inRenderProperties.probeExposure };
-        shaders->setUniform(ubufData, "qt_lightProbeProperties", props, 4 * sizeof(float), &cui.lightProbePropertiesIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::LightProbeProperties, props, 4 * sizeof(float));
 
         shaders->setLightProbeTexture(lightProbeTexture.m_texture, theHorzLightProbeTilingMode, theVertLightProbeTilingMode);
     } else {
         // no lightprobe
         const float emptyProps[4] = { 0.0f, 0.0f, -1.0f, 0.0f };
-        shaders->setUniform(ubufData, "qt_lightProbeProperties", emptyProps, 4 * sizeof(float), &cui.lightProbePropertiesIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::LightProbeProperties, emptyProps, 4 * sizeof(float));
 
         shaders->setLightProbeTexture(nullptr);
     }
 
     if (receivesReflections && reflectionProbe.enabled) {
-        shaders->setUniform(ubufData, "qt_reflectionProbeBoxCenter", &reflectionProbe.probeBoxCenter, 3 * sizeof(float), &cui.reflectionProbeBoxCenter);
-        shaders->setUniform(ubufData, "qt_reflectionProbeBoxMin", &reflectionProbe.probeBoxMin, 3 * sizeof(float), &cui.reflectionProbeBoxMin);
-        shaders->setUniform(ubufData, "qt_reflectionProbeBoxMax", &reflectionProbe.probeBoxMax, 3 * sizeof(float), &cui.reflectionProbeBoxMax);
-        shaders->setUniform(ubufData, "qt_reflectionProbeCorrection", &reflectionProbe.parallaxCorrection, sizeof(int), &cui.reflectionProbeCorrection);
+        shaders->setCommonUniform(ubufData, CommonUniform::ReflectionProbeBoxCenter, &reflectionProbe.probeBoxCenter, 3 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ReflectionProbeBoxMin, &reflectionProbe.probeBoxMin, 3 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ReflectionProbeBoxMax, &reflectionProbe.probeBoxMax, 3 * sizeof(float));
+        shaders->setCommonUniform(ubufData, CommonUniform::ReflectionProbeCorrection, &reflectionProbe.parallaxCorrection, sizeof(int));
     }
 
     const QVector3D emissiveColor = materialAdapter->emissiveColor();
-    shaders->setUniform(ubufData, "qt_material_emissive_color", &emissiveColor, 3 * sizeof(float), &cui.material_emissiveColorIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialEmissiveColor, &emissiveColor, 3 * sizeof(float));
 
     const auto qMix = [](float x, float y, float a) {
         return (x * (1.0f - a) + (y * a));
@@ -1911,11 +1982,11 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
     const QVector3D materialSpecularTint = materialAdapter->specularTint();
     const QVector3D specularTint = materialAdapter->isPrincipled() ? qMix3(QVector3D(1.0f, 1.0f, 1.0f), color.toVector3D(), materialSpecularTint.x())
                                                                    : materialSpecularTint;
-    shaders->setUniform(ubufData, "qt_material_base_color", &color, 4 * sizeof(float), &cui.material_baseColorIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialBaseColor, &color, 4 * sizeof(float));
 
     const float ior = materialAdapter->ior();
     QVector4D specularColor(specularTint, ior);
-    shaders->setUniform(ubufData, "qt_material_specular", &specularColor, 4 * sizeof(float), &cui.material_specularIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialSpecular, &specularColor, 4 * sizeof(float));
 
      // metalnessAmount cannot be multiplied in here yet due to custom materials
     const bool hasLighting = materialAdapter->hasLighting();
@@ -1931,7 +2002,7 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         memcpy(ubufData + shaders->ub0LightDataOffset(), &lightsUniformData, shaders->ub0LightDataSize());
     }
 
-    shaders->setUniform(ubufData, "qt_light_ambient_total", &theLightAmbientTotal, 3 * sizeof(float), &cui.light_ambient_totalIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::LightAmbientTotal, &theLightAmbientTotal, 3 * sizeof(float));
 
     const float materialProperties[4] = {
         materialAdapter->specularAmount(),
@@ -1939,7 +2010,7 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         materialAdapter->metalnessAmount(),
         inOpacity
     };
-    shaders->setUniform(ubufData, "qt_material_properties", materialProperties, 4 * sizeof(float), &cui.material_propertiesIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialProperties, materialProperties, 4 * sizeof(float));
 
     const float materialProperties2[4] = {
         materialAdapter->fresnelPower(),
@@ -1947,7 +2018,7 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         materialAdapter->translucentFallOff(),
         materialAdapter->diffuseLightWrap()
     };
-    shaders->setUniform(ubufData, "qt_material_properties2", materialProperties2, 4 * sizeof(float), &cui.material_properties2Idx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialProperties2, materialProperties2, 4 * sizeof(float));
 
     const float materialProperties3[4] = {
         materialAdapter->occlusionAmount(),
@@ -1955,7 +2026,7 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         materialAdapter->clearcoatAmount(),
         materialAdapter->clearcoatRoughnessAmount()
     };
-    shaders->setUniform(ubufData, "qt_material_properties3", materialProperties3, 4 * sizeof(float), &cui.material_properties3Idx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialProperties3, materialProperties3, 4 * sizeof(float));
 
     const float materialProperties4[4] = {
         materialAdapter->heightAmount(),
@@ -1963,15 +2034,15 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         materialAdapter->maxHeightSamples(),
         materialAdapter->transmissionFactor()
     };
-    shaders->setUniform(ubufData, "qt_material_properties4", materialProperties4, 4 * sizeof(float), &cui.material_properties4Idx);
+    shaders->setCommonUniform(ubufData, CommonUniform::MaterialProperties4, materialProperties4, 4 * sizeof(float));
 
     // We only ever use attenuation and thickness uniforms when using transmission
     if (materialAdapter->isTransmissionEnabled()) {
         const QVector4D attenuationProperties(materialAdapter->attenuationColor(), materialAdapter->attenuationDistance());
-        shaders->setUniform(ubufData, "qt_material_attenuation", &attenuationProperties, 4 * sizeof(float), &cui.material_attenuationIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::MaterialAttenuation, &attenuationProperties, 4 * sizeof(float));
 
         const float thickness = materialAdapter->thicknessFactor();
-        shaders->setUniform(ubufData, "qt_material_thickness", &thickness, sizeof(float), &cui.thicknessFactorIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::MaterialThickness, &thickness, sizeof(float));
     }
 
     const float rhiProperties[4] = {
@@ -1980,7 +2051,7 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
         inRenderProperties.isClipDepthZeroToOne ? 0.0f : -1.0f,
         0.0f // unused
     };
-    shaders->setUniform(ubufData, "qt_rhi_properties", rhiProperties, 4 * sizeof(float), &cui.rhiPropertiesIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::RhiProperties, rhiProperties, 4 * sizeof(float));
 
     quint32 imageIdx = 0;
     for (QSSGRenderableImage *theImage = inFirstImage; theImage; theImage = theImage->m_nextImage, ++imageIdx) {
@@ -2005,12 +2076,12 @@ void QSSGMaterialShaderGenerator::setRhiMaterialProperties(const QSSGRenderConte
     }
 
     if (shadowDepthAdjust)
-        shaders->setUniform(ubufData, "qt_shadowDepthAdjust", shadowDepthAdjust, 2 * sizeof(float), &cui.shadowDepthAdjustIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::ShadowDepthAdjust, shadowDepthAdjust, 2 * sizeof(float));
 
     const bool usesPointsTopology = inProperties.m_usesPointsTopology.getValue(inKey);
     if (usesPointsTopology) {
         const float pointSize = materialAdapter->pointSize();
-        shaders->setUniform(ubufData, "qt_materialPointSize", &pointSize, sizeof(float), &cui.pointSizeIdx);
+        shaders->setCommonUniform(ubufData, CommonUniform::MaterialPointSize, &pointSize, sizeof(float));
     }
 
     inPipelineState->lineWidth = materialAdapter->lineWidth();
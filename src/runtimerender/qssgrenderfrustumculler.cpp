@@ -0,0 +1,170 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qssgrenderfrustumculler_p.h"
+
+#include <QtCore/private/qsimd_p.h>
+
+#include <limits>
+
+QT_BEGIN_NAMESPACE
+
+void QSSGRenderFrustumCuller::clear()
+{
+    m_size = 0;
+    for (int axis = 0; axis != 3; ++axis) {
+        m_center[axis].clear();
+        m_extents[axis].clear();
+    }
+    m_visibility.clear();
+}
+
+qsizetype QSSGRenderFrustumCuller::addBounds(const QSSGBounds3 &inBounds, const QMatrix4x4 &globalTransform)
+{
+    // Start a new batch, the padding lanes are culled and ignored
+    if (m_size % BatchSize == 0) {
+        for (int axis = 0; axis != 3; ++axis) {
+            m_center[axis].resize(m_size + BatchSize);
+            m_extents[axis].resize(m_size + BatchSize);
+        }
+    }
+
+    const qsizetype index = m_size++;
+    if (inBounds.isEmpty()) {
+        // Negative extents put the box below every plane
+        for (int axis = 0; axis != 3; ++axis) {
+            m_center[axis][index] = 0.0f;
+            m_extents[axis][index] = -std::numeric_limits<float>::max();
+        }
+        return index;
+    }
+
+    // The axis aligned box around the transformed box, the same one that
+    // QSSGBounds3::transform() gets by mapping all the corners
+    const QVector3D center = inBounds.center();
+    const QVector3D extents = inBounds.extents();
+    for (int row = 0; row != 3; ++row) {
+        m_center[row][index] = globalTransform(row, 0) * center.x()
+                + globalTransform(row, 1) * center.y()
+                + globalTransform(row, 2) * center.z()
+                + globalTransform(row, 3);
+        m_extents[row][index] = qAbs(globalTransform(row, 0)) * extents.x()
+                + qAbs(globalTransform(row, 1)) * extents.y()
+                + qAbs(globalTransform(row, 2)) * extents.z();
+    }
+    return index;
+}
+
+// Returns a mask with a bit for each of the boxes starting at index that is
+// not completely below any of the planes. Same test as QSSGClipPlane::intersect
+// returning -1: the box corner furthest along the normal is below the plane.
+static inline int cullBatch(const QSSGClippingFrustum &frustum,
+                            const float *const *center,
+                            const float *const *extents,
+                            qsizetype index)
+{
+#if defined(__SSE2__)
+    const __m128 cx = _mm_loadu_ps(center[0] + index);
+    const __m128 cy = _mm_loadu_ps(center[1] + index);
+    const __m128 cz = _mm_loadu_ps(center[2] + index);
+    const __m128 ex = _mm_loadu_ps(extents[0] + index);
+    const __m128 ey = _mm_loadu_ps(extents[1] + index);
+    const __m128 ez = _mm_loadu_ps(extents[2] + index);
+    __m128 outside = _mm_setzero_ps();
+    for (const QSSGClipPlane &plane : frustum.mPlanes) {
+        const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.normal.x()), cx),
+                                                      _mm_mul_ps(_mm_set1_ps(plane.normal.y()), cy)),
+                                           _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.normal.z()), cz),
+                                                      _mm_set1_ps(plane.d)));
+        const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(qAbs(plane.normal.x())), ex),
+                                                    _mm_mul_ps(_mm_set1_ps(qAbs(plane.normal.y())), ey)),
+                                         _mm_mul_ps(_mm_set1_ps(qAbs(plane.normal.z())), ez));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+    }
+    return ~_mm_movemask_ps(outside) & 0xf;
+#elif defined(__ARM_NEON__)
+    const float32x4_t cx = vld1q_f32(center[0] + index);
+    const float32x4_t cy = vld1q_f32(center[1] + index);
+    const float32x4_t cz = vld1q_f32(center[2] + index);
+    const float32x4_t ex = vld1q_f32(extents[0] + index);
+    const float32x4_t ey = vld1q_f32(extents[1] + index);
+    const float32x4_t ez = vld1q_f32(extents[2] + index);
+    uint32x4_t outside = vdupq_n_u32(0);
+    for (const QSSGClipPlane &plane : frustum.mPlanes) {
+        float32x4_t distance = vdupq_n_f32(plane.d);
+        distance = vmlaq_n_f32(distance, cx, plane.normal.x());
+        distance = vmlaq_n_f32(distance, cy, plane.normal.y());
+        distance = vmlaq_n_f32(distance, cz, plane.normal.z());
+        float32x4_t radius = vmulq_n_f32(ex, qAbs(plane.normal.x()));
+        radius = vmlaq_n_f32(radius, ey, qAbs(plane.normal.y()));
+        radius = vmlaq_n_f32(radius, ez, qAbs(plane.normal.z()));
+        outside = vorrq_u32(outside, vcltq_f32(vaddq_f32(distance, radius), vdupq_n_f32(0.0f)));
+    }
+    static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+    const uint32x4_t mask = vandq_u32(outside, vld1q_u32(laneBits));
+    return ~int(vgetq_lane_u32(mask, 0) | vgetq_lane_u32(mask, 1) | vgetq_lane_u32(mask, 2) | vgetq_lane_u32(mask, 3)) & 0xf;
+#else
+    int mask = 0;
+    for (int lane = 0; lane != QSSGRenderFrustumCuller::BatchSize; ++lane) {
+        bool outside = false;
+        for (const QSSGClipPlane &plane : frustum.mPlanes) {
+            const float distance = plane.normal.x() * center[0][index + lane]
+                    + plane.normal.y() * center[1][index + lane]
+                    + plane.normal.z() * center[2][index + lane]
+                    + plane.d;
+            const float radius = qAbs(plane.normal.x()) * extents[0][index + lane]
+                    + qAbs(plane.normal.y()) * extents[1][index + lane]
+                    + qAbs(plane.normal.z()) * extents[2][index + lane];
+            outside = outside || (distance + radius < 0.0f);
+        }
+        if (!outside)
+            mask |= 1 << lane;
+    }
+    return mask;
+#endif
+}
+
+void QSSGRenderFrustumCuller::cull(const QSSGClippingFrustum &frustum)
+{
+    Q_STATIC_ASSERT(64 % BatchSize == 0);
+
+    m_visibility.fill(0, (m_size + 63) / 64);
+    const float *center[3] = { m_center[0].constData(), m_center[1].constData(), m_center[2].constData() };
+    const float *extents[3] = { m_extents[0].constData(), m_extents[1].constData(), m_extents[2].constData() };
+    for (qsizetype index = 0; index < m_size; index += BatchSize) {
+        const quint64 mask = quint64(cullBatch(frustum, center, extents, index));
+        m_visibility[index / 64] |= mask << (index % 64);
+    }
+
+    // Keep the bits of the padding lanes clear
+    if (m_size % 64)
+        m_visibility.last() &= (quint64(1) << (m_size % 64)) - 1;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGRENDERFRUSTUMCULLER_P_H
+#define QSSGRENDERFRUSTUMCULLER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderclippingfrustum_p.h>
+
+#include <QtQuick3DUtils/private/qssgbounds3_p.h>
+
+#include <QtCore/QVector>
+#include <QtGui/QMatrix4x4>
+
+QT_BEGIN_NAMESPACE
+
+// Culls a batch of boxes against a clipping frustum. The boxes are kept in
+// world space as centers and extents, one array per component, so that
+// several of them can be tested against a plane at once. The result is a
+// bitset with a bit set for each box that is at least partially inside.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderFrustumCuller
+{
+public:
+    static constexpr int BatchSize = 4;
+
+    void clear();
+
+    // Adds inBounds, transformed by the affine globalTransform, and returns
+    // its index. Empty bounds are never visible, like with
+    // QSSGClippingFrustum::intersectsWith.
+    qsizetype addBounds(const QSSGBounds3 &inBounds, const QMatrix4x4 &globalTransform);
+    qsizetype size() const { return m_size; }
+
+    void cull(const QSSGClippingFrustum &frustum);
+
+    // Valid after cull(), until the next clear()
+    bool isVisible(qsizetype index) const
+    {
+        Q_ASSERT(index >= 0 && index < m_size);
+        return (m_visibility.at(index / 64) >> (index % 64)) & 1;
+    }
+    const QVector<quint64> &visibility() const { return m_visibility; }
+
+private:
+    qsizetype m_size = 0;
+    // Padded to a multiple of BatchSize
+    QVector<float> m_center[3];
+    QVector<float> m_extents[3];
+    QVector<quint64> m_visibility;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSSGRENDERFRUSTUMCULLER_P_H
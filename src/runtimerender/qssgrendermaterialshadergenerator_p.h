@@ -61,6 +61,7 @@ struct QSSGRenderLight;
 class QSSGRenderShadowMap;
 struct QSSGRenderImage;
 class QRhiTexture;
+class QSSGLightClusters;
 
 struct QSSGLayerGlobalRenderProperties
 {
@@ -71,6 +72,7 @@ struct QSSGLayerGlobalRenderProperties
     QRhiTexture *rhiDepthTexture;
     QRhiTexture *rhiSsaoTexture;
     QRhiTexture *rhiScreenTexture;
+    const QSSGLightClusters *lightClusters;
     QSSGRenderImage *lightProbe;
     float probeHorizon;
     float probeExposure;
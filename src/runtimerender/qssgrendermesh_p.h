@@ -47,6 +47,8 @@
 #include <QtQuick3DUtils/private/qssgbounds3_p.h>
 #include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
 
+#include <QtCore/QSharedPointer>
+
 QT_BEGIN_NAMESPACE
 
 struct QSSGRenderSubset
@@ -54,7 +56,7 @@ struct QSSGRenderSubset
     quint32 count;
     quint32 offset;
     QSSGBounds3 bounds; // Vertex buffer bounds
-    QSSGMeshBVHNode *bvhRoot = nullptr;
+    int bvhRoot = -1; // Index into QSSGRenderMesh::bvh->nodes
     struct {
         QSSGRef<QSSGRhiBuffer> vertexBuffer;
         QSSGRef<QSSGRhiBuffer> indexBuffer;
@@ -83,6 +85,16 @@ struct QSSGRenderSubset
     }
 };
 
+// Outcome of a BVH build running on a thread pool. Shared between the job and
+// the mesh so that either one can go away first.
+struct QSSGMeshBVHBuildResult
+{
+    ~QSSGMeshBVHBuildResult() { delete bvh.loadAcquire(); }
+
+    QAtomicPointer<QSSGMeshBVH> bvh;
+    QAtomicInt finished;
+};
+
 struct QSSGRenderMesh
 {
     Q_DISABLE_COPY(QSSGRenderMesh)
@@ -90,17 +102,13 @@ struct QSSGRenderMesh
     QVector<QSSGRenderSubset> subsets;
     QSSGRenderDrawMode drawMode;
     QSSGRenderWinding winding;
-    QSSGMeshBVH *bvh = nullptr;
+    QSharedPointer<const QSSGMeshBVH> bvh; // Shared with the picking data
+    QSharedPointer<QSSGMeshBVHBuildResult> bvhBuild; // Set while (or after) building bvh asynchronously
 
     QSSGRenderMesh(QSSGRenderDrawMode inDrawMode, QSSGRenderWinding inWinding)
         : drawMode(inDrawMode), winding(inWinding)
     {
     }
-
-    ~QSSGRenderMesh()
-    {
-        delete bvh;
-    }
 };
 QT_END_NAMESPACE
 
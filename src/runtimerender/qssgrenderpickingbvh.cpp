@@ -0,0 +1,388 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qssgrenderpickingbvh_p.h"
+
+#include <QtQuick3DRuntimeRender/private/qssgrenderray_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendermodel_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendererimpllayerrenderpreparationdata_p.h>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+static inline QVector3D boundsCenter(const QSSGBounds3 &bounds)
+{
+    return bounds.isEmpty() ? QVector3D() : bounds.center();
+}
+
+void QSSGRenderBoundsBVH::build(const QSSGBounds3 *bounds, const QVector<int> &items)
+{
+    m_nodes.clear();
+    m_leafItems = items;
+    if (m_leafItems.isEmpty())
+        return;
+
+    m_nodes.reserve(2 * m_leafItems.size() / MaxLeafItems + 1);
+    m_nodes.append(QSSGMeshBVHNode());
+    splitNode(bounds, 0, 0, m_leafItems.size());
+}
+
+void QSSGRenderBoundsBVH::clear()
+{
+    m_nodes.clear();
+    m_leafItems.clear();
+}
+
+void QSSGRenderBoundsBVH::splitNode(const QSSGBounds3 *bounds, int nodeIndex, int offset, int count)
+{
+    QSSGBounds3 nodeBounds;
+    QSSGBounds3 centerBounds;
+    for (int i = offset, end = offset + count; i < end; ++i) {
+        const QSSGBounds3 &itemBounds = bounds[m_leafItems.at(i)];
+        nodeBounds.include(itemBounds);
+        centerBounds.include(boundsCenter(itemBounds));
+    }
+    m_nodes[nodeIndex].boundingData = nodeBounds;
+
+    if (count <= MaxLeafItems) {
+        m_nodes[nodeIndex].offset = offset;
+        m_nodes[nodeIndex].count = count;
+        return;
+    }
+
+    // Median split along the longest axis of the item centers. It is not as
+    // tight as a SAH split, but it is cheap and keeps the tree balanced, which
+    // matters more for the few hundred thousand items at most we deal with.
+    const QVector3D extents = centerBounds.isEmpty() ? QVector3D() : centerBounds.dimensions();
+    int axis = 0;
+    if (extents.y() > extents[axis])
+        axis = 1;
+    if (extents.z() > extents[axis])
+        axis = 2;
+
+    const int middle = offset + count / 2;
+    std::nth_element(m_leafItems.begin() + offset,
+                     m_leafItems.begin() + middle,
+                     m_leafItems.begin() + offset + count,
+                     [bounds, axis](int lhs, int rhs) {
+        return boundsCenter(bounds[lhs])[axis] < boundsCenter(bounds[rhs])[axis];
+    });
+
+    const int left = m_nodes.size();
+    m_nodes.append(QSSGMeshBVHNode());
+    m_nodes.append(QSSGMeshBVHNode());
+    m_nodes[nodeIndex].left = left;
+    splitNode(bounds, left, offset, middle - offset);
+    splitNode(bounds, left + 1, middle, offset + count - middle);
+}
+
+void QSSGRenderBoundsBVH::refit(const QSSGBounds3 *bounds)
+{
+    // Children are always stored after their parent
+    for (int i = m_nodes.size() - 1; i >= 0; --i) {
+        QSSGMeshBVHNode &node = m_nodes[i];
+        QSSGBounds3 nodeBounds;
+        if (node.isLeaf()) {
+            for (int j = node.offset, end = node.offset + node.count; j < end; ++j)
+                nodeBounds.include(bounds[m_leafItems.at(j)]);
+        } else {
+            nodeBounds.include(m_nodes.at(node.left).boundingData);
+            nodeBounds.include(m_nodes.at(node.right()).boundingData);
+        }
+        node.boundingData = nodeBounds;
+    }
+}
+
+float QSSGRenderBoundsBVH::totalArea() const
+{
+    float area = 0.0f;
+    for (const QSSGMeshBVHNode &node : m_nodes)
+        area += QSSGMeshBVH::surfaceArea(node.boundingData);
+    return area;
+}
+
+void QSSGRenderBoundsBVH::findHits(const QSSGRenderRay::RayData &rayData, const QSSGBounds3 *bounds, ItemList &hits) const
+{
+    if (m_nodes.isEmpty())
+        return;
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(0);
+    while (!stack.isEmpty()) {
+        const QSSGMeshBVHNode &node = m_nodes.at(stack.takeLast());
+        if (node.boundingData.isEmpty() || !QSSGRenderRay::intersectWithAABBv2(rayData, node.boundingData).intersects())
+            continue;
+        if (node.isLeaf()) {
+            for (int i = node.offset, end = node.offset + node.count; i < end; ++i) {
+                const int item = m_leafItems.at(i);
+                const QSSGBounds3 &itemBounds = bounds[item];
+                if (!itemBounds.isEmpty() && QSSGRenderRay::intersectWithAABBv2(rayData, itemBounds).intersects())
+                    hits.append(item);
+            }
+        } else {
+            stack.append(node.left);
+            stack.append(node.right());
+        }
+    }
+}
+
+bool QSSGRenderPickingBVH::isPickable(const QSSGRenderNode &node, bool pickEverything)
+{
+    // Particles can not be picked
+    if (node.type == QSSGRenderGraphObject::Type::Particles)
+        return false;
+    return pickEverything || node.flags.testFlag(QSSGRenderNode::Flag::LocallyPickable);
+}
+
+bool QSSGRenderPickingBVH::isUnbounded(const QSSGRenderNode &node)
+{
+    if (node.type == QSSGRenderGraphObject::Type::Item2D)
+        return true;
+    return node.type == QSSGRenderGraphObject::Type::Model
+            && static_cast<const QSSGRenderModel &>(node).instancing();
+}
+
+void QSSGRenderPickingBVH::update(const QVector<QSSGRenderableNodeEntry> &renderables,
+                                  bool pickEverything,
+                                  const LocalBoundsFunction &localBounds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    bool nodesChanged = !m_valid || pickEverything != m_pickEverything;
+    bool boundsChanged = false;
+    qsizetype entryCount = 0;
+    for (const QSSGRenderableNodeEntry &renderable : renderables) {
+        const QSSGRenderNode &node = *renderable.node;
+        if (!isPickable(node, pickEverything))
+            continue;
+
+        if (entryCount == m_entries.size()) {
+            m_entries.append(Entry());
+            m_worldBounds.append(QSSGBounds3());
+        }
+        const qsizetype entryIndex = entryCount++;
+        Entry &entry = m_entries[entryIndex];
+        const bool unbounded = isUnbounded(node);
+        if (entry.node != &node || entry.unbounded != unbounded) {
+            entry.node = &node;
+            entry.unbounded = unbounded;
+            nodesChanged = true;
+        }
+
+        if (unbounded)
+            continue;
+
+        const QSSGBounds3 bounds = localBounds(node);
+        if (nodesChanged
+                || entry.transform != node.globalTransform
+                || entry.localBounds.minimum != bounds.minimum
+                || entry.localBounds.maximum != bounds.maximum) {
+            entry.transform = node.globalTransform;
+            entry.localBounds = bounds;
+            QSSGBounds3 &worldBounds = m_worldBounds[entryIndex];
+            worldBounds = bounds;
+            if (!bounds.isEmpty())
+                worldBounds.transform(node.globalTransform);
+            boundsChanged = true;
+        }
+    }
+    if (entryCount != m_entries.size()) {
+        m_entries.resize(entryCount);
+        m_worldBounds.resize(entryCount);
+        nodesChanged = true;
+    }
+
+    m_graphGeneration = QSSGRenderNode::graphGeneration();
+    m_pickEverything = pickEverything;
+    m_valid = true;
+
+    if (nodesChanged) {
+        rebuild();
+    } else if (boundsChanged) {
+        m_tree.refit(m_worldBounds.constData());
+        if (m_tree.totalArea() > m_builtArea * MaxRefitAreaGrowth)
+            rebuild();
+    }
+}
+
+void QSSGRenderPickingBVH::invalidate()
+{
+    QMutexLocker locker(&m_mutex);
+    m_valid = false;
+}
+
+qsizetype QSSGRenderPickingBVH::entryCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+void QSSGRenderPickingBVH::rebuild()
+{
+    m_unboundedEntries.clear();
+
+    QVector<int> boundedEntries;
+    boundedEntries.reserve(m_entries.size());
+    for (int i = 0, end = m_entries.size(); i < end; ++i) {
+        if (m_entries.at(i).unbounded)
+            m_unboundedEntries.append(i);
+        else
+            boundedEntries.append(i);
+    }
+    m_tree.build(m_worldBounds.constData(), boundedEntries);
+
+    m_builtArea = m_tree.totalArea();
+    ++m_rebuildCount;
+}
+
+bool QSSGRenderPickingBVH::findCandidates(const QSSGRenderRay &ray, bool pickEverything, NodeList &candidates) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Nodes may have been removed, or even deleted, since the last update
+    if (!m_valid || m_graphGeneration != QSSGRenderNode::graphGeneration())
+        return false;
+    // The tree only has the locally pickable nodes
+    if (pickEverything && !m_pickEverything)
+        return false;
+
+    QSSGRenderBoundsBVH::ItemList entries;
+    const QMatrix4x4 identity;
+    m_tree.findHits(QSSGRenderRay::createRayData(identity, ray), m_worldBounds.constData(), entries);
+    entries.append(m_unboundedEntries.constData(), m_unboundedEntries.size());
+
+    // Keep the order of the full scene traversal, so that results with equal
+    // distances are still reported the same way.
+    std::sort(entries.begin(), entries.end(), std::greater<int>());
+    for (int entryIndex : qAsConst(entries))
+        candidates.append(m_entries.at(entryIndex).node);
+
+    return true;
+}
+
+bool QSSGRenderPickingBVH::findCandidates(const QVector<QSSGRenderRay> &rays, bool pickEverything, BatchCandidates &candidates) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_valid || m_graphGeneration != QSSGRenderNode::graphGeneration())
+        return false;
+    if (pickEverything && !m_pickEverything)
+        return false;
+
+    // (entry, ray) pairs, grouped by entry below
+    QVector<std::pair<int, int>> hits;
+    const QMatrix4x4 identity;
+    QSSGRenderBoundsBVH::ItemList entries;
+    for (int rayIndex = 0, rayCount = rays.size(); rayIndex < rayCount; ++rayIndex) {
+        entries.clear();
+        m_tree.findHits(QSSGRenderRay::createRayData(identity, rays.at(rayIndex)), m_worldBounds.constData(), entries);
+        entries.append(m_unboundedEntries.constData(), m_unboundedEntries.size());
+        for (int entryIndex : qAsConst(entries))
+            hits.append({ entryIndex, rayIndex });
+    }
+
+    // Entries in the order of the single ray case, rays in increasing order
+    std::sort(hits.begin(), hits.end(), [](const std::pair<int, int> &lhs, const std::pair<int, int> &rhs) {
+        return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+    });
+
+    candidates.rays.reserve(candidates.rays.size() + hits.size());
+    int previousEntry = -1;
+    for (const auto &hit : qAsConst(hits)) {
+        if (hit.first != previousEntry) {
+            candidates.nodes.append(m_entries.at(hit.first).node);
+            candidates.rayOffsets.append(candidates.rays.size());
+            previousEntry = hit.first;
+        }
+        candidates.rays.append(hit.second);
+    }
+    candidates.rayOffsets.append(candidates.rays.size());
+
+    return true;
+}
+
+bool QSSGRenderInstancePickingBVH::isUpToDate(const QSSGRenderModel &model, const QSSGBounds3 &meshBounds) const
+{
+    const QSSGRenderInstanceTable *table = model.instanceTable;
+    return m_table == table
+            && m_tableData == table->constData()
+            && m_tableSerial == table->serial()
+            && m_instanceCount == table->count()
+            && m_localInstanceTransform == model.localInstanceTransform
+            && m_meshBounds.minimum == meshBounds.minimum
+            && m_meshBounds.maximum == meshBounds.maximum;
+}
+
+void QSSGRenderInstancePickingBVH::rebuild(const QSSGRenderModel &model, const QSSGBounds3 &meshBounds)
+{
+    const QSSGRenderInstanceTable *table = model.instanceTable;
+    m_table = table;
+    m_tableData = table->constData();
+    m_tableSerial = table->serial();
+    m_instanceCount = table->count();
+    m_localInstanceTransform = model.localInstanceTransform;
+    m_meshBounds = meshBounds;
+
+    // The count can be overridden to be larger than the table
+    const int instanceCount = table->stride() > 0
+            ? qMin(table->count(), int(table->dataSize() / table->stride()))
+            : 0;
+    m_instanceBounds.resize(qMax(instanceCount, 0));
+
+    QVector<int> instances;
+    instances.reserve(m_instanceBounds.size());
+    for (int i = 0, end = m_instanceBounds.size(); i < end; ++i) {
+        QSSGBounds3 &bounds = m_instanceBounds[i];
+        bounds = meshBounds;
+        if (!bounds.isEmpty())
+            bounds.transform(table->getTransform(i) * model.localInstanceTransform);
+        instances.append(i);
+    }
+    m_tree.build(m_instanceBounds.constData(), instances);
+    ++m_rebuildCount;
+}
+
+void QSSGRenderInstancePickingBVH::findCandidates(const QSSGRenderModel &model,
+                                                  const QSSGBounds3 &meshBounds,
+                                                  const QSSGRenderRay &ray,
+                                                  InstanceList &instances)
+{
+    Q_ASSERT(model.instanceTable);
+    QMutexLocker locker(&m_mutex);
+    if (!isUpToDate(model, meshBounds))
+        rebuild(model, meshBounds);
+
+    const qsizetype firstInstance = instances.size();
+    const auto rayData = QSSGRenderRay::createRayData(model.globalInstanceTransform, ray);
+    m_tree.findHits(rayData, m_instanceBounds.constData(), instances);
+    std::sort(instances.begin() + firstInstance, instances.end());
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,198 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGRENDERPICKINGBVH_P_H
+#define QSSGRENDERPICKINGBVH_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderray_p.h>
+
+#include <QtQuick3DUtils/private/qssgbounds3_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
+
+#include <QtCore/QMutex>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+#include <QtGui/QMatrix4x4>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+struct QSSGRenderNode;
+struct QSSGRenderModel;
+struct QSSGRenderInstanceTable;
+struct QSSGRenderableNodeEntry;
+
+// Tree over a set of axis aligned boxes, shared by the picking trees below.
+// The boxes are owned by the caller and indexed by item.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderBoundsBVH
+{
+public:
+    using ItemList = QVarLengthArray<int, 64>;
+
+    void build(const QSSGBounds3 *bounds, const QVector<int> &items);
+    // Recomputes the node bounds without changing the topology
+    void refit(const QSSGBounds3 *bounds);
+    void clear();
+    float totalArea() const;
+
+    // Appends the items whose boxes are hit by the ray, in no particular order
+    void findHits(const QSSGRenderRay::RayData &rayData, const QSSGBounds3 *bounds, ItemList &hits) const;
+
+private:
+    void splitNode(const QSSGBounds3 *bounds, int nodeIndex, int offset, int count);
+
+    // Item indices, in leaf order
+    QVector<int> m_leafItems;
+    QVector<QSSGMeshBVHNode> m_nodes;
+
+    static constexpr int MaxLeafItems = 4;
+};
+
+// Top-level BVH over the world space bounds of the pickable renderables of a
+// layer. It is updated on the render thread once the global transforms are
+// known, and queried from picking, which may run on another thread, so that
+// only the nodes whose bounds are hit by the ray need to be tested.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderPickingBVH
+{
+public:
+    using NodeList = QVarLengthArray<const QSSGRenderNode *>;
+    using LocalBoundsFunction = std::function<QSSGBounds3(const QSSGRenderNode &node)>;
+
+    // Updates the tree for the current renderables. The tree is refit when only
+    // the transforms or bounds changed, and rebuilt when the set of pickable
+    // nodes changed or refitting made it too loose.
+    void update(const QVector<QSSGRenderableNodeEntry> &renderables,
+                bool pickEverything,
+                const LocalBoundsFunction &localBounds);
+
+    // Appends the nodes that may be hit by the ray, in the reverse order of
+    // the renderables. Returns false when the tree is not usable, for example
+    // because the scene graph changed since the last update. The caller has
+    // to visit all nodes then.
+    bool findCandidates(const QSSGRenderRay &ray, bool pickEverything, NodeList &candidates) const;
+
+    // The candidates of many rays. Each node is listed once, in the same order
+    // as for a single ray, and may be hit by the rays at the indices
+    // rays[rayOffsets[i]] up to rays[rayOffsets[i + 1]] of nodes[i].
+    struct BatchCandidates
+    {
+        NodeList nodes;
+        QVector<int> rayOffsets;
+        QVector<int> rays;
+    };
+    bool findCandidates(const QVector<QSSGRenderRay> &rays, bool pickEverything, BatchCandidates &candidates) const;
+
+    void invalidate();
+
+    qsizetype entryCount() const;
+    int rebuildCount() const { return m_rebuildCount; }
+
+private:
+    struct Entry
+    {
+        const QSSGRenderNode *node = nullptr;
+        QMatrix4x4 transform;
+        QSSGBounds3 localBounds;
+        bool unbounded = false;
+    };
+
+    static bool isPickable(const QSSGRenderNode &node, bool pickEverything);
+    static bool isUnbounded(const QSSGRenderNode &node);
+    void rebuild();
+
+    mutable QMutex m_mutex;
+    QVector<Entry> m_entries;
+    // World bounds of m_entries
+    QVector<QSSGBounds3> m_worldBounds;
+    // Item2Ds are picked against their infinite plane, and instanced models
+    // are culled by their own tree, so they are always candidates
+    QVector<int> m_unboundedEntries;
+    QSSGRenderBoundsBVH m_tree;
+    quint32 m_graphGeneration = 0;
+    bool m_pickEverything = false;
+    bool m_valid = false;
+    float m_builtArea = 0.0f;
+    int m_rebuildCount = 0;
+
+    // Rebuild once refitting grew the summed node area by this factor
+    static constexpr float MaxRefitAreaGrowth = 2.0f;
+};
+
+// Tree over the bounds of the instances of an instanced model, in the space
+// of its global instance transform. It is built when the model is picked and
+// kept until the instance table, the mesh or the local instance transform
+// changes. It is owned by the model and only used by picking, which may run
+// on several threads at once.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderInstancePickingBVH
+{
+public:
+    using InstanceList = QSSGRenderBoundsBVH::ItemList;
+
+    // Appends the indices of the instances whose bounds are hit by the ray,
+    // in increasing order. meshBounds are the local bounds of the model's mesh.
+    void findCandidates(const QSSGRenderModel &model,
+                        const QSSGBounds3 &meshBounds,
+                        const QSSGRenderRay &ray,
+                        InstanceList &instances);
+
+    int rebuildCount() const { return m_rebuildCount; }
+
+private:
+    bool isUpToDate(const QSSGRenderModel &model, const QSSGBounds3 &meshBounds) const;
+    void rebuild(const QSSGRenderModel &model, const QSSGBounds3 &meshBounds);
+
+    QMutex m_mutex;
+    const QSSGRenderInstanceTable *m_table = nullptr;
+    const void *m_tableData = nullptr;
+    int m_tableSerial = -1;
+    int m_instanceCount = 0;
+    QMatrix4x4 m_localInstanceTransform;
+    QSSGBounds3 m_meshBounds;
+    // Bounds of each instance, in the space of the global instance transform
+    QVector<QSSGBounds3> m_instanceBounds;
+    QSSGRenderBoundsBVH m_tree;
+    int m_rebuildCount = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSSGRENDERPICKINGBVH_P_H
@@ -0,0 +1,148 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qssgrenderpickingdata_p.h"
+
+#include <QtQuick3DRuntimeRender/private/qssgrendermesh_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendermodel_p.h>
+
+QT_BEGIN_NAMESPACE
+
+QSSGRenderMeshPickingDataPtr QSSGRenderMeshPickingData::create(const QSSGRenderMesh &mesh)
+{
+    QSharedPointer<QSSGRenderMeshPickingData> data(new QSSGRenderMeshPickingData);
+    data->subsets.reserve(mesh.subsets.size());
+    for (const QSSGRenderSubset &subset : mesh.subsets)
+        data->subsets.append({ subset.bounds, subset.bvhRoot });
+    data->bvh = mesh.bvh;
+    return data;
+}
+
+QSSGBounds3 QSSGRenderMeshPickingData::bounds() const
+{
+    QSSGBounds3 result;
+    for (const Subset &subset : subsets)
+        result.include(subset.bounds);
+    return result;
+}
+
+const QSSGRenderMeshPickingData *QSSGRenderPickingSnapshot::meshForModel(const QSSGRenderModel &model) const
+{
+    if (!model.meshPath.isNull()) {
+        const auto foundIt = meshes.constFind(model.meshPath);
+        if (foundIt != meshes.constEnd())
+            return foundIt->data();
+    }
+
+    if (model.geometry) {
+        const auto foundIt = customMeshes.constFind(model.geometry);
+        if (foundIt != customMeshes.constEnd())
+            return foundIt->data();
+    }
+
+    return nullptr;
+}
+
+QSSGRenderPickingSnapshots::ReadLocker::ReadLocker(const QSSGRenderPickingSnapshots &snapshots)
+    : m_snapshots(snapshots)
+{
+    // Register as a reader of the current epoch. If the epoch moved on in the
+    // meantime the writer may not have seen us, so try again with the new one.
+    quint64 epoch = m_snapshots.m_epoch.load();
+    for (;;) {
+        m_slot = int(epoch & 1);
+        m_snapshots.m_readers[m_slot].fetch_add(1);
+        const quint64 currentEpoch = m_snapshots.m_epoch.load();
+        if (currentEpoch == epoch)
+            break;
+        m_snapshots.m_readers[m_slot].fetch_sub(1);
+        epoch = currentEpoch;
+    }
+    m_snapshot = m_snapshots.m_current.load();
+}
+
+QSSGRenderPickingSnapshots::ReadLocker::~ReadLocker()
+{
+    m_snapshots.m_readers[m_slot].fetch_sub(1);
+}
+
+QSSGRenderPickingSnapshots::QSSGRenderPickingSnapshots()
+    : m_current(new QSSGRenderPickingSnapshot)
+{
+}
+
+QSSGRenderPickingSnapshots::~QSSGRenderPickingSnapshots()
+{
+    // There cannot be any readers left when the owner goes away
+    for (const Retired &retired : qAsConst(m_retired))
+        delete retired.snapshot;
+    delete m_current.load();
+}
+
+void QSSGRenderPickingSnapshots::publish(const QSSGRenderPickingSnapshot &snapshot)
+{
+    const QSSGRenderPickingSnapshot *previous = m_current.exchange(new QSSGRenderPickingSnapshot(snapshot));
+    // Readers that registered in this epoch or before may still use it
+    m_retired.append({ m_epoch.load(), previous });
+    reclaim();
+}
+
+void QSSGRenderPickingSnapshots::tryAdvanceEpoch()
+{
+    // Moving from epoch e to e + 1 reuses the reader count of e - 1, so that
+    // has to be drained first. Only this thread ever changes the epoch.
+    const quint64 epoch = m_epoch.load();
+    if (m_readers[(epoch + 1) & 1].load() == 0)
+        m_epoch.store(epoch + 1);
+}
+
+void QSSGRenderPickingSnapshots::reclaim()
+{
+    if (m_retired.isEmpty())
+        return;
+
+    // A snapshot retired in epoch e can only be seen by readers registered in
+    // e or earlier, and none of those are left once the epoch reached e + 2.
+    // Without readers both steps succeed right away.
+    tryAdvanceEpoch();
+    tryAdvanceEpoch();
+
+    const quint64 epoch = m_epoch.load();
+    qsizetype kept = 0;
+    for (qsizetype i = 0, end = m_retired.size(); i != end; ++i) {
+        const Retired &retired = m_retired.at(i);
+        if (retired.epoch + 2 <= epoch)
+            delete retired.snapshot;
+        else
+            m_retired[kept++] = retired;
+    }
+    m_retired.resize(kept);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,150 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGRENDERPICKINGDATA_P_H
+#define QSSGRENDERPICKINGDATA_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendererutil_p.h>
+
+#include <QtQuick3DUtils/private/qssgbounds3_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
+
+#include <QtCore/QHash>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+
+struct QSSGRenderMesh;
+struct QSSGRenderModel;
+class QSSGRenderGeometry;
+
+// What picking needs from a QSSGRenderMesh. Never modified once created, a
+// changed mesh gets a new instance. The BVH is shared with the mesh.
+struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderMeshPickingData
+{
+    struct Subset
+    {
+        QSSGBounds3 bounds;
+        int bvhRoot = -1; // Index into bvh->nodes
+    };
+
+    QVector<Subset> subsets;
+    QSharedPointer<const QSSGMeshBVH> bvh;
+
+    static QSharedPointer<const QSSGRenderMeshPickingData> create(const QSSGRenderMesh &mesh);
+    QSSGBounds3 bounds() const;
+};
+
+using QSSGRenderMeshPickingDataPtr = QSharedPointer<const QSSGRenderMeshPickingData>;
+
+// The picking data of all meshes of a buffer manager at one point in time
+struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderPickingSnapshot
+{
+    QHash<QSSGRenderPath, QSSGRenderMeshPickingDataPtr> meshes;
+    QHash<const QSSGRenderGeometry *, QSSGRenderMeshPickingDataPtr> customMeshes;
+
+    const QSSGRenderMeshPickingData *meshForModel(const QSSGRenderModel &model) const;
+};
+
+// Hands snapshots from the render thread to picking, which may run on other
+// threads, without either side ever waiting for the other. A new snapshot
+// replaces the current one with an atomic swap and readers keep using the one
+// they started with. Replaced snapshots are deleted once no reader can be
+// using them anymore, which is tracked with two alternating reader counts
+// (epoch based reclamation).
+//
+// publish() and reclaim() must always be called from the same thread,
+// ReadLocker can be used from any thread.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderPickingSnapshots
+{
+    Q_DISABLE_COPY(QSSGRenderPickingSnapshots)
+public:
+    class Q_QUICK3DRUNTIMERENDER_EXPORT ReadLocker
+    {
+        Q_DISABLE_COPY(ReadLocker)
+    public:
+        explicit ReadLocker(const QSSGRenderPickingSnapshots &snapshots);
+        ~ReadLocker();
+
+        // Never null, an empty snapshot is used until the first publish()
+        const QSSGRenderPickingSnapshot *snapshot() const { return m_snapshot; }
+        const QSSGRenderPickingSnapshot *operator->() const { return m_snapshot; }
+
+    private:
+        const QSSGRenderPickingSnapshots &m_snapshots;
+        const QSSGRenderPickingSnapshot *m_snapshot = nullptr;
+        int m_slot = 0;
+    };
+
+    QSSGRenderPickingSnapshots();
+    ~QSSGRenderPickingSnapshots();
+
+    // Makes a copy of the snapshot current. The hashes are implicitly shared,
+    // so this is cheap when the caller keeps its own copy around.
+    void publish(const QSSGRenderPickingSnapshot &snapshot);
+    // Deletes the replaced snapshots that no reader can see anymore
+    void reclaim();
+
+    qsizetype retiredCount() const { return m_retired.size(); }
+
+private:
+    void tryAdvanceEpoch();
+
+    struct Retired
+    {
+        quint64 epoch;
+        const QSSGRenderPickingSnapshot *snapshot;
+    };
+
+    // All accesses are sequentially consistent, the reader registration
+    // relies on it
+    std::atomic<const QSSGRenderPickingSnapshot *> m_current;
+    std::atomic<quint64> m_epoch { 0 };
+    mutable std::atomic<int> m_readers[2] { { 0 }, { 0 } };
+    QVector<Retired> m_retired;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSSGRENDERPICKINGDATA_P_H
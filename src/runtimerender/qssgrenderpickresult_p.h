@@ -60,6 +60,8 @@ struct QSSGRenderPickResult
     QVector3D m_faceNormal;
     // The subset index
     int m_subset = 0;
+    // The index of the hit instance, or -1 when the model is not instanced
+    int m_instanceIndex = -1;
 };
 
 Q_STATIC_ASSERT(std::is_trivially_destructible<QSSGRenderPickResult>::value);
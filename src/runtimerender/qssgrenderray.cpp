@@ -33,7 +33,10 @@
 #include <QtQuick3DUtils/private/qssgplane_p.h>
 #include <QtQuick3DUtils/private/qssgutils_p.h>
 #include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
-#include <QtQuick3DRuntimeRender/private/qssgrendermesh_p.h>
+
+#include <QtCore/QVarLengthArray>
+#include <QtCore/qalgorithms.h>
+#include <QtCore/private/qsimd_p.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -197,84 +200,291 @@ bool QSSGRenderRay::triangleIntersect(const QSSGRenderRay &ray,
 }
 
 void QSSGRenderRay::intersectWithBVH(const RayData &data,
-                                     const QSSGMeshBVHNode *bvh,
-                                     const QSSGRenderMesh *mesh,
-                                     QVector<IntersectionResult> &intersections,
-                                     int depth)
+                                     const QSSGMeshBVH &bvh,
+                                     int rootIndex,
+                                     QVector<IntersectionResult> &intersections)
 {
-    if (!bvh || !mesh || !mesh->bvh)
+    if (rootIndex < 0 || rootIndex >= bvh.nodes.size())
         return;
 
-    // If this is a leaf node, process it's triangles
-    if (bvh->count != 0) {
-        // If there is an intersection on a leaf node, then test against geometry
-        auto results = intersectWithBVHTriangles(data, mesh->bvh->triangles, bvh->offset, bvh->count);
-        if (!results.isEmpty())
-            intersections.append(results);
-        return;
-    }
+    const QSSGMeshBVHNode *nodes = bvh.nodes.constData();
 
-    auto hit = QSSGRenderRay::intersectWithAABBv2(data, bvh->left->boundingData);
-    if (hit.intersects())
-        intersectWithBVH(data, bvh->left, mesh, intersections, depth + 1);
+    // Iterative traversal. The tree depth is bounded by the builder, so the
+    // stack will rarely, if ever, need to leave the preallocated storage.
+    QVarLengthArray<int, 64> stack;
+    stack.append(rootIndex);
 
-    hit = QSSGRenderRay::intersectWithAABBv2(data, bvh->right->boundingData);
-    if (hit.intersects())
-        intersectWithBVH(data, bvh->right, mesh, intersections, depth + 1);
-}
+    while (!stack.isEmpty()) {
+        const QSSGMeshBVHNode &node = nodes[stack.takeLast()];
+
+        // If this is a leaf node, process it's triangles
+        if (node.isLeaf()) {
+            if (node.count != 0)
+                intersectWithBVHTriangles(data, bvh.triangles, node.offset, node.count, intersections);
+            continue;
+        }
 
+        if (QSSGRenderRay::intersectWithAABBv2(data, nodes[node.left].boundingData).intersects())
+            stack.append(node.left);
 
+        if (QSSGRenderRay::intersectWithAABBv2(data, nodes[node.right()].boundingData).intersects())
+            stack.append(node.right());
+    }
+}
+
+static QSSGRenderRay::IntersectionResult createTriangleIntersectionResult(const QMatrix4x4 &globalTransform,
+                                                                        const QSSGRenderRay &ray,
+                                                                        const QSSGMeshBVHTriangle &triangle,
+                                                                        float u,
+                                                                        float v,
+                                                                        const QVector3D &normal)
+{
+    const float w = 1.0f - u - v;
+    const QVector3D localIntersectionPoint = u * triangle.vertex1 +
+                                             v * triangle.vertex2 +
+                                             w * triangle.vertex3;
+
+    const QVector2D uvCoordinate = u * triangle.uvCoord1 +
+                                   v * triangle.uvCoord2 +
+                                   w * triangle.uvCoord3;
+    // Get the intersection point in scene coordinates
+    const QVector3D sceneIntersectionPos = mat44::transform(globalTransform,
+                                                            localIntersectionPoint);
+    const QVector3D hitVector = ray.origin - sceneIntersectionPos;
+    // Get the magnitude of the hit vector
+    const float rayLengthSquared = vec3::magnitudeSquared(hitVector);
+    return QSSGRenderRay::IntersectionResult(rayLengthSquared,
+                                             uvCoordinate,
+                                             sceneIntersectionPos,
+                                             localIntersectionPoint,
+                                             normal);
+}
 
-QVector<QSSGRenderRay::IntersectionResult> QSSGRenderRay::intersectWithBVHTriangles(const RayData &data,
-                                                                                    const QVector<QSSGMeshBVHTriangle *> &bvhTriangles,
-                                                                                    int triangleOffset,
-                                                                                    int triangleCount)
+void QSSGRenderRay::intersectWithBVHTriangles(const RayData &data,
+                                              const QVector<QSSGMeshBVHTriangle> &bvhTriangles,
+                                              int triangleOffset,
+                                              int triangleCount,
+                                              QVector<IntersectionResult> &intersections)
 {
     Q_ASSERT(bvhTriangles.count() >= triangleOffset + triangleCount);
 
-    QVector<QSSGRenderRay::IntersectionResult> results;
+    const QSSGRenderRay relativeRay(data.origin, data.direction);
 
     for (int i = triangleOffset; i < triangleCount + triangleOffset; ++i) {
         const auto &triangle = bvhTriangles[i];
 
-        QSSGRenderRay relativeRay(data.origin, data.direction);
-
         // Use Barycentric Coordinates to get the intersection values
         float u = 0.f;
         float v = 0.f;
         QVector3D normal;
         const bool intersects = triangleIntersect(relativeRay,
-                                                  triangle->vertex1,
-                                                  triangle->vertex2,
-                                                  triangle->vertex3,
+                                                  triangle.vertex1,
+                                                  triangle.vertex2,
+                                                  triangle.vertex3,
                                                   u,
                                                   v,
                                                   normal);
-        if (intersects) {
-            const float w = 1.0f - u - v;
-            const QVector3D localIntersectionPoint = u * triangle->vertex1 +
-                                                     v * triangle->vertex2 +
-                                                     w * triangle->vertex3;
-
-            const QVector2D uvCoordinate = u * triangle->uvCoord1 +
-                                           v * triangle->uvCoord2 +
-                                           w * triangle->uvCoord3;
-            // Get the intersection point in scene coordinates
-            const QVector3D sceneIntersectionPos = mat44::transform(data.globalTransform,
-                                                                    localIntersectionPoint);
-            const QVector3D hitVector = data.ray.origin - sceneIntersectionPos;
-            // Get the magnitude of the hit vector
-            const float rayLengthSquared = vec3::magnitudeSquared(hitVector);
-            results.append(IntersectionResult(rayLengthSquared,
-                                              uvCoordinate,
-                                              sceneIntersectionPos,
-                                              localIntersectionPoint,
-                                              normal));
+        if (intersects)
+            intersections.append(createTriangleIntersectionResult(data.globalTransform, data.ray, triangle, u, v, normal));
+    }
+}
+
+QSSGRenderRay::RayPacket QSSGRenderRay::createRayPacket(const QMatrix4x4 &globalTransform,
+                                                        const QSSGRenderRay *const *rays,
+                                                        int count)
+{
+    Q_ASSERT(count > 0 && count <= RayPacket::Size);
+
+    RayPacket packet;
+    packet.globalTransform = &globalTransform;
+    packet.count = count;
+
+    const QMatrix4x4 originTransform = globalTransform.inverted();
+    for (int lane = 0; lane != RayPacket::Size; ++lane) {
+        // Unused lanes repeat the last ray, they are masked out when traversing
+        const QSSGRenderRay &ray = *rays[qMin(lane, count - 1)];
+        packet.rays[lane] = &ray;
+        const QVector3D origin = mat44::transform(originTransform, ray.origin);
+        const QVector3D direction = mat44::rotate(originTransform, ray.direction).normalized();
+        for (int axis = 0; axis != 3; ++axis) {
+            packet.origin[axis][lane] = origin[axis];
+            packet.direction[axis][lane] = direction[axis];
+            // A large inverse keeps the slab test free of NaNs for rays
+            // parallel to the slab, which then only hit when inside of it.
+            packet.directionInvers[axis][lane] = qFuzzyIsNull(direction[axis])
+                    ? std::numeric_limits<float>::max()
+                    : 1.0f / direction[axis];
+        }
+    }
+
+    return packet;
+}
+
+// Returns a mask of the lanes whose ray enters the box before tMax
+static inline int intersectPacketWithAABB(const QSSGRenderRay::RayPacket &packet,
+                                          const float *tMax,
+                                          const QSSGBounds3 &bounds)
+{
+#if defined(__SSE2__)
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_loadu_ps(tMax);
+    for (int axis = 0; axis != 3; ++axis) {
+        const __m128 origin = _mm_loadu_ps(packet.origin[axis]);
+        const __m128 directionInvers = _mm_loadu_ps(packet.directionInvers[axis]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.minimum[axis]), origin), directionInvers);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.maximum[axis]), origin), directionInvers);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+    }
+    return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#elif defined(__ARM_NEON__)
+    float32x4_t tmin = vdupq_n_f32(0.0f);
+    float32x4_t tmax = vld1q_f32(tMax);
+    for (int axis = 0; axis != 3; ++axis) {
+        const float32x4_t origin = vld1q_f32(packet.origin[axis]);
+        const float32x4_t directionInvers = vld1q_f32(packet.directionInvers[axis]);
+        const float32x4_t t0 = vmulq_f32(vsubq_f32(vdupq_n_f32(bounds.minimum[axis]), origin), directionInvers);
+        const float32x4_t t1 = vmulq_f32(vsubq_f32(vdupq_n_f32(bounds.maximum[axis]), origin), directionInvers);
+        tmin = vmaxq_f32(tmin, vminq_f32(t0, t1));
+        tmax = vminq_f32(tmax, vmaxq_f32(t0, t1));
+    }
+    static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+    const uint32x4_t mask = vandq_u32(vcleq_f32(tmin, tmax), vld1q_u32(laneBits));
+    return int(vgetq_lane_u32(mask, 0) | vgetq_lane_u32(mask, 1) | vgetq_lane_u32(mask, 2) | vgetq_lane_u32(mask, 3));
+#else
+    int mask = 0;
+    for (int lane = 0; lane != QSSGRenderRay::RayPacket::Size; ++lane) {
+        float tmin = 0.0f;
+        float tmax = tMax[lane];
+        for (int axis = 0; axis != 3; ++axis) {
+            const float t0 = (bounds.minimum[axis] - packet.origin[axis][lane]) * packet.directionInvers[axis][lane];
+            const float t1 = (bounds.maximum[axis] - packet.origin[axis][lane]) * packet.directionInvers[axis][lane];
+            tmin = std::max(tmin, std::min(t0, t1));
+            tmax = std::min(tmax, std::max(t0, t1));
         }
+        if (tmin <= tmax)
+            mask |= 1 << lane;
+    }
+    return mask;
+#endif
+}
+
+// Same test as QSSGRenderRay::triangleIntersect, for all lanes of the packet
+// at once. Returns the mask of the lanes in laneMask that hit the triangle.
+static inline int intersectPacketWithTriangle(const QSSGRenderRay::RayPacket &packet,
+                                              int laneMask,
+                                              const QSSGMeshBVHTriangle &triangle,
+                                              float *t,
+                                              float *u,
+                                              float *v,
+                                              QVector3D &normal)
+{
+    constexpr int Size = QSSGRenderRay::RayPacket::Size;
+    const QVector3D &v0 = triangle.vertex1;
+    const QVector3D &v1 = triangle.vertex2;
+    const QVector3D &v2 = triangle.vertex3;
+    normal = QVector3D::crossProduct(v1 - v0, v2 - v0);
+    const float denominator = QVector3D::dotProduct(normal, normal);
+    const float d = QVector3D::dotProduct(normal, v0);
+    const QVector3D edge0 = v1 - v0;
+    const QVector3D edge1 = v2 - v1;
+    const QVector3D edge2 = v0 - v2;
+    // dot(normal, cross(edge, p - vertex)) == dot(cross(normal, edge), p) - dot(cross(normal, edge), vertex)
+    const QVector3D n0 = QVector3D::crossProduct(normal, edge0);
+    const QVector3D n1 = QVector3D::crossProduct(normal, edge1);
+    const QVector3D n2 = QVector3D::crossProduct(normal, edge2);
+    const float d0 = QVector3D::dotProduct(n0, v0);
+    const float d1 = QVector3D::dotProduct(n1, v1);
+    const float d2 = QVector3D::dotProduct(n2, v2);
+
+    // Plain lane loops without branches, so that they get vectorized
+    bool hits[Size];
+    for (int lane = 0; lane != Size; ++lane) {
+        const float ox = packet.origin[0][lane];
+        const float oy = packet.origin[1][lane];
+        const float oz = packet.origin[2][lane];
+        const float dx = packet.direction[0][lane];
+        const float dy = packet.direction[1][lane];
+        const float dz = packet.direction[2][lane];
+        const float vd = normal.x() * dx + normal.y() * dy + normal.z() * dz;
+        const bool parallel = std::abs(vd) < 0.0001f;
+        const float tl = -(normal.x() * ox + normal.y() * oy + normal.z() * oz - d) / (parallel ? 1.0f : vd);
+        const float px = ox + tl * dx;
+        const float py = oy + tl * dy;
+        const float pz = oz + tl * dz;
+        const float c0 = n0.x() * px + n0.y() * py + n0.z() * pz - d0;
+        const float c1 = n1.x() * px + n1.y() * py + n1.z() * pz - d1;
+        const float c2 = n2.x() * px + n2.y() * py + n2.z() * pz - d2;
+        hits[lane] = !parallel && tl >= 0.0f && c0 >= 0.0f && c1 >= 0.0f && c2 >= 0.0f;
+        t[lane] = tl;
+        u[lane] = c1 / denominator;
+        v[lane] = c2 / denominator;
     }
 
-    // Does not intersect with any of the triangles
-    return results;
+    int mask = 0;
+    for (int lane = 0; lane != Size; ++lane)
+        mask |= int(hits[lane]) << lane;
+    return mask & laneMask;
+}
+
+void QSSGRenderRay::intersectWithBVH(const RayPacket &packet,
+                                     const QSSGMeshBVH &bvh,
+                                     int rootIndex,
+                                     IntersectionResult *results)
+{
+    if (rootIndex < 0 || rootIndex >= bvh.nodes.size())
+        return;
+
+    constexpr int Size = RayPacket::Size;
+    const QSSGMeshBVHNode *nodes = bvh.nodes.constData();
+    const QSSGMeshBVHTriangle *triangles = bvh.triangles.constData();
+
+    // Distance of the closest hit of each lane along its local ray, used to
+    // skip the boxes behind it. Unused lanes never hit anything.
+    float tMax[Size];
+    for (int lane = 0; lane != Size; ++lane)
+        tMax[lane] = lane < packet.count ? std::numeric_limits<float>::max() : -1.0f;
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(rootIndex);
+
+    while (!stack.isEmpty()) {
+        const QSSGMeshBVHNode &node = nodes[stack.takeLast()];
+        if (node.boundingData.isEmpty())
+            continue;
+        const int laneMask = intersectPacketWithAABB(packet, tMax, node.boundingData);
+        if (!laneMask)
+            continue;
+
+        if (!node.isLeaf()) {
+            stack.append(node.left);
+            stack.append(node.right());
+            continue;
+        }
+
+        for (int i = node.offset, end = node.offset + node.count; i < end; ++i) {
+            const QSSGMeshBVHTriangle &triangle = triangles[i];
+            float t[Size];
+            float u[Size];
+            float v[Size];
+            QVector3D normal;
+            int hits = intersectPacketWithTriangle(packet, laneMask, triangle, t, u, v, normal);
+            while (hits) {
+                const int lane = qCountTrailingZeroBits(quint32(hits));
+                hits &= hits - 1;
+                const IntersectionResult result = createTriangleIntersectionResult(*packet.globalTransform,
+                                                                                   *packet.rays[lane],
+                                                                                   triangle,
+                                                                                   u[lane],
+                                                                                   v[lane],
+                                                                                   normal);
+                if (!results[lane].intersects || result.rayLengthSquared < results[lane].rayLengthSquared) {
+                    results[lane] = result;
+                    tMax[lane] = std::min(tMax[lane], t[lane]);
+                }
+            }
+        }
+    }
 }
 
 QSSGOption<QVector2D> QSSGRenderRay::relative(const QMatrix4x4 &inGlobalTransform,
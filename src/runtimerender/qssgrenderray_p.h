@@ -51,8 +51,7 @@
 #include <QtGui/QMatrix4x4>
 
 QT_BEGIN_NAMESPACE
-struct QSSGMeshBVHNode;
-struct QSSGRenderMesh;
+struct QSSGMeshBVH;
 struct QSSGMeshBVHTriangle;
 enum class QSSGRenderBasisPlanes
 {
@@ -140,15 +139,42 @@ struct Q_AUTOTEST_EXPORT QSSGRenderRay
                                          const QSSGBounds3 &bounds);
 
     static void intersectWithBVH(const RayData &data,
-                                        const QSSGMeshBVHNode *bvh,
-                                        const QSSGRenderMesh *mesh,
-                                        QVector<IntersectionResult> &intersections,
-                                        int depth = 0);
-
-    static QVector<IntersectionResult> intersectWithBVHTriangles(const RayData &data,
-                                                                 const QVector<QSSGMeshBVHTriangle *> &bvhTriangles,
-                                                                 int triangleOffset,
-                                                                 int triangleCount);
+                                 const QSSGMeshBVH &bvh,
+                                 int rootIndex,
+                                 QVector<IntersectionResult> &intersections);
+
+    static void intersectWithBVHTriangles(const RayData &data,
+                                          const QVector<QSSGMeshBVHTriangle> &bvhTriangles,
+                                          int triangleOffset,
+                                          int triangleCount,
+                                          QVector<IntersectionResult> &intersections);
+
+    // Rays that are traversed through a mesh BVH together. They share the
+    // global transform, and are stored one lane per ray so that the boxes
+    // and triangles can be tested against all of them at once.
+    struct RayPacket
+    {
+        static constexpr int Size = 4;
+
+        const QMatrix4x4 *globalTransform = nullptr;
+        const QSSGRenderRay *rays[Size] = {};
+        int count = 0;
+        // In the space of the global transform
+        float origin[3][Size];
+        float direction[3][Size];
+        float directionInvers[3][Size];
+    };
+
+    static RayPacket createRayPacket(const QMatrix4x4 &globalTransform,
+                                     const QSSGRenderRay *const *rays,
+                                     int count);
+
+    // Replaces the result of each ray of the packet with its closest hit in
+    // the tree, when that is closer than the result it already has.
+    static void intersectWithBVH(const RayPacket &packet,
+                                 const QSSGMeshBVH &bvh,
+                                 int rootIndex,
+                                 IntersectionResult *results);
 
     QSSGOption<QVector2D> relative(const QMatrix4x4 &inGlobalTransform,
                                         const QSSGBounds3 &inBounds,
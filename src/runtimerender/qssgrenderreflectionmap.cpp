@@ -545,6 +545,8 @@ void QSSGReflectionMapEntry::renderMips(QSSGRhiContext *context)
                     { 2, quint32(uBufSamplesElementSize * mipLevel) }
                 };
                 cb->setShaderResources(m_prefilterSrb, 2, dynamicOffsets.constData());
+                QSSGRHICTX_STAT(context, setGraphicsPipeline(m_prefilterPipeline));
+                QSSGRHICTX_STAT(context, setShaderResources(m_prefilterSrb));
             } else {
                 // Diffuse Irradiance
                 cb->setGraphicsPipeline(m_irradiancePipeline);
@@ -555,6 +557,8 @@ void QSSGReflectionMapEntry::renderMips(QSSGRhiContext *context)
                     { 2, quint32(uBufIrradianceElementSize) }
                 };
                 cb->setShaderResources(m_irradianceSrb, 1, dynamicOffsets.constData());
+                QSSGRHICTX_STAT(context, setGraphicsPipeline(m_irradiancePipeline));
+                QSSGRHICTX_STAT(context, setShaderResources(m_irradianceSrb));
             }
             cb->draw(36);
             QSSGRHICTX_STAT(context, draw(36, 1));
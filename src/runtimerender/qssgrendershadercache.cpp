@@ -38,6 +38,11 @@
 #include <QtCore/QRegularExpression>
 #include <QtCore/QString>
 #include <QtCore/qfile.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qbuffer.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qthreadpool.h>
 
 #include <QtGui/qsurfaceformat.h>
 #if QT_CONFIG(opengl)
@@ -93,7 +98,8 @@ static constexpr DefineEntry DefineTable[] {
     { "QSSG_ENABLE_RGBE_LIGHT_PROBE", QSSGShaderFeatures::Feature::RGBELightProbe },
     { "QSSG_ENABLE_OPAQUE_DEPTH_PRE_PASS", QSSGShaderFeatures::Feature::OpaqueDepthPrePass },
     { "QSSG_ENABLE_REFLECTION_PROBE", QSSGShaderFeatures::Feature::ReflectionProbe },
-    { "QSSG_REDUCE_MAX_NUM_LIGHTS", QSSGShaderFeatures::Feature::ReduceMaxNumLights }
+    { "QSSG_REDUCE_MAX_NUM_LIGHTS", QSSGShaderFeatures::Feature::ReduceMaxNumLights },
+    { "QSSG_ENABLE_CLUSTERED_LIGHTING", QSSGShaderFeatures::Feature::ClusteredLighting }
 };
 
 static_assert(std::size(DefineTable) == QSSGShaderFeatures::Count, "Missing feature define?");
@@ -174,19 +180,179 @@ static void initBaker(QShaderBaker *baker, QRhi *rhi)
     baker->setGeneratedShaders(outputs);
     baker->setGeneratedShaderVariants({ QShader::StandardShader });
 }
+
+static QShader bakeStage(QShaderBaker *baker, const QByteArray &code, QShader::Stage stage, QString *errorMessage)
+{
+    baker->setSourceString(code, stage);
+    QShader shader = baker->bake();
+    if (!shader.isValid())
+        *errorMessage = baker->errorMessage();
+    return shader;
+}
+
+// Set up on the render thread, baked on the worker thread, and only looked at
+// on the render thread again once done is set.
+struct QSSGShaderBakeJob
+{
+    QShaderBaker baker;
+    QByteArray vertexCode;
+    QByteArray fragmentCode;
+    QShader vertexShader;
+    QShader fragmentShader;
+    QString vertErr;
+    QString fragErr;
+    QAtomicInt done;
+
+    void run()
+    {
+        vertexShader = bakeStage(&baker, vertexCode, QShader::VertexStage, &vertErr);
+        fragmentShader = bakeStage(&baker, fragmentCode, QShader::FragmentStage, &fragErr);
+        done.storeRelease(1);
+    }
+};
 #else
 static void initBaker(QShaderBaker *, QRhi *)
 {
 }
+
+struct QSSGShaderBakeJob
+{
+};
 #endif // QT_QUICK3D_HAS_RUNTIME_SHADERS
 
-QSSGShaderCache::~QSSGShaderCache() {}
+QSSGShaderCache::~QSSGShaderCache()
+{
+    if (m_bakeThreadPool) {
+        m_bakeThreadPool->waitForDone();
+        delete m_bakeThreadPool;
+    }
+}
 
 QSSGShaderCache::QSSGShaderCache(const QSSGRef<QSSGRhiContext> &ctx,
                                  const InitBakerFunc initBakeFn)
     : m_rhiContext(ctx)
     , m_initBaker(initBakeFn ? initBakeFn : &initBaker)
 {
+    setPersistentCacheDirectory(qEnvironmentVariable("QT_QUICK3D_SHADER_CACHE_DIR"));
+}
+
+void QSSGShaderCache::setPersistentCacheDirectory(const QString &path)
+{
+    m_persistentCacheDir.clear();
+    if (path.isEmpty())
+        return;
+    if (!QDir().mkpath(path)) {
+        qWarning("Failed to create shader cache directory %s", qPrintable(path));
+        return;
+    }
+    m_persistentCacheDir = path;
+}
+
+// Bump when the contents of the persistent cache entries change
+static const char persistentCacheVersion[] = "1";
+
+// What the baked shaders depend on besides their source: the Qt version (the
+// QShader serialization format), the backend, and the device and the OpenGL
+// context that decide the target shading language version.
+static QByteArray rhiIdentity(QRhi *rhi)
+{
+    QByteArray id = QByteArrayLiteral("Qt ") + qVersion();
+    id += ';';
+    id += rhi->backendName();
+    const QRhiDriverInfo driverInfo = rhi->driverInfo();
+    id += ';' + driverInfo.deviceName + ';' + QByteArray::number(driverInfo.vendorId)
+            + ';' + QByteArray::number(driverInfo.deviceId);
+#if QT_CONFIG(opengl)
+    if (rhi->backend() == QRhi::OpenGLES2) {
+        auto h = static_cast<const QRhiGles2NativeHandles *>(rhi->nativeHandles());
+        if (h && h->context) {
+            const QSurfaceFormat format = h->context->format();
+            id += ';' + QByteArray::number(format.majorVersion()) + '.' + QByteArray::number(format.minorVersion())
+                    + ';' + QByteArray::number(int(format.profile()))
+                    + ';' + QByteArray::number(int(format.renderableType()));
+        }
+    }
+#endif
+    return id;
+}
+
+// Stored in the description of the entries, to detect files that were
+// written by someone else, or that got corrupted
+static QByteArray persistentCacheDescription(const QByteArray &inKey, const QShader &vertexShader, const QShader &fragmentShader)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QShader *shader : { &vertexShader, &fragmentShader }) {
+        const QList<QShaderKey> keys = shader->availableShaders();
+        for (const QShaderKey &key : keys)
+            hash.addData(shader->shader(key).shader());
+    }
+    return inKey + '\n' + hash.result().toHex();
+}
+
+QString QSSGShaderCache::persistentCacheFileName(const QByteArray &inVert, const QByteArray &inFrag)
+{
+    if (m_persistentCacheIdentity.isEmpty())
+        m_persistentCacheIdentity = rhiIdentity(m_rhiContext->rhi());
+
+    // The final source strings include the shader key and the features
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(persistentCacheVersion);
+    hash.addData(m_persistentCacheIdentity);
+    hash.addData(inVert);
+    hash.addData(inFrag);
+    return m_persistentCacheDir + QLatin1Char('/') + QString::fromLatin1(hash.result().toHex()) + QLatin1String(".qsbc");
+}
+
+bool QSSGShaderCache::loadFromPersistentCache(const QString &fileName, const QByteArray &inKey,
+                                              QShader *vertexShader, QShader *fragmentShader)
+{
+    if (!QFileInfo::exists(fileName))
+        return false;
+
+    bool ok = false;
+    QQsbCollection qsbc(fileName);
+    if (qsbc.map(QQsbCollection::Read)) {
+        const QQsbCollection::EntryMap entries = qsbc.getEntries();
+        QByteArray description;
+        if (entries.size() == 1 && qsbc.extractQsbEntry(*entries.cbegin(), &description, nullptr, vertexShader, fragmentShader)) {
+            ok = vertexShader->isValid() && fragmentShader->isValid()
+                    && description == persistentCacheDescription(inKey, *vertexShader, *fragmentShader);
+        }
+    }
+    qsbc.unmap();
+
+    if (!ok) {
+        qWarning("Discarding invalid shader cache entry %s", qPrintable(fileName));
+        QFile::remove(fileName);
+    }
+    return ok;
+}
+
+void QSSGShaderCache::storeToPersistentCache(const QString &fileName, const QByteArray &inKey,
+                                             const QSSGShaderFeatures &inFeatures,
+                                             const QShader &vertexShader, const QShader &fragmentShader)
+{
+    QQsbShaderFeatureSet featureSet;
+    for (const auto &def : DefineTable)
+        featureSet.insert(def.name, inFeatures.isSet(def.feature));
+
+    QBuffer buffer;
+    {
+        QQsbCollection qsbc(buffer);
+        if (!qsbc.map(QQsbCollection::Write))
+            return;
+        const size_t hkey = qMax(size_t(1), QSSGShaderCacheKey::generateHashCode(inKey, inFeatures));
+        const QQsbCollection::Entry entry = qsbc.addQsbEntry(persistentCacheDescription(inKey, vertexShader, fragmentShader),
+                                                             featureSet, vertexShader, fragmentShader, hkey);
+        if (!entry.isValid())
+            return;
+        qsbc.unmap();
+    }
+
+    // Readers never see a partially written file
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly) || f.write(buffer.data()) != buffer.size() || !f.commit())
+        qWarning("Failed to write shader cache entry %s", qPrintable(fileName));
 }
 
 QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::getRhiShaderPipeline(const QByteArray &inKey,
@@ -278,13 +444,55 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::compileForRhi(const QByteArray &
     QSSGRef<QSSGRhiShaderPipeline> shaders;
     QString vertErr, fragErr;
 
-    QShaderBaker baker;
-    m_initBaker(&baker, m_rhiContext->rhi());
-
     const bool editorMode = QSSGRhiContext::editorMode();
     // Shader debug is disabled in editor mode
     const bool shaderDebug = !editorMode && QSSGRhiContext::shaderDebuggingEnabled();
 
+    // The editor and shader debugging need the compilation to happen
+    const QString persistentCacheFile = (m_persistentCacheDir.isEmpty() || editorMode || shaderDebug)
+            ? QString() : persistentCacheFileName(m_vertexCode, m_fragmentCode);
+    if (!persistentCacheFile.isEmpty()) {
+        Q_QUICK3D_PROFILE_START(QQuick3DProfiler::Quick3DLoadShader);
+        QShader vertexShader;
+        QShader fragmentShader;
+        const bool loaded = loadFromPersistentCache(persistentCacheFile, inKey, &vertexShader, &fragmentShader);
+        Q_QUICK3D_PROFILE_END(QQuick3DProfiler::Quick3DLoadShader);
+        if (loaded) {
+            shaders = new QSSGRhiShaderPipeline(*m_rhiContext.data());
+            shaders->addStage(QRhiShaderStage(QRhiShaderStage::Vertex, vertexShader), stageFlags);
+            shaders->addStage(QRhiShaderStage(QRhiShaderStage::Fragment, fragmentShader), stageFlags);
+            const auto inserted = m_rhiShaders.insert(tempKey, shaders);
+            return inserted.value();
+        }
+    }
+
+    // The editor and shader debugging report the results right away
+    if (m_asyncCompilation != AsyncCompilation::Off && stageFlags.testFlag(QSSGRhiShaderPipeline::AsyncCompilation)
+            && !editorMode && !shaderDebug) {
+        QSharedPointer<QSSGShaderBakeJob> job(new QSSGShaderBakeJob);
+        m_initBaker(&job->baker, m_rhiContext->rhi());
+        job->vertexCode = m_vertexCode;
+        job->fragmentCode = m_fragmentCode;
+        if (!m_bakeThreadPool) {
+            // One thread, so that the background compilations never run
+            // in parallel with each other. Every bake has a QShaderBaker of
+            // its own, the synchronous ones on the render thread are not
+            // held up by the ones in here.
+            m_bakeThreadPool = new QThreadPool;
+            m_bakeThreadPool->setMaxThreadCount(1);
+        }
+        m_bakeThreadPool->start([job] { job->run(); });
+
+        shaders = new QSSGRhiShaderPipeline(*m_rhiContext.data());
+        shaders->setCompilationPending(true);
+        m_pendingCompilations.append({ shaders, job, tempKey, stageFlags, persistentCacheFile });
+        const auto inserted = m_rhiShaders.insert(tempKey, shaders);
+        return inserted.value();
+    }
+
+    QShaderBaker baker;
+    m_initBaker(&baker, m_rhiContext->rhi());
+
    static auto dumpShader = [](QShader::Stage stage, const QByteArray &code) {
        switch (stage) {
        case QShader::Stage::VertexStage:
@@ -310,11 +518,9 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::compileForRhi(const QByteArray &
        f.close();
    };
 
-    baker.setSourceString(m_vertexCode, QShader::VertexStage);
-    QShader vertexShader = baker.bake();
+    QShader vertexShader = bakeStage(&baker, m_vertexCode, QShader::VertexStage, &vertErr);
     const auto vertShaderValid = vertexShader.isValid();
     if (!vertShaderValid) {
-        vertErr = baker.errorMessage();
         if (!editorMode) {
             qWarning("Failed to compile vertex shader:\n");
             if (!shaderDebug)
@@ -328,11 +534,9 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::compileForRhi(const QByteArray &
             dumpShaderToFile(QShader::Stage::VertexStage, m_vertexCode);
     }
 
-    baker.setSourceString(m_fragmentCode, QShader::FragmentStage);
-    QShader fragmentShader = baker.bake();
+    QShader fragmentShader = bakeStage(&baker, m_fragmentCode, QShader::FragmentStage, &fragErr);
     const bool fragShaderValid = fragmentShader.isValid();
     if (!fragShaderValid) {
-        fragErr = baker.errorMessage();
         if (!editorMode) {
             qWarning("Failed to compile fragment shader \n");
             if (!shaderDebug)
@@ -352,6 +556,8 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::compileForRhi(const QByteArray &
         shaders->addStage(QRhiShaderStage(QRhiShaderStage::Fragment, fragmentShader), stageFlags);
         if (shaderDebug)
             qDebug("Compilation for vertex and fragment stages succeeded");
+        if (!persistentCacheFile.isEmpty())
+            storeToPersistentCache(persistentCacheFile, inKey, inFeatures, vertexShader, fragmentShader);
     }
 
     if (editorMode && s_statusCallback) {
@@ -378,6 +584,46 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::compileForRhi(const QByteArray &
 #endif
 }
 
+int QSSGShaderCache::processCompletedCompilations()
+{
+    int completed = 0;
+#ifdef QT_QUICK3D_HAS_RUNTIME_SHADERS
+    for (auto it = m_pendingCompilations.begin(); it != m_pendingCompilations.end(); ) {
+        const QSSGShaderBakeJob &job(*it->job);
+        if (!job.done.loadAcquire()) {
+            ++it;
+            continue;
+        }
+
+        const QByteArray &inKey(it->key.m_key);
+        const bool vertShaderValid = job.vertexShader.isValid();
+        if (!vertShaderValid) {
+            qWarning("Failed to compile vertex shader:\n");
+            qWarning() << inKey << '\n' << job.vertErr;
+        }
+        const bool fragShaderValid = job.fragmentShader.isValid();
+        if (!fragShaderValid) {
+            qWarning("Failed to compile fragment shader \n");
+            qWarning() << inKey << '\n' << job.fragErr;
+        }
+
+        // A pipeline that stays without stages once no longer pending is
+        // one that failed to compile
+        if (vertShaderValid && fragShaderValid) {
+            it->shaders->addStage(QRhiShaderStage(QRhiShaderStage::Vertex, job.vertexShader), it->stageFlags);
+            it->shaders->addStage(QRhiShaderStage(QRhiShaderStage::Fragment, job.fragmentShader), it->stageFlags);
+            if (!it->persistentCacheFile.isEmpty())
+                storeToPersistentCache(it->persistentCacheFile, inKey, it->key.m_features, job.vertexShader, job.fragmentShader);
+        }
+        it->shaders->setCompilationPending(false);
+
+        it = m_pendingCompilations.erase(it);
+        ++completed;
+    }
+#endif
+    return completed;
+}
+
 QSSGRef<QSSGRhiShaderPipeline> QSSGShaderCache::loadGeneratedShader(const QByteArray &inKey, QQsbCollection::Entry entry)
 {
     const QSSGRef<QSSGRhiShaderPipeline> &rhiShaders = getRhiShaderPipeline(inKey, QSSGShaderFeatures());
@@ -58,6 +58,8 @@ QT_BEGIN_NAMESPACE
 class QSSGRhiShaderPipeline;
 class QShaderBaker;
 class QRhi;
+class QThreadPool;
+struct QSSGShaderBakeJob;
 
 struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGShaderFeatures
 {
@@ -104,6 +106,7 @@ enum class Feature : FlagType
     OpaqueDepthPrePass = (1 << 20) + 12,
     ReflectionProbe = (1 << 21) + 13,
     ReduceMaxNumLights = (1 << 22) + 14,
+    ClusteredLighting = (1 << 23) + 15,
 
     LastFeature
 };
@@ -178,6 +181,13 @@ public:
     QAtomicInt ref;
 
     using InitBakerFunc = void (*)(QShaderBaker *baker, QRhi *rhi);
+
+    enum class AsyncCompilation
+    {
+        Off,
+        Fallback, // draw with the previous shaders of the object, or skip it
+        Skip
+    };
 private:
     typedef QHash<QSSGShaderCacheKey, QSSGRef<QSSGRhiShaderPipeline>> TRhiShaderMap;
     QSSGRef<QSSGRhiContext> m_rhiContext;
@@ -190,12 +200,33 @@ private:
     QString m_contextTypeString;
     QSSGShaderCacheKey m_tempKey;
     const InitBakerFunc m_initBaker;
+    QString m_persistentCacheDir;
+    QByteArray m_persistentCacheIdentity;
+
+    struct PendingCompilation
+    {
+        QSSGRef<QSSGRhiShaderPipeline> shaders;
+        QSharedPointer<QSSGShaderBakeJob> job;
+        QSSGShaderCacheKey key;
+        QSSGRhiShaderPipeline::StageFlags stageFlags;
+        QString persistentCacheFile;
+    };
+    AsyncCompilation m_asyncCompilation = AsyncCompilation::Off;
+    QThreadPool *m_bakeThreadPool = nullptr;
+    QVector<PendingCompilation> m_pendingCompilations;
 
     void addShaderPreprocessor(QByteArray &str,
                                const QByteArray &inKey,
                                ShaderType shaderType,
                                const QSSGShaderFeatures &inFeatures);
 
+    QString persistentCacheFileName(const QByteArray &inVert, const QByteArray &inFrag);
+    bool loadFromPersistentCache(const QString &fileName, const QByteArray &inKey,
+                                 QShader *vertexShader, QShader *fragmentShader);
+    void storeToPersistentCache(const QString &fileName, const QByteArray &inKey,
+                                const QSSGShaderFeatures &inFeatures,
+                                const QShader &vertexShader, const QShader &fragmentShader);
+
 public:
     QSSGShaderCache(const QSSGRef<QSSGRhiContext> &ctx,
                     const InitBakerFunc initBakeFn = nullptr);
@@ -215,6 +246,22 @@ public:
 
     static QByteArray resourceFolder();
     static QByteArray shaderCollectionFile();
+
+    // Runtime generated shaders are stored in, and on later runs loaded from,
+    // this directory. Off when empty, which is the default unless
+    // QT_QUICK3D_SHADER_CACHE_DIR is set.
+    void setPersistentCacheDirectory(const QString &path);
+    QString persistentCacheDirectory() const { return m_persistentCacheDir; }
+
+    // When on, the shaders of materials are baked on a worker thread, and
+    // compileForRhi() returns a pipeline for which isCompilationPending() is
+    // true. Such pipelines get their stages in processCompletedCompilations(),
+    // which returns the number of compilations that finished. Off by default;
+    // the render context turns it on with QT_QUICK3D_ASYNC_SHADER_COMPILATION.
+    void setAsyncCompilation(AsyncCompilation mode) { m_asyncCompilation = mode; }
+    AsyncCompilation asyncCompilation() const { return m_asyncCompilation; }
+    int processCompletedCompilations();
+    int pendingCompilationCount() const { return int(m_pendingCompilations.count()); }
 };
 
 namespace QtQuick3DEditorHelpers {
@@ -31,8 +31,12 @@
 #include <QtQuick3DUtils/private/qssgmesh_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderableimage_p.h>
 #include <QtQuick3DUtils/private/qssgutils_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgruntimerenderlogging_p.h>
 #include <QtCore/QVariant>
 
+#include <algorithm>
+#include <limits>
+
 QT_BEGIN_NAMESPACE
 
 QSSGRhiBuffer::QSSGRhiBuffer(QSSGRhiContext &context,
@@ -55,6 +59,70 @@ QSSGRhiBuffer::~QSSGRhiBuffer()
     delete m_buffer;
 }
 
+QSSGRhiUniformRing::~QSSGRhiUniformRing()
+{
+    releaseResources();
+}
+
+void QSSGRhiUniformRing::reset(QSSGRhiContext *context)
+{
+    Q_ASSERT(!m_context || m_context == context);
+    m_context = context;
+    commit();
+    for (Block &block : m_blocks)
+        block.used = 0;
+    m_current = 0;
+}
+
+QSSGRhiUniformRing::Allocation QSSGRhiUniformRing::allocate(int size)
+{
+    Q_ASSERT(m_context);
+    QRhi *rhi = m_context->rhi();
+    const int alignedSize = rhi->ubufAligned(size);
+
+    // Blocks are filled in order, the remainder of a block that cannot fit
+    // the allocation is left unused for the rest of the frame.
+    while (m_current < m_blocks.count() && m_blocks[m_current].used + alignedSize > m_blocks[m_current].buffer->size())
+        ++m_current;
+
+    if (m_current == m_blocks.count()) {
+        QRhiBuffer *buffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, qMax(int(BlockSize), alignedSize));
+        if (!buffer->create()) {
+            qWarning("Failed to build uniform buffer with size %d", buffer->size());
+            delete buffer;
+            m_current = qMax(0, int(m_blocks.count()) - 1);
+            return {};
+        }
+        m_blocks.append({ buffer, nullptr, 0 });
+    }
+
+    Block &block(m_blocks[m_current]);
+    if (!block.data)
+        block.data = block.buffer->beginFullDynamicBufferUpdateForCurrentFrame();
+    const Allocation allocation = { block.buffer, quint32(block.used), block.data + block.used };
+    block.used += alignedSize;
+    return allocation;
+}
+
+void QSSGRhiUniformRing::commit()
+{
+    for (Block &block : m_blocks) {
+        if (block.data) {
+            block.buffer->endFullDynamicBufferUpdateForCurrentFrame();
+            block.data = nullptr;
+        }
+    }
+}
+
+void QSSGRhiUniformRing::releaseResources()
+{
+    commit();
+    for (const Block &block : qAsConst(m_blocks))
+        delete block.buffer;
+    m_blocks.clear();
+    m_current = 0;
+}
+
 QRhiVertexInputAttribute::Format QSSGRhiInputAssemblerState::toVertexInputFormat(QSSGRenderComponentType compType, quint32 numComps)
 {
     if (compType == QSSGRenderComponentType::Float32) {
@@ -195,6 +263,94 @@ QRhiGraphicsPipeline::CullMode QSSGRhiGraphicsPipelineState::toCullMode(QSSGCull
     return QRhiGraphicsPipeline::None;
 }
 
+namespace {
+struct CommonUniformInfo
+{
+    const char *name;
+    int size; // the size in the std140 uniform block
+};
+}
+
+static const CommonUniformInfo commonUniformTable[] = {
+    { "qt_cameraPosition", 3 * sizeof(float) },
+    { "qt_cameraDirection", 3 * sizeof(float) },
+    { "qt_cameraProperties", 2 * sizeof(float) },
+    { "qt_projectionMatrix", 16 * sizeof(float) },
+    { "qt_inverseProjectionMatrix", 16 * sizeof(float) },
+    { "qt_viewMatrix", 16 * sizeof(float) },
+    { "qt_viewProjectionMatrix", 16 * sizeof(float) },
+    { "qt_modelMatrix", 16 * sizeof(float) },
+    { "qt_modelViewProjection", 16 * sizeof(float) },
+    { "qt_normalMatrix", 12 * sizeof(float) },
+    { "qt_parentMatrix", 16 * sizeof(float) },
+    { "qt_lightProbeOrientation", 12 * sizeof(float) },
+    { "qt_lightProbeProperties", 4 * sizeof(float) },
+    { "qt_reflectionProbeBoxCenter", 3 * sizeof(float) },
+    { "qt_reflectionProbeBoxMin", 3 * sizeof(float) },
+    { "qt_reflectionProbeBoxMax", 3 * sizeof(float) },
+    { "qt_reflectionProbeCorrection", sizeof(qint32) },
+    { "qt_material_emissive_color", 3 * sizeof(float) },
+    { "qt_material_base_color", 4 * sizeof(float) },
+    { "qt_material_specular", 4 * sizeof(float) },
+    { "qt_light_ambient_total", 3 * sizeof(float) },
+    { "qt_material_properties", 4 * sizeof(float) },
+    { "qt_material_properties2", 4 * sizeof(float) },
+    { "qt_material_properties3", 4 * sizeof(float) },
+    { "qt_material_properties4", 4 * sizeof(float) },
+    { "qt_material_attenuation", 4 * sizeof(float) },
+    { "qt_material_thickness", sizeof(float) },
+    { "qt_rhi_properties", 4 * sizeof(float) },
+    { "qt_shadowDepthAdjust", 2 * sizeof(float) },
+    { "qt_materialPointSize", sizeof(float) },
+    { "qt_clusterViewProjection", 16 * sizeof(float) },
+    { "qt_clusterViewDepth", 4 * sizeof(float) },
+    { "qt_clusterDepthParams", 4 * sizeof(float) },
+    { "qt_clusterOffsets", 4 * sizeof(float) }
+};
+
+static_assert(std::size(commonUniformTable) == size_t(QSSGRhiShaderPipeline::CommonUniform::Count),
+              "commonUniformTable does not match the CommonUniform enum");
+
+QSSGRhiShaderPipeline::QSSGRhiShaderPipeline(QSSGRhiContext &context)
+    : m_context(context)
+{
+    std::fill(std::begin(m_commonUniformOffsets), std::end(m_commonUniformOffsets), -1);
+    std::fill(std::begin(m_shadowMatrixOffsets), std::end(m_shadowMatrixOffsets), -1);
+    std::fill(std::begin(m_shadowControlOffsets), std::end(m_shadowControlOffsets), -1);
+}
+
+void QSSGRhiShaderPipeline::resolveCommonUniformOffsets()
+{
+    const auto offsetOf = [this](const QByteArray &name, int size) {
+        auto it = m_ub0.constFind(name);
+        if (it == m_ub0.cend())
+            return -1;
+#ifdef QT_DEBUG
+        if (it->size != size) {
+            qWarning("Uniform block member '%s' is %d bytes whereas %d bytes were expected",
+                     it->name.constData(), it->size, size);
+            return -1;
+        }
+#else
+        Q_UNUSED(size);
+#endif
+        return it->offset;
+    };
+
+    for (size_t i = 0; i < size_t(CommonUniform::Count); ++i) {
+        const CommonUniformInfo &info(commonUniformTable[i]);
+        m_commonUniformOffsets[i] = offsetOf(QByteArray::fromRawData(info.name, qstrlen(info.name)), info.size);
+    }
+
+    // The names must match the ones the material shader generator uses
+    // (qt_shadowmap0_matrix, qt_shadowmap0_control, ...)
+    for (int lightIdx = 0; lightIdx < QSSG_MAX_NUM_LIGHTS; ++lightIdx) {
+        const QByteArray stem = QByteArrayLiteral("qt_shadowmap") + QByteArray::number(lightIdx);
+        m_shadowMatrixOffsets[lightIdx] = offsetOf(stem + QByteArrayLiteral("_matrix"), 16 * sizeof(float));
+        m_shadowControlOffsets[lightIdx] = offsetOf(stem + QByteArrayLiteral("_control"), 4 * sizeof(float));
+    }
+}
+
 void QSSGRhiShaderPipeline::addStage(const QRhiShaderStage &stage, StageFlags flags)
 {
     m_stages.append(stage);
@@ -213,6 +369,7 @@ void QSSGRhiShaderPipeline::addStage(const QRhiShaderStage &stage, StageFlags fl
                 m_ub0NextUBufOffset = m_context.rhi()->ubufAligned(m_ub0Size);
                 for (const QShaderDescription::BlockVariable &var : blk.members)
                     m_ub0[var.name] = var;
+                resolveCommonUniformOffsets();
                 break;
             }
         }
@@ -916,6 +1073,12 @@ int QSSGRhiShaderPipeline::bindingForTexture(const char *name, int hint)
 QSSGRhiContext::QSSGRhiContext()
 {
     Q_STATIC_ASSERT(int(QSSGRhiSamplerBindingHints::LightProbe) > int(QSSGRenderableImage::Type::Occlusion));
+
+    // QT_QUICK3D_RHI_CACHE_MAX_UNUSED_FRAMES=0 disables the age based eviction
+    bool ok = false;
+    const int maxUnusedFrames = qEnvironmentVariableIntValue("QT_QUICK3D_RHI_CACHE_MAX_UNUSED_FRAMES", &ok);
+    if (ok)
+        m_cacheLimits.maxUnusedFrames = quint32(qMax(0, maxUnusedFrames));
 }
 
 QSSGRhiContext::~QSSGRhiContext()
@@ -923,9 +1086,11 @@ QSSGRhiContext::~QSSGRhiContext()
     for (QSSGRhiDrawCallData &dcd : m_drawCallData)
         dcd.reset();
 
-    qDeleteAll(m_pipelines);
+    for (const auto &entry : qAsConst(m_pipelines))
+        delete entry.resource;
     qDeleteAll(m_computePipelines);
-    qDeleteAll(m_srbCache);
+    for (const auto &entry : qAsConst(m_srbCache))
+        delete entry.resource;
     qDeleteAll(m_textures);
     for (const auto &samplerInfo : qAsConst(m_samplers))
         delete samplerInfo.second;
@@ -946,14 +1111,19 @@ void QSSGRhiContext::initialize(QRhi *rhi)
 
 QRhiShaderResourceBindings *QSSGRhiContext::srb(const QSSGRhiShaderResourceBindingList &bindings)
 {
-    auto it = m_srbCache.constFind(bindings);
-    if (it != m_srbCache.constEnd())
-        return *it;
+    CacheStats &stats(m_cacheStats[int(CacheType::ShaderResourceBindings)]);
+    auto it = m_srbCache.find(bindings);
+    if (it != m_srbCache.end()) {
+        stats.hits += 1;
+        it->lastUsedFrame = m_frameIndex;
+        return it->resource;
+    }
+    stats.misses += 1;
 
     QRhiShaderResourceBindings *srb = m_rhi->newShaderResourceBindings();
     srb->setBindings(bindings.v, bindings.v + bindings.p);
     if (srb->create()) {
-        m_srbCache.insert(bindings, srb);
+        m_srbCache.insert(bindings, { srb, m_frameIndex });
     } else {
         qWarning("Failed to build srb");
         delete srb;
@@ -966,9 +1136,14 @@ QRhiGraphicsPipeline *QSSGRhiContext::pipeline(const QSSGGraphicsPipelineStateKe
                                                QRhiRenderPassDescriptor *rpDesc,
                                                QRhiShaderResourceBindings *srb)
 {
-    auto it = m_pipelines.constFind(key);
-    if (it != m_pipelines.constEnd())
-        return it.value();
+    CacheStats &stats(m_cacheStats[int(CacheType::GraphicsPipelines)]);
+    auto it = m_pipelines.find(key);
+    if (it != m_pipelines.end()) {
+        stats.hits += 1;
+        it->lastUsedFrame = m_frameIndex;
+        return it->resource;
+    }
+    stats.misses += 1;
 
     // Build a new one. This is potentially expensive.
     QRhiGraphicsPipeline *ps = m_rhi->newGraphicsPipeline();
@@ -1011,7 +1186,7 @@ QRhiGraphicsPipeline *QSSGRhiContext::pipeline(const QSSGGraphicsPipelineStateKe
         return nullptr;
     }
 
-    m_pipelines.insert(key, ps);
+    m_pipelines.insert(key, { ps, m_frameIndex });
     return ps;
 }
 
@@ -1077,6 +1252,240 @@ void QSSGRhiContext::cleanupDrawCallData(const QSSGRenderModel *model)
     }
 }
 
+void QSSGRhiContext::releaseInstanceBuffer(QSSGRenderInstanceTable *instanceTable)
+{
+    const auto it = m_instanceBuffers.constFind(instanceTable);
+    if (it == m_instanceBuffers.constEnd())
+        return;
+    // The buffer may still be used by the frame being recorded
+    if (it->owned && it->buffer)
+        it->buffer->deleteLater();
+    m_instanceBuffers.erase(it);
+}
+
+// Releases the entries of hash that were not used in the last maxUnusedFrames
+// frames, and then the least recently used ones until at most maxEntries are
+// left. Entries used in the current frame are never released. maxAge is
+// raised to the age of the oldest entry kept by the first step.
+template<typename Hash, typename LastUsedFunc, typename ReleaseFunc>
+static quint64 evictCacheEntries(Hash &hash, quint32 frameIndex, quint32 maxUnusedFrames, int maxEntries,
+                                 LastUsedFunc lastUsedFrame, ReleaseFunc release, quint32 *maxAge)
+{
+    quint64 evicted = 0;
+    if (maxUnusedFrames > 0) {
+        for (auto it = hash.begin(); it != hash.end(); ) {
+            const quint32 age = frameIndex - lastUsedFrame(it);
+            if (age > maxUnusedFrames) {
+                release(it);
+                it = hash.erase(it);
+                ++evicted;
+            } else {
+                *maxAge = qMax(*maxAge, age);
+                ++it;
+            }
+        }
+    }
+
+    if (maxEntries <= 0 || hash.size() <= maxEntries)
+        return evicted;
+
+    QVector<quint32> ages;
+    ages.reserve(hash.size());
+    for (auto it = hash.begin(); it != hash.end(); ++it) {
+        const quint32 age = frameIndex - lastUsedFrame(it);
+        if (age > 0)
+            ages.append(age);
+    }
+    const qsizetype count = qMin(hash.size() - qsizetype(maxEntries), ages.size());
+    if (count <= 0)
+        return evicted;
+
+    // Release everything older than the count'th oldest entry, and then as
+    // many as needed of the entries exactly that old.
+    std::nth_element(ages.begin(), ages.begin() + count - 1, ages.end(), std::greater<quint32>());
+    const quint32 minAge = ages[count - 1];
+    qsizetype sameAgeCount = count - std::count_if(ages.cbegin(), ages.cend(), [minAge](quint32 age) { return age > minAge; });
+    for (auto it = hash.begin(); it != hash.end(); ) {
+        const quint32 age = frameIndex - lastUsedFrame(it);
+        if (age > minAge || (age == minAge && sameAgeCount-- > 0)) {
+            release(it);
+            it = hash.erase(it);
+            ++evicted;
+        } else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
+void QSSGRhiContext::trimCaches()
+{
+    // Everything looked up in this frame has an age of 0 here
+    const quint32 frameIndex = m_frameIndex++;
+
+    const quint32 maxUnusedFrames = m_cacheLimits.maxUnusedFrames;
+    const qsizetype cacheSizes[int(CacheType::Count)] = {
+        m_srbCache.size(), m_pipelines.size(), m_drawCallData.size(), m_instanceBuffers.size()
+    };
+    // Sweeping walks the whole caches. It is only done once the oldest entry
+    // may have gone unused for too long, or when a cache is over its limit.
+    // A cache that was over its limit with all its entries in use is only
+    // swept again when it grows, or at the next scheduled sweep.
+    bool sweep = qint32(frameIndex - m_nextCacheSweepFrame) >= 0;
+    for (int i = 0; i < int(CacheType::Count) && !sweep; ++i) {
+        const int maxEntries = m_cacheLimits.maxEntries[i];
+        sweep = maxEntries > 0 && cacheSizes[i] > qMax(qsizetype(maxEntries), m_untrimmedCacheSizes[i]);
+    }
+    if (!sweep)
+        return;
+
+    // The resources may still be referenced by the commands recorded in the
+    // current frame, hence deleteLater().
+    quint32 maxAge = 0;
+    quint64 evicted[int(CacheType::Count)];
+    evicted[int(CacheType::DrawCallData)] =
+            evictCacheEntries(m_drawCallData, frameIndex, maxUnusedFrames,
+                              m_cacheLimits.maxEntries[int(CacheType::DrawCallData)],
+                              [](auto it) { return it->lastUsedFrame; },
+                              [](auto it) {
+                                  if (it->ubuf)
+                                      it->ubuf->deleteLater();
+                              },
+                              &maxAge);
+
+    // The draw call data that is still around may refer to srbs and
+    // pipelines without looking them up from the cache each frame.
+    QHash<const QRhiResource *, quint32> referencedFrames;
+    auto reference = [&referencedFrames](const QRhiResource *resource, quint32 frame) {
+        if (resource) {
+            quint32 &lastFrame(referencedFrames[resource]);
+            lastFrame = qMax(lastFrame, frame);
+        }
+    };
+    for (const QSSGRhiDrawCallData &dcd : qAsConst(m_drawCallData)) {
+        reference(dcd.srb, dcd.lastUsedFrame);
+        reference(dcd.pipeline, dcd.lastUsedFrame);
+    }
+    auto referencedLastUsedFrame = [frameIndex, &referencedFrames](auto it) {
+        const auto found = referencedFrames.constFind(it->resource);
+        if (found == referencedFrames.cend())
+            return it->lastUsedFrame;
+        // compare ages since the frame index wraps around
+        return frameIndex - *found < frameIndex - it->lastUsedFrame ? *found : it->lastUsedFrame;
+    };
+
+    QSet<const QRhiResource *> released;
+    auto release = [&released](auto it) {
+        released.insert(it->resource);
+        it->resource->deleteLater();
+    };
+
+    evicted[int(CacheType::GraphicsPipelines)] =
+            evictCacheEntries(m_pipelines, frameIndex, maxUnusedFrames,
+                              m_cacheLimits.maxEntries[int(CacheType::GraphicsPipelines)],
+                              referencedLastUsedFrame, release, &maxAge);
+
+    // A pipeline keeps a reference to the srb it was created with
+    for (const auto &entry : qAsConst(m_pipelines))
+        reference(entry.resource->shaderResourceBindings(), entry.lastUsedFrame);
+
+    evicted[int(CacheType::ShaderResourceBindings)] =
+            evictCacheEntries(m_srbCache, frameIndex, maxUnusedFrames,
+                              m_cacheLimits.maxEntries[int(CacheType::ShaderResourceBindings)],
+                              referencedLastUsedFrame, release, &maxAge);
+
+    // Only possible when the size limits were hit: make the draw call data
+    // look up the srbs and pipelines again.
+    if (!released.isEmpty()) {
+        for (QSSGRhiDrawCallData &dcd : m_drawCallData) {
+            if (released.contains(dcd.srb))
+                dcd.srb = nullptr;
+            if (released.contains(dcd.pipeline))
+                dcd.pipeline = nullptr;
+        }
+    }
+
+    evicted[int(CacheType::InstanceBuffers)] =
+            evictCacheEntries(m_instanceBuffers, frameIndex, maxUnusedFrames,
+                              m_cacheLimits.maxEntries[int(CacheType::InstanceBuffers)],
+                              [](auto it) { return it->lastUsedFrame; },
+                              [](auto it) {
+                                  if (it->owned && it->buffer)
+                                      it->buffer->deleteLater();
+                              },
+                              &maxAge);
+
+    // Nothing kept can get older than maxUnusedFrames before the next sweep.
+    // Caches left over their limit are retried every now and then.
+    quint32 sweepInterval = maxUnusedFrames > 0 ? maxUnusedFrames - maxAge + 1 : quint32(std::numeric_limits<qint32>::max());
+    const qsizetype sizesLeft[int(CacheType::Count)] = {
+        m_srbCache.size(), m_pipelines.size(), m_drawCallData.size(), m_instanceBuffers.size()
+    };
+    for (int i = 0; i < int(CacheType::Count); ++i) {
+        const int maxEntries = m_cacheLimits.maxEntries[i];
+        m_untrimmedCacheSizes[i] = maxEntries > 0 && sizesLeft[i] > maxEntries ? sizesLeft[i] : 0;
+        if (m_untrimmedCacheSizes[i] > 0)
+            sweepInterval = qMin(sweepInterval, 64u);
+    }
+    m_nextCacheSweepFrame = frameIndex + sweepInterval;
+
+    bool anyEvicted = false;
+    for (int i = 0; i < int(CacheType::Count); ++i) {
+        m_cacheStats[i].evictions += evicted[i];
+        anyEvicted |= evicted[i] > 0;
+    }
+    if (anyEvicted) {
+        qCDebug(PERF_INFO, "Released %llu srbs, %llu pipelines, %llu draw call data and %llu instance buffers "
+                           "unused for a while; %lld srbs, %lld pipelines, %lld draw call data and %lld instance buffers left",
+                evicted[int(CacheType::ShaderResourceBindings)], evicted[int(CacheType::GraphicsPipelines)],
+                evicted[int(CacheType::DrawCallData)], evicted[int(CacheType::InstanceBuffers)],
+                qint64(m_srbCache.size()), qint64(m_pipelines.size()),
+                qint64(m_drawCallData.size()), qint64(m_instanceBuffers.size()));
+    }
+}
+
+QSSGRhiContext::CacheStats QSSGRhiContext::cacheStats(CacheType type) const
+{
+    CacheStats stats = m_cacheStats[int(type)];
+    switch (type) {
+    case CacheType::ShaderResourceBindings:
+        stats.entryCount = m_srbCache.size();
+        stats.memorySize = quint64(stats.entryCount) * (sizeof(QSSGRhiShaderResourceBindingList)
+                                                        + sizeof(CacheEntry<QRhiShaderResourceBindings>));
+        break;
+    case CacheType::GraphicsPipelines:
+        stats.entryCount = m_pipelines.size();
+        stats.memorySize = quint64(stats.entryCount) * (sizeof(QSSGGraphicsPipelineStateKey)
+                                                        + sizeof(CacheEntry<QRhiGraphicsPipeline>));
+        for (auto it = m_pipelines.cbegin(), end = m_pipelines.cend(); it != end; ++it) {
+            stats.memorySize += (it.key().renderTargetDescription.size()
+                                 + it.key().srbLayoutDescription.size()) * sizeof(quint32);
+        }
+        break;
+    case CacheType::DrawCallData:
+        stats.entryCount = m_drawCallData.size();
+        stats.memorySize = quint64(stats.entryCount) * (sizeof(QSSGRhiDrawCallDataKey) + sizeof(QSSGRhiDrawCallData));
+        for (const QSSGRhiDrawCallData &dcd : m_drawCallData) {
+            stats.memorySize += dcd.renderTargetDescription.size() * sizeof(quint32);
+            if (dcd.ubuf)
+                stats.memorySize += dcd.ubuf->size();
+        }
+        break;
+    case CacheType::InstanceBuffers:
+        stats.entryCount = m_instanceBuffers.size();
+        stats.memorySize = quint64(stats.entryCount) * (sizeof(QSSGRenderInstanceTable *) + sizeof(QSSGRhiInstanceBufferData));
+        for (const QSSGRhiInstanceBufferData &data : m_instanceBuffers) {
+            stats.memorySize += data.sortedData.size() + data.sortData.size() * sizeof(QSSGRhiSortData);
+            if (data.buffer)
+                stats.memorySize += data.buffer->size();
+        }
+        break;
+    default:
+        break;
+    }
+    return stats;
+}
+
 QRhiTexture *QSSGRhiContext::dummyTexture(QRhiTexture::Flags flags, QRhiResourceUpdateBatch *rub,
                                           const QSize &size, const QColor &fillColor)
 {
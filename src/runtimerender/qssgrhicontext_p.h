@@ -129,6 +129,65 @@ private:
     QRhiCommandBuffer::IndexFormat m_indexFormat;
 };
 
+// Suballocates the per-draw uniform data of a frame from a few large
+// dynamic uniform buffers, which are then bound with dynamic offsets.
+// Allocations only grow within a frame, and the data written for earlier
+// draw calls is never touched again until reset() is called at the
+// beginning of the next frame. Before recording a pass that uses the data,
+// commit() must be called to finish the host writes.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRhiUniformRing
+{
+    Q_DISABLE_COPY(QSSGRhiUniformRing)
+public:
+    enum { BlockSize = 4 * 1024 * 1024 };
+
+    struct Allocation
+    {
+        QRhiBuffer *buffer = nullptr;
+        quint32 offset = 0;
+        char *data = nullptr; // points to offset, valid until commit()
+    };
+
+    QSSGRhiUniformRing() = default;
+    ~QSSGRhiUniformRing();
+
+    void reset(QSSGRhiContext *context);
+    Allocation allocate(int size);
+    void commit();
+    void releaseResources();
+
+    int bufferCount() const { return m_blocks.count(); }
+    int usedBufferCount() const { return m_blocks.isEmpty() ? 0 : m_current + 1; }
+
+private:
+    struct Block
+    {
+        QRhiBuffer *buffer = nullptr;
+        char *data = nullptr; // non-null between the first allocation and commit()
+        int used = 0;
+    };
+
+    QSSGRhiContext *m_context = nullptr;
+    QVarLengthArray<Block, 4> m_blocks;
+    int m_current = 0;
+};
+
+// The dynamic offsets for the uniform buffers of a draw call, when they
+// were suballocated from a QSSGRhiUniformRing.
+struct QSSGRhiDynamicUniformOffsets
+{
+    QRhiCommandBuffer::DynamicOffset offsets[2];
+    int count = 0;
+
+    void set(quint32 ub0Offset) { offsets[0] = { 0, ub0Offset }; count = 1; }
+    void set(quint32 ub0Offset, quint32 lightsOffset)
+    {
+        offsets[0] = { 0, ub0Offset };
+        offsets[1] = { 1, lightsOffset };
+        count = 2;
+    }
+};
+
 struct QSSGRhiShaderUniform
 {
     char name[64];
@@ -191,6 +250,7 @@ enum class QSSGRhiSamplerBindingHints
     ScreenTexture,
     DepthTexture,
     AoTexture,
+    LightClusters,
 
     BindingMapSize
 };
@@ -237,16 +297,21 @@ class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRhiShaderPipeline
 public:
     QAtomicInt ref;
 
-    QSSGRhiShaderPipeline(QSSGRhiContext &context) : m_context(context) { }
+    QSSGRhiShaderPipeline(QSSGRhiContext &context);
 
     QSSGRhiContext &context() const { return m_context; }
     bool isNull() const { return m_stages.isEmpty(); }
+    bool isCompilationPending() const { return m_compilationPending; }
+    void setCompilationPending(bool pending) { m_compilationPending = pending; }
 
     enum StageFlag {
         // Indicates that this shaderpipeline object is not going to be used with
         // a QSSGRhiInputAssemblerState, i.e. bakeVertexInputLocations() will
         // not be called.
-        UsedWithoutIa = 0x01
+        UsedWithoutIa = 0x01,
+        // Allows baking the shaders on a worker thread. Until that finishes,
+        // the pipeline has no stages and isCompilationPending() returns true.
+        AsyncCompilation = 0x02
     };
     Q_DECLARE_FLAGS(StageFlags, StageFlag)
 
@@ -278,45 +343,57 @@ public:
 
     const QHash<QSSGRhiInputAssemblerState::InputSemantic, QShaderDescription::InOutVariable> &vertexInputs() const { return m_vertexInputs; }
 
+    // Uniforms of the main uniform block that are written for every
+    // renderable. Their offsets are resolved once per pipeline, when the
+    // vertex stage is added, so that per-frame updates are plain writes
+    // into the buffer without looking up names.
+    enum class CommonUniform {
+        CameraPosition,
+        CameraDirection,
+        CameraProperties,
+        ProjectionMatrix,
+        InverseProjectionMatrix,
+        ViewMatrix,
+        ViewProjectionMatrix,
+        ModelMatrix,
+        ModelViewProjection,
+        NormalMatrix,
+        ParentMatrix,
+        LightProbeOrientation,
+        LightProbeProperties,
+        ReflectionProbeBoxCenter,
+        ReflectionProbeBoxMin,
+        ReflectionProbeBoxMax,
+        ReflectionProbeCorrection,
+        MaterialEmissiveColor,
+        MaterialBaseColor,
+        MaterialSpecular,
+        LightAmbientTotal,
+        MaterialProperties,
+        MaterialProperties2,
+        MaterialProperties3,
+        MaterialProperties4,
+        MaterialAttenuation,
+        MaterialThickness,
+        RhiProperties,
+        ShadowDepthAdjust,
+        MaterialPointSize,
+        ClusterViewProjection,
+        ClusterViewDepth,
+        ClusterDepthParams,
+        ClusterOffsets,
+
+        Count
+    };
+
     // This struct is used purely for performance. It is used to quickly store
-    // and index common uniform names using the storeIndex argument in the
-    // setUniform method.
+    // and index the uniform names that are not in the CommonUniform table
+    // using the storeIndex argument in the setUniform method.
     struct CommonUniformIndices
     {
-        int cameraPositionIdx = -1;
-        int cameraDirectionIdx = -1;
-        int viewProjectionMatrixIdx = -1;
-        int projectionMatrixIdx = -1;
-        int inverseProjectionMatrixIdx = -1;
-        int viewMatrixIdx = -1;
-        int modelViewProjectionIdx = -1;
-        int normalMatrixIdx = -1;
-        int modelMatrixIdx = -1;
-        int lightProbeOrientationIdx = -1;
-        int lightProbePropertiesIdx = -1;
-        int material_emissiveColorIdx = -1;
-        int material_baseColorIdx = -1;
-        int material_specularIdx = -1;
-        int cameraPropertiesIdx = -1;
-        int light_ambient_totalIdx = -1;
-        int material_propertiesIdx = -1;
-        int material_properties2Idx = -1;
-        int material_properties3Idx = -1;
-        int material_properties4Idx = -1;
-        int material_properties5Idx = -1;
-        int material_attenuationIdx = -1;
-        int thicknessFactorIdx = -1;
-        int rhiPropertiesIdx = -1;
-        int displaceAmountIdx = -1;
         int boneTransformsIdx = -1;
         int boneNormalTransformsIdx = -1;
-        int shadowDepthAdjustIdx = -1;
-        int pointSizeIdx = -1;
         int morphWeightsIdx = -1;
-        int reflectionProbeBoxCenter = -1;
-        int reflectionProbeBoxMax = -1;
-        int reflectionProbeBoxMin = -1;
-        int reflectionProbeCorrection = -1;
 
         struct ImageIndices
         {
@@ -339,6 +416,31 @@ public:
     };
     Q_DECLARE_FLAGS(UniformFlags, UniformFlag)
 
+    int commonUniformOffset(CommonUniform uniform) const { return m_commonUniformOffsets[size_t(uniform)]; }
+    int shadowMatrixOffset(int lightIdx) const { return m_shadowMatrixOffsets[lightIdx]; }
+    int shadowControlOffset(int lightIdx) const { return m_shadowControlOffsets[lightIdx]; }
+
+    static void setUniformAtOffset(char *ubufData, int offset, const void *data, size_t size, UniformFlags flags = {})
+    {
+        // must silently ignore uniforms that are not in the actual shader
+        if (offset < 0)
+            return;
+        char *dst = ubufData + offset;
+        if (flags.testFlag(UniformFlag::Mat3)) {
+            // mat3 is still 4 floats per column in the uniform buffer
+            const float *src = static_cast<const float *>(data);
+            memcpy(dst, src, 3 * sizeof(float));
+            memcpy(dst + 4 * sizeof(float), src + 3, 3 * sizeof(float));
+            memcpy(dst + 8 * sizeof(float), src + 6, 3 * sizeof(float));
+        } else {
+            memcpy(dst, data, size);
+        }
+    }
+    void setCommonUniform(char *ubufData, CommonUniform uniform, const void *data, size_t size, UniformFlags flags = {})
+    {
+        setUniformAtOffset(ubufData, m_commonUniformOffsets[size_t(uniform)], data, size, flags);
+    }
+
     void setUniformValue(char *ubufData, const char *name, const QVariant &value, QSSGRenderShaderDataType type);
     void setUniform(char *ubufData, const char *name, const void *data, size_t size, int *storeIndex = nullptr, UniformFlags flags = {});
     void setUniformArray(char *ubufData, const char *name, const void *data, size_t itemCount, QSSGRenderShaderDataType type, int *storeIndex = nullptr);
@@ -377,6 +479,9 @@ public:
     void setSsaoTexture(QRhiTexture *texture) { m_ssaoTexture = texture; }
     QRhiTexture *ssaoTexture() const { return m_ssaoTexture; }
 
+    void setLightClusterTexture(QRhiTexture *texture) { m_lightClusterTexture = texture; }
+    QRhiTexture *lightClusterTexture() const { return m_lightClusterTexture; }
+
     void resetExtraTextures() { m_extraTextures.clear(); }
     void addExtraTexture(const QSSGRhiTexture &t) { m_extraTextures.append(t); }
     int extraTextureCount() const { return m_extraTextures.count(); }
@@ -388,14 +493,20 @@ public:
     int offsetOfUniform(const QByteArray &name);
 
 private:
+    void resolveCommonUniformOffsets();
+
     QSSGRhiContext &m_context;
     QVarLengthArray<QRhiShaderStage, 2> m_stages;
+    bool m_compilationPending = false;
     int m_ub0Size = 0;
     int m_ub0NextUBufOffset = 0;
     QHash<QByteArray, QShaderDescription::BlockVariable> m_ub0;
     QHash<QSSGRhiInputAssemblerState::InputSemantic, QShaderDescription::InOutVariable> m_vertexInputs;
     QHash<QByteArray, QShaderDescription::InOutVariable> m_combinedImageSamplers;
     int m_materialImageSamplerBindings[size_t(QSSGRhiSamplerBindingHints::BindingMapSize)];
+    int m_commonUniformOffsets[size_t(CommonUniform::Count)];
+    int m_shadowMatrixOffsets[QSSG_MAX_NUM_LIGHTS];
+    int m_shadowControlOffsets[QSSG_MAX_NUM_LIGHTS];
 
     QVarLengthArray<QSSGRhiShaderUniform, 32> m_uniforms; // members of the main (binding 0) uniform buffer
     QVarLengthArray<QSSGRhiShaderUniformArray, 8> m_uniformArrays;
@@ -411,6 +522,7 @@ private:
     QRhiTexture *m_screenTexture = nullptr;
     QRhiTexture *m_depthTexture = nullptr;
     QRhiTexture *m_ssaoTexture = nullptr;
+    QRhiTexture *m_lightClusterTexture = nullptr;
     QVarLengthArray<QSSGRhiTexture, 8> m_extraTextures;
 };
 
@@ -590,6 +702,7 @@ struct QSSGRhiShaderResourceBindingList
     }
 
     void addUniformBuffer(int binding, QRhiShaderResourceBinding::StageFlags stage, QRhiBuffer *buf, int offset, int size);
+    void addUniformBufferWithDynamicOffset(int binding, QRhiShaderResourceBinding::StageFlags stage, QRhiBuffer *buf, int size);
     void addTexture(int binding, QRhiShaderResourceBinding::StageFlags stage, QRhiTexture *tex, QRhiSampler *sampler);
 };
 
@@ -636,6 +749,26 @@ inline void QSSGRhiShaderResourceBindingList::addUniformBuffer(int binding, QRhi
     d->u.ubuf.hasDynamicOffset = false;
 }
 
+inline void QSSGRhiShaderResourceBindingList::addUniformBufferWithDynamicOffset(int binding, QRhiShaderResourceBinding::StageFlags stage,
+                                                                                QRhiBuffer *buf, int size)
+{
+#ifdef QT_DEBUG
+    if (p == MAX_SIZE) {
+        qWarning("Out of shader resource bindings slots (max is %d)", MAX_SIZE);
+        return;
+    }
+#endif
+    QRhiShaderResourceBinding::Data *d = v[p++].data();
+    h ^= qintptr(buf) ^ qintptr(size);
+    d->binding = binding;
+    d->stage = stage;
+    d->type = QRhiShaderResourceBinding::UniformBuffer;
+    d->u.ubuf.buf = buf;
+    d->u.ubuf.offset = 0;
+    d->u.ubuf.maybeSize = size;
+    d->u.ubuf.hasDynamicOffset = true;
+}
+
 inline void QSSGRhiShaderResourceBindingList::addTexture(int binding, QRhiShaderResourceBinding::StageFlags stage,
                                                          QRhiTexture *tex, QRhiSampler *sampler)
 {
@@ -659,17 +792,15 @@ inline void QSSGRhiShaderResourceBindingList::addTexture(int binding, QRhiShader
 // like "render a model in a shared scene between multiple View3Ds" (here both
 // the View3D ('layer') and the model ('model') act as the lookup key since
 // while the model is the same, we still want different uniform buffers per
-// View3D), or the case of shadow maps where the shadow map (there can be as
-// many as lights) is taken into account too ('entry').
+// View3D), or the case of reflection maps where the reflection map (there can
+// be as many as reflection probes) is taken into account too ('entry').
+// The depth passes suballocate their uniforms from QSSGRhiUniformRing instead.
 //
 struct QSSGRhiDrawCallDataKey
 {
     enum Selector {
         Main,
-        Shadow,
         ShadowBlur,
-        ZPrePass,
-        DepthTexture,
         AoTexture,
         ComputeMipmap,
         SkyBox,
@@ -713,12 +844,31 @@ struct QSSGRhiDrawCallData
     size_t renderTargetDescriptionHash = 0;
     QVector<quint32> renderTargetDescription;
     QSSGRhiGraphicsPipelineState ps;
+    quint32 lastUsedFrame = 0;
+    QSSGRef<QSSGRhiShaderPipeline> lastReadyShaders;
 
     void reset() {
         delete ubuf;
         ubuf = nullptr;
         srb = nullptr;
         pipeline = nullptr;
+        lastReadyShaders.clear();
+    }
+
+    // Returns the shaders to draw with. While the given ones are still being
+    // compiled in the background, these are the ones this draw call was last
+    // prepared with, or null when there are none or fallback is not wanted.
+    // Null as well when the background compilation failed.
+    QSSGRef<QSSGRhiShaderPipeline> readyShaders(const QSSGRef<QSSGRhiShaderPipeline> &shaders, bool allowFallback)
+    {
+        if (shaders && shaders->isNull()) {
+            if (allowFallback && shaders->isCompilationPending())
+                return lastReadyShaders;
+            return QSSGRef<QSSGRhiShaderPipeline>();
+        }
+        if (lastReadyShaders.data() != shaders.data())
+            lastReadyShaders = shaders;
+        return shaders;
     }
 };
 
@@ -737,6 +887,7 @@ struct QSSGRhiInstanceBufferData
     int serial = -1;
     bool owned = true;
     bool sorting = false;
+    quint32 lastUsedFrame = 0;
 };
 
 struct QSSGRhiParticleData
@@ -803,7 +954,8 @@ public:
             printRenderPass(rp);
         }
         if (externalRenderPass.indexedDraws.callCount || externalRenderPass.indexedDraws.instancedCallCount
-                || externalRenderPass.draws.callCount || externalRenderPass.draws.instancedCallCount)
+                || externalRenderPass.draws.callCount || externalRenderPass.draws.instancedCallCount
+                || externalRenderPass.binds.pipelineCount || externalRenderPass.binds.srbCount)
         {
             qDebug("Within external render passes:");
             printRenderPass(externalRenderPass);
@@ -812,7 +964,7 @@ public:
 
     void beginRenderPass(QRhiTextureRenderTarget *rt)
     {
-        renderPasses.append({ rt->pixelSize(), {}, {} });
+        renderPasses.append({ rt->pixelSize(), {}, {}, {} });
         currentRenderPassIndex = renderPasses.count() - 1;
     }
 
@@ -847,6 +999,26 @@ public:
         }
     }
 
+    // Only changes count, QRhi skips setting the same pipeline or
+    // bindings again
+    void setGraphicsPipeline(const QRhiGraphicsPipeline *ps)
+    {
+        RenderPassInfo &rp(currentRenderPassIndex >= 0 ? renderPasses[currentRenderPassIndex] : externalRenderPass);
+        if (ps != rp.binds.lastPipeline) {
+            rp.binds.lastPipeline = ps;
+            rp.binds.pipelineCount += 1;
+        }
+    }
+
+    void setShaderResources(const QRhiShaderResourceBindings *srb)
+    {
+        RenderPassInfo &rp(currentRenderPassIndex >= 0 ? renderPasses[currentRenderPassIndex] : externalRenderPass);
+        if (srb != rp.binds.lastSrb) {
+            rp.binds.lastSrb = srb;
+            rp.binds.srbCount += 1;
+        }
+    }
+
     struct IndexedDrawInfo {
         quint32 callCount = 0;
         quint32 instancedCallCount = 0;
@@ -861,10 +1033,17 @@ public:
         quint32 instancedVertexCount = 0;
         quint32 instanceCount = 0;
     };
+    struct BindInfo {
+        quint32 pipelineCount = 0;
+        quint32 srbCount = 0;
+        const QRhiGraphicsPipeline *lastPipeline = nullptr;
+        const QRhiShaderResourceBindings *lastSrb = nullptr;
+    };
     struct RenderPassInfo {
         QSize pixelSize;
         IndexedDrawInfo indexedDraws;
         DrawInfo draws;
+        BindInfo binds;
     };
     QVector<RenderPassInfo> renderPasses;
     RenderPassInfo externalRenderPass;
@@ -883,6 +1062,8 @@ public:
                    rp.indexedDraws.instancedCallCount, rp.indexedDraws.instancedIndexCount, rp.indexedDraws.instanceCount,
                    rp.draws.instancedCallCount, rp.draws.instancedVertexCount, rp.draws.instanceCount);
         }
+        qDebug("%u graphics pipeline changes, %u shader resource bindings changes",
+               rp.binds.pipelineCount, rp.binds.srbCount);
     }
 };
 
@@ -932,7 +1113,15 @@ public:
 
     QSSGRhiDrawCallData &drawCallData(const QSSGRhiDrawCallDataKey &key)
     {
-        return m_drawCallData[key];
+        auto it = m_drawCallData.find(key);
+        if (it == m_drawCallData.end()) {
+            m_cacheStats[int(CacheType::DrawCallData)].misses += 1;
+            it = m_drawCallData.insert(key, QSSGRhiDrawCallData());
+        } else {
+            m_cacheStats[int(CacheType::DrawCallData)].hits += 1;
+        }
+        it->lastUsedFrame = m_frameIndex;
+        return *it;
     }
 
     QRhiSampler *sampler(const QSSGRhiSamplerDescription &samplerDescription);
@@ -943,6 +1132,7 @@ public:
     void releaseTexture(QRhiTexture *texture);
 
     void cleanupDrawCallData(const QSSGRenderModel *model);
+    void releaseInstanceBuffer(QSSGRenderInstanceTable *instanceTable);
 
     QRhiTexture *dummyTexture(QRhiTexture::Flags flags, QRhiResourceUpdateBatch *rub,
                               const QSize &size = QSize(64, 64), const QColor &fillColor = Qt::black);
@@ -959,7 +1149,15 @@ public:
 
     QSSGRhiInstanceBufferData &instanceBufferData(QSSGRenderInstanceTable *instanceTable)
     {
-        return m_instanceBuffers[instanceTable];
+        auto it = m_instanceBuffers.find(instanceTable);
+        if (it == m_instanceBuffers.end()) {
+            m_cacheStats[int(CacheType::InstanceBuffers)].misses += 1;
+            it = m_instanceBuffers.insert(instanceTable, QSSGRhiInstanceBufferData());
+        } else {
+            m_cacheStats[int(CacheType::InstanceBuffers)].hits += 1;
+        }
+        it->lastUsedFrame = m_frameIndex;
+        return *it;
     }
     QSSGRhiParticleData &particleData(const QSSGRenderGraphObject *particlesOrModel)
     {
@@ -968,6 +1166,45 @@ public:
 
     QSSGRhiContextStats &stats() { return m_stats; }
 
+    enum class CacheType {
+        ShaderResourceBindings,
+        GraphicsPipelines,
+        DrawCallData,
+        InstanceBuffers,
+        Count
+    };
+
+    // Entries not used in the last maxUnusedFrames frames are released, and
+    // when a cache has more than its maxEntries, the least recently used
+    // entries are released too. Entries used in the current frame are kept
+    // even then. 0 means no limit.
+    struct CacheLimits {
+        quint32 maxUnusedFrames = 3600;
+        int maxEntries[int(CacheType::Count)] = { 4096, 1024, 16384, 1024 };
+    };
+
+    struct CacheStats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 evictions = 0;
+        qsizetype entryCount = 0;
+        quint64 memorySize = 0; // approximate, in bytes
+    };
+
+    void setCacheLimits(const CacheLimits &limits)
+    {
+        m_cacheLimits = limits;
+        // sweep with the new limits at the end of this frame
+        m_nextCacheSweepFrame = m_frameIndex;
+        for (qsizetype &size : m_untrimmedCacheSizes)
+            size = 0;
+    }
+    const CacheLimits &cacheLimits() const { return m_cacheLimits; }
+    CacheStats cacheStats(CacheType type) const;
+
+    // To be called once at the end of every frame
+    void trimCaches();
+
     int maxUniformBufferRange() const { return m_rhi->resourceLimit(QRhi::MaxUniformBufferRange); }
 
 private:
@@ -977,8 +1214,13 @@ private:
     QRhiRenderTarget *m_rt = nullptr;
     int m_mainSamples = 1;
     QHash<const void *, QSSGRhiGraphicsPipelineState> m_gfxPs;
-    QHash<QSSGRhiShaderResourceBindingList, QRhiShaderResourceBindings *> m_srbCache;
-    QHash<QSSGGraphicsPipelineStateKey, QRhiGraphicsPipeline *> m_pipelines;
+    template<typename T>
+    struct CacheEntry {
+        T *resource;
+        quint32 lastUsedFrame;
+    };
+    QHash<QSSGRhiShaderResourceBindingList, CacheEntry<QRhiShaderResourceBindings>> m_srbCache;
+    QHash<QSSGGraphicsPipelineStateKey, CacheEntry<QRhiGraphicsPipeline>> m_pipelines;
     QHash<QSSGComputePipelineStateKey, QRhiComputePipeline *> m_computePipelines;
     QHash<QSSGRhiDrawCallDataKey, QSSGRhiDrawCallData> m_drawCallData;
     QVector<QPair<QSSGRhiSamplerDescription, QRhiSampler*>> m_samplers;
@@ -987,6 +1229,11 @@ private:
     QHash<QSSGRenderInstanceTable *, QSSGRhiInstanceBufferData> m_instanceBuffers;
     QHash<const QSSGRenderGraphObject *, QSSGRhiParticleData> m_particleData;
     QSSGRhiContextStats m_stats;
+    quint32 m_frameIndex = 0;
+    CacheLimits m_cacheLimits;
+    quint32 m_nextCacheSweepFrame = 0;
+    qsizetype m_untrimmedCacheSizes[int(CacheType::Count)] = {};
+    CacheStats m_cacheStats[int(CacheType::Count)];
 };
 
 inline QRhiSampler::Filter toRhi(QSSGRenderTextureFilterOp op)
@@ -70,7 +70,9 @@ void QSSGCustomMaterialSystem::setRenderContextInterface(QSSGRenderContextInterf
 QSSGRef<QSSGRhiShaderPipeline> QSSGCustomMaterialSystem::shadersForCustomMaterial(QSSGRhiGraphicsPipelineState *ps,
                                                                                   const QSSGRenderCustomMaterial &material,
                                                                                   QSSGSubsetRenderable &renderable,
-                                                                                  const QSSGShaderFeatures &featureSet)
+                                                                                  const QSSGShaderFeatures &featureSet,
+                                                                                  QSSGRhiDrawCallData *dcd,
+                                                                                  bool *compilationPending)
 {
     // This just references inFeatureSet and inRenderable.shaderDescription -
     // cheap to construct and is good enough for the find()
@@ -109,6 +111,15 @@ QSSGRef<QSSGRhiShaderPipeline> QSSGCustomMaterialSystem::shadersForCustomMateria
         shaderPipeline = it.value();
     }
 
+    if (compilationPending)
+        *compilationPending = shaderPipeline && shaderPipeline->isCompilationPending();
+    if (dcd) {
+        const bool allowFallback = context->shaderCache()->asyncCompilation() == QSSGShaderCache::AsyncCompilation::Fallback;
+        shaderPipeline = dcd->readyShaders(shaderPipeline, allowFallback);
+    } else if (shaderPipeline && shaderPipeline->isNull()) {
+        shaderPipeline.clear();
+    }
+
     if (shaderPipeline) {
         ps->shaderPipeline = shaderPipeline.data();
         shaderPipeline->resetExtraTextures();
@@ -143,6 +154,7 @@ void QSSGCustomMaterialSystem::updateUniformsForCustomMaterial(QSSGRef<QSSGRhiSh
         layerData.m_rhiDepthTexture.texture,
         layerData.m_rhiAoTexture.texture,
         layerData.m_rhiScreenTexture.texture,
+        &layerData.lightClusters,
         layerData.layer.lightProbe,
         layerData.layer.probeHorizon,
         layerData.layer.probeExposure,
@@ -215,30 +227,31 @@ void QSSGCustomMaterialSystem::rhiPrepareRenderable(QSSGRhiGraphicsPipelineState
 
     const bool blendParticles = renderable.generator->contextInterface()->renderer()->defaultMaterialShaderKeyProperties().m_blendParticles.getValue(renderable.shaderDescription);
 
-    QSSGRef<QSSGRhiShaderPipeline> shaderPipeline = shadersForCustomMaterial(ps, material, renderable, featureSet);
+    QSSGRhiDrawCallData &dcd(cubeFace < 0 ? rhiCtx->drawCallData({ &layerData.layer,
+                                                    &renderable.modelContext.model,
+                                                    &material,
+                                                    0,
+                                                    QSSGRhiDrawCallDataKey::Main })
+                                          : rhiCtx->drawCallData({ &layerData.layer,
+                                                                   &renderable.modelContext.model,
+                                                                   entry, cubeFace + int(renderable.subset.offset << 3),
+                                                                   QSSGRhiDrawCallDataKey::Reflection }));
+
+    QSSGRef<QSSGRhiShaderPipeline> shaderPipeline = shadersForCustomMaterial(ps, material, renderable, featureSet, &dcd);
 
     if (shaderPipeline) {
         QSSGRhiShaderResourceBindingList bindings;
 
-        QSSGRhiDrawCallData &dcd(cubeFace < 0 ? rhiCtx->drawCallData({ &layerData.layer,
-                                                        &renderable.modelContext.model,
-                                                        &material,
-                                                        0,
-                                                        QSSGRhiDrawCallDataKey::Main })
-                                              : rhiCtx->drawCallData({ &layerData.layer,
-                                                                       &renderable.modelContext.model,
-                                                                       entry, cubeFace + int(renderable.subset.offset << 3),
-                                                                       QSSGRhiDrawCallDataKey::Reflection }));
-
-        shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd.ubuf);
-        char *ubufData = dcd.ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
+        const QSSGRhiUniformRing::Allocation ubuf = layerData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset()
+                                                                                     + int(sizeof(QSSGShaderLightsUniformData)));
+        if (!ubuf.buffer)
+            return;
         if (!camera)
-            updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubufData, ps, material, renderable, layerData, *layerData.camera, nullptr, nullptr);
+            updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, material, renderable, layerData, *layerData.camera, nullptr, nullptr);
         else
-            updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubufData, ps, material, renderable, layerData, *camera, nullptr, modelViewProjection);
+            updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, material, renderable, layerData, *camera, nullptr, modelViewProjection);
         if (blendParticles)
-            QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubufData, &renderable.modelContext.model, renderable.subset.offset);
-        dcd.ubuf->endFullDynamicBufferUpdateForCurrentFrame();
+            QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubuf.data, &renderable.modelContext.model, renderable.subset.offset);
 
         if (blendParticles)
             QSSGParticleRenderer::prepareParticlesForModel(shaderPipeline, rhiCtx, bindings, &renderable.modelContext.model);
@@ -260,7 +273,7 @@ void QSSGCustomMaterialSystem::rhiPrepareRenderable(QSSGRhiGraphicsPipelineState
         int instanceBufferBinding = 0;
         if (instancing) {
             // Need to setup new bindings for instanced buffers
-            const quint32 stride = renderable.modelContext.model.instanceTable->stride();
+            const quint32 stride = renderable.instanceTable->stride();
             QVarLengthArray<QRhiVertexInputBinding, 8> bindings;
             std::copy(ps->ia.inputLayout.cbeginBindings(),
                       ps->ia.inputLayout.cendBindings(),
@@ -277,10 +290,11 @@ void QSSGCustomMaterialSystem::rhiPrepareRenderable(QSSGRhiGraphicsPipelineState
         QRhiTexture *dummyCubeTexture = rhiCtx->dummyTexture(QRhiTexture::CubeMap, resourceUpdates);
         rhiCtx->commandBuffer()->resourceUpdate(resourceUpdates);
 
-        bindings.addUniformBuffer(0, VISIBILITY_ALL, dcd.ubuf, 0, shaderPipeline->ub0Size());
-        bindings.addUniformBuffer(1, VISIBILITY_ALL, dcd.ubuf,
-                                  shaderPipeline->ub0LightDataOffset(),
-                                  shaderPipeline->ub0LightDataSize());
+        bindings.addUniformBufferWithDynamicOffset(0, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0Size());
+        bindings.addUniformBufferWithDynamicOffset(1, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0LightDataSize());
+        QSSGRhiDynamicUniformOffsets &ubufOffsets(cubeFace < 0 ? renderable.rhiRenderData.mainPass.ubufOffsets
+                                                               : renderable.rhiRenderData.reflectionPass.ubufOffsets[cubeFace]);
+        ubufOffsets.set(ubuf.offset, ubuf.offset + quint32(shaderPipeline->ub0LightDataOffset()));
 
         QVector<QShaderDescription::InOutVariable> samplerVars =
                 shaderPipeline->fragmentStage()->shader().description().combinedImageSamplers();
@@ -350,6 +364,19 @@ void QSSGCustomMaterialSystem::rhiPrepareRenderable(QSSGRhiGraphicsPipelineState
             } // else ignore, not an error
         }
 
+        if (shaderPipeline->lightClusterTexture()) {
+            int binding = shaderPipeline->bindingForTexture("qt_lightClusters", int(QSSGRhiSamplerBindingHints::LightClusters));
+            if (binding >= 0) {
+                samplerBindingsSpecified.setBit(binding);
+                // only read with texelFetch
+                QRhiSampler *sampler = rhiCtx->sampler({ QRhiSampler::Nearest, QRhiSampler::Nearest, QRhiSampler::None,
+                                                         QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge, QRhiSampler::Repeat });
+                bindings.addTexture(binding,
+                                    QRhiShaderResourceBinding::FragmentStage,
+                                    shaderPipeline->lightClusterTexture(), sampler);
+            } // else ignore, not an error
+        }
+
         if (shaderPipeline->depthTexture()) {
             int binding = shaderPipeline->bindingForTexture("qt_depthTexture", int(QSSGRhiSamplerBindingHints::DepthTexture));
             if (binding >= 0) {
@@ -557,10 +584,12 @@ void QSSGCustomMaterialSystem::rhiRenderRenderable(QSSGRhiContext *rhiCtx,
 {
     QRhiGraphicsPipeline *ps = renderable.rhiRenderData.mainPass.pipeline;
     QRhiShaderResourceBindings *srb = renderable.rhiRenderData.mainPass.srb;
+    const QSSGRhiDynamicUniformOffsets *ubufOffsets = &renderable.rhiRenderData.mainPass.ubufOffsets;
 
     if (cubeFace >= 0) {
         ps = renderable.rhiRenderData.reflectionPass.pipeline;
         srb = renderable.rhiRenderData.reflectionPass.srb[cubeFace];
+        ubufOffsets = &renderable.rhiRenderData.reflectionPass.ubufOffsets[cubeFace];
     }
 
     if (!ps || !srb)
@@ -571,7 +600,9 @@ void QSSGCustomMaterialSystem::rhiRenderRenderable(QSSGRhiContext *rhiCtx,
 
     QRhiCommandBuffer *cb = rhiCtx->commandBuffer();
     cb->setGraphicsPipeline(ps);
-    cb->setShaderResources(srb);
+    cb->setShaderResources(srb, ubufOffsets->count, ubufOffsets->offsets);
+    QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(ps));
+    QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
 
     if (*needsSetViewport) {
         if (!state)
@@ -585,8 +616,8 @@ void QSSGCustomMaterialSystem::rhiRenderRenderable(QSSGRhiContext *rhiCtx,
     int vertexBufferCount = 1;
     vertexBuffers[0] = QRhiCommandBuffer::VertexInput(vertexBuffer, 0);
     quint32 instances = 1;
-    if (renderable.modelContext.model.instancing()) {
-        instances = renderable.modelContext.model.instanceCount();
+    if (renderable.instancing()) {
+        instances = renderable.instanceCount();
         vertexBuffers[1] = QRhiCommandBuffer::VertexInput(renderable.instanceBuffer, 0);
         vertexBufferCount = 2;
     }
@@ -64,6 +64,7 @@ struct QSSGRenderLayer;
 struct QSSGRenderLight;
 struct QSSGRenderCamera;
 struct QSSGReflectionMapEntry;
+struct QSSGRhiDrawCallData;
 class QRhiTexture;
 
 
@@ -102,7 +103,9 @@ public:
     QSSGRef<QSSGRhiShaderPipeline> shadersForCustomMaterial(QSSGRhiGraphicsPipelineState *ps,
                                                             const QSSGRenderCustomMaterial &material,
                                                             QSSGSubsetRenderable &renderable,
-                                                            const QSSGShaderFeatures &featureSet);
+                                                            const QSSGShaderFeatures &featureSet,
+                                                            QSSGRhiDrawCallData *dcd = nullptr,
+                                                            bool *compilationPending = nullptr);
 
     void updateUniformsForCustomMaterial(QSSGRef<QSSGRhiShaderPipeline> &shaderPipeline,
                                          QSSGRhiContext *rhiCtx,
@@ -65,16 +65,16 @@ void QSSGParticleRenderer::updateUniformsForParticles(QSSGRef<QSSGRhiShaderPipel
 {
     const QMatrix4x4 clipSpaceCorrMatrix = rhiCtx->rhi()->clipSpaceCorrMatrix();
 
-    QSSGRhiShaderPipeline::CommonUniformIndices &cui = shaders->commonUniformIndices;
+    using CommonUniform = QSSGRhiShaderPipeline::CommonUniform;
 
     const QMatrix4x4 projection = clipSpaceCorrMatrix * inCamera.projection;
-    shaders->setUniform(ubufData, "qt_projectionMatrix", projection.constData(), 16 * sizeof(float), &cui.projectionMatrixIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::ProjectionMatrix, projection.constData(), 16 * sizeof(float));
 
     const QMatrix4x4 viewMatrix = inCamera.globalTransform.inverted();
-    shaders->setUniform(ubufData, "qt_viewMatrix", viewMatrix.constData(), 16 * sizeof(float), &cui.viewMatrixIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::ViewMatrix, viewMatrix.constData(), 16 * sizeof(float));
 
     const QMatrix4x4 &modelMatrix = renderable.globalTransform;
-    shaders->setUniform(ubufData, "qt_modelMatrix", modelMatrix.constData(), 16 * sizeof(float), &cui.modelMatrixIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::ModelMatrix, modelMatrix.constData(), 16 * sizeof(float));
 
     QVector2D oneOverSize = QVector2D(1.0f, 1.0f);
     auto &particleBuffer = renderable.particles.m_particleBuffer;
@@ -145,7 +145,7 @@ void QSSGParticleRenderer::updateUniformsForParticles(QSSGRef<QSSGRhiShaderPipel
         if (lightOffset >= 0)
             memcpy(ubufData + lightOffset, &lightData, sizeof(ParticleLightData));
     }
-    shaders->setUniform(ubufData, "qt_light_ambient_total", &theLightAmbientTotal, 3 * sizeof(float), &cui.light_ambient_totalIdx);
+    shaders->setCommonUniform(ubufData, CommonUniform::LightAmbientTotal, &theLightAmbientTotal, 3 * sizeof(float));
     int enablePointLights = pointLight > 0 ? 1 : 0;
     int enableSpotLights = spotLight > 0 ? 1 : 0;
     shaders->setUniform(ubufData, "qt_pointLights", &enablePointLights, sizeof(int));
@@ -558,6 +558,8 @@ void QSSGParticleRenderer::rhiRenderRenderable(QSSGRhiContext *rhiCtx,
     cb->setGraphicsPipeline(ps);
     cb->setVertexInput(0, 0, nullptr);
     cb->setShaderResources(srb);
+    QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(ps));
+    QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
 
     if (needsSetViewport && *needsSetViewport) {
         if (!state)
@@ -116,8 +116,11 @@ void QSSGRhiQuadRenderer::recordRenderQuad(QSSGRhiContext *rhiCtx,
     }
 
     QRhiCommandBuffer *cb = rhiCtx->commandBuffer();
-    cb->setGraphicsPipeline(rhiCtx->pipeline(QSSGGraphicsPipelineStateKey::create(*ps, rpDesc, srb), rpDesc, srb));
+    QRhiGraphicsPipeline *pipeline = rhiCtx->pipeline(QSSGGraphicsPipelineStateKey::create(*ps, rpDesc, srb), rpDesc, srb);
+    cb->setGraphicsPipeline(pipeline);
     cb->setShaderResources(srb);
+    QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(pipeline));
+    QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
     cb->setViewport(ps->viewport);
     QRhiCommandBuffer::VertexInput vb(m_vbuf->buffer(), 0);
     cb->setVertexInput(0, 1, &vb, m_ibuf->buffer(), m_ibuf->indexFormat());
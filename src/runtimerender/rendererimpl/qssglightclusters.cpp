@@ -0,0 +1,312 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qssglightclusters_p.h"
+#include "qssgrendertasks_p.h"
+
+#include <QtQuick3DRuntimeRender/private/qssgrendercamera_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderlight_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrhicontext_p.h>
+#include <QtQuick3DUtils/private/qssgutils_p.h>
+
+#include <QtCore/QThreadPool>
+#include <QtCore/qmath.h>
+
+#include <cstring>
+#include <limits>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+// Binning is only split up with at least this many lights per task
+constexpr int QSSG_MIN_LIGHTS_PER_BIN_TASK = 64;
+
+// Lights are cut off where their contribution drops below 1/256
+constexpr float QSSG_LIGHT_CUTOFF = 256.0f;
+
+static_assert(QSSGLightClusters::ClusterCount < (1 << 16) && QSSGLightClusters::MaxLights <= (1 << 16),
+              "Cells and lights are packed into 16 bits each");
+static_assert(QSSGLightClusters::ClusterCount
+                      + QSSGLightClusters::MaxLights * QSSGLightClusters::TexelsPerLight
+                      + QSSGLightClusters::ClusterCount * QSSGLightClusters::MaxLights / 4
+                      <= QSSGLightClusters::TextureWidth * QSSGLightClusters::MaxTextureHeight,
+              "The light cluster texture cannot hold every light in every cell");
+
+} // namespace
+
+QSSGLightClusters::~QSSGLightClusters()
+{
+    releaseResources();
+}
+
+float QSSGLightClusters::lightRange(const QSSGRenderLight &light)
+{
+    const QVector3D diffuse = light.m_diffuseColor * light.m_brightness;
+    const QVector3D specular = light.m_specularColor * light.m_brightness;
+    const float intensity = qMax(qMax(qMax(diffuse.x(), diffuse.y()), qMax(diffuse.z(), specular.x())),
+                                 qMax(specular.y(), specular.z()));
+
+    // Solve intensity / (c + l * d + q * d^2) = 1 / QSSG_LIGHT_CUTOFF for d
+    const float c = aux::translateConstantAttenuation(light.m_constantFade) - intensity * QSSG_LIGHT_CUTOFF;
+    const float l = aux::translateLinearAttenuation(light.m_linearFade);
+    const float q = aux::translateQuadraticAttenuation(light.m_quadraticFade);
+    if (c >= 0.0f)
+        return 0.0f;
+    if (q > 0.0f)
+        return (-l + qSqrt(l * l - 4.0f * q * c)) / (2.0f * q);
+    if (l > 0.0f)
+        return -c / l;
+    return std::numeric_limits<float>::infinity();
+}
+
+int QSSGLightClusters::sliceForDepth(float depth) const
+{
+    depth = qBound(m_clipNear, depth, m_clipFar);
+    const float slice = (m_perspective ? qLn(depth) : depth) * m_depthParams.x() + m_depthParams.y();
+    return qBound(0, int(qFloor(slice)), GridDepth - 1);
+}
+
+float QSSGLightClusters::depthForSlice(int slice) const
+{
+    const float d = (float(slice) - m_depthParams.y()) / m_depthParams.x();
+    return m_perspective ? qExp(d) : d;
+}
+
+void QSSGLightClusters::binLight(int lightIndex, int firstSlice, int lastSlice, QVector<quint32> *pairs) const
+{
+    const BinnedLight &light = m_binnedLights.at(lightIndex);
+    if (light.range <= 0.0f)
+        return;
+
+    const float depth = -light.viewPos.z();
+    const float minDepth = depth - light.range;
+    const float maxDepth = depth + light.range;
+    if (maxDepth < m_clipNear || minDepth > m_clipFar)
+        return;
+
+    const bool unbounded = qIsInf(light.range);
+    const int sliceBegin = unbounded ? firstSlice : qMax(firstSlice, sliceForDepth(minDepth));
+    const int sliceEnd = unbounded ? lastSlice : qMin(lastSlice, sliceForDepth(maxDepth) + 1);
+
+    for (int slice = sliceBegin; slice < sliceEnd; ++slice) {
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = GridWidth - 1;
+        int y1 = GridHeight - 1;
+        if (!unbounded) {
+            // The bounding box of the light, clipped to the slice, in normalized device coordinates
+            const float sliceNear = qMax(qMax(depthForSlice(slice), minDepth), m_clipNear);
+            const float sliceFar = qMin(qMin(depthForSlice(slice + 1), maxDepth), m_clipFar);
+            if (sliceNear > sliceFar)
+                continue;
+            float minX = std::numeric_limits<float>::max();
+            float minY = minX;
+            float maxX = -minX;
+            float maxY = -minX;
+            for (int corner = 0; corner < 8; ++corner) {
+                const QVector4D p(light.viewPos.x() + ((corner & 1) ? light.range : -light.range),
+                                  light.viewPos.y() + ((corner & 2) ? light.range : -light.range),
+                                  (corner & 4) ? -sliceFar : -sliceNear,
+                                  1.0f);
+                const QVector4D clipPos = m_projection * p;
+                const float x = clipPos.x() / clipPos.w();
+                const float y = clipPos.y() / clipPos.w();
+                minX = qMin(minX, x);
+                maxX = qMax(maxX, x);
+                minY = qMin(minY, y);
+                maxY = qMax(maxY, y);
+            }
+            if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+                continue;
+            x0 = qBound(0, int(qFloor((minX * 0.5f + 0.5f) * GridWidth)), GridWidth - 1);
+            x1 = qBound(0, int(qFloor((maxX * 0.5f + 0.5f) * GridWidth)), GridWidth - 1);
+            y0 = qBound(0, int(qFloor((minY * 0.5f + 0.5f) * GridHeight)), GridHeight - 1);
+            y1 = qBound(0, int(qFloor((maxY * 0.5f + 0.5f) * GridHeight)), GridHeight - 1);
+        }
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                const quint32 cell = quint32(x + y * GridWidth + slice * GridWidth * GridHeight);
+                pairs->append((cell << 16) | quint32(lightIndex));
+            }
+        }
+    }
+}
+
+void QSSGLightClusters::update(const QSSGShaderLightList &lights, const QSSGRenderCamera &camera, QThreadPool *threadPool)
+{
+    m_lightCount = int(qMin(lights.size(), qsizetype(MaxLights)));
+    m_projection = camera.projection;
+    const QMatrix4x4 view = camera.globalTransform.inverted();
+    m_viewProjection = m_projection * view;
+    m_viewDepth = -view.row(2);
+    // Perspective projections have -z in w
+    m_perspective = !qFuzzyIsNull(m_projection(3, 2));
+    m_clipNear = qMax(camera.clipNear, 0.001f);
+    m_clipFar = qMax(camera.clipFar, m_clipNear * 1.001f);
+    if (m_perspective) {
+        const float scale = GridDepth / qLn(m_clipFar / m_clipNear);
+        m_depthParams = QVector4D(scale, -qLn(m_clipNear) * scale, 1.0f, 0.0f);
+    } else {
+        const float scale = GridDepth / (m_clipFar - m_clipNear);
+        m_depthParams = QVector4D(scale, -m_clipNear * scale, 0.0f, 0.0f);
+    }
+
+    m_ambientTotal = QVector3D();
+    m_binnedLights.resize(m_lightCount);
+    for (int i = 0; i < m_lightCount; ++i) {
+        const QSSGRenderLight *light = lights[i].light;
+        m_binnedLights[i] = { view.map(light->getGlobalPos()), lightRange(*light) };
+        m_ambientTotal += light->m_ambientColor;
+    }
+
+    // Each task bins all the lights into its own range of depth slices, so
+    // the tasks never touch the same cells
+    int taskCount = 1;
+    if (threadPool)
+        taskCount = qBound(1, m_lightCount / QSSG_MIN_LIGHTS_PER_BIN_TASK, qMin(threadPool->maxThreadCount() + 1, int(GridDepth)));
+    m_taskPairs.resize(taskCount);
+    QSSGRenderTasks::run(threadPool, taskCount, [&](int task) {
+        QVector<quint32> &pairs(m_taskPairs[task]);
+        pairs.clear();
+        const int firstSlice = GridDepth * task / taskCount;
+        const int lastSlice = GridDepth * (task + 1) / taskCount;
+        for (int i = 0; i < m_lightCount; ++i)
+            binLight(i, firstSlice, lastSlice, &pairs);
+    });
+
+    m_cellCounts.fill(0, ClusterCount);
+    m_indexCount = 0;
+    for (const QVector<quint32> &pairs : qAsConst(m_taskPairs)) {
+        for (quint32 pair : pairs)
+            ++m_cellCounts[pair >> 16];
+        m_indexCount += int(pairs.size());
+    }
+
+    const int lightBase = ClusterCount;
+    const int indexBase = lightBase + m_lightCount * TexelsPerLight;
+    const int texelCount = indexBase + (m_indexCount + 3) / 4;
+    const int rows = (texelCount + TextureWidth - 1) / TextureWidth;
+    m_offsets = QVector4D(float(lightBase), float(indexBase), float(TextureWidth), 0.0f);
+
+    m_texels.fill(QVector4D(), rows * TextureWidth);
+
+    // Cells: where their indices start, and how many there are. The counts
+    // are turned into the write positions of the indices along the way.
+    quint32 offset = 0;
+    for (int cell = 0; cell < ClusterCount; ++cell) {
+        const quint32 count = m_cellCounts.at(cell);
+        m_texels[cell] = QVector4D(float(offset), float(count), 0.0f, 0.0f);
+        m_cellCounts[cell] = offset;
+        offset += count;
+    }
+
+    // Lights, with the same values as the light uniforms
+    for (int i = 0; i < m_lightCount; ++i) {
+        const QSSGShaderLight &shaderLight = lights[i];
+        const QSSGRenderLight *light = shaderLight.light;
+        QVector4D *texel = m_texels.data() + lightBase + i * TexelsPerLight;
+        const bool isSpot = light->type == QSSGRenderLight::Type::SpotLight;
+        float coneAngle = 180.0f;
+        float innerConeAngle = 0.0f;
+        if (isSpot) {
+            const float innerConeDegrees = qMin(light->m_innerConeAngle, light->m_coneAngle);
+            coneAngle = qCos(qDegreesToRadians(light->m_coneAngle));
+            innerConeAngle = qCos(qDegreesToRadians(innerConeDegrees));
+        }
+        texel[0] = QVector4D(light->getGlobalPos(), isSpot ? 1.0f : 0.0f);
+        texel[1] = QVector4D(shaderLight.direction, coneAngle);
+        texel[2] = QVector4D(light->m_diffuseColor * light->m_brightness, innerConeAngle);
+        texel[3] = QVector4D(light->m_specularColor * light->m_brightness, 1.0f);
+        texel[4] = QVector4D(aux::translateConstantAttenuation(light->m_constantFade),
+                             aux::translateLinearAttenuation(light->m_linearFade),
+                             aux::translateQuadraticAttenuation(light->m_quadraticFade),
+                             0.0f);
+    }
+
+    // Indices, four per texel, in light order within each cell
+    float *indices = reinterpret_cast<float *>(m_texels.data() + indexBase);
+    for (const QVector<quint32> &pairs : qAsConst(m_taskPairs)) {
+        for (quint32 pair : pairs)
+            indices[m_cellCounts[pair >> 16]++] = float(pair & 0xffff);
+    }
+}
+
+void QSSGLightClusters::clear()
+{
+    m_lightCount = 0;
+    m_indexCount = 0;
+    m_ambientTotal = QVector3D();
+}
+
+void QSSGLightClusters::prepareTexture(QSSGRhiContext *rhiCtx)
+{
+    if (isEmpty())
+        return;
+
+    const int rows = int(m_texels.size() / TextureWidth);
+    Q_ASSERT(rows > 0 && rows <= MaxTextureHeight);
+    if (!m_texture || m_texture->pixelSize().height() < rows) {
+        // Grow in steps, so that changing light counts do not recreate the
+        // texture every frame
+        const QSize size(TextureWidth, qMin(int(MaxTextureHeight), int(qNextPowerOfTwo(quint32(rows)))));
+        if (!m_texture) {
+            m_texture = rhiCtx->rhi()->newTexture(QRhiTexture::RGBA32F, size);
+            m_texture->create();
+        } else {
+            m_texture->setPixelSize(size);
+            m_texture->create();
+        }
+        m_uploadedTexels.clear();
+    }
+
+    // Static lights and a still camera give the same texels every frame
+    if (m_uploadedTexels.size() == m_texels.size()
+            && std::memcmp(m_uploadedTexels.constData(), m_texels.constData(), m_texels.size() * sizeof(QVector4D)) == 0)
+        return;
+
+    QRhiResourceUpdateBatch *rub = rhiCtx->rhi()->nextResourceUpdateBatch();
+    QRhiTextureSubresourceUploadDescription upload;
+    upload.setData(QByteArray(reinterpret_cast<const char *>(m_texels.constData()),
+                              qsizetype(m_texels.size() * sizeof(QVector4D))));
+    upload.setSourceSize(QSize(TextureWidth, rows));
+    QRhiTextureUploadDescription uploadDesc(QRhiTextureUploadEntry(0, 0, upload));
+    rub->uploadTexture(m_texture, uploadDesc);
+    rhiCtx->commandBuffer()->resourceUpdate(rub);
+    m_uploadedTexels = m_texels;
+}
+
+void QSSGLightClusters::releaseResources()
+{
+    delete m_texture;
+    m_texture = nullptr;
+    m_uploadedTexels.clear();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,150 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGLIGHTCLUSTERS_P_H
+#define QSSGLIGHTCLUSTERS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderableobjects_p.h>
+
+#include <QtCore/QVector>
+#include <QtGui/QMatrix4x4>
+#include <QtGui/QVector4D>
+
+QT_BEGIN_NAMESPACE
+
+class QThreadPool;
+class QRhiTexture;
+class QSSGRhiContext;
+struct QSSGRenderCamera;
+
+// Assigns point and spot lights to the cells of a view frustum aligned grid
+// (16x9 tiles, 24 exponential depth slices), so that the fragment shader only
+// has to evaluate the lights whose range reaches its cell, instead of all of
+// them. Everything the shader needs goes into one RGBA32F texture, addressed
+// by texel index in rows of TextureWidth texels:
+//
+//  [0, ClusterCount)        per cell: offset of its first light index, light count
+//  [lightBase, indexBase)   TexelsPerLight texels per light, see lightTexel()
+//  [indexBase, ...)         the light indices of all the cells, four per texel
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLightClusters
+{
+public:
+    static constexpr int GridWidth = 16;
+    static constexpr int GridHeight = 9;
+    static constexpr int GridDepth = 24;
+    static constexpr int ClusterCount = GridWidth * GridHeight * GridDepth;
+    static constexpr int MaxLights = 1024;
+    static constexpr int TexelsPerLight = 5;
+    static constexpr int TextureWidth = 1024;
+    // Limits the texture to 16 MB
+    static constexpr int MaxTextureHeight = 1024;
+
+    QSSGLightClusters() = default;
+    ~QSSGLightClusters();
+    Q_DISABLE_COPY(QSSGLightClusters)
+
+    // Bins the lights for camera. The lights are expected to be point and
+    // spot lights, with at most MaxLights of them. Large light counts are
+    // binned on threadPool, when given.
+    void update(const QSSGShaderLightList &lights, const QSSGRenderCamera &camera, QThreadPool *threadPool = nullptr);
+    void clear();
+
+    // Uploads the data of the last update(), on the render thread
+    void prepareTexture(QSSGRhiContext *rhiCtx);
+    void releaseResources();
+
+    bool isEmpty() const { return m_lightCount == 0; }
+    int lightCount() const { return m_lightCount; }
+    int indexCount() const { return m_indexCount; }
+    QRhiTexture *texture() const { return m_texture; }
+
+    // projection * view, without the clip space correction
+    const QMatrix4x4 &viewProjection() const { return m_viewProjection; }
+    // dot(viewDepth, vec4(worldPos, 1.0)) is the distance from the camera plane
+    const QVector4D &viewDepth() const { return m_viewDepth; }
+    // The depth slice is log(depth) * x + y with a perspective projection
+    // (z = 1) and depth * x + y otherwise
+    const QVector4D &depthParams() const { return m_depthParams; }
+    // lightBase, indexBase, TextureWidth
+    const QVector4D &offsets() const { return m_offsets; }
+    const QVector3D &ambientTotal() const { return m_ambientTotal; }
+    // What prepareTexture() uploads, TextureWidth texels per row
+    const QVector<QVector4D> &texels() const { return m_texels; }
+
+    // The distance at which the contribution of the light falls below 1/256,
+    // or infinity for lights without falloff
+    static float lightRange(const QSSGRenderLight &light);
+    // Appends (cell << 16 | lightIndex) for the cells of the slices
+    // [firstSlice, lastSlice) that are within range of the light
+    void binLight(int lightIndex, int firstSlice, int lastSlice, QVector<quint32> *pairs) const;
+
+private:
+    struct BinnedLight
+    {
+        QVector3D viewPos;
+        float range;
+    };
+
+    int sliceForDepth(float depth) const;
+    float depthForSlice(int slice) const;
+
+    QVector<BinnedLight> m_binnedLights;
+    QVector<QVector<quint32>> m_taskPairs;
+    QVector<quint32> m_cellCounts;
+    QVector<QVector4D> m_texels;
+    QVector<QVector4D> m_uploadedTexels;
+    QMatrix4x4 m_projection;
+    QMatrix4x4 m_viewProjection;
+    QVector4D m_viewDepth;
+    QVector4D m_depthParams;
+    QVector4D m_offsets;
+    QVector3D m_ambientTotal;
+    float m_clipNear = 0.0f;
+    float m_clipFar = 0.0f;
+    bool m_perspective = true;
+    int m_lightCount = 0;
+    int m_indexCount = 0;
+    QRhiTexture *m_texture = nullptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSSGLIGHTCLUSTERS_P_H
@@ -62,6 +62,7 @@ QSSGSubsetRenderable::QSSGSubsetRenderable(QSSGRenderableObjectFlags inFlags,
     , generator(gen)
     , modelContext(inModelContext)
     , subset(inSubset)
+    , instanceTable(inModelContext.model.instanceTable)
     , opacity(inOpacity)
     , material(mat)
     , firstImage(inFirstImage)
@@ -78,6 +79,12 @@ QSSGSubsetRenderable::QSSGSubsetRenderable(QSSGRenderableObjectFlags inFlags,
         renderableFlags.setDefaultMaterialMeshSubset(true);
         depthWriteMode = static_cast<const QSSGRenderDefaultMaterial *>(&mat)->depthDrawMode;
     }
+    updateStateSortKey();
+}
+
+void QSSGSubsetRenderable::updateStateSortKey()
+{
+    stateSortKey = (quint32(shaderDescription.hash()) & 0xffff0000u) | (quint32(qHash(&material)) & 0x0000ffffu);
 }
 
 QSSGParticlesRenderable::QSSGParticlesRenderable(QSSGRenderableObjectFlags inFlags,
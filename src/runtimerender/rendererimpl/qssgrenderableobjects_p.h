@@ -249,6 +249,9 @@ struct QSSGRenderableObject
     QVector3D worldCenterPoint;
     float depthBias;
     QSSGDepthDrawMode depthWriteMode = QSSGDepthDrawMode::OpaqueOnly;
+    // Identifies the shader and the material, so that sorting can group
+    // renderables at the same distance by state
+    quint32 stateSortKey = 0;
 
     QSSGRenderableObject(QSSGRenderableObjectFlags inFlags,
                          const QVector3D &inWorldCenterPt,
@@ -308,6 +311,13 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGSubsetRenderable : public QSSGRenderabl
     const QSSGRef<QSSGRenderer> &generator;
     const QSSGModelContext &modelContext;
     QSSGRenderSubset &subset;
+    // The instances to draw: the ones of the model, or the models batched
+    // into this renderable by auto-instancing, whose instance transforms are
+    // global transforms already
+    QSSGRenderInstanceTable *instanceTable = nullptr;
+    bool autoInstanced = false;
+    // World space bounds of all the models batched by auto-instancing
+    QSSGBounds3 autoInstanceBounds;
     QRhiBuffer *instanceBuffer = nullptr;
     float opacity;
     const QSSGRenderGraphObject &material;
@@ -325,18 +335,22 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGSubsetRenderable : public QSSGRenderabl
         struct {
             QRhiGraphicsPipeline *pipeline = nullptr;
             QRhiShaderResourceBindings *srb = nullptr;
+            QSSGRhiDynamicUniformOffsets ubufOffsets;
         } mainPass;
         struct {
             QRhiGraphicsPipeline *pipeline = nullptr;
             QRhiShaderResourceBindings *srb = nullptr;
+            QSSGRhiDynamicUniformOffsets ubufOffsets;
         } depthPrePass;
         struct {
             QRhiGraphicsPipeline *pipeline = nullptr;
             QRhiShaderResourceBindings *srb[6] = {};
+            QSSGRhiDynamicUniformOffsets ubufOffsets[6];
         } shadowPass;
         struct {
             QRhiGraphicsPipeline *pipeline = nullptr;
             QRhiShaderResourceBindings *srb[6] = {};
+            QSSGRhiDynamicUniformOffsets ubufOffsets[6];
         } reflectionPass;
     } rhiRenderData;
 
@@ -364,7 +378,11 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGSubsetRenderable : public QSSGRenderabl
         Q_ASSERT(renderableFlags.isCustomMaterialMeshSubset());
         return static_cast<const QSSGRenderCustomMaterial &>(material);
     }
+    bool instancing() const { return instanceTable; }
+    int instanceCount() const { return instanceTable ? instanceTable->count() : 0; }
     bool prepareInstancing(QSSGRhiContext *rhiCtx, const QVector3D &cameraDirection);
+    // To be called whenever shaderDescription changes after construction
+    void updateStateSortKey();
 };
 
 Q_STATIC_ASSERT(std::is_trivially_destructible<QSSGSubsetRenderable>::value);
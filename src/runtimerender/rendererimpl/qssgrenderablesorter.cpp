@@ -0,0 +1,181 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qssgrenderablesorter_p.h"
+#include "qssgrendertasks_p.h"
+
+#include <QtCore/QThreadPool>
+#include <QtCore/QVarLengthArray>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+constexpr int RadixBits = 8;
+constexpr int BucketCount = 1 << RadixBits;
+constexpr int PassCount = 64 / RadixBits;
+
+// Splitting the sort is only worth it with at least this many entries per task
+constexpr qsizetype QSSG_MIN_ENTRIES_PER_SORT_TASK = 16384;
+
+inline quint32 digit(quint64 key, int pass)
+{
+    return quint32(key >> (pass * RadixBits)) & (BucketCount - 1);
+}
+
+} // namespace
+
+void QSSGRenderableSorter::radixSort(Entry *entries, Entry *scratch, qsizetype count, QThreadPool *threadPool)
+{
+    if (count < 2)
+        return;
+
+    int taskCount = 1;
+    if (threadPool)
+        taskCount = int(qBound<qsizetype>(1, count / QSSG_MIN_ENTRIES_PER_SORT_TASK, threadPool->maxThreadCount() + 1));
+    const auto taskBegin = [count, taskCount](int task) { return count * task / taskCount; };
+
+    // Passes over digits that are the same in all the keys would not move
+    // anything, find the bits that vary to skip them. Typically the high
+    // bits of the distance do not.
+    QVarLengthArray<quint64, 16> taskVaryingBits(taskCount);
+    QSSGRenderTasks::run(threadPool, taskCount, [&](int task) {
+        const quint64 firstKey = entries[0].key;
+        quint64 varyingBits = 0;
+        for (qsizetype i = taskBegin(task), end = taskBegin(task + 1); i < end; ++i)
+            varyingBits |= entries[i].key ^ firstKey;
+        taskVaryingBits[task] = varyingBits;
+    });
+    quint64 varyingBits = 0;
+    for (quint64 bits : qAsConst(taskVaryingBits))
+        varyingBits |= bits;
+
+    // Each task counts the digits in its range, then scatters its range to
+    // the slots after the ones of the previous tasks in each bucket. That
+    // keeps the sort stable, which LSD radix sorting depends on.
+    QVarLengthArray<quint32, BucketCount> offsets(taskCount * BucketCount);
+    Entry *src = entries;
+    Entry *dst = scratch;
+    for (int pass = 0; pass < PassCount; ++pass) {
+        if (digit(varyingBits, pass) == 0)
+            continue;
+
+        QSSGRenderTasks::run(threadPool, taskCount, [&](int task) {
+            quint32 *taskCounts = offsets.data() + task * BucketCount;
+            std::fill_n(taskCounts, BucketCount, 0);
+            for (qsizetype i = taskBegin(task), end = taskBegin(task + 1); i < end; ++i)
+                ++taskCounts[digit(src[i].key, pass)];
+        });
+
+        quint32 offset = 0;
+        for (int bucket = 0; bucket < BucketCount; ++bucket) {
+            for (int task = 0; task < taskCount; ++task) {
+                quint32 &slot = offsets[task * BucketCount + bucket];
+                const quint32 bucketCount = slot;
+                slot = offset;
+                offset += bucketCount;
+            }
+        }
+
+        QSSGRenderTasks::run(threadPool, taskCount, [&](int task) {
+            quint32 *taskOffsets = offsets.data() + task * BucketCount;
+            for (qsizetype i = taskBegin(task), end = taskBegin(task + 1); i < end; ++i) {
+                const Entry &entry = src[i];
+                dst[taskOffsets[digit(entry.key, pass)]++] = entry;
+            }
+        });
+
+        std::swap(src, dst);
+    }
+
+    if (src != entries)
+        std::copy(src, src + count, entries);
+}
+
+bool QSSGRenderableSorter::insertionSort(Entry *entries, qsizetype count, qsizetype maxMoves)
+{
+    qsizetype moves = 0;
+    for (qsizetype i = 1; i < count; ++i) {
+        if (entries[i].key >= entries[i - 1].key)
+            continue;
+        const Entry entry = entries[i];
+        qsizetype j = i;
+        do {
+            entries[j] = entries[j - 1];
+            --j;
+            ++moves;
+        } while (j > 0 && entries[j - 1].key > entry.key);
+        entries[j] = entry;
+        if (moves > maxMoves)
+            return false;
+    }
+    return true;
+}
+
+void QSSGRenderableSorter::sort(QVector<QSSGRenderableObjectHandle> &objects, Order order, QThreadPool *threadPool)
+{
+    const qsizetype count = objects.size();
+    m_entries.resize(count);
+    Entry *entries = m_entries.data();
+
+    bool sorted = false;
+    if (m_lastOrder.size() == count) {
+        // Most likely the same renderables as last time, in the same order.
+        // Starting from where they ended up then, an insertion sort with a
+        // bounded number of moves beats the radix sort's passes.
+        for (qsizetype i = 0; i < count; ++i) {
+            const quint32 index = m_lastOrder.at(i);
+            const QSSGRenderableObjectHandle &theHandle(objects.at(index));
+            entries[i] = { sortKey(theHandle.cameraDistanceSq, theHandle.obj->stateSortKey, order), index };
+        }
+        sorted = insertionSort(entries, count, count);
+    } else {
+        for (qsizetype i = 0; i < count; ++i) {
+            const QSSGRenderableObjectHandle &theHandle(objects.at(i));
+            entries[i] = { sortKey(theHandle.cameraDistanceSq, theHandle.obj->stateSortKey, order), quint32(i) };
+        }
+    }
+
+    if (!sorted) {
+        m_scratch.resize(count);
+        radixSort(entries, m_scratch.data(), count, threadPool);
+    }
+
+    m_sorted.resize(count);
+    m_lastOrder.resize(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        m_sorted[i] = objects.at(entries[i].index);
+        m_lastOrder[i] = entries[i].index;
+    }
+    objects.swap(m_sorted);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGRENDERABLESORTER_P_H
+#define QSSGRENDERABLESORTER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderableobjects_p.h>
+
+#include <QtCore/QVector>
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+class QThreadPool;
+
+// Sorts renderables by 64-bit keys with an LSD radix sort. By default the
+// camera distance goes into the high 32 bits, the state sort key of the
+// renderable into the low ones, so renderables at the same distance end up
+// grouped by shader and material. StateFrontToBack swaps the two, for as few
+// state changes as possible.
+class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderableSorter
+{
+public:
+    enum class Order {
+        FrontToBack,
+        BackToFront,
+        StateFrontToBack
+    };
+
+    struct Entry
+    {
+        quint64 key;
+        quint32 index;
+    };
+
+    // Maps a float to an unsigned integer with the same order
+    static quint32 depthBits(float depth)
+    {
+        quint32 bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits ^ ((bits & 0x80000000u) ? 0xffffffffu : 0x80000000u);
+    }
+
+    static quint64 sortKey(float cameraDistanceSq, quint32 stateSortKey, Order order)
+    {
+        switch (order) {
+        case Order::FrontToBack:
+            return (quint64(depthBits(cameraDistanceSq)) << 32) | stateSortKey;
+        case Order::BackToFront:
+            return (quint64(~depthBits(cameraDistanceSq)) << 32) | stateSortKey;
+        case Order::StateFrontToBack:
+            break;
+        }
+        return (quint64(stateSortKey) << 32) | depthBits(cameraDistanceSq);
+    }
+
+    // Sorts by cameraDistanceSq and stateSortKey. Starts from the order of
+    // the previous call when the list has the same size, which typically
+    // needs only a few moves when the scene and the camera barely changed.
+    // Large lists are sorted on threadPool, when given.
+    void sort(QVector<QSSGRenderableObjectHandle> &objects, Order order, QThreadPool *threadPool = nullptr);
+
+    // Stable, ascending by key. scratch must have room for count entries.
+    static void radixSort(Entry *entries, Entry *scratch, qsizetype count, QThreadPool *threadPool = nullptr);
+    // Gives up, leaving the entries partially sorted, after maxMoves moves
+    static bool insertionSort(Entry *entries, qsizetype count, qsizetype maxMoves);
+
+private:
+    QVector<Entry> m_entries;
+    QVector<Entry> m_scratch;
+    QVector<QSSGRenderableObjectHandle> m_sorted;
+    QVector<quint32> m_lastOrder;
+};
+
+Q_DECLARE_TYPEINFO(QSSGRenderableSorter::Entry, Q_PRIMITIVE_TYPE);
+
+QT_END_NAMESPACE
+
+#endif // QSSGRENDERABLESORTER_P_H
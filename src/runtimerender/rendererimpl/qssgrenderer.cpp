@@ -42,15 +42,18 @@
 #include <QtQuick3DRuntimeRender/private/qssgperframeallocator_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrhiquadrenderer_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendertexturedata_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingbvh_p.h>
 
 #include <QtQuick3DUtils/private/qssgdataref_p.h>
 #include <QtQuick3DUtils/private/qssgutils_p.h>
 
-#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 
 #include <cstdlib>
 #include <algorithm>
 #include <limits>
+#include <numeric>
 
 QT_BEGIN_NAMESPACE
 
@@ -61,9 +64,19 @@ void QSSGRenderer::releaseResources()
 {
     delete m_rhiQuadRenderer;
     m_rhiQuadRenderer = nullptr;
+
+    delete m_prepareThreadPool;
+    m_prepareThreadPool = nullptr;
 }
 
-QSSGRenderer::QSSGRenderer() = default;
+QSSGRenderer::QSSGRenderer()
+{
+    bool ok = false;
+    const int threadCount = qEnvironmentVariableIntValue("QT_QUICK3D_PREPARE_THREADS", &ok);
+    setPrepareThreadCount(ok ? threadCount : QThread::idealThreadCount());
+    setRetainedRenderables(qEnvironmentVariableIntValue("QT_QUICK3D_RETAINED_RENDERABLES") != 0);
+    setAutoInstancing(qEnvironmentVariableIntValue("QT_QUICK3D_AUTO_INSTANCING") != 0);
+}
 
 QSSGRenderer::~QSSGRenderer()
 {
@@ -76,6 +89,24 @@ void QSSGRenderer::setRenderContextInterface(QSSGRenderContextInterface *ctx)
     m_contextInterface = ctx;
 }
 
+void QSSGRenderer::setPrepareThreadCount(int count)
+{
+    m_prepareThreadCount = qMax(1, count);
+    if (m_prepareThreadPool)
+        m_prepareThreadPool->setMaxThreadCount(qMax(1, m_prepareThreadCount - 1));
+}
+
+QThreadPool *QSSGRenderer::prepareThreadPool()
+{
+    // Not the global pool, the render thread waits for all the tasks in this
+    // one to finish and must not end up waiting for, e.g., BVH builds.
+    if (!m_prepareThreadPool) {
+        m_prepareThreadPool = new QThreadPool;
+        m_prepareThreadPool->setMaxThreadCount(qMax(1, m_prepareThreadCount - 1));
+    }
+    return m_prepareThreadPool;
+}
+
 bool QSSGRenderer::prepareLayerForRender(QSSGRenderLayer &inLayer)
 {
     QSSGLayerRenderData *theRenderData = getOrCreateLayerRenderData(inLayer);
@@ -126,6 +157,8 @@ void QSSGRenderer::cleanupResources(QList<QSSGRenderGraphObject *> &resources)
         delete resource;
     }
     resources.clear();
+    // Stop picking from finding released geometry by address
+    bufferManager->publishPickingSnapshot();
 }
 
 QSSGLayerRenderData *QSSGRenderer::getOrCreateLayerRenderData(QSSGRenderLayer &layer)
@@ -305,7 +338,9 @@ void QSSGRenderer::endLayerRender()
 
 bool QSSGRenderer::rendererRequestsFrames() const
 {
-    return m_progressiveAARenderRequest;
+    // Keep rendering until the shaders compiling in the background get used
+    const bool shadersPending = m_contextInterface && m_contextInterface->shaderCache()->pendingCompilationCount() > 0;
+    return m_progressiveAARenderRequest || shadersPending;
 }
 
 using RenderableList = QVarLengthArray<const QSSGRenderNode *>;
@@ -324,6 +359,16 @@ void QSSGRenderer::getLayerHitObjectList(const QSSGRenderLayer &layer,
                                          bool inPickEverything,
                                          PickResultList &outIntersectionResult)
 {
+    // Only visit the nodes whose world bounds are hit when the picking tree is up to date
+    QSSGRenderPickingBVH::NodeList candidates;
+    if (layer.pickingBVH && layer.pickingBVH->findCandidates(ray, inPickEverything, candidates)) {
+        for (const QSSGRenderNode *pickableObject : qAsConst(candidates)) {
+            if (inPickEverything || pickableObject->flags.testFlag(QSSGRenderNode::Flag::LocallyPickable))
+                intersectRayWithSubsetRenderable(bufferManager, ray, *pickableObject, outIntersectionResult);
+        }
+        return;
+    }
+
     RenderableList renderables;
     for (const auto &childNode : layer.children)
         dfs(childNode, renderables);
@@ -335,6 +380,49 @@ void QSSGRenderer::getLayerHitObjectList(const QSSGRenderLayer &layer,
     }
 }
 
+QVector<QSSGRenderPickResult> QSSGRenderer::syncPickMany(const QSSGRenderLayer &layer,
+                                                         const QSSGRef<QSSGBufferManager> &bufferManager,
+                                                         const QVector<QSSGRenderRay> &rays)
+{
+    QVector<QSSGRenderPickResult> pickResults(rays.size());
+    if (rays.isEmpty() || !layer.flags.testFlag(QSSGRenderLayer::Flag::Active))
+        return pickResults;
+
+    // The nodes are visited in the same order as when picking with one ray,
+    // and a hit only replaces a strictly closer one, so that every ray gets
+    // the result syncPick() would return for it.
+    QSSGRenderPickingBVH::BatchCandidates candidates;
+    if (layer.pickingBVH && layer.pickingBVH->findCandidates(rays, m_globalPickingEnabled, candidates)) {
+        for (int i = 0, end = candidates.nodes.size(); i < end; ++i) {
+            const QSSGRenderNode *pickableObject = candidates.nodes.at(i);
+            if (!m_globalPickingEnabled && !pickableObject->flags.testFlag(QSSGRenderNode::Flag::LocallyPickable))
+                continue;
+            const int offset = candidates.rayOffsets.at(i);
+            intersectRaysWithSubsetRenderable(bufferManager,
+                                              rays.constData(),
+                                              candidates.rays.constData() + offset,
+                                              candidates.rayOffsets.at(i + 1) - offset,
+                                              *pickableObject,
+                                              pickResults.data());
+        }
+        return pickResults;
+    }
+
+    RenderableList renderables;
+    for (const auto &childNode : layer.children)
+        dfs(childNode, renderables);
+
+    QVector<int> allRays(rays.size());
+    std::iota(allRays.begin(), allRays.end(), 0);
+    for (int idx = renderables.size() - 1; idx >= 0; --idx) {
+        const auto &pickableObject = renderables.at(idx);
+        if (m_globalPickingEnabled || pickableObject->flags.testFlag(QSSGRenderNode::Flag::LocallyPickable))
+            intersectRaysWithSubsetRenderable(bufferManager, rays.constData(), allRays.constData(), allRays.size(), *pickableObject, pickResults.data());
+    }
+
+    return pickResults;
+}
+
 void QSSGRenderer::intersectRayWithSubsetRenderable(const QSSGRef<QSSGBufferManager> &bufferManager,
                                                     const QSSGRenderRay &inRay,
                                                     const QSSGRenderNode &node,
@@ -352,46 +440,166 @@ void QSSGRenderer::intersectRayWithSubsetRenderable(const QSSGRef<QSSGBufferMana
 
     const QSSGRenderModel &model = static_cast<const QSSGRenderModel &>(node);
 
-    // We have to have a guard here, as the meshes are usually loaded on the render thread,
-    // and we assume all meshes are loaded before picking and none are removed, which
-    // is usually true, except for custom geometry which can be updated at any time. So this
-    // guard should really only be locked whenever a custom geometry buffer is being updated
-    // on the render thread.  Still naughty though because this can block the render thread.
-    QMutexLocker mutexLocker(bufferManager->meshUpdateMutex());
-    auto mesh = bufferManager->getMeshForPicking(model);
+    // The meshes are loaded, updated and released on the render thread while
+    // picking may be going on. Picking only sees the snapshot of the picking
+    // data that was current when it started, which stays valid until the
+    // reader lock is gone, so neither side ever waits for the other.
+    QSSGRenderPickingSnapshots::ReadLocker snapshot(bufferManager->pickingSnapshots());
+    const QSSGRenderMeshPickingData *mesh = snapshot->meshForModel(model);
     if (!mesh)
         return;
 
-    const auto &globalTransform = model.globalTransform;
-    auto rayData = QSSGRenderRay::createRayData(globalTransform, inRay);
-    const auto &subMeshes = mesh->subsets;
-    QSSGBounds3 modelBounds;
-    for (const auto &subMesh : subMeshes)
-        modelBounds.include(subMesh.bounds);
-
+    const QSSGBounds3 modelBounds = mesh->bounds();
     if (modelBounds.isEmpty())
         return;
 
-    auto hit = QSSGRenderRay::intersectWithAABBv2(rayData, modelBounds);
+    QSSGRenderRay::IntersectionResult intersectionResult;
+    int resultSubset = 0;
+    int resultInstance = -1;
+    if (model.instancing()) {
+        // Only test the instances whose bounds are hit, each with the
+        // transform it is rendered with.
+        QSSGRenderInstancePickingBVH *instanceBVH = model.instancePickingBVH.loadAcquire();
+        if (!instanceBVH) {
+            QSSGRenderInstancePickingBVH *created = new QSSGRenderInstancePickingBVH;
+            if (model.instancePickingBVH.testAndSetOrdered(nullptr, created, instanceBVH))
+                instanceBVH = created;
+            else
+                delete created;
+        }
+        QSSGRenderInstancePickingBVH::InstanceList instances;
+        instanceBVH->findCandidates(model, modelBounds, inRay, instances);
+        for (int instance : qAsConst(instances)) {
+            int subset = 0;
+            const auto rayData = QSSGRenderRay::createRayData(model.instanceGlobalTransform(instance), inRay);
+            const auto result = intersectRayWithMesh(*mesh, rayData, subset);
+            if (result.intersects && (!intersectionResult.intersects || result.rayLengthSquared < intersectionResult.rayLengthSquared)) {
+                intersectionResult = result;
+                resultSubset = subset;
+                resultInstance = instance;
+            }
+        }
+    } else {
+        auto rayData = QSSGRenderRay::createRayData(model.globalTransform, inRay);
+        // If we don't intersect with the model at all, then there's no need to go furher down!
+        if (!QSSGRenderRay::intersectWithAABBv2(rayData, modelBounds).intersects())
+            return;
+        intersectionResult = intersectRayWithMesh(*mesh, rayData, resultSubset);
+    }
 
-    // If we don't intersect with the model at all, then there's no need to go furher down!
-    if (!hit.intersects())
+    if (!intersectionResult.intersects)
         return;
 
+    QSSGRenderPickResult pickResult { &model,
+                                      intersectionResult.rayLengthSquared,
+                                      intersectionResult.relXY,
+                                      intersectionResult.scenePosition,
+                                      intersectionResult.localPosition,
+                                      intersectionResult.faceNormal,
+                                      resultSubset };
+    pickResult.m_instanceIndex = resultInstance;
+    outIntersectionResultList.push_back(pickResult);
+}
+
+void QSSGRenderer::intersectRaysWithSubsetRenderable(const QSSGRef<QSSGBufferManager> &bufferManager,
+                                                     const QSSGRenderRay *rays,
+                                                     const int *rayIndices,
+                                                     int rayIndexCount,
+                                                     const QSSGRenderNode &node,
+                                                     QSSGRenderPickResult *results)
+{
+    const auto keepClosest = [results](int rayIndex, const QSSGRenderPickResult &result) {
+        QSSGRenderPickResult &closest = results[rayIndex];
+        if (!closest.m_hitObject || result.m_distanceSq < closest.m_distanceSq)
+            closest = result;
+    };
+
+    // Only the meshes of models without instancing are traversed with packets
+    const bool isModel = node.type == QSSGRenderGraphObject::Type::Model;
+    if (!isModel || static_cast<const QSSGRenderModel &>(node).instancing()) {
+        PickResultList pickResults;
+        for (int i = 0; i < rayIndexCount; ++i) {
+            pickResults.clear();
+            intersectRayWithSubsetRenderable(bufferManager, rays[rayIndices[i]], node, pickResults);
+            for (const auto &pickResult : qAsConst(pickResults))
+                keepClosest(rayIndices[i], pickResult);
+        }
+        return;
+    }
+
+    const QSSGRenderModel &model = static_cast<const QSSGRenderModel &>(node);
+
+    // See intersectRayWithSubsetRenderable()
+    QSSGRenderPickingSnapshots::ReadLocker snapshot(bufferManager->pickingSnapshots());
+    const QSSGRenderMeshPickingData *mesh = snapshot->meshForModel(model);
+    if (!mesh)
+        return;
+
+    constexpr int PacketSize = QSSGRenderRay::RayPacket::Size;
+    for (int first = 0; first < rayIndexCount; first += PacketSize) {
+        const int count = qMin(PacketSize, rayIndexCount - first);
+        const QSSGRenderRay *packetRays[PacketSize];
+        for (int lane = 0; lane != count; ++lane)
+            packetRays[lane] = &rays[rayIndices[first + lane]];
+        const auto packet = QSSGRenderRay::createRayPacket(model.globalTransform, packetRays, count);
+
+        QSSGRenderRay::IntersectionResult closest[PacketSize];
+        int closestSubset[PacketSize] = {};
+        int subset = 0;
+        for (const auto &subMesh : mesh->subsets) {
+            QSSGRenderRay::IntersectionResult subsetResults[PacketSize];
+            if (mesh->bvh && subMesh.bvhRoot >= 0) {
+                QSSGRenderRay::intersectWithBVH(packet, *mesh->bvh, subMesh.bvhRoot, subsetResults);
+            } else {
+                for (int lane = 0; lane != count; ++lane) {
+                    const auto rayData = QSSGRenderRay::createRayData(model.globalTransform, *packetRays[lane]);
+                    const auto hit = QSSGRenderRay::intersectWithAABBv2(rayData, subMesh.bounds);
+                    if (hit.intersects())
+                        subsetResults[lane] = QSSGRenderRay::createIntersectionResult(rayData, hit);
+                }
+            }
+            for (int lane = 0; lane != count; ++lane) {
+                const auto &result = subsetResults[lane];
+                if (result.intersects && (!closest[lane].intersects || result.rayLengthSquared < closest[lane].rayLengthSquared)) {
+                    closest[lane] = result;
+                    closestSubset[lane] = subset;
+                }
+            }
+            ++subset;
+        }
+
+        for (int lane = 0; lane != count; ++lane) {
+            const auto &result = closest[lane];
+            if (!result.intersects)
+                continue;
+            keepClosest(rayIndices[first + lane], QSSGRenderPickResult { &model,
+                                                                         result.rayLengthSquared,
+                                                                         result.relXY,
+                                                                         result.scenePosition,
+                                                                         result.localPosition,
+                                                                         result.faceNormal,
+                                                                         closestSubset[lane] });
+        }
+    }
+}
+
+QSSGRenderRay::IntersectionResult QSSGRenderer::intersectRayWithMesh(const QSSGRenderMeshPickingData &mesh,
+                                                                     const QSSGRenderRay::RayData &rayData,
+                                                                     int &outSubset)
+{
     // Check each submesh to find the closest intersection point
     float minRayLength = std::numeric_limits<float>::max();
     QSSGRenderRay::IntersectionResult intersectionResult;
     QVector<QSSGRenderRay::IntersectionResult> results;
 
     int subset = 0;
-    int resultSubset = 0;
-    for (const auto &subMesh : subMeshes) {
+    for (const auto &subMesh : mesh.subsets) {
         QSSGRenderRay::IntersectionResult result;
-        if (subMesh.bvhRoot) {
-            hit = QSSGRenderRay::intersectWithAABBv2(rayData, subMesh.bvhRoot->boundingData);
+        if (mesh.bvh && subMesh.bvhRoot >= 0) {
+            auto hit = QSSGRenderRay::intersectWithAABBv2(rayData, mesh.bvh->nodes.at(subMesh.bvhRoot).boundingData);
             if (hit.intersects()) {
                 results.clear();
-                inRay.intersectWithBVH(rayData, subMesh.bvhRoot, mesh, results);
+                QSSGRenderRay::intersectWithBVH(rayData, *mesh.bvh, subMesh.bvhRoot, results);
                 float subMeshMinRayLength = std::numeric_limits<float>::max();
                 for (const auto &subMeshResult : qAsConst(results)) {
                     if (subMeshResult.rayLengthSquared < subMeshMinRayLength) {
@@ -401,28 +609,19 @@ void QSSGRenderer::intersectRayWithSubsetRenderable(const QSSGRef<QSSGBufferMana
                 }
             }
         } else {
-            hit = QSSGRenderRay::intersectWithAABBv2(rayData, subMesh.bounds);
+            auto hit = QSSGRenderRay::intersectWithAABBv2(rayData, subMesh.bounds);
             if (hit.intersects())
                 result = QSSGRenderRay::createIntersectionResult(rayData, hit);
         }
         if (result.intersects && result.rayLengthSquared < minRayLength) {
             intersectionResult = result;
             minRayLength = intersectionResult.rayLengthSquared;
-            resultSubset = subset;
+            outSubset = subset;
         }
         subset++;
     }
 
-    if (!intersectionResult.intersects)
-        return;
-
-    outIntersectionResultList.push_back(QSSGRenderPickResult { &model,
-                                                               intersectionResult.rayLengthSquared,
-                                                               intersectionResult.relXY,
-                                                               intersectionResult.scenePosition,
-                                                               intersectionResult.localPosition,
-                                                               intersectionResult.faceNormal,
-                                                               resultSubset });
+    return intersectionResult;
 }
 
 void QSSGRenderer::intersectRayWithItem2D(const QSSGRenderRay &inRay, const QSSGRenderItem2D &item2D, QSSGRenderer::PickResultList &outIntersectionResultList)
@@ -522,6 +721,7 @@ QSSGLayerGlobalRenderProperties QSSGRenderer::getLayerGlobalRenderProperties()
                                               theData.m_rhiDepthTexture.texture,
                                               theData.m_rhiAoTexture.texture,
                                               theData.m_rhiScreenTexture.texture,
+                                              &theData.lightClusters,
                                               theLayer.lightProbe,
                                               theLayer.probeHorizon,
                                               theLayer.probeExposure,
@@ -67,6 +67,7 @@
 QT_BEGIN_NAMESPACE
 
 class QSSGRhiQuadRenderer;
+class QThreadPool;
 
 class Q_QUICK3DRUNTIMERENDER_EXPORT QSSGRenderer
 {
@@ -107,12 +108,38 @@ public:
                                   const QSSGRenderRay &ray,
                                   QSSGRenderNode *target = nullptr);
 
+    // Picks the closest hit of each ray, like syncPick. The results are in the
+    // order of the rays, with a null m_hitObject for the rays that hit nothing.
+    QVector<QSSGRenderPickResult> syncPickMany(const QSSGRenderLayer &layer,
+                                               const QSSGRef<QSSGBufferManager> &bufferManager,
+                                               const QVector<QSSGRenderRay> &rays);
+
     // Setting this true enables picking for all the models, regardless of
     // the models pickable property.
     void setGlobalPickingEnabled(bool isEnabled);
+    bool isGlobalPickingEnabled() const { return m_globalPickingEnabled; }
 
     QSSGRhiQuadRenderer *rhiQuadRenderer();
 
+    // Number of threads, the render thread included, preparing the renderables
+    // of layers that are large enough to be split up. Defaults to the ideal
+    // thread count, or QT_QUICK3D_PREPARE_THREADS when set.
+    void setPrepareThreadCount(int count);
+    int prepareThreadCount() const { return m_prepareThreadCount; }
+    QThreadPool *prepareThreadPool();
+
+    // Retained mode keeps the node and light lists of the layers between
+    // frames, collecting them again only after nodes were added or removed.
+    // Off by default, or QT_QUICK3D_RETAINED_RENDERABLES when set.
+    void setRetainedRenderables(bool enable) { m_retainedRenderables = enable; }
+    bool retainedRenderables() const { return m_retainedRenderables; }
+
+    // Auto-instancing draws the opaque subsets of models sharing the mesh,
+    // the material and the lights with a single instanced draw call.
+    // Off by default, or QT_QUICK3D_AUTO_INSTANCING when set.
+    void setAutoInstancing(bool enable) { m_autoInstancing = enable; }
+    bool autoInstancing() const { return m_autoInstancing; }
+
     // Callback during the layer render process.
     void beginLayerDepthPassRender(QSSGLayerRenderData &inLayer);
     void endLayerDepthPassRender();
@@ -161,6 +188,19 @@ protected:
                                                  const QSSGRenderRay &inRay,
                                                  const QSSGRenderNode &node,
                                                  PickResultList &outIntersectionResultList);
+    // Keeps the closest hit of the rays at rayIndices in results, which has an
+    // entry for each ray
+    static void intersectRaysWithSubsetRenderable(const QSSGRef<QSSGBufferManager> &bufferManager,
+                                                  const QSSGRenderRay *rays,
+                                                  const int *rayIndices,
+                                                  int rayIndexCount,
+                                                  const QSSGRenderNode &node,
+                                                  QSSGRenderPickResult *results);
+    // Returns the closest hit of the ray with the subsets of the mesh, placed
+    // in the scene with the transform the ray data was created for
+    static QSSGRenderRay::IntersectionResult intersectRayWithMesh(const QSSGRenderMeshPickingData &mesh,
+                                                                  const QSSGRenderRay::RayData &rayData,
+                                                                  int &outSubset);
     static void intersectRayWithItem2D(const QSSGRenderRay &inRay, const QSSGRenderItem2D &item2D, PickResultList &outIntersectionResultList);
 
 private:
@@ -208,6 +248,11 @@ private:
 
     QSSGRhiQuadRenderer *m_rhiQuadRenderer = nullptr;
 
+    int m_prepareThreadCount = 1;
+    QThreadPool *m_prepareThreadPool = nullptr;
+    bool m_retainedRenderables = false;
+    bool m_autoInstancing = false;
+
     QHash<QSSGShaderMapKey, QSSGRef<QSSGRhiShaderPipeline>> m_shaderMap;
 
     // Skybox shader state
@@ -35,6 +35,7 @@
 #include <QtQuick3DRuntimeRender/private/qssgrhicustommaterialsystem_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrhiquadrenderer_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrhiparticles_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendershadercache_p.h>
 #include <QtQuick/private/qsgtexture_p.h>
 #include <QtQuick/private/qsgrenderer_p.h>
 
@@ -81,12 +82,27 @@ void QSSGLayerRenderData::resetForFrame()
     QSSGLayerRenderPreparationData::resetForFrame();
 }
 
+// Without dcd, objects whose shaders are still being compiled in the
+// background are skipped. With it, they may be drawn with the shaders the
+// same draw call was last prepared with. There is no generic fallback
+// shader, so objects drawn for the first time are skipped either way.
+// compilationPending tells these apart from shaders that failed.
 static QSSGRef<QSSGRhiShaderPipeline> shadersForDefaultMaterial(QSSGRhiGraphicsPipelineState *ps,
                                                                 QSSGSubsetRenderable &subsetRenderable,
-                                                                const QSSGShaderFeatures &featureSet)
+                                                                const QSSGShaderFeatures &featureSet,
+                                                                QSSGRhiDrawCallData *dcd = nullptr,
+                                                                bool *compilationPending = nullptr)
 {
     const QSSGRef<QSSGRenderer> &generator(subsetRenderable.generator);
     QSSGRef<QSSGRhiShaderPipeline> shaderPipeline = generator->getRhiShaders(subsetRenderable, featureSet);
+    if (compilationPending)
+        *compilationPending = shaderPipeline && shaderPipeline->isCompilationPending();
+    if (dcd) {
+        const bool allowFallback = generator->contextInterface()->shaderCache()->asyncCompilation() == QSSGShaderCache::AsyncCompilation::Fallback;
+        shaderPipeline = dcd->readyShaders(shaderPipeline, allowFallback);
+    } else if (shaderPipeline && shaderPipeline->isNull()) {
+        shaderPipeline.clear();
+    }
     if (shaderPipeline)
         ps->shaderPipeline = shaderPipeline.data();
     return shaderPipeline;
@@ -118,8 +134,9 @@ static void updateUniformsForDefaultMaterial(QSSGRef<QSSGRhiShaderPipeline> &sha
                                                      : subsetRenderable.modelContext.modelViewProjection);
 
     const auto &modelNode = subsetRenderable.modelContext.model;
-    const QMatrix4x4 &localInstanceTransform(modelNode.localInstanceTransform);
-    const QMatrix4x4 &globalInstanceTransform(modelNode.globalInstanceTransform);
+    static const QMatrix4x4 identity;
+    const QMatrix4x4 &localInstanceTransform(subsetRenderable.autoInstanced ? identity : modelNode.localInstanceTransform);
+    const QMatrix4x4 &globalInstanceTransform(subsetRenderable.autoInstanced ? identity : modelNode.globalInstanceTransform);
     const QMatrix4x4 &modelMatrix(modelNode.boneTransforms.isEmpty() ? subsetRenderable.globalTransform
                                     : modelNode.skin ? QMatrix4x4() : modelNode.skeleton->globalTransform);
 
@@ -233,9 +250,9 @@ static void sortInstances(QByteArray &sortedData, QList<QSSGRhiSortData> &sortDa
 
 bool QSSGSubsetRenderable::prepareInstancing(QSSGRhiContext *rhiCtx, const QVector3D &cameraDirection)
 {
-    if (!modelContext.model.instancing() || instanceBuffer)
+    if (!instancing() || instanceBuffer)
         return instanceBuffer;
-    auto *table = modelContext.model.instanceTable;
+    auto *table = instanceTable;
     QSSGRhiInstanceBufferData &instanceData(rhiCtx->instanceBufferData(table));
     qsizetype instanceBufferSize = table->dataSize();
     // Create or resize the instance buffer ### if (instanceData.owned)
@@ -297,7 +314,7 @@ static int setupInstancing(QSSGSubsetRenderable *renderable, QSSGRhiGraphicsPipe
     int instanceBufferBinding = 0;
     if (instancing) {
         // set up new bindings for instanced buffers
-        const quint32 stride = renderable->modelContext.model.instanceTable->stride();
+        const quint32 stride = renderable->instanceTable->stride();
         QVarLengthArray<QRhiVertexInputBinding, 8> bindings;
         std::copy(ps->ia.inputLayout.cbeginBindings(), ps->ia.inputLayout.cendBindings(), std::back_inserter(bindings));
         bindings.append({ stride, QRhiVertexInputBinding::PerInstance });
@@ -307,6 +324,40 @@ static int setupInstancing(QSSGSubsetRenderable *renderable, QSSGRhiGraphicsPipe
     return instanceBufferBinding;
 }
 
+// The shaders of an earlier material key, drawn with while the current ones
+// are compiled in the background, may declare samplers the current state
+// has no texture for, e.g. for a map that was just removed or a light that
+// no longer casts shadows. These get dummy textures, the srb must provide
+// every binding of the pipeline.
+static void addDummyTextureBindings(QSSGRhiContext *rhiCtx,
+                                    const QSSGRhiShaderPipeline &shaderPipeline,
+                                    QSSGRhiShaderResourceBindingList &bindings)
+{
+    QRhiTexture *dummyTexture = nullptr;
+    QRhiTexture *dummyCubeTexture = nullptr;
+    QRhiSampler *dummySampler = nullptr;
+    for (auto stage = shaderPipeline.cbeginStages(); stage != shaderPipeline.cendStages(); ++stage) {
+        const auto samplerVars = stage->shader().description().combinedImageSamplers();
+        for (const QShaderDescription::InOutVariable &var : samplerVars) {
+            bool bound = false;
+            for (int i = 0; i < bindings.p && !bound; ++i)
+                bound = bindings.v[i].data()->binding == var.binding;
+            if (bound)
+                continue;
+            if (!dummySampler) {
+                dummySampler = rhiCtx->sampler({ QRhiSampler::Nearest, QRhiSampler::Nearest, QRhiSampler::None,
+                                                 QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge, QRhiSampler::Repeat });
+                QRhiResourceUpdateBatch *resourceUpdates = rhiCtx->rhi()->nextResourceUpdateBatch();
+                dummyTexture = rhiCtx->dummyTexture({}, resourceUpdates);
+                dummyCubeTexture = rhiCtx->dummyTexture(QRhiTexture::CubeMap, resourceUpdates);
+                rhiCtx->commandBuffer()->resourceUpdate(resourceUpdates);
+            }
+            QRhiTexture *t = var.type == QShaderDescription::SamplerCube ? dummyCubeTexture : dummyTexture;
+            bindings.addTexture(var.binding, VISIBILITY_ALL, t, dummySampler);
+        }
+    }
+}
+
 static void rhiPrepareRenderable(QSSGRhiContext *rhiCtx,
                                  QSSGLayerRenderData &inData,
                                  QSSGRenderableObject &inObject,
@@ -335,34 +386,39 @@ static void rhiPrepareRenderable(QSSGRhiContext *rhiCtx,
         if (cubeFace >= 0) {
             // Disable tonemapping for the reflection pass
             featureSet.disableTonemapping();
+            // The light clusters are built for the camera of the layer
+            featureSet.set(QSSGShaderFeatures::Feature::ClusteredLighting, false);
         }
 
-        QSSGRef<QSSGRhiShaderPipeline> shaderPipeline = shadersForDefaultMaterial(ps, subsetRenderable, featureSet);
+        // Unlike the subsetRenderable (which is allocated per frame so is
+        // not persistent in any way), the model reference is persistent in
+        // the sense that it references the model node in the scene graph.
+        // Combined with the layer node (multiple View3Ds may share the
+        // same scene!), this is suitable as a key to get the srb and
+        // pipeline that were used with the rendering of the same model in
+        // the previous frame. The uniform data itself is suballocated
+        // from the per-frame uniform ring of the layer.
+        const void *layerNode = &inData.layer;
+        const void *modelNode = &subsetRenderable.modelContext.model;
+        QSSGRhiDrawCallData &dcd(cubeFace >= 0 ? rhiCtx->drawCallData({ layerNode, modelNode,
+                                                                        entry, cubeFace + int(subsetRenderable.subset.offset << 3),
+                                                                        QSSGRhiDrawCallDataKey::Reflection })
+                                               : rhiCtx->drawCallData({ layerNode, modelNode,
+                                                                        &subsetRenderable.material, 0, QSSGRhiDrawCallDataKey::Main }));
+
+        bool compilationPending = false;
+        QSSGRef<QSSGRhiShaderPipeline> shaderPipeline = shadersForDefaultMaterial(ps, subsetRenderable, featureSet, &dcd, &compilationPending);
         if (shaderPipeline) {
-            // Unlike the subsetRenderable (which is allocated per frame so is
-            // not persistent in any way), the model reference is persistent in
-            // the sense that it references the model node in the scene graph.
-            // Combined with the layer node (multiple View3Ds may share the
-            // same scene!), this is suitable as a key to get the uniform
-            // buffers that were used with the rendering of the same model in
-            // the previous frame.
             QSSGRhiShaderResourceBindingList bindings;
-            const void *layerNode = &inData.layer;
-            const void *modelNode = &subsetRenderable.modelContext.model;
             const bool blendParticles = subsetRenderable.generator->contextInterface()->renderer()->defaultMaterialShaderKeyProperties().m_blendParticles.getValue(subsetRenderable.shaderDescription);
 
-            QSSGRhiDrawCallData &dcd(cubeFace >= 0 ? rhiCtx->drawCallData({ layerNode, modelNode,
-                                                                            entry, cubeFace + int(subsetRenderable.subset.offset << 3),
-                                                                            QSSGRhiDrawCallDataKey::Reflection })
-                                                   : rhiCtx->drawCallData({ layerNode, modelNode,
-                                                                            &subsetRenderable.material, 0, QSSGRhiDrawCallDataKey::Main }));
-
-            shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd.ubuf);
-            char *ubufData = dcd.ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
-            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubufData, ps, subsetRenderable, *camera, nullptr, alteredModelViewProjection);
+            const QSSGRhiUniformRing::Allocation ubuf = inData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset()
+                                                                                      + int(sizeof(QSSGShaderLightsUniformData)));
+            if (!ubuf.buffer)
+                return;
+            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, subsetRenderable, *camera, nullptr, alteredModelViewProjection);
             if (blendParticles)
-                QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubufData, &subsetRenderable.modelContext.model, subsetRenderable.subset.offset);
-            dcd.ubuf->endFullDynamicBufferUpdateForCurrentFrame();
+                QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubuf.data, &subsetRenderable.modelContext.model, subsetRenderable.subset.offset);
 
             if (blendParticles)
                 QSSGParticleRenderer::prepareParticlesForModel(shaderPipeline, rhiCtx, bindings, &subsetRenderable.modelContext.model);
@@ -379,12 +435,15 @@ static void rhiPrepareRenderable(QSSGRhiContext *rhiCtx,
             int instanceBufferBinding = setupInstancing(&subsetRenderable, ps, rhiCtx, cameraDirection);
             ps->ia.bakeVertexInputLocations(*shaderPipeline, instanceBufferBinding);
 
-            bindings.addUniformBuffer(0, VISIBILITY_ALL, dcd.ubuf, 0, shaderPipeline->ub0Size());
+            QSSGRhiDynamicUniformOffsets &ubufOffsets(cubeFace >= 0 ? subsetRenderable.rhiRenderData.reflectionPass.ubufOffsets[cubeFace]
+                                                                    : subsetRenderable.rhiRenderData.mainPass.ubufOffsets);
+            bindings.addUniformBufferWithDynamicOffset(0, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0Size());
 
             if (shaderPipeline->isLightingEnabled()) {
-                bindings.addUniformBuffer(1, VISIBILITY_ALL, dcd.ubuf,
-                                          shaderPipeline->ub0LightDataOffset(),
-                                          shaderPipeline->ub0LightDataSize());
+                bindings.addUniformBufferWithDynamicOffset(1, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0LightDataSize());
+                ubufOffsets.set(ubuf.offset, ubuf.offset + quint32(shaderPipeline->ub0LightDataOffset()));
+            } else {
+                ubufOffsets.set(ubuf.offset);
             }
 
             // Texture maps
@@ -470,11 +529,28 @@ static void rhiPrepareRenderable(QSSGRhiContext *rhiCtx,
                                             shaderPipeline->screenTexture(), sampler);
                     } // else ignore, not an error
                 }
+
+                // Light clusters
+                if (shaderPipeline->lightClusterTexture()) {
+                    int binding = shaderPipeline->bindingForTexture("qt_lightClusters", int(QSSGRhiSamplerBindingHints::LightClusters));
+                    if (binding >= 0) {
+                        // only read with texelFetch
+                        QRhiSampler *sampler = rhiCtx->sampler({ QRhiSampler::Nearest, QRhiSampler::Nearest, QRhiSampler::None,
+                                                                 QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge, QRhiSampler::Repeat });
+                        bindings.addTexture(binding,
+                                            QRhiShaderResourceBinding::FragmentStage,
+                                            shaderPipeline->lightClusterTexture(), sampler);
+                    } // else ignore, not an error
+                }
             }
 
             // Depth and SSAO textures
             addDepthTextureBindings(rhiCtx, shaderPipeline.data(), bindings);
 
+            // Drawing with the fallback shaders
+            if (compilationPending)
+                addDummyTextureBindings(rhiCtx, *shaderPipeline, bindings);
+
             // Instead of always doing a QHash find in srb(), store the binding
             // list and the srb object in the per-model+material
             // QSSGRhiUniformBufferSet. While this still needs comparing the
@@ -537,6 +613,8 @@ static void rhiPrepareRenderable(QSSGRhiContext *rhiCtx,
         if (cubeFace >= 0) {
             // Disable tonemapping for the reflection pass
             featureSet.disableTonemapping();
+            // The light clusters are built for the camera of the layer
+            featureSet.set(QSSGShaderFeatures::Feature::ClusteredLighting, false);
         }
 
         customMaterialSystem.rhiPrepareRenderable(ps, subsetRenderable, featureSet,
@@ -648,14 +726,18 @@ static void addOpaqueDepthPrePassBindings(QSSGRhiContext *rhiCtx,
     }
 }
 
-static bool rhiPrepareDepthPassForObject(QSSGRhiContext *rhiCtx,
-                                         QSSGLayerRenderData &layerData,
-                                         QSSGRenderableObject *obj,
-                                         QRhiRenderPassDescriptor *rpDesc,
-                                         QSSGRhiGraphicsPipelineState *ps,
-                                         QSSGRhiDrawCallDataKey::Selector ubufSel)
+// Objects whose shaders are still being compiled in the background are left
+// out of the depth passes until the shaders are ready
+enum class DepthPassObjectResult { Prepared, Pending, Failed };
+
+static DepthPassObjectResult rhiPrepareDepthPassForObject(QSSGRhiContext *rhiCtx,
+                                                          QSSGLayerRenderData &layerData,
+                                                          QSSGRenderableObject *obj,
+                                                          QRhiRenderPassDescriptor *rpDesc,
+                                                          QSSGRhiGraphicsPipelineState *ps)
 {
     QSSGRef<QSSGRhiShaderPipeline> shaderPipeline;
+    bool compilationPending = false;
 
     const bool isOpaqueDepthPrePass = obj->depthWriteMode == QSSGDepthDrawMode::OpaquePrePass;
     QSSGShaderFeatures featureSet;
@@ -663,42 +745,37 @@ static bool rhiPrepareDepthPassForObject(QSSGRhiContext *rhiCtx,
     if (isOpaqueDepthPrePass)
         featureSet.set(QSSGShaderFeatures::Feature::OpaqueDepthPrePass, true);
 
-    QSSGRhiDrawCallData *dcd = nullptr;
-    if (obj->renderableFlags.isDefaultMaterialMeshSubset() || obj->renderableFlags.isCustomMaterialMeshSubset()) {
-        QSSGSubsetRenderable &subsetRenderable(static_cast<QSSGSubsetRenderable &>(*obj));
-        const void *layerNode = &layerData.layer;
-        const void *modelNode = &subsetRenderable.modelContext.model;
-        dcd = &rhiCtx->drawCallData({ layerNode, modelNode, &subsetRenderable.material, 0, ubufSel });
-    }
+    QSSGRhiUniformRing::Allocation ubuf;
 
     if (obj->renderableFlags.isDefaultMaterialMeshSubset()) {
         QSSGSubsetRenderable &subsetRenderable(static_cast<QSSGSubsetRenderable &>(*obj));
         ps->cullMode = QSSGRhiGraphicsPipelineState::toCullMode(subsetRenderable.defaultMaterial().cullMode);
 
-        shaderPipeline = shadersForDefaultMaterial(ps, subsetRenderable, featureSet);
+        shaderPipeline = shadersForDefaultMaterial(ps, subsetRenderable, featureSet, nullptr, &compilationPending);
         if (shaderPipeline) {
-            shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd->ubuf);
-            char *ubufData = dcd->ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
-            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubufData, ps, subsetRenderable, *layerData.camera, nullptr, nullptr);
-            dcd->ubuf->endFullDynamicBufferUpdateForCurrentFrame();
+            ubuf = layerData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset() + int(sizeof(QSSGShaderLightsUniformData)));
+            if (!ubuf.buffer)
+                return DepthPassObjectResult::Failed;
+            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, subsetRenderable, *layerData.camera, nullptr, nullptr);
         } else {
-            return false;
+            return compilationPending ? DepthPassObjectResult::Pending : DepthPassObjectResult::Failed;
         }
     } else if (obj->renderableFlags.isCustomMaterialMeshSubset()) {
         QSSGSubsetRenderable &subsetRenderable(static_cast<QSSGSubsetRenderable &>(*obj));
         ps->cullMode = QSSGRhiGraphicsPipelineState::toCullMode(subsetRenderable.customMaterial().m_cullMode);
 
         QSSGCustomMaterialSystem &customMaterialSystem(*subsetRenderable.generator->contextInterface()->customMaterialSystem().data());
-        shaderPipeline = customMaterialSystem.shadersForCustomMaterial(ps, subsetRenderable.customMaterial(), subsetRenderable, featureSet);
+        shaderPipeline = customMaterialSystem.shadersForCustomMaterial(ps, subsetRenderable.customMaterial(), subsetRenderable, featureSet,
+                                                                       nullptr, &compilationPending);
 
         if (shaderPipeline) {
-            shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd->ubuf);
-            char *ubufData = dcd->ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
-            customMaterialSystem.updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubufData, ps, subsetRenderable.customMaterial(), subsetRenderable,
+            ubuf = layerData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset() + int(sizeof(QSSGShaderLightsUniformData)));
+            if (!ubuf.buffer)
+                return DepthPassObjectResult::Failed;
+            customMaterialSystem.updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, subsetRenderable.customMaterial(), subsetRenderable,
                                                                  layerData, *layerData.camera, nullptr, nullptr);
-            dcd->ubuf->endFullDynamicBufferUpdateForCurrentFrame();
         } else {
-            return false;
+            return compilationPending ? DepthPassObjectResult::Pending : DepthPassObjectResult::Failed;
         }
     }
 
@@ -711,7 +788,8 @@ static bool rhiPrepareDepthPassForObject(QSSGRhiContext *rhiCtx,
         ps->ia.bakeVertexInputLocations(*shaderPipeline, instanceBufferBinding);
 
         QSSGRhiShaderResourceBindingList bindings;
-        bindings.addUniformBuffer(0, VISIBILITY_ALL, dcd->ubuf);
+        bindings.addUniformBufferWithDynamicOffset(0, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0Size());
+        subsetRenderable.rhiRenderData.depthPrePass.ubufOffsets.set(ubuf.offset);
 
         // Depth and SSAO textures, in case a custom material's shader code does something with them.
         addDepthTextureBindings(rhiCtx, shaderPipeline.data(), bindings);
@@ -732,7 +810,7 @@ static bool rhiPrepareDepthPassForObject(QSSGRhiContext *rhiCtx,
         subsetRenderable.rhiRenderData.depthPrePass.srb = srb;
     }
 
-    return true;
+    return DepthPassObjectResult::Prepared;
 }
 
 static bool rhiPrepareDepthPass(QSSGRhiContext *rhiCtx,
@@ -741,7 +819,6 @@ static bool rhiPrepareDepthPass(QSSGRhiContext *rhiCtx,
                                 QSSGLayerRenderData &inData,
                                 const QVector<QSSGRenderableObjectHandle> &sortedOpaqueObjects,
                                 const QVector<QSSGRenderableObjectHandle> &sortedTransparentObjects,
-                                QSSGRhiDrawCallDataKey::Selector ubufSel,
                                 int samples)
 {
     // Phase 1 (prepare) for the Z prepass or the depth texture generation.
@@ -759,13 +836,14 @@ static bool rhiPrepareDepthPass(QSSGRhiContext *rhiCtx,
     ps.depthWriteEnable = true;
     ps.targetBlend.colorWrite = {};
 
+    // Pending objects keep a null depthPrePass.pipeline and are not drawn
     for (const QSSGRenderableObjectHandle &handle : sortedOpaqueObjects) {
-        if (!rhiPrepareDepthPassForObject(rhiCtx, inData, handle.obj, rpDesc, &ps, ubufSel))
+        if (rhiPrepareDepthPassForObject(rhiCtx, inData, handle.obj, rpDesc, &ps) == DepthPassObjectResult::Failed)
             return false;
     }
 
     for (const QSSGRenderableObjectHandle &handle : sortedTransparentObjects) {
-        if (!rhiPrepareDepthPassForObject(rhiCtx, inData, handle.obj, rpDesc, &ps, ubufSel))
+        if (rhiPrepareDepthPassForObject(rhiCtx, inData, handle.obj, rpDesc, &ps) == DepthPassObjectResult::Failed)
             return false;
     }
 
@@ -838,8 +916,11 @@ static void rhiRenderDepthPassForObject(QSSGRhiContext *rhiCtx,
         if (!srb)
             return;
 
+        const QSSGRhiDynamicUniformOffsets &ubufOffsets(subsetRenderable->rhiRenderData.depthPrePass.ubufOffsets);
         cb->setGraphicsPipeline(ps);
-        cb->setShaderResources(srb);
+        cb->setShaderResources(srb, ubufOffsets.count, ubufOffsets.offsets);
+        QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(ps));
+        QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
 
         if (*needsSetViewport) {
             cb->setViewport(rhiCtx->graphicsPipelineState(&inData)->viewport);
@@ -850,8 +931,8 @@ static void rhiRenderDepthPassForObject(QSSGRhiContext *rhiCtx,
         int vertexBufferCount = 1;
         vertexBuffers[0] = QRhiCommandBuffer::VertexInput(vertexBuffer, 0);
         quint32 instances = 1;
-        if (subsetRenderable->modelContext.model.instancing()) {
-            instances = subsetRenderable->modelContext.model.instanceCount();
+        if (subsetRenderable->instancing()) {
+            instances = subsetRenderable->instanceCount();
             vertexBuffers[1] = QRhiCommandBuffer::VertexInput(subsetRenderable->instanceBuffer, 0);
             vertexBufferCount = 2;
         }
@@ -921,6 +1002,12 @@ static std::pair<BoxPoints, BoxPoints> calculateSortedObjectBounds(const QVector
                 bounds.include(obj.globalTransform.map(max));
                 // Model particles are in world space
                 bounds.include(obj.particleBounds);
+                // So are the models batched into an auto-instanced renderable
+                if (obj.renderableFlags.isDefaultMaterialMeshSubset()) {
+                    const QSSGSubsetRenderable &subsetRenderable(static_cast<const QSSGSubsetRenderable &>(obj));
+                    if (subsetRenderable.autoInstanced)
+                        bounds.include(subsetRenderable.autoInstanceBounds);
+                }
 
                 if (obj.renderableFlags.castsShadows()) {
                     boundsCasting.include(bounds);
@@ -1292,13 +1379,11 @@ static void rhiPrepareResourcesForShadowMap(QSSGRhiContext *rhiCtx,
         if (isOpaqueDepthPrePass)
             objectFeatureSet.set(QSSGShaderFeatures::Feature::OpaqueDepthPrePass, true);
 
-        QSSGRhiDrawCallData *dcd = nullptr;
+        QSSGRhiUniformRing::Allocation ubuf;
         QMatrix4x4 modelViewProjection;
         if (theObject->renderableFlags.isDefaultMaterialMeshSubset() || theObject->renderableFlags.isCustomMaterialMeshSubset()) {
             QSSGSubsetRenderable *renderable(static_cast<QSSGSubsetRenderable *>(theObject));
             modelViewProjection = pEntry->m_lightVP * renderable->globalTransform;
-            dcd = &rhiCtx->drawCallData({ &inData.layer, &renderable->modelContext.model,
-                                          pEntry, cubeFace + int(renderable->subset.offset << 3), QSSGRhiDrawCallDataKey::Shadow });
         }
 
         QSSGRhiShaderResourceBindingList bindings;
@@ -1311,12 +1396,12 @@ static void rhiPrepareResourcesForShadowMap(QSSGRhiContext *rhiCtx,
             shaderPipeline = shadersForDefaultMaterial(ps, subsetRenderable, objectFeatureSet);
             if (!shaderPipeline)
                 continue;
-            shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd->ubuf);
-            char *ubufData = dcd->ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
-            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubufData, ps, subsetRenderable, inCamera, depthAdjust, &modelViewProjection);
+            ubuf = inData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset() + int(sizeof(QSSGShaderLightsUniformData)));
+            if (!ubuf.buffer)
+                continue;
+            updateUniformsForDefaultMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, subsetRenderable, inCamera, depthAdjust, &modelViewProjection);
             if (blendParticles)
-                QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubufData, &subsetRenderable.modelContext.model, subsetRenderable.subset.offset);
-            dcd->ubuf->endFullDynamicBufferUpdateForCurrentFrame();
+                QSSGParticleRenderer::updateUniformsForParticleModel(shaderPipeline, ubuf.data, &subsetRenderable.modelContext.model, subsetRenderable.subset.offset);
             if (blendParticles)
                 QSSGParticleRenderer::prepareParticlesForModel(shaderPipeline, rhiCtx, bindings, &subsetRenderable.modelContext.model);
         } else if (theObject->renderableFlags.isCustomMaterialMeshSubset()) {
@@ -1326,12 +1411,12 @@ static void rhiPrepareResourcesForShadowMap(QSSGRhiContext *rhiCtx,
             shaderPipeline = customMaterialSystem.shadersForCustomMaterial(ps, subsetRenderable.customMaterial(), subsetRenderable, objectFeatureSet);
             if (!shaderPipeline)
                 continue;
-            shaderPipeline->ensureCombinedMainLightsUniformBuffer(&dcd->ubuf);
-            char *ubufData = dcd->ubuf->beginFullDynamicBufferUpdateForCurrentFrame();
+            ubuf = inData.m_uniformRing.allocate(shaderPipeline->ub0LightDataOffset() + int(sizeof(QSSGShaderLightsUniformData)));
+            if (!ubuf.buffer)
+                continue;
             // inCamera is the shadow camera, not the same as inData.camera
-            customMaterialSystem.updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubufData, ps, subsetRenderable.customMaterial(), subsetRenderable,
+            customMaterialSystem.updateUniformsForCustomMaterial(shaderPipeline, rhiCtx, ubuf.data, ps, subsetRenderable.customMaterial(), subsetRenderable,
                                                                  inData, inCamera, depthAdjust, &modelViewProjection);
-            dcd->ubuf->endFullDynamicBufferUpdateForCurrentFrame();
         }
 
         if (theObject->renderableFlags.isDefaultMaterialMeshSubset() || theObject->renderableFlags.isCustomMaterialMeshSubset()) {
@@ -1341,8 +1426,8 @@ static void rhiPrepareResourcesForShadowMap(QSSGRhiContext *rhiCtx,
             int instanceBufferBinding = setupInstancing(&subsetRenderable, ps, rhiCtx, inData.cameraDirection);
             ps->ia.bakeVertexInputLocations(*shaderPipeline, instanceBufferBinding);
 
-
-            bindings.addUniformBuffer(0, VISIBILITY_ALL, dcd->ubuf);
+            bindings.addUniformBufferWithDynamicOffset(0, VISIBILITY_ALL, ubuf.buffer, shaderPipeline->ub0Size());
+            subsetRenderable.rhiRenderData.shadowPass.ubufOffsets[cubeFace].set(ubuf.offset);
 
             // Depth and SSAO textures, in case a custom material's shader code does something with them.
             addDepthTextureBindings(rhiCtx, shaderPipeline.data(), bindings);
@@ -1413,9 +1498,12 @@ static void rhiRenderOneShadowMap(QSSGRhiContext *rhiCtx,
                 continue;
 
             cb->setGraphicsPipeline(renderable->rhiRenderData.shadowPass.pipeline);
+            QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(renderable->rhiRenderData.shadowPass.pipeline));
 
             QRhiShaderResourceBindings *srb = renderable->rhiRenderData.shadowPass.srb[cubeFace];
-            cb->setShaderResources(srb);
+            const QSSGRhiDynamicUniformOffsets &ubufOffsets(renderable->rhiRenderData.shadowPass.ubufOffsets[cubeFace]);
+            cb->setShaderResources(srb, ubufOffsets.count, ubufOffsets.offsets);
+            QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
 
             if (needsSetViewport) {
                 cb->setViewport(ps->viewport);
@@ -1426,8 +1514,8 @@ static void rhiRenderOneShadowMap(QSSGRhiContext *rhiCtx,
             int vertexBufferCount = 1;
             vertexBuffers[0] = QRhiCommandBuffer::VertexInput(vertexBuffer, 0);
             quint32 instances = 1;
-            if (renderable->modelContext.model.instancing()) {
-                instances = renderable->modelContext.model.instanceCount();
+            if (renderable->instancing()) {
+                instances = renderable->instanceCount();
                 vertexBuffers[1] = QRhiCommandBuffer::VertexInput(renderable->instanceBuffer, 0);
                 vertexBufferCount = 2;
             }
@@ -1590,6 +1678,7 @@ static void rhiRenderShadowMap(QSSGRhiContext *rhiCtx,
             // Render into the 2D texture pEntry->m_rhiDepthMap, using
             // pEntry->m_rhiDepthStencil as the (throwaway) depth/stencil buffer.
             QRhiTextureRenderTarget *rt = pEntry->m_rhiRenderTargets[0];
+            inData.m_uniformRing.commit();
             cb->beginPass(rt, Qt::white, { 1.0f, 0 }, nullptr, QSSGRhiContext::commonPassFlags());
             QSSGRHICTX_STAT(rhiCtx, beginRenderPass(rt));
             rhiRenderOneShadowMap(rhiCtx, &ps, sortedOpaqueObjects, 0);
@@ -1648,6 +1737,7 @@ static void rhiRenderShadowMap(QSSGRhiContext *rhiCtx,
                         outFace = 2;
                 }
                 QRhiTextureRenderTarget *rt = pEntry->m_rhiRenderTargets[outFace];
+                inData.m_uniformRing.commit();
                 cb->beginPass(rt, Qt::white, { 1.0f, 0 }, nullptr, QSSGRhiContext::commonPassFlags());
                 QSSGRHICTX_STAT(rhiCtx, beginRenderPass(rt));
                 rhiRenderOneShadowMap(rhiCtx, &ps, sortedOpaqueObjects, face);
@@ -1721,6 +1811,7 @@ static void rhiRenderReflectionMap(QSSGRhiContext *rhiCtx,
                     outFace = 2;
             }
             QRhiTextureRenderTarget *rt = pEntry->m_rhiRenderTargets[outFace];
+            inData.m_uniformRing.commit();
             cb->beginPass(rt, reflectionProbes[i]->clearColor, { 1.0f, 0 }, nullptr, QSSGRhiContext::commonPassFlags());
             QSSGRHICTX_STAT(rhiCtx, beginRenderPass(rt));
 
@@ -1957,6 +2048,11 @@ void QSSGLayerRenderData::rhiPrepare()
     const QRect sc = layerPrepResult->scissor.toRect();
     ps->scissor = { sc.x(), sc.y(), sc.width(), sc.height() };
 
+    // Read by the fragment shaders of all the passes with lighting below
+    lightClusters.prepareTexture(rhiCtx);
+
+    // Start filling the per-draw uniform data from the beginning of the ring
+    m_uniformRing.reset(rhiCtx);
 
     const bool animating = layerPrepResult->flags.wasLayerDataDirty();
     if (animating)
@@ -2044,10 +2140,10 @@ void QSSGLayerRenderData::rhiPrepare()
                 Q_ASSERT(m_rhiDepthTexture.isValid());
                 if (rhiPrepareDepthPass(rhiCtx, *ps, m_rhiDepthTexture.rpDesc, *this,
                                         sortedOpaqueObjects, sortedTransparentObjects,
-                                        QSSGRhiDrawCallDataKey::DepthTexture,
                                         1))
                 {
                     bool needsSetVieport = true;
+                    m_uniformRing.commit();
                     cb->beginPass(m_rhiDepthTexture.rt, Qt::transparent, { 1.0f, 0 }, nullptr, QSSGRhiContext::commonPassFlags());
                     QSSGRHICTX_STAT(rhiCtx, beginRenderPass(m_rhiDepthTexture.rt));
                     // NB! We do not pass sortedTransparentObjects in the 4th
@@ -2147,13 +2243,11 @@ void QSSGLayerRenderData::rhiPrepare()
             if (!zPrePass) {
                 rhiPrepareDepthPass(rhiCtx, *ps, rhiCtx->mainRenderPassDescriptor(), *this,
                                     {}, renderedOpaqueDepthPrepassObjects,
-                                    QSSGRhiDrawCallDataKey::ZPrePass,
                                     rhiCtx->mainPassSampleCount());
 
             } else {
                 m_globalZPrePassActive = rhiPrepareDepthPass(rhiCtx, *ps, rhiCtx->mainRenderPassDescriptor(), *this,
                                                          renderedDepthWriteObjects, renderedOpaqueDepthPrepassObjects,
-                                                         QSSGRhiDrawCallDataKey::ZPrePass,
                                                          rhiCtx->mainPassSampleCount());
             }
             cb->debugMarkEnd();
@@ -2197,6 +2291,7 @@ void QSSGLayerRenderData::rhiPrepare()
                 QColor clearColor(Qt::transparent);
                 if (layer.background == QSSGRenderLayer::Background::Color)
                     clearColor = QColor::fromRgbF(layer.clearColor.x(), layer.clearColor.y(), layer.clearColor.z());
+                m_uniformRing.commit();
                 cb->beginPass(m_rhiScreenTexture.rt, clearColor, { 1.0f, 0 }, nullptr, QSSGRhiContext::commonPassFlags());
                 QSSGRHICTX_STAT(rhiCtx, beginRenderPass(m_rhiScreenTexture.rt));
                 if (layer.background == QSSGRenderLayer::Background::SkyBox
@@ -2322,6 +2417,9 @@ void QSSGLayerRenderData::rhiPrepare()
                 rhiPrepareRenderable(rhiCtx, *this, *theObject, mainRpDesc, samples);
         }
 
+        // the main pass is recorded in rhiRender()
+        m_uniformRing.commit();
+
         cb->debugMarkEnd();
 
         renderer->endLayerRender();
@@ -2352,10 +2450,15 @@ static void rhiRenderRenderable(QSSGRhiContext *rhiCtx,
         QRhiBuffer *vertexBuffer = subsetRenderable.subset.rhi.vertexBuffer->buffer();
         QRhiBuffer *indexBuffer = subsetRenderable.subset.rhi.indexBuffer ? subsetRenderable.subset.rhi.indexBuffer->buffer() : nullptr;
 
+        const QSSGRhiDynamicUniformOffsets &ubufOffsets(cubeFace >= 0 ? subsetRenderable.rhiRenderData.reflectionPass.ubufOffsets[cubeFace]
+                                                                      : subsetRenderable.rhiRenderData.mainPass.ubufOffsets);
+
         QRhiCommandBuffer *cb = rhiCtx->commandBuffer();
         // QRhi optimizes out unnecessary binding of the same pipline
         cb->setGraphicsPipeline(ps);
-        cb->setShaderResources(srb);
+        cb->setShaderResources(srb, ubufOffsets.count, ubufOffsets.offsets);
+        QSSGRHICTX_STAT(rhiCtx, setGraphicsPipeline(ps));
+        QSSGRHICTX_STAT(rhiCtx, setShaderResources(srb));
 
         if (*needsSetViewport) {
             if (!state)
@@ -2369,8 +2472,8 @@ static void rhiRenderRenderable(QSSGRhiContext *rhiCtx,
         int vertexBufferCount = 1;
         vertexBuffers[0] = QRhiCommandBuffer::VertexInput(vertexBuffer, 0);
         quint32 instances = 1;
-        if ( subsetRenderable.modelContext.model.instancing()) {
-            instances = subsetRenderable.modelContext.model.instanceCount();
+        if (subsetRenderable.instancing()) {
+            instances = subsetRenderable.instanceCount();
             vertexBuffers[1] = QRhiCommandBuffer::VertexInput(subsetRenderable.instanceBuffer, 0);
             vertexBufferCount = 2;
         }
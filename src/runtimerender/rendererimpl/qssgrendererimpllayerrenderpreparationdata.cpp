@@ -42,9 +42,15 @@
 #include <QtQuick3DRuntimeRender/private/qssgrhicustommaterialsystem_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendershadercache_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgperframeallocator_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingbvh_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendertasks_p.h>
 #include <QtQuick3DUtils/private/qssgutils_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgruntimerenderlogging_p.h>
 
+#include <QtCore/QThreadPool>
+
+#include <array>
+
 #ifdef Q_CC_MSVC
 #pragma warning(disable : 4355)
 #endif
@@ -111,7 +117,95 @@ inline void collectNode(const V &node, QVector<T> &dst, int &dstPos)
 #define MAX_MORPH_TARGET_INDEX_SUPPORTS_NORMALS 3
 #define MAX_MORPH_TARGET_INDEX_SUPPORTS_TANGENTS 1
 
+// Skipping the subtrees that are completely outside of the frustum while
+// collecting the nodes
+struct QSSGSubtreeCulling
+{
+    const QSSGClippingFrustum *clipFrustum = nullptr;
+    // The nodes to refit, they are never skipped
+    QVector<QSSGRenderNode *> *refitNodes = nullptr;
+    // All renderables for the picking tree, including the ones in skipped
+    // subtrees. Only collected when culling.
+    QVector<QSSGRenderableNodeEntry> *pickingNodes = nullptr;
+    int pickingNodeCount = 0;
+    bool pickEverything = false;
+    int culledObjectCount = 0;
+    // The roots of the skipped subtrees, their resources are kept loaded
+    QVector<QSSGRenderNode *> *culledSubtrees = nullptr;
+};
+
+static void collectPickableNodes(QSSGRenderNode &inNode, QSSGSubtreeCulling &ioCulling)
+{
+    if (QSSGRenderGraphObject::isRenderable(inNode.type))
+        collectNode(QSSGRenderableNodeEntry(inNode), *ioCulling.pickingNodes, ioCulling.pickingNodeCount);
+    for (auto &theChild : inNode.children) {
+        if (ioCulling.pickEverything || theChild.flags.testFlag(QSSGRenderNode::Flag::SubtreePickable))
+            collectPickableNodes(theChild, ioCulling);
+    }
+}
+
+static QSSGClippingFrustum calculateClippingFrustum(const QSSGRenderCamera &inCamera, const QMatrix4x4 &inViewProjection)
+{
+    QSSGClipPlane nearPlane;
+    QMatrix3x3 theUpper33(inCamera.globalTransform.normalMatrix());
+
+    QVector3D dir(mat33::transform(theUpper33, QVector3D(0, 0, -1)));
+    dir.normalize();
+    nearPlane.normal = dir;
+    QVector3D theGlobalPos = inCamera.getGlobalPos() + inCamera.clipNear * dir;
+    nearPlane.d = -(QVector3D::dotProduct(dir, theGlobalPos));
+    // the near plane's bbox edges are calculated in the clipping frustum's
+    // constructor.
+    return QSSGClippingFrustum(inViewProjection, nearPlane);
+}
+
+// Copies the bone and morph data of a model, every frame, whether the model
+// is collected or taken from the retained lists.
+static void prepareModelDeformation(QSSGRenderModel *modelNode, QVector<QSSGRenderSkeleton*> &dirtySkeletons)
+{
+    auto skeletonNode = modelNode->skeleton;
+    bool hcj = false;
+    if (modelNode->skin) {
+        modelNode->boneTransforms = modelNode->skin->boneMatrices;
+        modelNode->boneNormalTransforms = modelNode->skin->boneNormalMatrices;
+    } else if (skeletonNode) {
+        const bool dirtySkeleton = dirtySkeletons.contains(skeletonNode);
+        const bool hasDirtyNonJoints = (modelNode->skeletonContainsNonJointNodes
+                                        && (hasDirtyNonJointNodes(skeletonNode, hcj) || dirtySkeleton));
+        const bool dirtyTransform = skeletonNode->flags.testFlag(QSSGRenderNode::Flag::TransformDirty);
+        if (modelNode->skinningDirty || hasDirtyNonJoints || dirtyTransform) {
+            skeletonNode->boneTransformsDirty = false;
+            if (hasDirtyNonJoints && !dirtySkeleton)
+                dirtySkeletons.append(skeletonNode);
+            modelNode->skinningDirty = false;
+            // For now, boneTransforms is a QVector<QMatrix4x4>
+            // but it will be efficient to use QVector<float>
+            // to pass it to the shader uniform buffer
+            if (modelNode->boneTransforms.size() < skeletonNode->maxIndex + 1) {
+                modelNode->boneTransforms.resize(skeletonNode->maxIndex + 1);
+                modelNode->boneNormalTransforms.resize(skeletonNode->maxIndex + 1);
+            }
+            skeletonNode->calculateGlobalVariables();
+            const QMatrix4x4 inverseRootM = skeletonNode->globalTransform.inverted();
+            modelNode->skeletonContainsNonJointNodes = false;
+            for (auto &child : skeletonNode->children)
+                collectBoneTransforms(&child, modelNode, inverseRootM, modelNode->inverseBindPoses);
+        }
+    }
+    const int numMorphTarget = modelNode->morphTargets.size();
+    for (int i = 0; i < numMorphTarget; ++i) {
+        auto morphTarget = static_cast<const QSSGRenderMorphTarget *>(modelNode->morphTargets.at(i));
+        modelNode->morphWeights[i] = morphTarget->weight;
+        modelNode->morphAttributes[i] = morphTarget->attributes;
+        if (i > MAX_MORPH_TARGET_INDEX_SUPPORTS_NORMALS)
+            modelNode->morphAttributes[i] &= 0x1; // MorphTarget.Position
+        else if (i > MAX_MORPH_TARGET_INDEX_SUPPORTS_TANGENTS)
+            modelNode->morphAttributes[i] &= 0x3; // MorphTarget.Position | MorphTarget.Normal
+    }
+}
+
 static void maybeQueueNodeForRender(QSSGRenderNode &inNode,
+                                    QSSGSubtreeCulling &ioCulling,
                                     QVector<QSSGRenderableNodeEntry> &outRenderables,
                                     int &ioRenderableCount,
                                     QVector<QSSGRenderCamera *> &outCameras,
@@ -123,52 +217,27 @@ static void maybeQueueNodeForRender(QSSGRenderNode &inNode,
                                     quint32 &ioDFSIndex,
                                     QVector<QSSGRenderSkeleton*> &dirtySkeletons)
 {
+    if (inNode.flags.testFlag(QSSGRenderNode::Flag::SubtreeBoundsDirty)) {
+        ioCulling.refitNodes->append(&inNode);
+    } else if (ioCulling.clipFrustum && !inNode.flags.testFlag(QSSGRenderNode::Flag::SubtreeUnbounded)
+               && !ioCulling.clipFrustum->intersectsWith(inNode.subtreeBounds)) {
+        // Nothing in here changed since the bounds were calculated, so the
+        // subtree only has static models, all of which are outside
+        ioCulling.culledObjectCount += inNode.subtreeObjectCount;
+        ioCulling.culledSubtrees->append(&inNode);
+        if (ioCulling.pickEverything || inNode.flags.testFlag(QSSGRenderNode::Flag::SubtreePickable))
+            collectPickableNodes(inNode, ioCulling);
+        return;
+    }
+
     ++ioDFSIndex;
     inNode.dfsIndex = ioDFSIndex;
     if (QSSGRenderGraphObject::isRenderable(inNode.type)) {
         collectNode(QSSGRenderableNodeEntry(inNode), outRenderables, ioRenderableCount);
-        if (inNode.type == QSSGRenderGraphObject::Type::Model) {
-            auto modelNode = static_cast<QSSGRenderModel *>(&inNode);
-            auto skeletonNode = modelNode->skeleton;
-            bool hcj = false;
-            if (modelNode->skin) {
-                modelNode->boneTransforms = modelNode->skin->boneMatrices;
-                modelNode->boneNormalTransforms = modelNode->skin->boneNormalMatrices;
-            } else if (skeletonNode) {
-                const bool dirtySkeleton = dirtySkeletons.contains(skeletonNode);
-                const bool hasDirtyNonJoints = (modelNode->skeletonContainsNonJointNodes
-                                                && (hasDirtyNonJointNodes(skeletonNode, hcj) || dirtySkeleton));
-                const bool dirtyTransform = skeletonNode->flags.testFlag(QSSGRenderNode::Flag::TransformDirty);
-                if (modelNode->skinningDirty || hasDirtyNonJoints || dirtyTransform) {
-                    skeletonNode->boneTransformsDirty = false;
-                    if (hasDirtyNonJoints && !dirtySkeleton)
-                        dirtySkeletons.append(skeletonNode);
-                    modelNode->skinningDirty = false;
-                    // For now, boneTransforms is a QVector<QMatrix4x4>
-                    // but it will be efficient to use QVector<float>
-                    // to pass it to the shader uniform buffer
-                    if (modelNode->boneTransforms.size() < skeletonNode->maxIndex + 1) {
-                        modelNode->boneTransforms.resize(skeletonNode->maxIndex + 1);
-                        modelNode->boneNormalTransforms.resize(skeletonNode->maxIndex + 1);
-                    }
-                    skeletonNode->calculateGlobalVariables();
-                    const QMatrix4x4 inverseRootM = skeletonNode->globalTransform.inverted();
-                    modelNode->skeletonContainsNonJointNodes = false;
-                    for (auto &child : skeletonNode->children)
-                        collectBoneTransforms(&child, modelNode, inverseRootM, modelNode->inverseBindPoses);
-                }
-            }
-            const int numMorphTarget = modelNode->morphTargets.size();
-            for (int i = 0; i < numMorphTarget; ++i) {
-                auto morphTarget = static_cast<const QSSGRenderMorphTarget *>(modelNode->morphTargets.at(i));
-                modelNode->morphWeights[i] = morphTarget->weight;
-                modelNode->morphAttributes[i] = morphTarget->attributes;
-                if (i > MAX_MORPH_TARGET_INDEX_SUPPORTS_NORMALS)
-                    modelNode->morphAttributes[i] &= 0x1; // MorphTarget.Position
-                else if (i > MAX_MORPH_TARGET_INDEX_SUPPORTS_TANGENTS)
-                    modelNode->morphAttributes[i] &= 0x3; // MorphTarget.Position | MorphTarget.Normal
-            }
-        }
+        if (ioCulling.pickingNodes)
+            collectNode(QSSGRenderableNodeEntry(inNode), *ioCulling.pickingNodes, ioCulling.pickingNodeCount);
+        if (inNode.type == QSSGRenderGraphObject::Type::Model)
+            prepareModelDeformation(static_cast<QSSGRenderModel *>(&inNode), dirtySkeletons);
     } else if (QSSGRenderGraphObject::isCamera(inNode.type)) {
         collectNode(static_cast<QSSGRenderCamera *>(&inNode), outCameras, ioCameraCount);
     } else if (QSSGRenderGraphObject::isLight(inNode.type)) {
@@ -179,6 +248,7 @@ static void maybeQueueNodeForRender(QSSGRenderNode &inNode,
 
     for (auto &theChild : inNode.children)
         maybeQueueNodeForRender(theChild,
+                                ioCulling,
                                 outRenderables,
                                 ioRenderableCount,
                                 outCameras,
@@ -210,6 +280,12 @@ QSSGLayerRenderPreparationData::~QSSGLayerRenderPreparationData()
 {
     delete shadowMapManager;
     delete reflectionMapManager;
+    if (!autoInstanceTables.isEmpty() && renderer->contextInterface()) {
+        const auto &rhiCtx = renderer->contextInterface()->rhiContext();
+        for (QSSGRenderInstanceTable *table : qAsConst(autoInstanceTables))
+            rhiCtx->releaseInstanceBuffer(table);
+    }
+    qDeleteAll(autoInstanceTables);
 }
 
 QVector3D QSSGLayerRenderPreparationData::getCameraDirection()
@@ -223,6 +299,11 @@ QVector3D QSSGLayerRenderPreparationData::getCameraDirection()
     return *cameraDirection;
 }
 
+QThreadPool *QSSGLayerRenderPreparationData::sortThreadPool() const
+{
+    return renderer->prepareThreadCount() > 1 ? renderer->prepareThreadPool() : nullptr;
+}
+
 static inline float signedSquare(float val)
 {
     const float sign = (val >= 0.0f) ? 1.0f : -1.0f;
@@ -245,12 +326,12 @@ const QVector<QSSGRenderableObjectHandle> &QSSGLayerRenderPreparationData::getOp
             theInfo.cameraDistanceSq = QVector3D::dotProduct(difference, theCameraDirection) + signedSquare(theInfo.obj->depthBias);
         }
 
-        static const auto isRenderObjectPtrLessThan = [](const QSSGRenderableObjectHandle &lhs, const QSSGRenderableObjectHandle &rhs) {
-            return lhs.cameraDistanceSq < rhs.cameraDistanceSq;
-        };
-        // Render nearest to furthest objects
+        // Render nearest to furthest objects, or grouped by state first
+        const QSSGRenderableSorter::Order order = (layer.opaqueOrdering == QSSGRenderLayer::OpaqueOrdering::State)
+                ? QSSGRenderableSorter::Order::StateFrontToBack
+                : QSSGRenderableSorter::Order::FrontToBack;
         if (performSort)
-            std::sort(renderedOpaqueObjects.begin(), renderedOpaqueObjects.end(), isRenderObjectPtrLessThan);
+            opaqueSorter.sort(renderedOpaqueObjects, order, sortThreadPool());
     }
     return renderedOpaqueObjects;
 }
@@ -277,11 +358,8 @@ const QVector<QSSGRenderableObjectHandle> &QSSGLayerRenderPreparationData::getTr
             theInfo.cameraDistanceSq = QVector3D::dotProduct(difference, theCameraDirection) + signedSquare(theInfo.obj->depthBias);
         }
 
-        static const auto iSRenderObjectPtrGreatThan = [](const QSSGRenderableObjectHandle &lhs, const QSSGRenderableObjectHandle &rhs) {
-            return lhs.cameraDistanceSq > rhs.cameraDistanceSq;
-        };
         // render furthest to nearest.
-        std::sort(renderedTransparentObjects.begin(), renderedTransparentObjects.end(), iSRenderObjectPtrGreatThan);
+        transparentSorter.sort(renderedTransparentObjects, QSSGRenderableSorter::Order::BackToFront, sortThreadPool());
     }
 
     return renderedTransparentObjects;
@@ -301,12 +379,8 @@ const QVector<QSSGRenderableObjectHandle> &QSSGLayerRenderPreparationData::getSc
             const QVector3D difference = theInfo.obj->worldCenterPoint - theCameraPosition;
             theInfo.cameraDistanceSq = QVector3D::dotProduct(difference, theCameraDirection) + signedSquare(theInfo.obj->depthBias);
         }
-        static const auto iSRenderObjectPtrGreatThan = [](const QSSGRenderableObjectHandle &lhs,
-                                                          const QSSGRenderableObjectHandle &rhs) {
-            return lhs.cameraDistanceSq > rhs.cameraDistanceSq;
-        };
         // render furthest to nearest.
-        std::sort(renderedScreenTextureObjects.begin(), renderedScreenTextureObjects.end(), iSRenderObjectPtrGreatThan);
+        screenTextureSorter.sort(renderedScreenTextureObjects, QSSGRenderableSorter::Order::BackToFront, sortThreadPool());
     }
     return renderedScreenTextureObjects;
 }
@@ -364,6 +438,14 @@ Q_REQUIRED_RESULT inline T *RENDER_FRAME_NEW(QSSGRenderContextInterface &ctx, Ar
     return new (ctx.perFrameAllocator().allocate(sizeof(T)))T(std::forward<Args>(args)...);
 }
 
+// Same, but from a specific per-frame allocator, e.g. the one of the worker
+// thread preparing a chunk of renderables
+template <typename T, typename... Args>
+Q_REQUIRED_RESULT inline T *RENDER_FRAME_NEW(QSSGPerFrameAllocator &allocator, Args&&... args)
+{
+    return new (allocator.allocate(sizeof(T)))T(std::forward<Args>(args)...);
+}
+
 QSSGShaderDefaultMaterialKey QSSGLayerRenderPreparationData::generateLightingKey(
         QSSGRenderDefaultMaterial::MaterialLighting inLightingType, const QSSGShaderLightList &lights, bool receivesShadows)
 {
@@ -394,20 +476,23 @@ QSSGShaderDefaultMaterialKey QSSGLayerRenderPreparationData::generateLightingKey
     return theGeneratedKey;
 }
 
-void QSSGLayerRenderPreparationData::prepareImageForRender(QSSGRenderImage &inImage,
-                                                           QSSGRenderableImage::Type inMapType,
-                                                           QSSGRenderableImage *&ioFirstImage,
-                                                           QSSGRenderableImage *&ioNextImage,
-                                                           QSSGRenderableObjectFlags &ioFlags,
-                                                           QSSGShaderDefaultMaterialKey &inShaderKey,
-                                                           quint32 inImageIndex,
-                                                           QSSGRenderDefaultMaterial *inMaterial)
+QSSGRenderImageTexture QSSGLayerRenderPreparationData::loadImageForRender(QSSGRenderImage &inImage, bool &ioDirty)
 {
+    // Preparing on worker threads, everything was loaded on the render thread
+    // beforehand and only needs to be looked up.
+    if (imagesPreloaded) {
+        const auto it = preloadedImages.constFind(&inImage);
+        Q_ASSERT(it != preloadedImages.cend());
+        if (it->dirty)
+            ioDirty = true;
+        return it->texture;
+    }
+
     QSSGRenderContextInterface &contextInterface = *renderer->contextInterface();
     const QSSGRef<QSSGBufferManager> &bufferManager = contextInterface.bufferManager();
 
     if (inImage.clearDirty())
-        ioFlags |= QSSGRenderableObjectFlag::Dirty;
+        ioDirty = true;
 
     // This is where the QRhiTexture gets created, if not already done. Note
     // that the bufferManager is per-QQuickWindow, and so per-render-thread.
@@ -418,7 +503,31 @@ void QSSGLayerRenderPreparationData::prepareImageForRender(QSSGRenderImage &inIm
     // models (QSSGRenderModel -> QSSGRenderMesh retrieved from the
     // bufferManager in each prepareModelForRender, etc.).
 
-    const QSSGRenderImageTexture texture = bufferManager->loadRenderImage(&inImage, inImage.m_generateMipmaps ? QSSGBufferManager::MipModeGenerated : QSSGBufferManager::MipModeNone);
+    return bufferManager->loadRenderImage(&inImage, inImage.m_generateMipmaps ? QSSGBufferManager::MipModeGenerated : QSSGBufferManager::MipModeNone);
+}
+
+void QSSGLayerRenderPreparationData::preloadImageForRender(QSSGRenderImage *inImage)
+{
+    if (!inImage || preloadedImages.contains(inImage))
+        return;
+    QSSGPreloadedRenderImage &preloaded = preloadedImages[inImage];
+    preloaded.texture = loadImageForRender(*inImage, preloaded.dirty);
+}
+
+void QSSGLayerRenderPreparationData::prepareImageForRender(QSSGRenderImage &inImage,
+                                                           QSSGRenderableImage::Type inMapType,
+                                                           QSSGRenderableImage *&ioFirstImage,
+                                                           QSSGRenderableImage *&ioNextImage,
+                                                           QSSGRenderableObjectFlags &ioFlags,
+                                                           QSSGShaderDefaultMaterialKey &inShaderKey,
+                                                           quint32 inImageIndex,
+                                                           QSSGRenderablePrepareChunk &chunk,
+                                                           QSSGRenderDefaultMaterial *inMaterial)
+{
+    bool dirty = false;
+    const QSSGRenderImageTexture texture = loadImageForRender(inImage, dirty);
+    if (dirty)
+        ioFlags |= QSSGRenderableObjectFlag::Dirty;
 
     if (texture.m_texture) {
         if (texture.m_flags.hasTransparency()
@@ -429,7 +538,7 @@ void QSSGLayerRenderPreparationData::prepareImageForRender(QSSGRenderImage &inIm
             ioFlags |= QSSGRenderableObjectFlag::HasTransparency;
         }
 
-        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(contextInterface, inMapType, inImage, texture);
+        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(*chunk.allocator, inMapType, inImage, texture);
         QSSGShaderKeyImageMap &theKeyProp = renderer->defaultMaterialShaderKeyProperties().m_imageMaps[inImageIndex];
 
         theKeyProp.setEnabled(inShaderKey, true);
@@ -568,8 +677,9 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
         QSSGRenderDefaultMaterial &inMaterial,
         QSSGRenderableObjectFlags &inExistingFlags,
         float inOpacity,
+        bool vertexColorsEnabled,
         const QSSGShaderLightList &lights,
-        QSSGLayerRenderPreparationResultFlags &ioFlags)
+        QSSGRenderablePrepareChunk &chunk)
 {
     QSSGRenderDefaultMaterial *theMaterial = &inMaterial;
     QSSGDefaultMaterialPreparationResult retval(generateLightingKey(theMaterial->lighting, lights, inExistingFlags.receivesShadows()));
@@ -612,7 +722,7 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
 //    }
 
     if (!renderer->defaultMaterialShaderKeyProperties().m_hasIbl.getValue(theGeneratedKey) && theMaterial->iblProbe) {
-        features.set(QSSGShaderFeatures::Feature::LightProbe, true);
+        chunk.usesLightProbe = true;
         renderer->defaultMaterialShaderKeyProperties().m_hasIbl.setValue(theGeneratedKey, true);
         // features.set(ShaderFeatureDefines::enableIblFov(),
         // m_Renderer.GetLayerRenderData()->m_Layer.m_ProbeFov < 180.0f );
@@ -650,7 +760,7 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
         renderer->defaultMaterialShaderKeyProperties().m_fresnelEnabled.setValue(theGeneratedKey, theMaterial->isFresnelEnabled());
 
         renderer->defaultMaterialShaderKeyProperties().m_vertexColorsEnabled.setValue(theGeneratedKey,
-                                                                                      theMaterial->isVertexColorsEnabled());
+                                                                                      vertexColorsEnabled);
         renderer->defaultMaterialShaderKeyProperties().m_clearcoatEnabled.setValue(theGeneratedKey,
                                                                                    theMaterial->isClearcoatEnabled());
         renderer->defaultMaterialShaderKeyProperties().m_transmissionEnabled.setValue(theGeneratedKey,
@@ -663,7 +773,7 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
 #define CHECK_IMAGE_AND_PREPARE(img, imgtype, shadercomponent)                          \
     if ((img))                                                                          \
         prepareImageForRender(*(img), imgtype, firstImage, nextImage, renderableFlags,  \
-                              theGeneratedKey, shadercomponent, &inMaterial)
+                              theGeneratedKey, shadercomponent, chunk, &inMaterial)
 
         if (theMaterial->type == QSSGRenderGraphObject::Type::PrincipledMaterial) {
             CHECK_IMAGE_AND_PREPARE(theMaterial->colorMap,
@@ -732,8 +842,8 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
         renderableFlags |= QSSGRenderableObjectFlag::HasTransparency;
 
     if (inMaterial.isTransmissionEnabled()) {
-        ioFlags.setRequiresScreenTexture(true);
-        ioFlags.setRequiresMipmapsForScreenTexture(true);
+        chunk.flags.setRequiresScreenTexture(true);
+        chunk.flags.setRequiresMipmapsForScreenTexture(true);
         renderableFlags |= QSSGRenderableObjectFlag::RequiresScreenTexture;
     }
 
@@ -741,14 +851,14 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareDefa
     if (retval.renderableFlags.isDirty())
         retval.dirty = true;
     if (retval.dirty)
-        renderer->addMaterialDirtyClear(&inMaterial);
+        chunk.dirtyMaterials.append(&inMaterial);
     return retval;
 }
 
 QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareCustomMaterialForRender(
         QSSGRenderCustomMaterial &inMaterial, QSSGRenderableObjectFlags &inExistingFlags,
         float inOpacity, bool alreadyDirty, const QSSGShaderLightList &lights,
-        QSSGLayerRenderPreparationResultFlags &ioFlags)
+        QSSGRenderablePrepareChunk &chunk)
 {
     QSSGDefaultMaterialPreparationResult retval(
                 generateLightingKey(QSSGRenderDefaultMaterial::MaterialLighting::FragmentLighting,
@@ -803,81 +913,79 @@ QSSGDefaultMaterialPreparationResult QSSGLayerRenderPreparationData::prepareCust
         renderableFlags |= QSSGRenderableObjectFlag::HasTransparency;
 
     if (inMaterial.m_renderFlags.testFlag(QSSGRenderCustomMaterial::RenderFlag::ScreenTexture)) {
-        ioFlags.setRequiresScreenTexture(true);
+        chunk.flags.setRequiresScreenTexture(true);
         renderableFlags |= QSSGRenderableObjectFlag::RequiresScreenTexture;
     }
 
     if (inMaterial.m_renderFlags.testFlag(QSSGRenderCustomMaterial::RenderFlag::ScreenMipTexture)) {
-        ioFlags.setRequiresScreenTexture(true);
-        ioFlags.setRequiresMipmapsForScreenTexture(true);
+        chunk.flags.setRequiresScreenTexture(true);
+        chunk.flags.setRequiresMipmapsForScreenTexture(true);
         renderableFlags |= QSSGRenderableObjectFlag::RequiresScreenTexture;
     }
 
     if (inMaterial.m_renderFlags.testFlag(QSSGRenderCustomMaterial::RenderFlag::DepthTexture))
-        ioFlags.setRequiresDepthTexture(true);
+        chunk.flags.setRequiresDepthTexture(true);
 
     if (inMaterial.m_renderFlags.testFlag(QSSGRenderCustomMaterial::RenderFlag::AoTexture)) {
-        ioFlags.setRequiresDepthTexture(true);
-        ioFlags.setRequiresSsaoPass(true);
+        chunk.flags.setRequiresDepthTexture(true);
+        chunk.flags.setRequiresSsaoPass(true);
     }
 
     retval.firstImage = nullptr;
 
     if (retval.dirty || alreadyDirty)
-        renderer->addMaterialDirtyClear(&inMaterial);
+        chunk.dirtyMaterials.append(&inMaterial);
     return retval;
 }
 
+// Completely transparent models cannot be pickable.  But models with completely
+// transparent materials still are.  This allows the artist to control pickability
+// in a somewhat fine-grained style.
+static std::array<QSSGRenderImage *, 17> defaultMaterialImages(const QSSGRenderDefaultMaterial &inMaterial)
+{
+    return { inMaterial.colorMap, inMaterial.emissiveMap,
+             inMaterial.specularReflection, inMaterial.specularMap,
+             inMaterial.roughnessMap, inMaterial.opacityMap,
+             inMaterial.bumpMap, inMaterial.normalMap,
+             inMaterial.translucencyMap, inMaterial.metalnessMap,
+             inMaterial.occlusionMap, inMaterial.heightMap,
+             inMaterial.clearcoatMap, inMaterial.clearcoatRoughnessMap,
+             inMaterial.clearcoatNormalMap, inMaterial.transmissionMap,
+             inMaterial.thicknessMap };
+}
+
+static bool canModelBePickable(const QSSGRenderModel &inModel)
+{
+    return (inModel.globalOpacity > QSSG_RENDER_MINIMUM_RENDER_OPACITY)
+            && inModel.flags.testFlag(QSSGRenderModel::Flag::GloballyPickable);
+}
+
 // inModel is const to emphasize the fact that its members cannot be written
 // here: in case there is a scene shared between multiple View3Ds in different
 // QQuickWindows, each window may run this in their own render thread, while
-// inModel is the same.
+// inModel is the same. The same goes for the worker threads preparing
+// different chunks of the same layer.
 bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel &inModel,
+                                                           QSSGRenderMesh *theMesh,
                                                            const QMatrix4x4 &inViewProjection,
-                                                           const QSSGOption<QSSGClippingFrustum> &inClipFrustum,
-                                                           QSSGShaderLightList &lights,
-                                                           QSSGLayerRenderPreparationResultFlags &ioFlags)
+                                                           qsizetype cullIndex,
+                                                           const QSSGShaderLightList &lights,
+                                                           QSSGRenderablePrepareChunk &chunk)
 {
-    QSSGRenderContextInterface &contextInterface = *renderer->contextInterface();
-    const QSSGRef<QSSGBufferManager> &bufferManager = contextInterface.bufferManager();
-
-    // Up to the BufferManager to employ the appropriate caching mechanisms, so
-    // loadMesh() is expected to be fast if already loaded. Note that preparing
-    // the same QSSGRenderModel in different QQuickWindows (possible when a
-    // scene is shared between View3Ds where the View3Ds belong to different
-    // windows) leads to a different QSSGRenderMesh since the BufferManager is,
-    // very correctly, per window, and so per scenegraph render thread.
-
-    QSSGRenderMesh *theMesh = bufferManager->loadMesh(&inModel);
-
-    if (theMesh == nullptr)
+    // Skip the whole model when the combined bounds of its subsets were
+    // culled, before doing any per subset work. The subsets of visible models
+    // are checked one by one further down.
+    const bool frustumCulling = cullIndex >= 0;
+    if (frustumCulling && !frustumCuller.isVisible(cullIndex)) {
+        chunk.culledObjectCount += theMesh->subsets.size();
         return false;
+    }
 
-    QSSGModelContext &theModelContext = *RENDER_FRAME_NEW<QSSGModelContext>(contextInterface, inModel, inViewProjection);
-    modelContexts.push_back(&theModelContext);
+    QSSGModelContext &theModelContext = *RENDER_FRAME_NEW<QSSGModelContext>(*chunk.allocator, inModel, inViewProjection);
+    chunk.modelContexts.push_back(&theModelContext);
 
     bool subsetDirty = false;
 
-    // Completely transparent models cannot be pickable.  But models with completely
-    // transparent materials still are.  This allows the artist to control pickability
-    // in a somewhat fine-grained style.
-    const bool canModelBePickable = (inModel.globalOpacity > QSSG_RENDER_MINIMUM_RENDER_OPACITY)
-                                    && (theModelContext.model.flags.testFlag(QSSGRenderModel::Flag::GloballyPickable));
-    if (canModelBePickable) {
-        // Check if there is BVH data, if not generate it
-        if (!theMesh->bvh) {
-            if (!inModel.meshPath.isNull())
-                theMesh->bvh = bufferManager->loadMeshBVH(inModel.meshPath);
-            else if (inModel.geometry)
-                theMesh->bvh = bufferManager->loadMeshBVH(inModel.geometry);
-
-            if (theMesh->bvh) {
-                for (int i = 0; i < theMesh->bvh->roots.count(); ++i)
-                    theMesh->subsets[i].bvhRoot = theMesh->bvh->roots.at(i);
-            }
-        }
-    }
-
     // many renderableFlags are the same for all the subsets
     QSSGRenderableObjectFlags renderableFlagsForModel;
     quint32 morphTargetAttribs[MAX_MORPH_TARGET] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -885,7 +993,7 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
     if (theMesh->subsets.size() > 0) {
         QSSGRenderSubset &theSubset = theMesh->subsets[0];
 
-        renderableFlagsForModel.setPickable(canModelBePickable);
+        renderableFlagsForModel.setPickable(canModelBePickable(inModel));
         renderableFlagsForModel.setCastsShadows(inModel.castsShadows);
         renderableFlagsForModel.setReceivesShadows(inModel.receivesShadows);
         renderableFlagsForModel.setReceivesReflections(inModel.receivesReflections);
@@ -957,19 +1065,18 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
             theMaterialObject = inModel.materials.at(idx);
 
         QSSGRenderSubset &theSubset = theMesh->subsets[idx];
+
+        // Culled subsets get no renderable, there is nothing to prepare for them
+        if (frustumCulling && !frustumCuller.isVisible(cullIndex + 1 + idx)) {
+            ++chunk.culledObjectCount;
+            continue;
+        }
+
         QSSGRenderableObjectFlags renderableFlags = renderableFlagsForModel;
         float subsetOpacity = inModel.globalOpacity;
         QVector3D theModelCenter(theSubset.bounds.center());
         theModelCenter = mat44::transform(inModel.globalTransform, theModelCenter);
 
-        if (subsetOpacity >= QSSG_RENDER_MINIMUM_RENDER_OPACITY && inClipFrustum.hasValue()) {
-            // Check bounding box against the clipping planes
-            QSSGBounds3 theGlobalBounds = theSubset.bounds;
-            theGlobalBounds.transform(theModelContext.model.globalTransform);
-            if (!inClipFrustum->intersectsWith(theGlobalBounds))
-                subsetOpacity = 0.0f;
-        }
-
         renderableFlags.setPointsTopology(theSubset.rhi.ia.topology == QRhiGraphicsPipeline::Points);
         QSSGRenderableObject *theRenderableObject = nullptr;
 
@@ -988,9 +1095,10 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
             QSSGRenderDefaultMaterial &theMaterial(static_cast<QSSGRenderDefaultMaterial &>(*theMaterialObject));
             // vertexColor should be supported in both DefaultMaterial and PrincipleMaterial
             // if the mesh has it.
-            theMaterial.vertexColorsEnabled = renderableFlags.hasAttributeColor() || usesInstancing || usesBlendParticles;
+            const bool vertexColorsEnabled = renderableFlags.hasAttributeColor() || usesInstancing || usesBlendParticles;
+            chunk.vertexColorsEnabled.append(qMakePair(&theMaterial, vertexColorsEnabled));
             QSSGDefaultMaterialPreparationResult theMaterialPrepResult(
-                    prepareDefaultMaterialForRender(theMaterial, renderableFlags, subsetOpacity, lights, ioFlags));
+                    prepareDefaultMaterialForRender(theMaterial, renderableFlags, subsetOpacity, vertexColorsEnabled, lights, chunk));
             QSSGShaderDefaultMaterialKey &theGeneratedKey(theMaterialPrepResult.materialKey);
             subsetOpacity = theMaterialPrepResult.opacity;
             QSSGRenderableImage *firstImage(theMaterialPrepResult.firstImage);
@@ -1013,7 +1121,7 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
             for (int i = 0; i < inModel.morphAttributes.size(); ++i)
                 renderer->defaultMaterialShaderKeyProperties().m_morphTargetAttributes[i].setValue(theGeneratedKey, inModel.morphAttributes[i] & morphTargetAttribs[i]);
 
-            theRenderableObject = RENDER_FRAME_NEW<QSSGSubsetRenderable>(contextInterface,
+            theRenderableObject = RENDER_FRAME_NEW<QSSGSubsetRenderable>(*chunk.allocator,
                                                                          renderableFlags,
                                                                          theModelCenter,
                                                                          renderer,
@@ -1031,12 +1139,12 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
         } else if (theMaterialObject->type == QSSGRenderGraphObject::Type::CustomMaterial) {
             QSSGRenderCustomMaterial &theMaterial(static_cast<QSSGRenderCustomMaterial &>(*theMaterialObject));
 
-            const QSSGRef<QSSGCustomMaterialSystem> &theMaterialSystem(contextInterface.customMaterialSystem());
+            const QSSGRef<QSSGCustomMaterialSystem> &theMaterialSystem(renderer->contextInterface()->customMaterialSystem());
             subsetDirty |= theMaterialSystem->prepareForRender(theModelContext.model, theSubset, theMaterial);
 
             QSSGDefaultMaterialPreparationResult theMaterialPrepResult(
                     prepareCustomMaterialForRender(theMaterial, renderableFlags, subsetOpacity, subsetDirty,
-                                                   lights, ioFlags));
+                                                   lights, chunk));
             QSSGShaderDefaultMaterialKey &theGeneratedKey(theMaterialPrepResult.materialKey);
             subsetOpacity = theMaterialPrepResult.opacity;
             QSSGRenderableImage *firstImage(theMaterialPrepResult.firstImage);
@@ -1062,10 +1170,7 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
             for (int i = 0; i < MAX_MORPH_TARGET; ++i)
                 renderer->defaultMaterialShaderKeyProperties().m_morphTargetAttributes[i].setValue(theGeneratedKey, morphTargetAttribs[i]);
 
-            if (theMaterial.m_iblProbe)
-                theMaterial.m_iblProbe->clearDirty();
-
-            theRenderableObject = RENDER_FRAME_NEW<QSSGSubsetRenderable>(contextInterface,
+            theRenderableObject = RENDER_FRAME_NEW<QSSGSubsetRenderable>(*chunk.allocator,
                                                                          renderableFlags,
                                                                          theModelCenter,
                                                                          renderer,
@@ -1081,38 +1186,24 @@ bool QSSGLayerRenderPreparationData::prepareModelForRender(const QSSGRenderModel
                                                                          morphWeights);
         }
         if (theRenderableObject) {
+            ++chunk.visibleObjectCount;
             if (theRenderableObject->renderableFlags.requiresScreenTexture())
-                screenTextureObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.screenTextureObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
             else if (theRenderableObject->renderableFlags.hasTransparency())
-                transparentObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.transparentObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
             else
-                opaqueObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.opaqueObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
         }
     }
 
-    // Now is the time to kick off the vertex/index buffer updates for all the
-    // new meshes (and their submeshes). This here is the last possible place
-    // to kick this off because the rest of the rendering pipeline will only
-    // see the individual sub-objects as "renderable objects".
-    bufferManager->commitBufferResourceUpdates();
-
     return subsetDirty;
 }
 
 bool QSSGLayerRenderPreparationData::prepareParticlesForRender(const QSSGRenderParticles &inParticles,
-                                                               const QSSGOption<QSSGClippingFrustum> &inClipFrustum,
-                                                               QSSGShaderLightList &lights)
+                                                               qsizetype cullIndex,
+                                                               const QSSGShaderLightList &lights,
+                                                               QSSGRenderablePrepareChunk &chunk)
 {
-    QSSGRenderContextInterface &contextInterface = *renderer->contextInterface();
-
-    const bool supportRgba32f = contextInterface.rhiContext()->rhi()->isTextureFormatSupported(QRhiTexture::RGBA32F);
-    if (!supportRgba32f) {
-        if (!particlesNotSupportedWarningShown)
-            qWarning () << "Particles not supported due to missing RGBA32F texture format support";
-        particlesNotSupportedWarningShown = true;
-        return false;
-    }
-
     QSSGRenderableObjectFlags renderableFlags;
     renderableFlags.setPickable(false);
     renderableFlags.setCastsShadows(false);
@@ -1127,45 +1218,29 @@ bool QSSGLayerRenderPreparationData::prepareParticlesForRender(const QSSGRenderP
     QVector3D center(inParticles.m_particleBuffer.bounds().center());
     center = mat44::transform(inParticles.globalTransform, center);
 
-    if (opacity >= QSSG_RENDER_MINIMUM_RENDER_OPACITY && inClipFrustum.hasValue()) {
-        // Check bounding box against the clipping planes
-        QSSGBounds3 theGlobalBounds = inParticles.m_particleBuffer.bounds();
-        theGlobalBounds.transform(inParticles.globalTransform);
-        if (!inClipFrustum->intersectsWith(theGlobalBounds))
-            opacity = 0.0f;
+    if (cullIndex >= 0 && !frustumCuller.isVisible(cullIndex)) {
+        ++chunk.culledObjectCount;
+        return false;
     }
 
     bool dirty = false;
 
     QSSGRenderableImage *firstImage = nullptr;
     if (inParticles.m_sprite) {
-        const QSSGRef<QSSGBufferManager> &bufferManager = contextInterface.bufferManager();
-
-        if (inParticles.m_sprite->clearDirty())
-            dirty = true;
-
-        const QSSGRenderImageTexture texture = bufferManager->loadRenderImage(inParticles.m_sprite,
-                                                                              inParticles.m_sprite->m_generateMipmaps ? QSSGBufferManager::MipModeGenerated : QSSGBufferManager::MipModeNone);
-        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(contextInterface, QSSGRenderableImage::Type::Diffuse, *inParticles.m_sprite, texture);
+        const QSSGRenderImageTexture texture = loadImageForRender(*inParticles.m_sprite, dirty);
+        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(*chunk.allocator, QSSGRenderableImage::Type::Diffuse, *inParticles.m_sprite, texture);
         firstImage = theImage;
     }
 
     QSSGRenderableImage *colorTable = nullptr;
     if (inParticles.m_colorTable) {
-        const QSSGRef<QSSGBufferManager> &bufferManager = contextInterface.bufferManager();
-
-        if (inParticles.m_colorTable->clearDirty())
-            dirty = true;
-
-        const QSSGRenderImageTexture texture = bufferManager->loadRenderImage(inParticles.m_colorTable,
-                                                                              inParticles.m_colorTable->m_generateMipmaps ? QSSGBufferManager::MipModeGenerated : QSSGBufferManager::MipModeNone);
-
-        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(contextInterface, QSSGRenderableImage::Type::Diffuse, *inParticles.m_colorTable, texture);
+        const QSSGRenderImageTexture texture = loadImageForRender(*inParticles.m_colorTable, dirty);
+        QSSGRenderableImage *theImage = RENDER_FRAME_NEW<QSSGRenderableImage>(*chunk.allocator, QSSGRenderableImage::Type::Diffuse, *inParticles.m_colorTable, texture);
         colorTable = theImage;
     }
 
     if (opacity > 0.0f && inParticles.m_particleBuffer.particleCount()) {
-        auto *theRenderableObject = RENDER_FRAME_NEW<QSSGParticlesRenderable>(contextInterface,
+        auto *theRenderableObject = RENDER_FRAME_NEW<QSSGParticlesRenderable>(*chunk.allocator,
                                                                               renderableFlags,
                                                                               center,
                                                                               renderer,
@@ -1175,24 +1250,317 @@ bool QSSGLayerRenderPreparationData::prepareParticlesForRender(const QSSGRenderP
                                                                               lights,
                                                                               opacity);
         if (theRenderableObject) {
+            ++chunk.visibleObjectCount;
             if (theRenderableObject->renderableFlags.requiresScreenTexture())
-                screenTextureObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.screenTextureObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
             else if (theRenderableObject->renderableFlags.hasTransparency())
-                transparentObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.transparentObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
             else
-                opaqueObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
+                chunk.opaqueObjects.push_back(QSSGRenderableObjectHandle::create(theRenderableObject));
         }
     }
 
     return dirty;
 }
 
+void QSSGLayerRenderPreparationData::prepareRenderableChunk(QSSGRenderablePrepareChunk &chunk,
+                                                            const QMatrix4x4 &inViewProjection)
+{
+    for (qsizetype idx = chunk.begin; idx < chunk.end; ++idx) {
+        const QSSGRenderablePrepareEntry &theEntry(prepareEntries.at(idx));
+        bool wasNodeDirty = false;
+        if (theEntry.node->type == QSSGRenderGraphObject::Type::Model) {
+            const QSSGRenderModel &theModel(*static_cast<QSSGRenderModel *>(theEntry.node));
+            wasNodeDirty = prepareModelForRender(theModel, theEntry.mesh, inViewProjection, theEntry.cullIndex, *theEntry.lights, chunk);
+        } else {
+            const QSSGRenderParticles &theParticles(*static_cast<QSSGRenderParticles *>(theEntry.node));
+            wasNodeDirty = prepareParticlesForRender(theParticles, theEntry.cullIndex, *theEntry.lights, chunk);
+        }
+        chunk.dirty = chunk.dirty || wasNodeDirty;
+    }
+}
+
+void QSSGRenderablePrepareChunk::reset(QSSGPerFrameAllocator *inAllocator, qsizetype inBegin, qsizetype inEnd)
+{
+    allocator = inAllocator;
+    begin = inBegin;
+    end = inEnd;
+    opaqueObjects.clear();
+    transparentObjects.clear();
+    screenTextureObjects.clear();
+    modelContexts.clear();
+    dirtyMaterials.clear();
+    vertexColorsEnabled.clear();
+    flags = QSSGLayerRenderPreparationResultFlags();
+    usesLightProbe = false;
+    dirty = false;
+    visibleObjectCount = 0;
+    culledObjectCount = 0;
+}
+
+// The buffer manager releases everything that was not used in a frame. Culled
+// objects are not prepared, so mark what they use as used, to not have to
+// load it all again when they come back into view.
+static void retainImage(const QSSGRef<QSSGBufferManager> &bufferManager, const QSSGRenderImage *inImage)
+{
+    if (inImage)
+        bufferManager->loadRenderImage(inImage, inImage->m_generateMipmaps ? QSSGBufferManager::MipModeGenerated : QSSGBufferManager::MipModeNone);
+}
+
+static void retainMaterialImages(const QSSGRef<QSSGBufferManager> &bufferManager, const QSSGRenderGraphObject *inMaterial)
+{
+    if (!inMaterial)
+        return;
+    if (inMaterial->type == QSSGRenderGraphObject::Type::DefaultMaterial
+            || inMaterial->type == QSSGRenderGraphObject::Type::PrincipledMaterial) {
+        for (const QSSGRenderImage *theImage : defaultMaterialImages(static_cast<const QSSGRenderDefaultMaterial &>(*inMaterial)))
+            retainImage(bufferManager, theImage);
+    } else if (inMaterial->type == QSSGRenderGraphObject::Type::CustomMaterial) {
+        const QSSGRenderCustomMaterial &theMaterial(static_cast<const QSSGRenderCustomMaterial &>(*inMaterial));
+        for (const QSSGRenderCustomMaterial::TextureProperty &theProperty : theMaterial.m_textureProperties) {
+            // Same as what the custom material system loads
+            if (theProperty.texImage) {
+                bufferManager->loadRenderImage(theProperty.texImage,
+                                               theProperty.mipFilterType != QSSGRenderTextureFilterOp::None
+                                                       ? QSSGBufferManager::MipModeGenerated
+                                                       : QSSGBufferManager::MipModeNone);
+            }
+        }
+    }
+}
+
+static void retainSubtreeResources(const QSSGRef<QSSGBufferManager> &bufferManager, const QSSGRenderNode &inNode)
+{
+    // Bounded subtrees have nothing but nodes and static models
+    if (inNode.type == QSSGRenderGraphObject::Type::Model && inNode.flags.testFlag(QSSGRenderNode::Flag::GloballyActive)) {
+        const QSSGRenderModel &theModel = static_cast<const QSSGRenderModel &>(inNode);
+        bufferManager->loadMesh(&theModel);
+        for (const QSSGRenderGraphObject *theMaterial : theModel.materials)
+            retainMaterialImages(bufferManager, theMaterial);
+    }
+    for (const QSSGRenderNode &theChild : inNode.children)
+        retainSubtreeResources(bufferManager, theChild);
+}
+
+void QSSGLayerRenderPreparationData::retainCulledResources()
+{
+    const QSSGRef<QSSGBufferManager> &bufferManager = renderer->contextInterface()->bufferManager();
+    for (const QSSGRenderablePrepareEntry &theEntry : qAsConst(prepareEntries)) {
+        if (theEntry.cullIndex < 0)
+            continue;
+        const bool nodeVisible = frustumCuller.isVisible(theEntry.cullIndex);
+        if (theEntry.node->type == QSSGRenderGraphObject::Type::Particles) {
+            if (!nodeVisible) {
+                const QSSGRenderParticles &theParticles(*static_cast<QSSGRenderParticles *>(theEntry.node));
+                retainImage(bufferManager, theParticles.m_sprite);
+                retainImage(bufferManager, theParticles.m_colorTable);
+            }
+            continue;
+        }
+        // The mesh was loaded already, only the material images are left
+        const QSSGRenderModel &theModel(*static_cast<QSSGRenderModel *>(theEntry.node));
+        for (qsizetype idx = 0, end = theEntry.mesh->subsets.size(); idx < end; ++idx) {
+            if (nodeVisible && frustumCuller.isVisible(theEntry.cullIndex + 1 + idx))
+                continue;
+            retainMaterialImages(bufferManager, idx < theModel.materials.size() ? theModel.materials.at(idx)
+                                                                                 : theModel.materials.last());
+        }
+    }
+}
+
+// Only plain opaque subsets with a default material are instanced: no skinning,
+// morphing, particles, reflection probes or instancing of their own
+static bool canAutoInstance(const QSSGSubsetRenderable &inRenderable)
+{
+    const QSSGRenderModel &theModel = inRenderable.modelContext.model;
+    return inRenderable.renderableFlags.isDefaultMaterialMeshSubset()
+            && !inRenderable.renderableFlags.receivesReflections()
+            && !inRenderable.instancing()
+            && inRenderable.boneGlobals.mSize == 0
+            && inRenderable.morphWeights.mSize == 0
+            && theModel.particleBuffer == nullptr;
+}
+
+static bool sameLights(const QSSGShaderLightList &inLights, const QSSGShaderLightList &inOtherLights)
+{
+    if (&inLights == &inOtherLights)
+        return true;
+    if (inLights.size() != inOtherLights.size())
+        return false;
+    for (qsizetype i = 0, end = inLights.size(); i < end; ++i) {
+        const QSSGShaderLight &theLight(inLights.at(i));
+        const QSSGShaderLight &theOtherLight(inOtherLights.at(i));
+        if (theLight.light != theOtherLight.light || theLight.enabled != theOtherLight.enabled
+                || theLight.shadows != theOtherLight.shadows)
+            return false;
+    }
+    return true;
+}
+
+// Everything that ends up in the uniforms, except for the transform, must match
+static bool canInstanceTogether(const QSSGSubsetRenderable &inRenderable, const QSSGSubsetRenderable &inOther)
+{
+    QSSGRenderableObjectFlags theFlags = inRenderable.renderableFlags;
+    QSSGRenderableObjectFlags theOtherFlags = inOther.renderableFlags;
+    for (QSSGRenderableObjectFlags *flags : { &theFlags, &theOtherFlags }) {
+        flags->setDirty(false);
+        flags->setPickable(false);
+    }
+    return &inRenderable.subset == &inOther.subset
+            && &inRenderable.material == &inOther.material
+            && inRenderable.opacity == inOther.opacity
+            && theFlags == theOtherFlags
+            && inRenderable.shaderDescription == inOther.shaderDescription
+            && sameLights(inRenderable.lights, inOther.lights);
+}
+
+// Auto-instancing needs at least this many renderables to replace with one
+static constexpr qsizetype QSSG_MIN_AUTO_INSTANCES = 2;
+
+void QSSGLayerRenderPreparationData::prepareAutoInstancing()
+{
+    QSSGRhiContext *rhiCtx = renderer->contextInterface()->rhiContext().data();
+    if (!renderer->autoInstancing() || !rhiCtx->rhi()->isFeatureSupported(QRhi::Instancing))
+        return;
+
+    autoInstanceCandidates.clear();
+    for (qsizetype idx = 0, end = opaqueObjects.size(); idx < end; ++idx) {
+        QSSGRenderableObject *theObject = opaqueObjects.at(idx).obj;
+        if (!theObject->renderableFlags.isDefaultMaterialMeshSubset())
+            continue;
+        QSSGSubsetRenderable *theRenderable = static_cast<QSSGSubsetRenderable *>(theObject);
+        if (!canAutoInstance(*theRenderable))
+            continue;
+        const size_t hash = qHashMulti(0, &theRenderable->subset, &theRenderable->material, theRenderable->shaderDescription.hash());
+        autoInstanceCandidates.append({ theRenderable, idx, -1, hash });
+    }
+    if (autoInstanceCandidates.size() < QSSG_MIN_AUTO_INSTANCES)
+        return;
+
+    // Candidates with the same hash are likely compatible. Split them up by
+    // the remaining state, the lights mostly, giving each group the index of
+    // its first renderable.
+    auto candidatesBegin = autoInstanceCandidates.begin();
+    auto candidatesEnd = autoInstanceCandidates.end();
+    std::sort(candidatesBegin, candidatesEnd, [](const QSSGAutoInstanceCandidate &lhs, const QSSGAutoInstanceCandidate &rhs) {
+        return lhs.hash < rhs.hash || (lhs.hash == rhs.hash && lhs.index < rhs.index);
+    });
+    for (auto first = candidatesBegin; first != candidatesEnd; ) {
+        auto last = first;
+        QVarLengthArray<QSSGAutoInstanceCandidate *, 8> leaders;
+        for (; last != candidatesEnd && last->hash == first->hash; ++last) {
+            for (QSSGAutoInstanceCandidate *leader : qAsConst(leaders)) {
+                if (canInstanceTogether(*leader->renderable, *last->renderable)) {
+                    last->leader = leader->index;
+                    break;
+                }
+            }
+            if (last->leader < 0) {
+                last->leader = last->index;
+                leaders.append(&*last);
+            }
+        }
+        first = last;
+    }
+    std::sort(candidatesBegin, candidatesEnd, [](const QSSGAutoInstanceCandidate &lhs, const QSSGAutoInstanceCandidate &rhs) {
+        return lhs.leader < rhs.leader || (lhs.leader == rhs.leader && lhs.index < rhs.index);
+    });
+
+    // The first renderable of each group draws the instances, with the global
+    // transforms of the models as the instance transforms, the others are
+    // dropped from the list
+    const auto &keyProperties = renderer->defaultMaterialShaderKeyProperties();
+    qsizetype tableCount = 0;
+    bool merged = false;
+    for (auto first = candidatesBegin; first != candidatesEnd; ) {
+        auto last = first;
+        while (last != candidatesEnd && last->leader == first->leader)
+            ++last;
+        const qsizetype instanceCount = last - first;
+        if (instanceCount < QSSG_MIN_AUTO_INSTANCES) {
+            first = last;
+            continue;
+        }
+
+        QByteArray theData(instanceCount * sizeof(QSSGRenderInstanceTableEntry), Qt::Uninitialized);
+        auto *theEntry = reinterpret_cast<QSSGRenderInstanceTableEntry *>(theData.data());
+        QSSGBounds3 theBounds;
+        for (auto it = first; it != last; ++it) {
+            const QMatrix4x4 &theTransform = it->renderable->globalTransform;
+            *theEntry++ = { theTransform.row(0), theTransform.row(1), theTransform.row(2),
+                            QVector4D(1.0f, 1.0f, 1.0f, 1.0f), QVector4D() };
+            QSSGBounds3 theInstanceBounds = it->renderable->bounds;
+            theInstanceBounds.transform(theTransform);
+            theBounds.include(theInstanceBounds);
+            if (it != first)
+                opaqueObjects[it->index].obj = nullptr;
+        }
+
+        if (tableCount == autoInstanceTables.size())
+            autoInstanceTables.append(new QSSGRenderInstanceTable);
+        QSSGRenderInstanceTable *theTable = autoInstanceTables.at(tableCount++);
+        // Unchanged data keeps the instance buffer as is
+        if (theTable->dataSize() != theData.size() || memcmp(theTable->constData(), theData.constData(), theData.size()) != 0)
+            theTable->setData(theData, int(instanceCount), sizeof(QSSGRenderInstanceTableEntry));
+
+        QSSGSubsetRenderable *theLeader = first->renderable;
+        theLeader->instanceTable = theTable;
+        theLeader->autoInstanced = true;
+        keyProperties.m_usesInstancing.setValue(theLeader->shaderDescription, true);
+        // The leader now uses another shader than the renderables it replaced
+        theLeader->updateStateSortKey();
+        // Taken into account for the shadow maps
+        theLeader->autoInstanceBounds = theBounds;
+        autoInstancedObjectCount += int(instanceCount);
+        merged = true;
+        first = last;
+    }
+
+    if (merged) {
+        opaqueObjects.erase(std::remove_if(opaqueObjects.begin(), opaqueObjects.end(),
+                                           [](const QSSGRenderableObjectHandle &handle) { return handle.obj == nullptr; }),
+                            opaqueObjects.end());
+    }
+}
+
+// Preparing a chunk is only worth a task of its own with at least this many nodes
+static constexpr qsizetype QSSG_MIN_NODES_PER_PREPARE_CHUNK = 128;
+
 bool QSSGLayerRenderPreparationData::prepareRenderablesForRender(const QMatrix4x4 &inViewProjection,
                                                                    const QSSGOption<QSSGClippingFrustum> &inClipFrustum,
                                                                    QSSGLayerRenderPreparationResultFlags &ioFlags)
 {
     bool wasDataDirty = false;
-    QSSGRhiContext *rhiCtx = renderer->contextInterface()->rhiContext().data();
+    QSSGRenderContextInterface &contextInterface = *renderer->contextInterface();
+    const QSSGRef<QSSGBufferManager> &bufferManager = contextInterface.bufferManager();
+    QSSGRhiContext *rhiCtx = contextInterface.rhiContext().data();
+
+    // The first pass does everything that touches shared state: the global
+    // transforms (which may update parents), the buffer manager and the dirty
+    // flags of objects shared between models. It also collects the world
+    // space bounds of the models, their subsets and the particles, which are
+    // then culled all at once.
+    prepareEntries.clear();
+    frustumCuller.clear();
+    // Only needed when a mesh gets loaded, so collected on the first miss
+    bool pickableMeshPathsValid = false;
+    const auto isMeshPickable = [&](const QSSGRenderModel &inModel) {
+        if (inModel.meshPath.isNull() || bufferManager->getMeshMap().contains(inModel.meshPath))
+            return false;
+        if (!pickableMeshPathsValid) {
+            pickableMeshPaths.clear();
+            for (const QSSGRenderableNodeEntry &theNodeEntry : qAsConst(renderableNodes)) {
+                if (theNodeEntry.node->type == QSSGRenderGraphObject::Type::Model
+                        && theNodeEntry.node->flags.testFlag(QSSGRenderNode::Flag::GloballyPickable)) {
+                    const QSSGRenderModel *theModel = static_cast<const QSSGRenderModel *>(theNodeEntry.node);
+                    if (!theModel->meshPath.isNull())
+                        pickableMeshPaths.insert(theModel->meshPath);
+                }
+            }
+            pickableMeshPathsValid = true;
+        }
+        return pickableMeshPaths.contains(inModel.meshPath);
+    };
     for (qint32 idx = 0, end = renderableNodes.size(); idx < end; ++idx) {
         QSSGRenderableNodeEntry &theNodeEntry(renderableNodes[idx]);
         QSSGRenderNode *theNode = theNodeEntry.node;
@@ -1202,16 +1570,59 @@ bool QSSGLayerRenderPreparationData::prepareRenderablesForRender(const QMatrix4x
             QSSGRenderModel *theModel = static_cast<QSSGRenderModel *>(theNode);
             theModel->calculateGlobalVariables();
             if (theModel->flags.testFlag(QSSGRenderModel::Flag::GloballyActive)) {
-                bool wasModelDirty = prepareModelForRender(*theModel, inViewProjection, inClipFrustum, theNodeEntry.lights, ioFlags);
-                wasDataDirty = wasDataDirty || wasModelDirty;
+                // Up to the BufferManager to employ the appropriate caching mechanisms, so
+                // loadMesh() is expected to be fast if already loaded. Note that preparing
+                // the same QSSGRenderModel in different QQuickWindows (possible when a
+                // scene is shared between View3Ds where the View3Ds belong to different
+                // windows) leads to a different QSSGRenderMesh since the BufferManager is,
+                // very correctly, per window, and so per scenegraph render thread.
+                QSSGRenderMesh *theMesh = bufferManager->loadMesh(theModel, isMeshPickable(*theModel));
+                if (theMesh == nullptr)
+                    break;
+
+                // Check if there is BVH data, if not generate it. This happens in the
+                // background, picking uses the subset bounds until it is ready.
+                if (canModelBePickable(*theModel) && !theMesh->bvh)
+                    bufferManager->requestMeshBVH(*theModel, theMesh);
+
+                for (QSSGRenderGraphObject *theMaterialObject : qAsConst(theModel->materials)) {
+                    if (theMaterialObject && theMaterialObject->type == QSSGRenderGraphObject::Type::CustomMaterial) {
+                        QSSGRenderCustomMaterial &theMaterial(static_cast<QSSGRenderCustomMaterial &>(*theMaterialObject));
+                        if (theMaterial.m_iblProbe)
+                            theMaterial.m_iblProbe->clearDirty();
+                    }
+                }
+
+                qsizetype cullIndex = -1;
+                if (inClipFrustum.hasValue() && theModel->globalOpacity >= QSSG_RENDER_MINIMUM_RENDER_OPACITY
+                        && !theMesh->subsets.isEmpty() && !theModel->materials.isEmpty()) {
+                    QSSGBounds3 theBounds;
+                    for (const QSSGRenderSubset &theSubset : qAsConst(theMesh->subsets))
+                        theBounds.include(theSubset.bounds);
+                    cullIndex = frustumCuller.addBounds(theBounds, theModel->globalTransform);
+                    for (const QSSGRenderSubset &theSubset : qAsConst(theMesh->subsets))
+                        frustumCuller.addBounds(theSubset.bounds, theModel->globalTransform);
+                }
+
+                prepareEntries.append({ theModel, theMesh, theNodeEntry.lights, cullIndex });
             }
         } break;
         case QSSGRenderGraphObject::Type::Particles: {
             QSSGRenderParticles *theParticles = static_cast<QSSGRenderParticles *>(theNode);
             theParticles->calculateGlobalVariables();
             if (theParticles->flags.testFlag(QSSGRenderModel::Flag::GloballyActive)) {
-                bool wasModelDirty = prepareParticlesForRender(*theParticles, inClipFrustum, theNodeEntry.lights);
-                wasDataDirty = wasDataDirty || wasModelDirty;
+                const bool supportRgba32f = rhiCtx->rhi()->isTextureFormatSupported(QRhiTexture::RGBA32F);
+                if (!supportRgba32f) {
+                    if (!particlesNotSupportedWarningShown)
+                        qWarning () << "Particles not supported due to missing RGBA32F texture format support";
+                    particlesNotSupportedWarningShown = true;
+                    break;
+                }
+                qsizetype cullIndex = -1;
+                if (inClipFrustum.hasValue() && theParticles->globalOpacity >= QSSG_RENDER_MINIMUM_RENDER_OPACITY)
+                    cullIndex = frustumCuller.addBounds(theParticles->m_particleBuffer.bounds(), theParticles->globalTransform);
+
+                prepareEntries.append({ theParticles, nullptr, theNodeEntry.lights, cullIndex });
             }
         } break;
         case QSSGRenderGraphObject::Type::Item2D: {
@@ -1234,6 +1645,87 @@ bool QSSGLayerRenderPreparationData::prepareRenderablesForRender(const QMatrix4x
             break;
         }
     }
+
+    // Now is the time to kick off the vertex/index buffer updates for all the
+    // new meshes (and their submeshes). This here is the last possible place
+    // to kick this off because the rest of the rendering pipeline will only
+    // see the individual sub-objects as "renderable objects".
+    bufferManager->commitBufferResourceUpdates();
+
+    if (inClipFrustum.hasValue()) {
+        frustumCuller.cull(*inClipFrustum);
+        retainCulledResources();
+    }
+
+    const qsizetype entryCount = prepareEntries.size();
+    const qsizetype chunkCount = qBound(qsizetype(1),
+                                        entryCount / QSSG_MIN_NODES_PER_PREPARE_CHUNK,
+                                        qsizetype(renderer->prepareThreadCount()));
+
+    // The worker threads cannot load textures, so load all the ones the
+    // materials and particles refer to up front. Culled nodes are skipped,
+    // but this still includes the ones of culled subsets of visible models,
+    // which the serial path does not load until visible.
+    imagesPreloaded = false;
+    preloadedImages.clear();
+    if (chunkCount > 1) {
+        for (const QSSGRenderablePrepareEntry &theEntry : qAsConst(prepareEntries)) {
+            if (theEntry.cullIndex >= 0 && !frustumCuller.isVisible(theEntry.cullIndex))
+                continue;
+            if (theEntry.node->type == QSSGRenderGraphObject::Type::Particles) {
+                const QSSGRenderParticles &theParticles(*static_cast<QSSGRenderParticles *>(theEntry.node));
+                preloadImageForRender(theParticles.m_sprite);
+                preloadImageForRender(theParticles.m_colorTable);
+                continue;
+            }
+            const QSSGRenderModel &theModel(*static_cast<QSSGRenderModel *>(theEntry.node));
+            for (QSSGRenderGraphObject *theMaterialObject : theModel.materials) {
+                if (!theMaterialObject || (theMaterialObject->type != QSSGRenderGraphObject::Type::DefaultMaterial
+                                           && theMaterialObject->type != QSSGRenderGraphObject::Type::PrincipledMaterial))
+                    continue;
+                const QSSGRenderDefaultMaterial &theMaterial(static_cast<const QSSGRenderDefaultMaterial &>(*theMaterialObject));
+                for (QSSGRenderImage *theImage : defaultMaterialImages(theMaterial)) {
+                    preloadImageForRender(theImage);
+                }
+            }
+        }
+        imagesPreloaded = true;
+    }
+
+    // Contiguous ranges of entries, so merging the chunks in order gives the
+    // same lists as preparing everything serially.
+    prepareChunks.resize(chunkCount);
+    for (qsizetype i = 0; i < chunkCount; ++i) {
+        QSSGPerFrameAllocator *allocator = (i == 0) ? &contextInterface.perFrameAllocator()
+                                                    : &contextInterface.workerFrameAllocator(int(i - 1));
+        prepareChunks[i].reset(allocator, entryCount * i / chunkCount, entryCount * (i + 1) / chunkCount);
+    }
+
+    QSSGRenderTasks::run(chunkCount > 1 ? renderer->prepareThreadPool() : nullptr, int(chunkCount), [&](int chunk) {
+        prepareRenderableChunk(prepareChunks[chunk], inViewProjection);
+    });
+
+    for (const QSSGRenderablePrepareChunk &chunk : qAsConst(prepareChunks)) {
+        opaqueObjects += chunk.opaqueObjects;
+        transparentObjects += chunk.transparentObjects;
+        screenTextureObjects += chunk.screenTextureObjects;
+        modelContexts += chunk.modelContexts;
+        for (QSSGRenderGraphObject *theMaterial : chunk.dirtyMaterials)
+            renderer->addMaterialDirtyClear(theMaterial);
+        // vertexColorsEnabled is read later on by the shader generator, and
+        // as before, the last model using the material wins
+        for (const auto &vertexColors : chunk.vertexColorsEnabled)
+            vertexColors.first->vertexColorsEnabled = vertexColors.second;
+        ioFlags |= chunk.flags;
+        visibleObjectCount += chunk.visibleObjectCount;
+        culledObjectCount += chunk.culledObjectCount;
+        if (chunk.usesLightProbe)
+            features.set(QSSGShaderFeatures::Feature::LightProbe, true);
+        wasDataDirty = wasDataDirty || chunk.dirty;
+    }
+
+    prepareAutoInstancing();
+
     return wasDataDirty;
 }
 
@@ -1297,15 +1789,95 @@ void QSSGLayerRenderPreparationData::prepareReflectionProbesForRender()
     }
 }
 
-static bool scopeLight(QSSGRenderNode *node, QSSGRenderNode *lightScope)
+quint32 QSSGLayerRenderPreparationData::lightScopeMask(const QSSGRenderNode *inNode)
 {
-    // check if the node is parent of the lightScope
-    while (node) {
-        if (node == lightScope)
-            return true;
-        node = node->parent;
+    // A node is in the scopes of its parent, and in the ones it is the scope
+    // of itself. Resolving the parents first means every node in the graph
+    // is only looked at once.
+    const auto it = lightScopeMasks.constFind(inNode);
+    if (it != lightScopeMasks.constEnd())
+        return *it;
+    quint32 mask = inNode->parent ? lightScopeMask(inNode->parent) : 0;
+    for (qsizetype lightIdx = 0, end = lightScopes.size(); lightIdx < end; ++lightIdx) {
+        if (lightScopes.at(lightIdx) == inNode)
+            mask |= 1u << lightIdx;
+    }
+    lightScopeMasks.insert(inNode, mask);
+    return mask;
+}
+
+void QSSGLayerRenderPreparationData::updateNodeLights(const QSSGShaderLightList &inLights, bool nodesUnchanged)
+{
+    Q_STATIC_ASSERT(QSSG_MAX_NUM_LIGHTS <= 32);
+    const quint32 graphGeneration = QSSGRenderNode::graphGeneration();
+    bool scopesValid = lightScopesValid && lightScopesGraphGeneration == graphGeneration
+            && lightScopes.size() == inLights.size();
+    quint32 scopedLights = 0;
+    for (qsizetype lightIdx = 0, end = inLights.size(); lightIdx < end; ++lightIdx) {
+        QSSGRenderNode *theScope = inLights.at(lightIdx).light->m_scope;
+        scopesValid = scopesValid && lightScopes.at(lightIdx) == theScope;
+        if (theScope)
+            scopedLights |= 1u << lightIdx;
     }
-    return false;
+    if (!scopesValid) {
+        lightScopeMasks.clear();
+        lightScopes.resize(inLights.size());
+        for (qsizetype lightIdx = 0, end = inLights.size(); lightIdx < end; ++lightIdx)
+            lightScopes[lightIdx] = inLights.at(lightIdx).light->m_scope;
+        lightScopesGraphGeneration = graphGeneration;
+        lightScopesValid = true;
+    }
+
+    const auto fillLightList = [&inLights, scopedLights](QSSGShaderLightList &outLights, quint32 mask) {
+        outLights = inLights;
+        for (qsizetype lightIdx = 0, end = outLights.size(); lightIdx < end; ++lightIdx) {
+            if (scopedLights & (1u << lightIdx))
+                outLights[lightIdx].enabled = (mask & (1u << lightIdx)) != 0;
+        }
+    };
+
+    // The same nodes in the same scopes, only the light data may have
+    // changed. The nodes point into the lists already.
+    if (nodesUnchanged && scopesValid && sharedLightListsValid) {
+        for (qsizetype listIdx = 0, end = sharedLightLists.size(); listIdx < end; ++listIdx)
+            fillLightList(sharedLightLists[listIdx], sharedLightListMasks.at(listIdx));
+        return;
+    }
+
+    // Assign the nodes to the lists first, the list storage may move while
+    // adding them
+    sharedLightListMasks.clear();
+    nodeLightListIndices.resize(renderableNodes.size());
+    if (scopedLights) {
+        QHash<quint32, qsizetype> listIndices;
+        quint32 lastMask = 0;
+        qsizetype lastListIdx = -1;
+        for (qsizetype idx = 0, end = renderableNodes.size(); idx < end; ++idx) {
+            const quint32 mask = lightScopeMask(renderableNodes.at(idx).node) & scopedLights;
+            if (lastListIdx < 0 || mask != lastMask) {
+                const auto it = listIndices.constFind(mask);
+                if (it != listIndices.constEnd()) {
+                    lastListIdx = *it;
+                } else {
+                    lastListIdx = sharedLightListMasks.size();
+                    listIndices.insert(mask, lastListIdx);
+                    sharedLightListMasks.append(mask);
+                }
+                lastMask = mask;
+            }
+            nodeLightListIndices[idx] = lastListIdx;
+        }
+    } else {
+        sharedLightListMasks.append(0);
+        std::fill(nodeLightListIndices.begin(), nodeLightListIndices.end(), 0);
+    }
+
+    sharedLightLists.resize(sharedLightListMasks.size());
+    for (qsizetype listIdx = 0, end = sharedLightLists.size(); listIdx < end; ++listIdx)
+        fillLightList(sharedLightLists[listIdx], sharedLightListMasks.at(listIdx));
+    for (qsizetype idx = 0, end = renderableNodes.size(); idx < end; ++idx)
+        renderableNodes[idx].lights = &sharedLightLists.at(nodeLightListIndices.at(idx));
+    sharedLightListsValid = true;
 }
 
 static const int REDUCED_MAX_LIGHT_COUNT_THRESHOLD_BYTES = 4096; // 256 vec4
@@ -1358,6 +1930,10 @@ void QSSGLayerRenderPreparationData::prepareForRender()
         // Get the layer's width and height.
         if (layer.flags.testFlag(QSSGRenderLayer::Flag::Dirty)) {
             wasDirty = true;
+            // Layer changes used to make all the nodes dirty. They no longer
+            // do, but still count as a data change, restarting progressive
+            // antialiasing.
+            wasDataDirty = true;
             layer.calculateGlobalVariables();
         }
 
@@ -1412,51 +1988,6 @@ void QSSGLayerRenderPreparationData::prepareForRender()
                     features.set(QSSGShaderFeatures::Feature::RGBELightProbe, true);
             }
 
-            // Do not just clear() renderableNodes and friends. Rather, reuse
-            // the space (even if clear does not actually deallocate, it still
-            // costs time to run dtors and such). In scenes with a static node
-            // count in the range of thousands this may matter.
-            int renderableNodeCount = 0;
-            int cameraNodeCount = 0;
-            int lightNodeCount = 0;
-            int reflectionProbeCount = 0;
-            quint32 dfsIndex = 0;
-            // First model using skeleton clears the dirty flag so we need another mechanism
-            // to tell to the other models the skeleton is dirty.
-            QVector<QSSGRenderSkeleton*> dirtySkeletons;
-            for (auto &theChild : layer.children)
-                maybeQueueNodeForRender(theChild,
-                                        renderableNodes,
-                                        renderableNodeCount,
-                                        cameras,
-                                        cameraNodeCount,
-                                        lights,
-                                        lightNodeCount,
-                                        reflectionProbes,
-                                        reflectionProbeCount,
-                                        dfsIndex,
-                                        dirtySkeletons);
-            dirtySkeletons.clear();
-
-            if (renderableNodes.size() != renderableNodeCount)
-                renderableNodes.resize(renderableNodeCount);
-            if (cameras.size() != cameraNodeCount)
-                cameras.resize(cameraNodeCount);
-            if (lights.size() != lightNodeCount)
-                lights.resize(lightNodeCount);
-            if (reflectionProbes.size() != reflectionProbeCount)
-                reflectionProbes.resize(reflectionProbeCount);
-
-            renderableItem2Ds.clear();
-
-            globalLights.clear();
-            for (const auto &oo : qAsConst(opaqueObjects))
-                delete oo.obj;
-            opaqueObjects.clear();
-            for (const auto &to : qAsConst(transparentObjects))
-                delete to.obj;
-            transparentObjects.clear();
-
             // Cameras
             // 1. If there's an explicit camera set and it's active (visible) we'll use that.
             // 2. ... if the explicitly set camera is not visible, no further attempts will be done.
@@ -1474,7 +2005,99 @@ void QSSGLayerRenderPreparationData::prepareForRender()
                 // 2.
                 if (!camera->flags.testFlag(QSSGRenderCamera::Flag::GloballyActive))
                     camera = nullptr;
+            }
+
+            // In retained mode the node lists are only collected again when
+            // nodes were added or removed since the last time.
+            const bool retained = renderer->retainedRenderables();
+            const quint32 graphGeneration = QSSGRenderNode::graphGeneration();
+            const bool reuseNodes = retained && retainedNodesValid && retainedGraphGeneration == graphGeneration;
+
+            // With the explicit camera known before walking the scene, whole
+            // subtrees outside of its frustum can be skipped on the way. The
+            // picking tree still needs all the renderables in there. Not when
+            // retaining the lists, those must have everything.
+            QSSGSubtreeCulling subtreeCulling;
+            subtreeCulling.refitNodes = &subtreeBoundsRefitNodes;
+            if (camera && camera->enableFrustumClipping && !retained) {
+                QMatrix4x4 viewProjection(Qt::Uninitialized);
+                camera->calculateViewProjectionMatrix(viewProjection);
+                clippingFrustum = calculateClippingFrustum(*camera, viewProjection);
+                subtreeCulling.clipFrustum = &clippingFrustum.getValue();
+                subtreeCulling.pickingNodes = &pickingNodes;
+                subtreeCulling.pickEverything = renderer->isGlobalPickingEnabled();
+            }
+
+            subtreeBoundsRefitNodes.clear();
+            culledSubtrees.clear();
+            // First model using skeleton clears the dirty flag so we need another mechanism
+            // to tell to the other models the skeleton is dirty.
+            QVector<QSSGRenderSkeleton*> dirtySkeletons;
+            if (reuseNodes) {
+                // The bone and morph data still change without changes to
+                // the graph. The renderables are in depth first order, same
+                // as when collecting them.
+                for (const QSSGRenderableNodeEntry &theNodeEntry : qAsConst(renderableNodes)) {
+                    if (theNodeEntry.node->type == QSSGRenderGraphObject::Type::Model)
+                        prepareModelDeformation(static_cast<QSSGRenderModel *>(theNodeEntry.node), dirtySkeletons);
+                }
             } else {
+                // Do not just clear() renderableNodes and friends. Rather, reuse
+                // the space (even if clear does not actually deallocate, it still
+                // costs time to run dtors and such). In scenes with a static node
+                // count in the range of thousands this may matter.
+                int renderableNodeCount = 0;
+                int cameraNodeCount = 0;
+                int lightNodeCount = 0;
+                int reflectionProbeCount = 0;
+                quint32 dfsIndex = 0;
+                subtreeCulling.culledSubtrees = &culledSubtrees;
+                for (auto &theChild : layer.children)
+                    maybeQueueNodeForRender(theChild,
+                                            subtreeCulling,
+                                            renderableNodes,
+                                            renderableNodeCount,
+                                            cameras,
+                                            cameraNodeCount,
+                                            lights,
+                                            lightNodeCount,
+                                            reflectionProbes,
+                                            reflectionProbeCount,
+                                            dfsIndex,
+                                            dirtySkeletons);
+                culledObjectCount += subtreeCulling.culledObjectCount;
+                if (!culledSubtrees.isEmpty()) {
+                    const auto &bufferManager = renderer->contextInterface()->bufferManager();
+                    for (const QSSGRenderNode *theNode : qAsConst(culledSubtrees))
+                        retainSubtreeResources(bufferManager, *theNode);
+                }
+
+                if (renderableNodes.size() != renderableNodeCount)
+                    renderableNodes.resize(renderableNodeCount);
+                if (cameras.size() != cameraNodeCount)
+                    cameras.resize(cameraNodeCount);
+                if (lights.size() != lightNodeCount)
+                    lights.resize(lightNodeCount);
+                if (reflectionProbes.size() != reflectionProbeCount)
+                    reflectionProbes.resize(reflectionProbeCount);
+                if (pickingNodes.size() != subtreeCulling.pickingNodeCount)
+                    pickingNodes.resize(subtreeCulling.pickingNodeCount);
+
+                retainedNodesValid = retained;
+                retainedGraphGeneration = graphGeneration;
+                sharedLightListsValid = false;
+            }
+            dirtySkeletons.clear();
+
+            renderableItem2Ds.clear();
+
+            globalLights.clear();
+            // The renderables live in the per-frame allocator, which releases
+            // them all at once when the next frame begins
+            opaqueObjects.clear();
+            transparentObjects.clear();
+
+            if (layer.explicitCamera == nullptr) {
                 // 3.
                 for (auto iter = cameras.cbegin();
                      (camera == nullptr) && (iter != cameras.cend()); iter++) {
@@ -1496,11 +2119,17 @@ void QSSGLayerRenderPreparationData::prepareForRender()
             prepareResourceLoaders();
 
             QSSGShaderLightList renderableLights;
+            clusteredLights.clear();
             int shadowMapCount = 0;
+            // The clusters are read with texel fetches from a float texture
+            const bool clusterLights = layer.clusteredLighting && rhiCtx->isValid()
+                    && rhiCtx->rhi()->isFeatureSupported(QRhi::TexelFetch)
+                    && rhiCtx->rhi()->isTextureFormatSupported(QRhiTexture::RGBA32F);
             // Lights
             const int maxLightCount = effectiveMaxLightCount(features);
             for (auto rIt = lights.crbegin(); rIt != lights.crend(); rIt++) {
-                if (renderableLights.count() == maxLightCount) {
+                // Clustered lights may still follow
+                if (renderableLights.count() == maxLightCount && !clusterLights) {
                     if (!tooManyLightsWarningShown) {
                         qWarning("Too many lights in scene, maximum is %d", maxLightCount);
                         tooManyLightsWarningShown = true;
@@ -1517,6 +2146,31 @@ void QSSGLayerRenderPreparationData::prepareForRender()
                 shaderLight.light = theLight;
                 shaderLight.enabled = theLight->flags.testFlag(QSSGRenderLight::Flag::GloballyActive);
                 shaderLight.enabled &= theLight->m_brightness > 0.0f;
+
+                if (clusterLights && !theLight->m_castShadow && !theLight->m_scope
+                        && theLight->type != QSSGRenderLight::Type::DirectionalLight) {
+                    if (!shaderLight.enabled)
+                        continue;
+                    if (clusteredLights.count() == QSSGLightClusters::MaxLights) {
+                        if (!tooManyClusteredLightsWarningShown) {
+                            qWarning("Too many clustered lights in scene, maximum is %d", QSSGLightClusters::MaxLights);
+                            tooManyClusteredLightsWarningShown = true;
+                        }
+                        continue;
+                    }
+                    shaderLight.direction = theLight->getScalingCorrectDirection();
+                    clusteredLights.push_back(shaderLight);
+                    continue;
+                }
+
+                if (renderableLights.count() == maxLightCount) {
+                    if (!tooManyLightsWarningShown) {
+                        qWarning("Too many lights in scene, maximum is %d", maxLightCount);
+                        tooManyLightsWarningShown = true;
+                    }
+                    continue;
+                }
+
                 shaderLight.shadows = theLight->m_castShadow;
                 if (shaderLight.shadows && shaderLight.enabled) {
                     if (shadowMapCount < QSSG_MAX_NUM_SHADOW_MAPS) {
@@ -1565,30 +2219,22 @@ void QSSGLayerRenderPreparationData::prepareForRender()
                     globalLights.append(shaderLight);
             }
 
-            for (qint32 idx = 0, end = renderableNodes.size(); idx < end; ++idx) {
-                QSSGRenderableNodeEntry &theNodeEntry(renderableNodes[idx]);
-                theNodeEntry.lights = renderableLights;
-                for (auto &light : theNodeEntry.lights) {
-                    if (light.light->m_scope)
-                        light.enabled = scopeLight(theNodeEntry.node, light.light->m_scope);
-                }
+            updateNodeLights(renderableLights, reuseNodes);
+
+            if (camera && !clusteredLights.isEmpty()) {
+                lightClusters.update(clusteredLights, *camera,
+                                     renderer->prepareThreadCount() > 1 ? renderer->prepareThreadPool() : nullptr);
+                features.set(QSSGShaderFeatures::Feature::ClusteredLighting, true);
+            } else {
+                lightClusters.clear();
             }
 
             QMatrix4x4 viewProjection(Qt::Uninitialized);
             if (camera) {
                 camera->calculateViewProjectionMatrix(viewProjection);
                 if (camera->enableFrustumClipping) {
-                    QSSGClipPlane nearPlane;
-                    QMatrix3x3 theUpper33(camera->globalTransform.normalMatrix());
-
-                    QVector3D dir(mat33::transform(theUpper33, QVector3D(0, 0, -1)));
-                    dir.normalize();
-                    nearPlane.normal = dir;
-                    QVector3D theGlobalPos = camera->getGlobalPos() + camera->clipNear * dir;
-                    nearPlane.d = -(QVector3D::dotProduct(dir, theGlobalPos));
-                    // the near plane's bbox edges are calculated in the clipping frustum's
-                    // constructor.
-                    clippingFrustum = QSSGClippingFrustum(viewProjection, nearPlane);
+                    if (!subtreeCulling.clipFrustum)
+                        clippingFrustum = calculateClippingFrustum(*camera, viewProjection);
                 } else if (clippingFrustum.hasValue()) {
                     clippingFrustum.setEmpty();
                 }
@@ -1603,6 +2249,26 @@ void QSSGLayerRenderPreparationData::prepareForRender()
                                                                 thePrepResult.flags);
             wasDataDirty = wasDataDirty || renderablesDirty;
 
+            // The global transforms are up to date now, refit the bounds of the
+            // changed subtrees, then refit or rebuild the picking tree
+            refitSubtreeBounds();
+
+            const auto &bufferManager = renderer->contextInterface()->bufferManager();
+            layer.pickingBVH->update(subtreeCulling.pickingNodes ? pickingNodes : renderableNodes,
+                                     renderer->isGlobalPickingEnabled(),
+                                     [&bufferManager](const QSSGRenderNode &node) {
+                QSSGBounds3 bounds;
+                if (node.type == QSSGRenderGraphObject::Type::Model) {
+                    if (const QSSGRenderMesh *mesh = bufferManager->getMeshForPicking(static_cast<const QSSGRenderModel &>(node))) {
+                        for (const QSSGRenderSubset &subset : mesh->subsets)
+                            bounds.include(subset.bounds);
+                    }
+                }
+                return bounds;
+            });
+            // Let picking see the meshes loaded and the BVHs finished by now
+            bufferManager->publishPickingSnapshot();
+
             prepareReflectionProbesForRender();
         }
 
@@ -1633,6 +2299,67 @@ void QSSGLayerRenderPreparationData::prepareForRender()
 
 }
 
+void QSSGLayerRenderPreparationData::refitSubtreeBounds()
+{
+    const QSSGRef<QSSGBufferManager> &bufferManager = renderer->contextInterface()->bufferManager();
+
+    // In reverse depth first order, so that the children are up to date
+    // before their parents include them.
+    for (auto it = subtreeBoundsRefitNodes.crbegin(), end = subtreeBoundsRefitNodes.crend(); it != end; ++it) {
+        QSSGRenderNode &theNode = **it;
+        // Nodes without renderables may still be dirty, no dirty node can be
+        // in a subtree that is skipped
+        theNode.calculateGlobalVariables();
+
+        QSSGBounds3 theBounds;
+        int theObjectCount = 0;
+        bool unbounded = false;
+        bool pickable = false;
+        if (theNode.type == QSSGRenderGraphObject::Type::Model) {
+            const QSSGRenderModel &theModel = static_cast<const QSSGRenderModel &>(theNode);
+            pickable = theModel.flags.testFlag(QSSGRenderNode::Flag::LocallyPickable);
+            if (theModel.flags.testFlag(QSSGRenderNode::Flag::GloballyActive)) {
+                // Skinning, morphing, instancing and particles change what is
+                // drawn without changes to the model itself
+                QSSGRenderMesh *theMesh = nullptr;
+                if (!theModel.skin && !theModel.skeleton && theModel.morphTargets.isEmpty()
+                        && !theModel.instancing() && !theModel.particleBuffer) {
+                    theMesh = bufferManager->loadMesh(&theModel);
+                }
+                if (theMesh) {
+                    QSSGBounds3 theModelBounds;
+                    for (const QSSGRenderSubset &theSubset : qAsConst(theMesh->subsets))
+                        theModelBounds.include(theSubset.bounds);
+                    theModelBounds.transform(theModel.globalTransform);
+                    theBounds.include(theModelBounds);
+                    if (!theModel.materials.isEmpty())
+                        theObjectCount = theMesh->subsets.size();
+                } else {
+                    unbounded = true;
+                }
+            }
+        } else if (theNode.type != QSSGRenderGraphObject::Type::Node
+                   && theNode.type != QSSGRenderGraphObject::Type::ImportScene) {
+            // Lights, cameras and the like have to be collected every frame
+            unbounded = true;
+        }
+
+        for (const QSSGRenderNode &theChild : theNode.children) {
+            unbounded = unbounded || theChild.flags.testFlag(QSSGRenderNode::Flag::SubtreeUnbounded);
+            pickable = pickable || theChild.flags.testFlag(QSSGRenderNode::Flag::SubtreePickable);
+            theBounds.include(theChild.subtreeBounds);
+            theObjectCount += theChild.subtreeObjectCount;
+        }
+
+        theNode.subtreeBounds = theBounds;
+        theNode.subtreeObjectCount = theObjectCount;
+        theNode.flags.setFlag(QSSGRenderNode::Flag::SubtreeUnbounded, unbounded);
+        theNode.flags.setFlag(QSSGRenderNode::Flag::SubtreePickable, pickable);
+        theNode.flags.setFlag(QSSGRenderNode::Flag::SubtreeBoundsDirty, false);
+    }
+    subtreeBoundsRefitNodes.clear();
+}
+
 void QSSGLayerRenderPreparationData::resetForFrame()
 {
     transparentObjects.clear();
@@ -1649,6 +2376,9 @@ void QSSGLayerRenderPreparationData::resetForFrame()
     renderedItem2Ds.clear();
     renderedOpaqueDepthPrepassObjects.clear();
     renderedDepthWriteObjects.clear();
+    visibleObjectCount = 0;
+    culledObjectCount = 0;
+    autoInstancedObjectCount = 0;
 }
 
 QSSGLayerRenderPreparationResult::QSSGLayerRenderPreparationResult(const QRectF &inViewport, const QRectF &inScissor, QSSGRenderLayer &inLayer)
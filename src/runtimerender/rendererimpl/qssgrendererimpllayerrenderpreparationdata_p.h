@@ -45,21 +45,29 @@
 #include <QtQuick3DRuntimeRender/private/qssgrendershadercache_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderableobjects_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderclippingfrustum_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderfrustumculler_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderablesorter_p.h>
+#include <QtQuick3DRuntimeRender/private/qssglightclusters_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendershadowmap_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendereffect_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderitem2d_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderresourceloader_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderreflectionmap_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendercamera_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderimagetexture_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgperframeallocator_p.h>
 
 #include <QtQuick3DUtils/private/qssgrenderbasetypes_p.h>
 
+#include <QtCore/qset.h>
+
 #define QSSG_RENDER_MINIMUM_RENDER_OPACITY .01f
 
 QT_BEGIN_NAMESPACE
 
 class QSSGRendererImpl;
 struct QSSGRenderableObject;
+struct QSSGRenderMesh;
 
 enum class QSSGLayerRenderPreparationResultFlag
 {
@@ -163,7 +171,9 @@ struct QSSGLayerRenderPreparationResult
 struct QSSGRenderableNodeEntry
 {
     QSSGRenderNode *node = nullptr;
-    QSSGShaderLightList lights;
+    // Shared by all the nodes lit by the same lights, see
+    // QSSGLayerRenderPreparationData::updateNodeLights()
+    const QSSGShaderLightList *lights = nullptr;
     QSSGRenderableNodeEntry() = default;
     QSSGRenderableNodeEntry(QSSGRenderNode &inNode) : node(&inNode) {}
 };
@@ -179,6 +189,62 @@ struct QSSGDefaultMaterialPreparationResult
     explicit QSSGDefaultMaterialPreparationResult(QSSGShaderDefaultMaterialKey inMaterialKey);
 };
 
+// A model or particles node that passed the serial part of the preparation
+// (transforms, mesh loading) and is ready to get its renderable objects
+struct QSSGRenderablePrepareEntry
+{
+    QSSGRenderNode *node = nullptr;
+    QSSGRenderMesh *mesh = nullptr; // Models only
+    const QSSGShaderLightList *lights = nullptr;
+    // Index of the node bounds in the frustum culler, followed by the bounds
+    // of each subset for models. -1 when not culled.
+    qsizetype cullIndex = -1;
+};
+
+// An opaque subset renderable that may be drawn as an instance of another
+// one with auto-instancing
+struct QSSGAutoInstanceCandidate
+{
+    QSSGSubsetRenderable *renderable = nullptr;
+    // Index in the opaque objects, of this one and of the renderable drawing it
+    qsizetype index = -1;
+    qsizetype leader = -1;
+    // Of the subset, the material and the shader key
+    size_t hash = 0;
+};
+
+struct QSSGPreloadedRenderImage
+{
+    QSSGRenderImageTexture texture;
+    bool dirty = false;
+};
+
+// The results of preparing a contiguous range of the prepare entries. Large
+// layers are split into several chunks prepared on worker threads, each with
+// its own allocator. The chunks are merged in order afterwards, so the lists
+// end up the same as when preparing everything serially.
+struct QSSGRenderablePrepareChunk
+{
+    QSSGPerFrameAllocator *allocator = nullptr;
+    qsizetype begin = 0;
+    qsizetype end = 0;
+
+    QVector<QSSGRenderableObjectHandle> opaqueObjects;
+    QVector<QSSGRenderableObjectHandle> transparentObjects;
+    QVector<QSSGRenderableObjectHandle> screenTextureObjects;
+    QVector<QSSGModelContext *> modelContexts;
+    QVector<QSSGRenderGraphObject *> dirtyMaterials;
+    // Shared materials are only written while merging, in node order
+    QVector<QPair<QSSGRenderDefaultMaterial *, bool>> vertexColorsEnabled;
+    QSSGLayerRenderPreparationResultFlags flags;
+    bool usesLightProbe = false;
+    bool dirty = false;
+    int visibleObjectCount = 0;
+    int culledObjectCount = 0;
+
+    void reset(QSSGPerFrameAllocator *inAllocator, qsizetype inBegin, qsizetype inEnd);
+};
+
 // Data used strictly in the render preparation step.
 struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
 {
@@ -198,15 +264,43 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
 
     // renderableNodes have all lights, but properties configured for specific node
     QVector<QSSGRenderableNodeEntry> renderableNodes;
+    // The renderables for the picking tree when whole subtrees were culled,
+    // as renderableNodes lacks the ones in there
+    QVector<QSSGRenderableNodeEntry> pickingNodes;
+    // Nodes with SubtreeBoundsDirty set seen while collecting the nodes, in
+    // depth first order
+    QVector<QSSGRenderNode *> subtreeBoundsRefitNodes;
+    // The roots of the subtrees skipped by the frustum while collecting the
+    // nodes
+    QVector<QSSGRenderNode *> culledSubtrees;
     QVector<QSSGRenderCamera *> cameras;
     QVector<QSSGRenderLight *> lights;
     QVector<QSSGRenderReflectionProbe *> reflectionProbes;
     QVector<QSSGRenderableNodeEntry> renderableItem2Ds;
+    // Retained mode, see QSSGRenderer::setRetainedRenderables(). The lists
+    // above stay valid until the graph generation changes.
+    quint32 retainedGraphGeneration = 0;
+    bool retainedNodesValid = false;
+    // The light lists of the renderable nodes, one per set of scoped lights
+    // lighting them. The sets are bits of the light indices, resolved once
+    // per node and kept while the graph and the scopes of the lights stay
+    // the same.
+    QVector<QSSGShaderLightList> sharedLightLists;
+    QVector<quint32> sharedLightListMasks;
+    QVector<qsizetype> nodeLightListIndices;
+    QHash<const QSSGRenderNode *, quint32> lightScopeMasks;
+    QVarLengthArray<QSSGRenderNode *, 16> lightScopes;
+    quint32 lightScopesGraphGeneration = 0;
+    bool lightScopesValid = false;
+    bool sharedLightListsValid = false;
     QVector<QSSGRenderableNodeEntry> renderedItem2Ds;
 
     // Results of prepare for render.
     QSSGRenderCamera *camera;
     QSSGShaderLightList globalLights; // Contains all lights
+    // With clustered lighting, the lights that are not in the light lists
+    QSSGShaderLightList clusteredLights;
+    QSSGLightClusters lightClusters;
     TRenderableObjectList opaqueObjects;
     TRenderableObjectList transparentObjects;
     TRenderableObjectList screenTextureObjects;
@@ -217,20 +311,50 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
     TRenderableObjectList renderedScreenTextureObjects;
     TRenderableObjectList renderedOpaqueDepthPrepassObjects;
     TRenderableObjectList renderedDepthWriteObjects;
+    // Remember the orders of the previous frame, which the new ones are
+    // likely close to
+    QSSGRenderableSorter opaqueSorter;
+    QSSGRenderableSorter transparentSorter;
+    QSSGRenderableSorter screenTextureSorter;
     QSSGOption<QSSGClippingFrustum> clippingFrustum;
     QSSGOption<QSSGLayerRenderPreparationResult> layerPrepResult;
     QSSGOption<QVector3D> cameraDirection;
 
     TModelContextPtrList modelContexts;
 
+    // Renderable objects (model subsets and particles) prepared for rendering
+    // and skipped by frustum culling in the last prepareForRender
+    int visibleObjectCount = 0;
+    int culledObjectCount = 0;
+    // Renderables drawn with a generated instance table in the last frame
+    int autoInstancedObjectCount = 0;
+
     QSSGShaderFeatures features;
     bool tooManyLightsWarningShown = false;
+    bool tooManyClusteredLightsWarningShown = false;
     bool tooManyShadowLightsWarningShown = false;
     bool particlesNotSupportedWarningShown = false;
 
     QSSGRenderShadowMap *shadowMapManager = nullptr;
     QSSGRenderReflectionMap *reflectionMapManager = nullptr;
 
+    // Scratch data of prepareRenderablesForRender, kept to reuse the storage
+    QVector<QSSGRenderablePrepareEntry> prepareEntries;
+    QVector<QSSGRenderablePrepareChunk> prepareChunks;
+    QSSGRenderFrustumCuller frustumCuller;
+    // The meshes used by pickable models. Their data is kept for building
+    // the picking BVH, whichever model happens to load them first. Only
+    // collected in frames where a mesh is not loaded yet.
+    QSet<QSSGRenderPath> pickableMeshPaths;
+    // Textures loaded up front when the chunks are prepared on worker threads,
+    // which must not touch the buffer manager. Empty otherwise.
+    QHash<QSSGRenderImage *, QSSGPreloadedRenderImage> preloadedImages;
+    bool imagesPreloaded = false;
+    // Auto-instancing, see QSSGRenderer::setAutoInstancing(). The generated
+    // tables are reused by the groups of the next frames, in order.
+    QVector<QSSGAutoInstanceCandidate> autoInstanceCandidates;
+    QVector<QSSGRenderInstanceTable *> autoInstanceTables;
+
     QSSGLayerRenderPreparationData(QSSGRenderLayer &inLayer, const QSSGRef<QSSGRenderer> &inRenderer);
     virtual ~QSSGLayerRenderPreparationData();
 
@@ -243,7 +367,12 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
                                QSSGRenderableImage *&ioNextImage,
                                QSSGRenderableObjectFlags &ioFlags,
                                QSSGShaderDefaultMaterialKey &ioGeneratedShaderKey,
-                               quint32 inImageIndex, QSSGRenderDefaultMaterial *inMaterial = nullptr);
+                               quint32 inImageIndex,
+                               QSSGRenderablePrepareChunk &chunk,
+                               QSSGRenderDefaultMaterial *inMaterial = nullptr);
+    // Returns the texture for inImage, from preloadedImages when set up
+    QSSGRenderImageTexture loadImageForRender(QSSGRenderImage &inImage, bool &ioDirty);
+    void preloadImageForRender(QSSGRenderImage *inImage);
 
     void setVertexInputPresence(const QSSGRenderableObjectFlags &renderableFlags,
                                 QSSGShaderDefaultMaterialKey &key,
@@ -252,24 +381,34 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
     QSSGDefaultMaterialPreparationResult prepareDefaultMaterialForRender(QSSGRenderDefaultMaterial &inMaterial,
                                                                            QSSGRenderableObjectFlags &inExistingFlags,
                                                                            float inOpacity,
+                                                                         bool vertexColorsEnabled,
                                                                          const QSSGShaderLightList &lights,
-                                                                         QSSGLayerRenderPreparationResultFlags &ioFlags);
+                                                                         QSSGRenderablePrepareChunk &chunk);
 
     QSSGDefaultMaterialPreparationResult prepareCustomMaterialForRender(QSSGRenderCustomMaterial &inMaterial,
                                                                         QSSGRenderableObjectFlags &inExistingFlags,
                                                                         float inOpacity, bool alreadyDirty,
                                                                         const QSSGShaderLightList &lights,
-                                                                        QSSGLayerRenderPreparationResultFlags &ioFlags);
+                                                                        QSSGRenderablePrepareChunk &chunk);
 
-    // Updates lights with model receivesShadows. Do not pass globalLights.
+    // The prepare functions below may run on worker threads, they must only
+    // write to the chunk and the objects allocated from it.
     bool prepareModelForRender(const QSSGRenderModel &inModel,
+                               QSSGRenderMesh *theMesh,
                                const QMatrix4x4 &inViewProjection,
-                               const QSSGOption<QSSGClippingFrustum> &inClipFrustum,
-                               QSSGShaderLightList &lights,
-                               QSSGLayerRenderPreparationResultFlags &ioFlags);
+                               qsizetype cullIndex,
+                               const QSSGShaderLightList &lights,
+                               QSSGRenderablePrepareChunk &chunk);
     bool prepareParticlesForRender(const QSSGRenderParticles &inParticles,
-                                   const QSSGOption<QSSGClippingFrustum> &inClipFrustum,
-                                   QSSGShaderLightList &lights);
+                                   qsizetype cullIndex,
+                                   const QSSGShaderLightList &lights,
+                                   QSSGRenderablePrepareChunk &chunk);
+    // Keeps the images of the culled objects loaded
+    void retainCulledResources();
+    void prepareRenderableChunk(QSSGRenderablePrepareChunk &chunk,
+                                const QMatrix4x4 &inViewProjection);
+    // Merges the compatible opaque renderables into instanced ones
+    void prepareAutoInstancing();
 
     // Helper function used during PrepareForRender and PrepareAndRender
     bool prepareRenderablesForRender(const QMatrix4x4 &inViewProjection,
@@ -278,11 +417,21 @@ struct Q_QUICK3DRUNTIMERENDER_EXPORT QSSGLayerRenderPreparationData
 
     void prepareResourceLoaders();
 
+    // Recalculates the subtree bounds of the nodes in subtreeBoundsRefitNodes
+    void refitSubtreeBounds();
+    // Points the renderable nodes at the shared light lists. With
+    // nodesUnchanged the lists are only updated in place when possible.
+    void updateNodeLights(const QSSGShaderLightList &inLights, bool nodesUnchanged);
+    // The bits of the scoped lights inNode is in
+    quint32 lightScopeMask(const QSSGRenderNode *inNode);
+
     virtual void prepareForRender();
     // Helper function used during prepareForRender
     void prepareReflectionProbesForRender();
 
     QVector3D getCameraDirection();
+    // The pool to sort large lists on, if any
+    QThreadPool *sortThreadPool() const;
     // Per-frame cache of renderable objects post-sort.
     const QVector<QSSGRenderableObjectHandle> &getOpaqueRenderableObjects(bool performSort = true);
     // If layer depth test is false, this may also contain opaque objects.
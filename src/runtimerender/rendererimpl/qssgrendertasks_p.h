@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QSSGRENDERTASKS_P_H
+#define QSSGRENDERTASKS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
+
+#include <QtCore/QThreadPool>
+
+QT_BEGIN_NAMESPACE
+
+namespace QSSGRenderTasks {
+
+// Calls function(task) for every task in [0, taskCount), task 0 on the
+// calling thread and the others on threadPool, and waits for all of them.
+// threadPool may be null when taskCount is 1.
+template<typename Function>
+inline void run(QThreadPool *threadPool, int taskCount, const Function &function)
+{
+    for (int task = 1; task < taskCount; ++task)
+        threadPool->start([&function, task]() { function(task); });
+    function(0);
+    if (taskCount > 1)
+        threadPool->waitForDone();
+}
+
+} // namespace QSSGRenderTasks
+
+QT_END_NAMESPACE
+
+#endif // QSSGRENDERTASKS_P_H
@@ -39,6 +39,7 @@
 #include <QtQuick/QSGTexture>
 
 #include <QtCore/QDir>
+#include <QtCore/QThreadPool>
 #include <QtGui/private/qimage_p.h>
 #include <QtQuick/private/qsgtexture_p.h>
 #include <QtQuick/private/qsgcompressedtexture_p.h>
@@ -50,6 +51,9 @@
 #include <QtQuick3DRuntimeRender/private/qssgrendertexturedata_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendercontextcore_p.h>
 
+#include <functional>
+#include <memory>
+
 QT_BEGIN_NAMESPACE
 
 //#define QSSG_RENDERBUFFER_DEBUGGING
@@ -85,6 +89,14 @@ static MeshIdxNamePair splitRuntimeMeshPath(const QSSGRenderPath &rpath)
     return (ok) ? qMakePair(idx, strings.at(1)) : qMakePair(qsizetype(-1), QString());
 }
 
+static qint64 meshDataSize(const QSSGMesh::Mesh &mesh)
+{
+    const QSSGMesh::Mesh::BVHData bvhData = mesh.bvhData();
+    return mesh.vertexBuffer().data.size() + mesh.indexBuffer().data.size()
+            + bvhData.nodes.size() * sizeof(QSSGMeshBVHNode)
+            + bvhData.triangleOrder.size() * sizeof(quint32);
+}
+
 namespace {
 struct PrimitiveEntry
 {
@@ -113,6 +125,10 @@ static constexpr QSize sizeForMipLevel(int mipLevel, const QSize &baseLevelSize)
 
 QSSGBufferManager::QSSGBufferManager()
 {
+    // In MB, QT_QUICK3D_RETAINED_MESH_DATA_BUDGET=0 disables keeping the data
+    bool ok = false;
+    const int budget = qEnvironmentVariableIntValue("QT_QUICK3D_RETAINED_MESH_DATA_BUDGET", &ok);
+    m_retainedMeshDataBudget = qint64(ok ? qMax(0, budget) : 128) * 1024 * 1024;
 }
 
 QSSGBufferManager::~QSSGBufferManager()
@@ -966,9 +982,32 @@ QString QSSGBufferManager::primitivePath(const QString &primitive)
     return {};
 }
 
-QMutex *QSSGBufferManager::meshUpdateMutex()
+void QSSGBufferManager::publishPickingSnapshot()
 {
-    return &meshBufferMutex;
+    if (m_pickingSnapshotDirty) {
+        m_pickingSnapshots.publish(m_pendingPickingSnapshot);
+        m_pickingSnapshotDirty = false;
+    } else {
+        m_pickingSnapshots.reclaim();
+    }
+}
+
+void QSSGBufferManager::setMeshPickingData(const QSSGRenderPath &inSourcePath, const QSSGRenderMesh *mesh)
+{
+    if (mesh)
+        m_pendingPickingSnapshot.meshes.insert(inSourcePath, QSSGRenderMeshPickingData::create(*mesh));
+    else
+        m_pendingPickingSnapshot.meshes.remove(inSourcePath);
+    m_pickingSnapshotDirty = true;
+}
+
+void QSSGBufferManager::setCustomMeshPickingData(const QSSGRenderGeometry *geometry, const QSSGRenderMesh *mesh)
+{
+    if (mesh)
+        m_pendingPickingSnapshot.customMeshes.insert(geometry, QSSGRenderMeshPickingData::create(*mesh));
+    else
+        m_pendingPickingSnapshot.customMeshes.remove(geometry);
+    m_pickingSnapshotDirty = true;
 }
 
 QSSGMesh::Mesh QSSGBufferManager::loadPrimitive(const QString &inRelativePath)
@@ -986,13 +1025,13 @@ QSSGMesh::Mesh QSSGBufferManager::loadPrimitive(const QString &inRelativePath)
     return QSSGMesh::Mesh();
 }
 
-QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderModel *model)
+QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderModel *model, bool retainForPicking)
 {
     QSSGRenderMesh *theMesh = nullptr;
     if (model->meshPath.isNull() && model->geometry)
         theMesh = loadCustomMesh(model->geometry);
     else
-        theMesh = loadMesh(model->meshPath);
+        theMesh = loadMesh(model->meshPath, retainForPicking || model->flags.testFlag(QSSGRenderModel::Flag::GloballyPickable));
 
     return theMesh;
 }
@@ -1192,7 +1231,7 @@ QSSGRenderMesh *QSSGBufferManager::createRenderMesh(const QSSGMesh::Mesh &mesh)
         QSSGRenderSubset subset;
         const QSSGMesh::Mesh::Subset &source(meshSubsets[subsetIdx]);
         subset.bounds = QSSGBounds3(source.bounds.min, source.bounds.max);
-        subset.bvhRoot = nullptr;
+        subset.bvhRoot = -1;
         subset.count = source.count;
         subset.offset = source.offset;
 
@@ -1210,7 +1249,6 @@ QSSGRenderMesh *QSSGBufferManager::createRenderMesh(const QSSGMesh::Mesh &mesh)
 
 void QSSGBufferManager::releaseGeometry(QSSGRenderGeometry *geometry)
 {
-    QMutexLocker meshMutexLocker(&meshBufferMutex);
     const auto meshItr = customMeshMap.constFind(geometry);
     if (meshItr != customMeshMap.cend()) {
 #ifdef QSSG_RENDERBUFFER_DEBUGGING
@@ -1220,6 +1258,7 @@ void QSSGBufferManager::releaseGeometry(QSSGRenderGeometry *geometry)
         Q_QUICK3D_PROFILE_IF_ENABLED(QQuick3DProfiler::Quick3DCustomMeshLoad, decreaseMemoryStat(meshItr.value().mesh));
         delete meshItr.value().mesh;
         customMeshMap.erase(meshItr);
+        setCustomMeshPickingData(geometry, nullptr);
         Q_QUICK3D_PROFILE_END_WITH_PAYLOAD(QQuick3DProfiler::Quick3DCustomMeshLoad,
                                            stats.meshDataSize);
     }
@@ -1247,7 +1286,6 @@ void QSSGBufferManager::releaseTextureData(QSSGRenderTextureData *textureData)
 
 void QSSGBufferManager::releaseMesh(const QSSGRenderPath &inSourcePath)
 {
-    QMutexLocker meshMutexLocker(&meshBufferMutex);
     const auto meshItr = meshMap.constFind(inSourcePath);
     if (meshItr != meshMap.cend()) {
 #ifdef QSSG_RENDERBUFFER_DEBUGGING
@@ -1256,7 +1294,9 @@ void QSSGBufferManager::releaseMesh(const QSSGRenderPath &inSourcePath)
         Q_QUICK3D_PROFILE_START(QQuick3DProfiler::Quick3DMeshLoad);
         Q_QUICK3D_PROFILE_IF_ENABLED(QQuick3DProfiler::Quick3DMeshLoad, decreaseMemoryStat(meshItr.value().mesh));
         delete meshItr.value().mesh;
-        meshMap.erase(meshItr);
+        takeRetainedMeshData(inSourcePath);
+        meshMap.remove(inSourcePath);
+        setMeshPickingData(inSourcePath, nullptr);
         Q_QUICK3D_PROFILE_END_WITH_PAYLOAD(QQuick3DProfiler::Quick3DMeshLoad,
                                            stats.meshDataSize);
     }
@@ -1299,7 +1339,6 @@ void QSSGBufferManager::cleanupUnreferencedBuffers(quint32 frameId, QSSGRenderLa
     };
 
     {
-        QMutexLocker meshMutexLocker(&meshBufferMutex);
         // Meshes (by path)
         auto meshIterator = meshMap.cbegin();
         while (meshIterator != meshMap.cend()) {
@@ -1308,6 +1347,11 @@ void QSSGBufferManager::cleanupUnreferencedBuffers(quint32 frameId, QSSGRenderLa
                 qDebug() << "- releaseGeometry: " << meshIterator.key().path() << currentLayer;
 #endif
                 delete meshIterator.value().mesh;
+                if (meshIterator.value().retainedMeshData.isValid()) {
+                    m_retainedMeshDataSize -= meshDataSize(meshIterator.value().retainedMeshData);
+                    m_retainedMeshDataQueue.removeOne(meshIterator.key());
+                }
+                setMeshPickingData(meshIterator.key(), nullptr);
                 meshIterator = meshMap.erase(meshIterator);
             } else {
                 ++meshIterator;
@@ -1322,6 +1366,7 @@ void QSSGBufferManager::cleanupUnreferencedBuffers(quint32 frameId, QSSGRenderLa
                 qDebug() << "- releaseGeometry: " << customMeshIterator.key() << currentLayer;
 #endif
                 delete customMeshIterator.value().mesh;
+                setCustomMeshPickingData(customMeshIterator.key(), nullptr);
                 customMeshIterator = customMeshMap.erase(customMeshIterator);
             } else {
                 ++customMeshIterator;
@@ -1432,7 +1477,7 @@ void QSSGBufferManager::unregisterMeshData(const QString &assetId)
         g_assetMeshMap->erase(AssetMeshMap::const_iterator(it));
 }
 
-QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderPath &inMeshPath)
+QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderPath &inMeshPath, bool retainForPicking)
 {
     if (inMeshPath.isNull())
         return nullptr;
@@ -1458,6 +1503,10 @@ QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderPath &inMeshPath)
 #endif
     auto ret = createRenderMesh(result);
     meshMap.insert(inMeshPath, { ret, {{currentLayer, 1}} });
+    setMeshPickingData(inMeshPath, ret);
+    // Pickable meshes will need the data again to build the BVH
+    if (retainForPicking)
+        retainMeshData(inMeshPath, result);
     Q_QUICK3D_PROFILE_IF_ENABLED(QQuick3DProfiler::Quick3DMeshLoad, increaseMemoryStat(ret));
 
     Q_QUICK3D_PROFILE_END_WITH_PAYLOAD(QQuick3DProfiler::Quick3DMeshLoad,
@@ -1465,6 +1514,45 @@ QSSGRenderMesh *QSSGBufferManager::loadMesh(const QSSGRenderPath &inMeshPath)
     return ret;
 }
 
+void QSSGBufferManager::setRetainedMeshDataBudget(qint64 bytes)
+{
+    m_retainedMeshDataBudget = qMax<qint64>(0, bytes);
+    while (m_retainedMeshDataSize > m_retainedMeshDataBudget && !m_retainedMeshDataQueue.isEmpty())
+        takeRetainedMeshData(m_retainedMeshDataQueue.first());
+}
+
+void QSSGBufferManager::retainMeshData(const QSSGRenderPath &inSourcePath, const QSSGMesh::Mesh &mesh)
+{
+    const qint64 size = meshDataSize(mesh);
+    if (size > m_retainedMeshDataBudget)
+        return;
+
+    // Make room by dropping the oldest copies
+    while (m_retainedMeshDataSize + size > m_retainedMeshDataBudget && !m_retainedMeshDataQueue.isEmpty())
+        takeRetainedMeshData(m_retainedMeshDataQueue.first());
+
+    auto meshItr = meshMap.find(inSourcePath);
+    if (meshItr == meshMap.end() || meshItr->retainedMeshData.isValid())
+        return;
+
+    meshItr->retainedMeshData = mesh;
+    m_retainedMeshDataSize += size;
+    m_retainedMeshDataQueue.append(inSourcePath);
+}
+
+QSSGMesh::Mesh QSSGBufferManager::takeRetainedMeshData(const QSSGRenderPath &inSourcePath)
+{
+    QSSGMesh::Mesh mesh;
+    auto meshItr = meshMap.find(inSourcePath);
+    if (meshItr != meshMap.end() && meshItr->retainedMeshData.isValid()) {
+        mesh = meshItr->retainedMeshData;
+        meshItr->retainedMeshData = QSSGMesh::Mesh();
+        m_retainedMeshDataSize -= meshDataSize(mesh);
+        m_retainedMeshDataQueue.removeOne(inSourcePath);
+    }
+    return mesh;
+}
+
 QSSGRenderMesh *QSSGBufferManager::loadCustomMesh(QSSGRenderGeometry *geometry)
 {
     auto meshIterator = customMeshMap.find(geometry);
@@ -1493,6 +1581,7 @@ QSSGRenderMesh *QSSGBufferManager::loadCustomMesh(QSSGRenderGeometry *geometry)
             meshIterator->mesh = createRenderMesh(mesh);
             meshIterator->usageCounts[currentLayer] = 1;
             meshIterator->generationId = geometry->generationId();
+            setCustomMeshPickingData(geometry, meshIterator->mesh);
             Q_QUICK3D_PROFILE_IF_ENABLED(QQuick3DProfiler::Quick3DCustomMeshLoad, increaseMemoryStat(meshIterator->mesh));
         } else {
             qWarning("Mesh building failed: %s", qPrintable(error));
@@ -1505,6 +1594,26 @@ QSSGRenderMesh *QSSGBufferManager::loadCustomMesh(QSSGRenderGeometry *geometry)
     return meshIterator->mesh;
 }
 
+// Set QT_QUICK3D_BVH_SAH=1 to build the picking BVHs with the surface area
+// heuristic instead of splitting at the average triangle center. The quality
+// of each tree is reported in the QSSG.perf_info category.
+static QSSGMeshBVH *buildMeshBVH(QSSGMeshBVHBuilder &builder)
+{
+    static const bool useSAH = (qEnvironmentVariableIntValue("QT_QUICK3D_BVH_SAH") != 0);
+    builder.setSplitMethod(useSAH ? QSSGMeshBVHBuilder::SplitMethod::SAH
+                                  : QSSGMeshBVHBuilder::SplitMethod::AverageCentroid);
+    QSSGMeshBVH *bvh = builder.buildTree();
+    if (bvh && PERF_INFO().isDebugEnabled()) {
+        const QSSGMeshBVH::Statistics stats = bvh->statistics();
+        qCDebug(PERF_INFO, "BVH (%s): %lld triangles, %d nodes, %d leaves (%d empty), depth %d, "
+                           "leaf triangles avg %.2f max %d, SAH cost %.2f",
+                useSAH ? "SAH" : "average centroid", qlonglong(bvh->triangles.size()),
+                stats.nodeCount, stats.leafCount, stats.emptyLeafCount, stats.maxDepth,
+                stats.averageLeafTriangles, stats.maxLeafTriangles, stats.sahCost);
+    }
+    return bvh;
+}
+
 QSSGMeshBVH *QSSGBufferManager::loadMeshBVH(const QSSGRenderPath &inSourcePath)
 {
     const QSSGMesh::Mesh mesh = loadMeshData(inSourcePath);
@@ -1513,10 +1622,10 @@ QSSGMeshBVH *QSSGBufferManager::loadMeshBVH(const QSSGRenderPath &inSourcePath)
         return nullptr;
     }
     QSSGMeshBVHBuilder meshBVHBuilder(mesh);
-    return meshBVHBuilder.buildTree();
+    return buildMeshBVH(meshBVHBuilder);
 }
 
-QSSGMeshBVH *QSSGBufferManager::loadMeshBVH(QSSGRenderGeometry *geometry)
+static QSSGMeshBVHBuilder *createMeshBVHBuilder(QSSGRenderGeometry *geometry)
 {
     if (!geometry)
         return nullptr;
@@ -1551,15 +1660,109 @@ QSSGMeshBVH *QSSGBufferManager::loadMeshBVH(QSSGRenderGeometry *geometry)
         }
     }
 
-    QSSGMeshBVHBuilder meshBVHBuilder(geometry->vertexBuffer(),
-                                      geometry->stride(),
-                                      posOffset,
-                                      hasUV,
-                                      uvOffset,
-                                      hasIndexBuffer,
-                                      geometry->indexBuffer(),
-                                      indexBufferFormat);
-    return meshBVHBuilder.buildTree();
+    return new QSSGMeshBVHBuilder(geometry->vertexBuffer(),
+                                  geometry->stride(),
+                                  posOffset,
+                                  hasUV,
+                                  uvOffset,
+                                  hasIndexBuffer,
+                                  geometry->indexBuffer(),
+                                  indexBufferFormat);
+}
+
+QSSGMeshBVH *QSSGBufferManager::loadMeshBVH(QSSGRenderGeometry *geometry)
+{
+    std::unique_ptr<QSSGMeshBVHBuilder> meshBVHBuilder(createMeshBVHBuilder(geometry));
+    if (!meshBVHBuilder)
+        return nullptr;
+    return buildMeshBVH(*meshBVHBuilder);
+}
+
+bool QSSGBufferManager::requestMeshBVH(const QSSGRenderModel &model, QSSGRenderMesh *mesh)
+{
+    if (mesh->bvh)
+        return true;
+
+    if (mesh->bvhBuild) {
+        // Until the build is done picking falls back to the subset bounds
+        if (!mesh->bvhBuild->finished.loadAcquire())
+            return false;
+        QSSGMeshBVH *bvh = mesh->bvhBuild->bvh.fetchAndStoreAcquire(nullptr);
+        // A failed build is not retried, keep the result around to remember that
+        if (!bvh)
+            return false;
+        mesh->bvhBuild.reset();
+
+        mesh->bvh.reset(bvh);
+        for (int i = 0, end = qMin(bvh->roots.count(), mesh->subsets.count()); i < end; ++i)
+            mesh->subsets[i].bvhRoot = bvh->roots.at(i);
+        // Picking keeps using the old data until the next snapshot
+        if (!model.meshPath.isNull())
+            setMeshPickingData(model.meshPath, mesh);
+        else if (model.geometry)
+            setCustomMeshPickingData(model.geometry, mesh);
+        return true;
+    }
+
+    // Everything the job needs is gathered here, on the render thread. The job
+    // only holds implicitly shared copies of the data, never the mesh, the
+    // model or the geometry, which may all be gone by the time it finishes.
+    std::function<QSSGMeshBVH *()> build;
+    if (!model.meshPath.isNull()) {
+        const QSSGRenderPath path = model.meshPath;
+        // Prefer the data kept from loading the mesh over loading it again
+        QSSGMesh::Mesh retainedMeshData = takeRetainedMeshData(path);
+        if (retainedMeshData.isValid()) {
+            build = [retainedMeshData]() {
+                QSSGMeshBVHBuilder builder(retainedMeshData);
+                builder.setThreadPool(QThreadPool::globalInstance());
+                return buildMeshBVH(builder);
+            };
+        } else if (path.path().startsWith(u'!')) {
+            // Runtime meshes live in a registry that is only safe to use here
+            const QSSGMesh::Mesh meshData = loadMeshData(path);
+            if (meshData.isValid()) {
+                build = [meshData]() {
+                    QSSGMeshBVHBuilder builder(meshData);
+                    builder.setThreadPool(QThreadPool::globalInstance());
+                    return buildMeshBVH(builder);
+                };
+            }
+        } else {
+            build = [path]() {
+                const QSSGMesh::Mesh meshData = loadMeshData(path);
+                if (!meshData.isValid()) {
+                    qCWarning(WARNING, "Failed to load mesh: %s", qPrintable(path.path()));
+                    return static_cast<QSSGMeshBVH *>(nullptr);
+                }
+                QSSGMeshBVHBuilder builder(meshData);
+                builder.setThreadPool(QThreadPool::globalInstance());
+                return buildMeshBVH(builder);
+            };
+        }
+    } else if (model.geometry) {
+        QSharedPointer<QSSGMeshBVHBuilder> builder(createMeshBVHBuilder(model.geometry));
+        if (builder) {
+            build = [builder]() {
+                builder->setThreadPool(QThreadPool::globalInstance());
+                return buildMeshBVH(*builder);
+            };
+        }
+    }
+
+    QSharedPointer<QSSGMeshBVHBuildResult> result(new QSSGMeshBVHBuildResult);
+    mesh->bvhBuild = result;
+    if (!build) {
+        result->finished.storeRelease(1);
+        return false;
+    }
+
+    QThreadPool::globalInstance()->start([result, build]() {
+        result->bvh.storeRelease(build());
+        result->finished.storeRelease(1);
+    });
+
+    return false;
 }
 
 QSSGMesh::Mesh QSSGBufferManager::loadMeshData(const QSSGRenderPath &inMeshPath)
@@ -1615,7 +1818,6 @@ void QSSGBufferManager::clear()
     }
 
     {
-        QMutexLocker meshMutexLocker(&meshBufferMutex);
         // Meshes (by path)
         for (auto iter = meshMap.begin(), end = meshMap.end(); iter != end; ++iter) {
             QSSGRenderMesh *theMesh = iter.value().mesh;
@@ -1627,6 +1829,8 @@ void QSSGBufferManager::clear()
             }
         }
         meshMap.clear();
+        m_retainedMeshDataQueue.clear();
+        m_retainedMeshDataSize = 0;
 
         // Meshes (custom)
         for (auto iter = customMeshMap.begin(), end = customMeshMap.end(); iter != end; ++iter) {
@@ -1639,6 +1843,10 @@ void QSSGBufferManager::clear()
             }
         }
         customMeshMap.clear();
+
+        m_pendingPickingSnapshot = QSSGRenderPickingSnapshot();
+        m_pickingSnapshotDirty = true;
+        publishPickingSnapshot();
     }
 
     // Textures (by path)
@@ -1688,6 +1896,7 @@ void QSSGBufferManager::processResourceLoader(const QSSGRenderResourceLoader *lo
 
     // Make sure the uploads occur
     commitBufferResourceUpdates();
+    publishPickingSnapshot();
 }
 
 #if QT_CONFIG(qml_debug)
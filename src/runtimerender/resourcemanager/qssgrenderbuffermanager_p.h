@@ -45,14 +45,13 @@
 #include <QtQuick3DRuntimeRender/private/qtquick3druntimerenderglobal_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrenderimagetexture_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendermesh_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingdata_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendererutil_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendershadercache_p.h>
 #include <QtQuick3DUtils/private/qssgmesh_p.h>
 
 #include <QtQuick3DUtils/private/qquick3dprofiler_p.h>
 
-#include <QtCore/QMutex>
-
 QT_BEGIN_NAMESPACE
 
 struct QSSGRenderMesh;
@@ -96,6 +95,8 @@ public:
         QSSGRenderMesh *mesh = nullptr;
         QHash<QSSGRenderLayer*, uint32_t> usageCounts;
         uint32_t generationId = 0;
+        // CPU side copy of the mesh, kept for pickable meshes until the BVH is built
+        QSSGMesh::Mesh retainedMeshData;
     };
 
     struct MemoryStats {
@@ -123,10 +124,14 @@ public:
                                            MipMode inMipMode = MipModeNone,
                                            LoadRenderImageFlags flags = LoadWithFlippedY);
 
+    // Render thread only, picking goes through pickingSnapshots()
     QSSGRenderMesh *getMeshForPicking(const QSSGRenderModel &model) const;
     QSSGBounds3 getModelBounds(const QSSGRenderModel *model) const;
 
-    QSSGRenderMesh *loadMesh(const QSSGRenderModel *model);
+    // The data of the mesh is kept for building the picking BVH when the
+    // model is pickable, or when retainForPicking is true because other
+    // models using the same mesh are.
+    QSSGRenderMesh *loadMesh(const QSSGRenderModel *model, bool retainForPicking = false);
 
     // Called at the end of the frame to release unreferenced geometry and textures
     void cleanupUnreferencedBuffers(quint32 frameId, QSSGRenderLayer *layer);
@@ -141,6 +146,9 @@ public:
 
     static QSSGMeshBVH *loadMeshBVH(const QSSGRenderPath &inSourcePath);
     static QSSGMeshBVH *loadMeshBVH(QSSGRenderGeometry *geometry);
+    // Builds the BVH for the model's mesh on a thread pool, never blocks.
+    // Returns true once mesh->bvh is available.
+    bool requestMeshBVH(const QSSGRenderModel &model, QSSGRenderMesh *mesh);
 
     static QRhiTexture::Format toRhiFormat(const QSSGRenderTextureFormat format);
 
@@ -149,7 +157,18 @@ public:
     static QString runtimeMeshSourceName(const QString &assetId, qsizetype meshId);
     static QString primitivePath(const QString &primitive);
 
-    QMutex *meshUpdateMutex();
+    // The picking data of the loaded meshes, readable from any thread
+    // without locking. Changes to the meshes become visible to picking once
+    // publishPickingSnapshot() is called on the render thread.
+    const QSSGRenderPickingSnapshots &pickingSnapshots() const { return m_pickingSnapshots; }
+    void publishPickingSnapshot();
+
+    // Upper limit, in bytes, for the CPU side mesh data kept around for
+    // building the picking BVH without loading the mesh again. The oldest
+    // copies are dropped first when the limit is reached.
+    void setRetainedMeshDataBudget(qint64 bytes);
+    qint64 retainedMeshDataBudget() const { return m_retainedMeshDataBudget; }
+    qint64 retainedMeshDataSize() const { return m_retainedMeshDataSize; }
 #if QT_CONFIG(qml_debug)
     MemoryStats memoryStats() const;
     void increaseMemoryStat(QRhiTexture *texture);
@@ -178,7 +197,9 @@ private:
                           const QSSGLoadedTexture *inTexture,
                           MipMode inMipMode = MipModeNone,
                           CreateRhiTextureFlags inFlags = {});
-    QSSGRenderMesh *loadMesh(const QSSGRenderPath &inSourcePath);
+    QSSGRenderMesh *loadMesh(const QSSGRenderPath &inSourcePath, bool retainForPicking = false);
+    void retainMeshData(const QSSGRenderPath &inSourcePath, const QSSGMesh::Mesh &mesh);
+    QSSGMesh::Mesh takeRetainedMeshData(const QSSGRenderPath &inSourcePath);
     QSSGRenderMesh *loadCustomMesh(QSSGRenderGeometry *geometry);
     static QSSGMesh::Mesh loadMeshData(const QSSGRenderPath &inSourcePath);
     QSSGRenderMesh *createRenderMesh(const QSSGMesh::Mesh &mesh);
@@ -186,6 +207,8 @@ private:
     bool createEnvironmentMap(const QSSGLoadedTexture *inImage, QSSGRenderImageTexture *outTexture);
 
     void releaseMesh(const QSSGRenderPath &inSourcePath);
+    void setMeshPickingData(const QSSGRenderPath &inSourcePath, const QSSGRenderMesh *mesh);
+    void setCustomMeshPickingData(const QSSGRenderGeometry *geometry, const QSSGRenderMesh *mesh);
     void releaseImage(const ImageCacheKey &key);
 
     QSSGRenderContextInterface *m_contextInterface = nullptr; // ContextInterfaces owns BufferManager
@@ -198,7 +221,15 @@ private:
     QHash<QSSGRenderTextureData *, ImageData> customTextureMap; // Textures (QQuick3DTextureData)
 
     QRhiResourceUpdateBatch *meshBufferUpdates = nullptr;
-    QMutex meshBufferMutex;
+
+    // Changed on the render thread, handed to picking by publishPickingSnapshot()
+    QSSGRenderPickingSnapshot m_pendingPickingSnapshot;
+    QSSGRenderPickingSnapshots m_pickingSnapshots;
+    bool m_pickingSnapshotDirty = false;
+
+    QList<QSSGRenderPath> m_retainedMeshDataQueue; // Oldest first
+    qint64 m_retainedMeshDataSize = 0;
+    qint64 m_retainedMeshDataBudget = 0;
 
     quint32 frameCleanupIndex = 0;
     quint32 frameResetIndex = 0;
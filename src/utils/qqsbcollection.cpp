@@ -72,7 +72,7 @@ bool QQsbCollection::map(MapMode mode)
         if (fileId == MagicaDS && version == Version::One) {
             if (start >= 0 && start < size && device.seek(start)) {
                 ds >> entries;
-                ret = true;
+                ret = (ds.status() == QDataStream::Ok);
             }
         }
     }
@@ -117,6 +117,10 @@ bool QQsbCollection::extractQsbEntry(QQsbCollection::Entry entry, QByteArray *ou
                 QByteArray vertData;
                 QByteArray fragData;
                 ds >> desc >> fs >> vertData >> fragData;
+                if (ds.status() != QDataStream::Ok) {
+                    qWarning("Entry id(%zu) at offset(%lld) is truncated or corrupt", entry.hkey, entry.offset);
+                    return false;
+                }
                 if (outDesc)
                     *outDesc = desc;
                 if (outVertShader)
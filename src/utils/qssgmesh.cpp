@@ -28,8 +28,11 @@
 ****************************************************************************/
 
 #include "qssgmesh_p.h"
+#include "qssgmeshbvhbuilder_p.h"
 
 #include <QtCore/QVector>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QVarLengthArray>
 #include <QtQuick3DUtils/private/qssgdataref_p.h>
 
 QT_BEGIN_NAMESPACE
@@ -56,6 +59,9 @@ static const size_t SUBSET_STRUCT_SIZE_V3_V4 = 40;
 // subset list: count, offset, minXYZ, maxXYZ, nameOffset, nameLength, lightmapSizeWidth, lightmapSizeHeight
 static const size_t SUBSET_STRUCT_SIZE_V5 = 48;
 
+// BVH node list: minXYZ, maxXYZ, left, offset, count
+static const size_t BVH_NODE_STRUCT_SIZE = 36;
+
 MeshInternal::MultiMeshInfo MeshInternal::readFileHeader(QIODevice *device)
 {
     const qint64 multiHeaderStartOffset = device->size() - qint64(MULTI_HEADER_STRUCT_SIZE);
@@ -249,9 +255,161 @@ quint64 MeshInternal::readMeshData(QIODevice *device, quint64 offset, Mesh *mesh
     for (const MeshInternal::Subset &internalSubset : internalSubsets)
         mesh->m_subsets.append(internalSubset.toMeshSubset());
 
+    if (header->hasBVH() && header->fileVersion >= MeshDataHeader::FILE_VERSION) {
+        if (!readBVHData(device, mesh)) {
+            // The mesh itself is fine, the BVH gets built at runtime instead
+            qWarning("Mesh BVH data invalid, ignoring it");
+            mesh->m_bvhData = {};
+        }
+    }
+
     return header->sizeInBytes;
 }
 
+bool MeshInternal::readBVHData(QIODevice *device, Mesh *mesh)
+{
+    QDataStream inputStream(device);
+    inputStream.setByteOrder(QDataStream::LittleEndian);
+    inputStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 chunkId = 0;
+    quint32 chunkVersion = 0;
+    quint32 nodeCount = 0;
+    quint32 rootCount = 0;
+    quint32 triangleCount = 0;
+    inputStream >> chunkId >> chunkVersion >> nodeCount >> rootCount >> triangleCount;
+    if (inputStream.status() != QDataStream::Ok
+            || chunkId != MeshDataHeader::BVH_CHUNK_ID
+            || chunkVersion != MeshDataHeader::BVH_CHUNK_VERSION
+            || rootCount != quint32(mesh->m_subsets.count()))
+        return false;
+
+    const qint64 chunkDataSize = qint64(nodeCount) * BVH_NODE_STRUCT_SIZE
+            + qint64(rootCount) * sizeof(qint32)
+            + qint64(triangleCount) * sizeof(quint32);
+    if (device->bytesAvailable() < chunkDataSize)
+        return false;
+
+    Mesh::BVHData &bvhData(mesh->m_bvhData);
+    bvhData.nodes.resize(nodeCount);
+    bvhData.roots.resize(rootCount);
+    bvhData.triangleOrder.resize(triangleCount);
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    // The file layout matches the in-memory one, read straight into the final storage
+    static_assert(sizeof(QSSGMeshBVHNode) == BVH_NODE_STRUCT_SIZE, "Unexpected QSSGMeshBVHNode layout");
+    static_assert(sizeof(int) == sizeof(qint32), "Unexpected int size");
+    const qint64 nodesSize = qint64(nodeCount) * BVH_NODE_STRUCT_SIZE;
+    const qint64 rootsSize = qint64(rootCount) * sizeof(qint32);
+    const qint64 orderSize = qint64(triangleCount) * sizeof(quint32);
+    if (device->read(reinterpret_cast<char *>(bvhData.nodes.data()), nodesSize) != nodesSize
+            || device->read(reinterpret_cast<char *>(bvhData.roots.data()), rootsSize) != rootsSize
+            || device->read(reinterpret_cast<char *>(bvhData.triangleOrder.data()), orderSize) != orderSize)
+        return false;
+#else
+    for (QSSGMeshBVHNode &node : bvhData.nodes) {
+        float minX;
+        float minY;
+        float minZ;
+        float maxX;
+        float maxY;
+        float maxZ;
+        qint32 left;
+        qint32 offset;
+        qint32 count;
+        inputStream >> minX >> minY >> minZ >> maxX >> maxY >> maxZ >> left >> offset >> count;
+        node.boundingData = QSSGBounds3(QVector3D(minX, minY, minZ), QVector3D(maxX, maxY, maxZ));
+        node.left = left;
+        node.offset = offset;
+        node.count = count;
+    }
+    for (int &root : bvhData.roots) {
+        qint32 value;
+        inputStream >> value;
+        root = value;
+    }
+    for (quint32 &triangle : bvhData.triangleOrder)
+        inputStream >> triangle;
+    if (inputStream.status() != QDataStream::Ok)
+        return false;
+#endif
+
+    // Validate everything the picking traversal relies on. Children are
+    // stored after their parent, which rules out cycles.
+    for (quint32 i = 0; i < nodeCount; ++i) {
+        const QSSGMeshBVHNode &node = bvhData.nodes.at(i);
+        if (node.isLeaf()) {
+            if (node.offset < 0 || node.count < 0 || quint32(node.offset) + quint32(node.count) > triangleCount)
+                return false;
+        } else if (quint32(node.left) <= i || quint32(node.left) + 1 >= nodeCount) {
+            return false;
+        }
+    }
+    // Each node belongs to one tree, and the leaves of a subset's tree only
+    // refer to the triangles of that subset
+    QVarLengthArray<int, 64> stack;
+    quint32 visitedCount = 0;
+    for (int subsetIdx = 0; subsetIdx < int(rootCount); ++subsetIdx) {
+        const int root = bvhData.roots.at(subsetIdx);
+        if (root < 0 || quint32(root) >= nodeCount)
+            return false;
+        const Mesh::Subset &subset = mesh->m_subsets.at(subsetIdx);
+        const quint32 firstTriangle = subset.offset / 3;
+        const quint32 endTriangle = firstTriangle + subset.count / 3;
+        stack.append(root);
+        while (!stack.isEmpty()) {
+            if (++visitedCount > nodeCount)
+                return false;
+            const QSSGMeshBVHNode &node = bvhData.nodes.at(stack.takeLast());
+            if (node.isLeaf()) {
+                if (quint32(node.offset) < firstTriangle || quint32(node.offset) + quint32(node.count) > endTriangle)
+                    return false;
+            } else {
+                stack.append(node.left);
+                stack.append(node.right());
+            }
+        }
+    }
+    for (quint32 triangle : qAsConst(bvhData.triangleOrder)) {
+        if (triangle >= triangleCount)
+            return false;
+    }
+
+    return true;
+}
+
+void MeshInternal::writeBVHData(QIODevice *device, const Mesh::BVHData &bvhData)
+{
+    QDataStream outputStream(device);
+    outputStream.setByteOrder(QDataStream::LittleEndian);
+    outputStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    const quint32 nodeCount = bvhData.nodes.count();
+    const quint32 rootCount = bvhData.roots.count();
+    const quint32 triangleCount = bvhData.triangleOrder.count();
+    // chunkId, chunkVersion, nodeCount, rootCount, triangleCount
+    outputStream << MeshDataHeader::BVH_CHUNK_ID
+                 << MeshDataHeader::BVH_CHUNK_VERSION
+                 << nodeCount
+                 << rootCount
+                 << triangleCount;
+
+    // Every entry is 4 byte sized, so no alignment padding is needed
+    for (const QSSGMeshBVHNode &node : bvhData.nodes) {
+        const QVector3D &min = node.boundingData.minimum;
+        const QVector3D &max = node.boundingData.maximum;
+        outputStream << min.x() << min.y() << min.z()
+                     << max.x() << max.y() << max.z()
+                     << qint32(node.left)
+                     << qint32(node.offset)
+                     << qint32(node.count);
+    }
+    for (int root : bvhData.roots)
+        outputStream << qint32(root);
+    for (quint32 triangle : bvhData.triangleOrder)
+        outputStream << triangle;
+}
+
 void MeshInternal::writeMeshHeader(QIODevice *device, const MeshDataHeader &header)
 {
     QDataStream outputStream(device);
@@ -389,6 +547,9 @@ quint64 MeshInternal::writeMeshData(QIODevice *device, const Mesh &mesh)
             device->write(alignPadding, alignAmount);
     }
 
+    if (mesh.hasBVH())
+        writeBVHData(device, mesh.m_bvhData);
+
     const quint32 endPos = device->pos();
     const quint32 sizeInBytes = endPos - startPos;
     device->seek(endPos);
@@ -664,6 +825,8 @@ quint32 Mesh::save(QIODevice *device, quint32 id) const
     header.meshEntries.insert(newId, meshOffset);
 
     MeshInternal::MeshDataHeader meshHeader = MeshInternal::MeshDataHeader::withDefaults();
+    if (hasBVH())
+        meshHeader.flags |= MeshInternal::MeshDataHeader::HAS_BVH_FLAG;
     // skip the space for the mesh header for now
     device->seek(device->pos() + MESH_HEADER_STRUCT_SIZE);
     meshHeader.sizeInBytes = MeshInternal::writeMeshData(device, *this);
@@ -677,6 +840,24 @@ quint32 Mesh::save(QIODevice *device, quint32 id) const
     return newId;
 }
 
+bool Mesh::generateBVH()
+{
+    m_bvhData = {};
+    if (!isValid() || m_drawMode != DrawMode::Triangles)
+        return false;
+
+    QSSGMeshBVHBuilder builder(*this);
+    builder.setSplitMethod(QSSGMeshBVHBuilder::SplitMethod::SAH);
+    QScopedPointer<QSSGMeshBVH> bvh(builder.buildTree());
+    if (!bvh || bvh->roots.count() != m_subsets.count())
+        return false;
+
+    m_bvhData.nodes = bvh->nodes;
+    m_bvhData.roots = bvh->roots;
+    m_bvhData.triangleOrder = builder.triangleOrder();
+    return true;
+}
+
 QSSGBounds3 MeshInternal::calculateSubsetBounds(const Mesh::VertexBufferEntry &entry,
                                                 const QByteArray &vertexBufferData,
                                                 quint32 vertexBufferStride,
@@ -44,6 +44,7 @@
 #include <QtQuick3DUtils/private/qtquick3dutilsglobal_p.h>
 
 #include <QtQuick3DUtils/private/qssgbounds3_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
 
 #include <QtQuick3DUtils/private/qssgrenderbasetypes_p.h>
 
@@ -130,10 +131,20 @@ public:
         QSize lightmapSizeHint;
     };
 
+    // Precomputed picking BVH, one root per subset. triangleOrder maps each
+    // leaf triangle back to its original triangle index.
+    struct BVHData {
+        QVector<QSSGMeshBVHNode> nodes;
+        QVector<int> roots;
+        QVector<quint32> triangleOrder;
+    };
+
     // can just return by value (big data is all implicitly shared)
     VertexBuffer vertexBuffer() const { return m_vertexBuffer; }
     IndexBuffer indexBuffer() const { return m_indexBuffer; }
     QVector<Subset> subsets() const { return m_subsets; }
+    BVHData bvhData() const { return m_bvhData; }
+    bool hasBVH() const { return !m_bvhData.nodes.isEmpty(); }
 
     // id 0 == first, otherwise has to match
     static Mesh loadMesh(QIODevice *device, quint32 id = 0);
@@ -156,12 +167,17 @@ public:
     // id 0 == generate new id; otherwise uses it as-is, and must be an unused one
     quint32 save(QIODevice *device, quint32 id = 0) const;
 
+    // Builds the picking BVH so that it gets stored by save(). Only meshes
+    // with the Triangles draw mode are supported.
+    bool generateBVH();
+
 private:
     DrawMode m_drawMode = DrawMode::Triangles;
     Winding m_winding = Winding::CounterClockwise;
     VertexBuffer m_vertexBuffer;
     IndexBuffer m_indexBuffer;
     QVector<Subset> m_subsets;
+    BVHData m_bvhData;
     friend struct MeshInternal;
 };
 
@@ -285,6 +301,12 @@ struct Q_QUICK3DUTILS_EXPORT MeshInternal
         // This needs branching in the deserializer.
         static const quint32 FILE_VERSION = 5;
 
+        // The BVH chunk follows the subset names and is covered by
+        // sizeInBytes, so readers not knowing about it simply skip it.
+        static const quint16 HAS_BVH_FLAG = 0x1;
+        static const quint32 BVH_CHUNK_ID = 0x48564251; // "QBVH"
+        static const quint32 BVH_CHUNK_VERSION = 1;
+
         static MeshDataHeader withDefaults() {
             return { FILE_ID, FILE_VERSION, 0, 0 };
         }
@@ -298,6 +320,10 @@ struct Q_QUICK3DUTILS_EXPORT MeshInternal
         bool hasLightmapSizeHint() const {
             return fileVersion >= 5;
         }
+
+        bool hasBVH() const {
+            return (flags & HAS_BVH_FLAG) != 0;
+        }
     };
 
     struct MeshOffsetTracker {
@@ -349,6 +375,8 @@ struct Q_QUICK3DUTILS_EXPORT MeshInternal
     static quint64 readMeshData(QIODevice *device, quint64 offset, Mesh *mesh, MeshDataHeader *header);
     static void writeMeshHeader(QIODevice *device, const MeshDataHeader &header);
     static quint64 writeMeshData(QIODevice *device, const Mesh &mesh);
+    static bool readBVHData(QIODevice *device, Mesh *mesh);
+    static void writeBVHData(QIODevice *device, const Mesh::BVHData &bvhData);
 
     static int byteSizeForComponentType(Mesh::ComponentType componentType) {
         switch (componentType) {
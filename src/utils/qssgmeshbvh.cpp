@@ -29,12 +29,55 @@
 
 #include "qssgmeshbvh_p.h"
 
+#include <QtCore/QVarLengthArray>
+
 QT_BEGIN_NAMESPACE
 
-QSSGMeshBVH::~QSSGMeshBVH()
+qsizetype QSSGMeshBVH::memoryUsage() const
+{
+    return sizeof(QSSGMeshBVH)
+            + nodes.capacity() * qsizetype(sizeof(QSSGMeshBVHNode))
+            + roots.capacity() * qsizetype(sizeof(int))
+            + triangles.capacity() * qsizetype(sizeof(QSSGMeshBVHTriangle));
+}
+
+QSSGMeshBVH::Statistics QSSGMeshBVH::statistics() const
 {
-    qDeleteAll(triangles);
-    qDeleteAll(roots);
+    Statistics stats;
+    qint64 leafTriangles = 0;
+
+    for (const int root : roots) {
+        if (root < 0 || root >= nodes.size())
+            continue;
+        const float rootArea = surfaceArea(nodes.at(root).boundingData);
+        struct Entry { int node; int depth; };
+        QVarLengthArray<Entry, 64> stack;
+        stack.append({ root, 1 });
+        while (!stack.isEmpty()) {
+            const Entry entry = stack.takeLast();
+            const QSSGMeshBVHNode &node = nodes.at(entry.node);
+            const float relativeArea = rootArea > 0.0f ? surfaceArea(node.boundingData) / rootArea : 1.0f;
+            ++stats.nodeCount;
+            stats.maxDepth = qMax(stats.maxDepth, entry.depth);
+            if (node.isLeaf()) {
+                ++stats.leafCount;
+                if (node.count == 0)
+                    ++stats.emptyLeafCount;
+                stats.maxLeafTriangles = qMax(stats.maxLeafTriangles, node.count);
+                leafTriangles += node.count;
+                stats.sahCost += relativeArea * node.count * IntersectionCost;
+            } else {
+                stats.sahCost += relativeArea * TraversalCost;
+                stack.append({ node.left, entry.depth + 1 });
+                stack.append({ node.right(), entry.depth + 1 });
+            }
+        }
+    }
+
+    if (stats.leafCount > 0)
+        stats.averageLeafTriangles = float(leafTriangles) / float(stats.leafCount);
+
+    return stats;
 }
 
 QT_END_NAMESPACE
@@ -49,25 +49,28 @@
 
 QT_BEGIN_NAMESPACE
 
-struct Q_QUICK3DUTILS_EXPORT QSSGMeshBVHNode {
-    ~QSSGMeshBVHNode() {
-        delete left;
-        delete right;
-    }
-
-    // Internal
-    QSSGMeshBVHNode *left = nullptr;
-    QSSGMeshBVHNode *right = nullptr;
+// The BVH is stored linearized: all nodes of all subsets live in one
+// contiguous array and refer to their children by index. The two children of
+// an internal node are always stored next to each other, so only the index of
+// the left child is kept; the right child is at left + 1.
+struct QSSGMeshBVHNode {
     QSSGBounds3 boundingData;
-    //splitAxis
+
+    // Internal (-1 for leaves)
+    int left = -1;
 
     // Leaf
     int offset = 0;
     int count = 0;
+
+    bool isLeaf() const { return left < 0; }
+    int right() const { return left + 1; }
 };
+Q_DECLARE_TYPEINFO(QSSGMeshBVHNode, Q_RELOCATABLE_TYPE);
 
-struct Q_QUICK3DUTILS_EXPORT QSSGMeshBVHTriangle {
-    QSSGBounds3 bounds;
+// Triangles are stored by value, in leaf order, so the triangles referenced by
+// a leaf are contiguous in memory.
+struct QSSGMeshBVHTriangle {
     QVector3D vertex1;
     QVector3D vertex2;
     QVector3D vertex3;
@@ -75,18 +78,50 @@ struct Q_QUICK3DUTILS_EXPORT QSSGMeshBVHTriangle {
     QVector2D uvCoord2;
     QVector2D uvCoord3;
 };
+Q_DECLARE_TYPEINFO(QSSGMeshBVHTriangle, Q_RELOCATABLE_TYPE);
 
 struct Q_QUICK3DUTILS_EXPORT QSSGMeshBVH
 {
-    QSSGMeshBVH(const QVector<QSSGMeshBVHNode *> &bvhRoots,
-                const QVector<QSSGMeshBVHTriangle *> &bvhTriangles)
-        : roots(bvhRoots)
-        , triangles(bvhTriangles)
+    QSSGMeshBVH() = default;
+    QSSGMeshBVH(QVector<QSSGMeshBVHNode> &&bvhNodes,
+                QVector<int> &&bvhRoots,
+                QVector<QSSGMeshBVHTriangle> &&bvhTriangles)
+        : nodes(std::move(bvhNodes))
+        , roots(std::move(bvhRoots))
+        , triangles(std::move(bvhTriangles))
     {}
-    ~QSSGMeshBVH();
 
-    QVector<QSSGMeshBVHNode *> roots;
-    QVector<QSSGMeshBVHTriangle *> triangles;
+    // Relative costs used by the surface area heuristic, both when building
+    // the tree and when evaluating the quality of an existing one.
+    static constexpr float TraversalCost = 0.125f;
+    static constexpr float IntersectionCost = 1.0f;
+
+    struct Statistics
+    {
+        float sahCost = 0.0f; // Sum over all roots, relative to each root's surface area
+        int maxDepth = 0;
+        int nodeCount = 0;
+        int leafCount = 0;
+        int emptyLeafCount = 0;
+        int maxLeafTriangles = 0;
+        float averageLeafTriangles = 0.0f;
+    };
+
+    // Approximate memory used by the acceleration structure, in bytes.
+    qsizetype memoryUsage() const;
+    Statistics statistics() const;
+
+    static inline float surfaceArea(const QSSGBounds3 &bounds)
+    {
+        if (bounds.isEmpty())
+            return 0.0f;
+        const QVector3D d = bounds.dimensions();
+        return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    QVector<QSSGMeshBVHNode> nodes;
+    QVector<int> roots; // Index of the root node in nodes, one per subset
+    QVector<QSSGMeshBVHTriangle> triangles;
 };
 
 QT_END_NAMESPACE
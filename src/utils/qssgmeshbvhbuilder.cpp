@@ -29,6 +29,12 @@
 
 #include "qssgmeshbvhbuilder_p.h"
 
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+
+#include <memory>
+
 QT_BEGIN_NAMESPACE
 
 QSSGMeshBVHBuilder::QSSGMeshBVHBuilder(const QSSGMesh::Mesh &mesh)
@@ -90,78 +96,123 @@ QSSGMeshBVHBuilder::QSSGMeshBVHBuilder(const QByteArray &vertexBuffer,
 QSSGMeshBVH* QSSGMeshBVHBuilder::buildTree()
 {
     m_roots.clear();
+    m_nodes.clear();
 
     // This only works with triangles
     if (m_mesh.isValid() && m_mesh.drawMode() != QSSGMesh::Mesh::DrawMode::Triangles)
         return nullptr;
 
-    // Calculate the bounds for each triangle in whole mesh once
     quint32 indexCount = 0;
     if (m_hasIndexBuffer)
         indexCount = m_indexBufferData.size() / getSizeOfType(m_indexBufferComponentType);
     else
         indexCount = m_vertexBufferData.size() / m_vertexStride;
-    m_triangleBounds = calculateTriangleBounds(0, indexCount);
+
+    // Meshes saved with a BVH only need their triangles gathered in leaf order
+    if (m_mesh.hasBVH()) {
+        if (QSSGMeshBVH *bvh = createTreeFromMeshBVH(indexCount / 3))
+            return bvh;
+    }
+
+    // Calculate the bounds for each triangle in whole mesh once
+    calculateTriangleBounds(0, indexCount);
+
+    // A balanced tree has roughly 2 * (triangles / leaf size) nodes
+    m_nodes.reserve(qMax<qsizetype>(1, 2 * m_triangles.size() / qMax<quint32>(1, m_maxLeafTriangles / 2)));
 
     // For each submesh, generate a root bvh node
     if (m_mesh.isValid()) {
         const QVector<QSSGMesh::Mesh::Subset> subsets = m_mesh.subsets();
         for (quint32 subsetIdx = 0, subsetEnd = subsets.size(); subsetIdx < subsetEnd; ++subsetIdx) {
             const QSSGMesh::Mesh::Subset &source(subsets[subsetIdx]);
-            QSSGMeshBVHNode *root = new QSSGMeshBVHNode();
             // Offsets provided by subset are for the index buffer
             // Convert them to work with the triangle bounds list
             const quint32 triangleOffset = source.offset / 3;
             const quint32 triangleCount = source.count / 3;
-            root->boundingData = getBounds(triangleOffset, triangleCount);
+            const int root = createNode(m_nodes, triangleOffset, triangleCount);
             // Recursively split the mesh into a tree of smaller bounding volumns
-            root = splitNode(root, triangleOffset, triangleCount);
+            splitNode(m_nodes, root, triangleOffset, triangleCount);
             m_roots.append(root);
         }
     } else {
         // Custom Geometry only has one subset
-        QSSGMeshBVHNode *root = new QSSGMeshBVHNode();
-        root->boundingData = getBounds(0, m_triangleBounds.count());
-        root = splitNode(root, 0, m_triangleBounds.count());
+        const int root = createNode(m_nodes, 0, m_triangles.count());
+        splitNode(m_nodes, root, 0, m_triangles.count());
         m_roots.append(root);
     }
-    return new QSSGMeshBVH(m_roots, m_triangleBounds);
+
+    // Store the triangles in leaf order so each leaf references a contiguous range
+    QVector<QSSGMeshBVHTriangle> triangles;
+    triangles.resize(m_triangleIndices.size());
+    for (qsizetype i = 0, end = m_triangleIndices.size(); i < end; ++i)
+        triangles[i] = m_triangles.at(m_triangleIndices.at(i));
+
+    m_triangles.clear();
+    m_triangleBounds.clear();
+    m_triangleCenters.clear();
+    m_nodes.squeeze();
+
+    return new QSSGMeshBVH(std::move(m_nodes), std::move(m_roots), std::move(triangles));
 }
 
-QVector<QSSGMeshBVHTriangle *> QSSGMeshBVHBuilder::calculateTriangleBounds(quint32 indexOffset, quint32 indexCount) const
+QSSGMeshBVH *QSSGMeshBVHBuilder::createTreeFromMeshBVH(quint32 triangleCount) const
 {
-    QVector<QSSGMeshBVHTriangle *> triangleBounds;
-    const quint32 triangleCount = indexCount / 3;
+    const QSSGMesh::Mesh::BVHData bvhData = m_mesh.bvhData();
+    if (quint32(bvhData.triangleOrder.size()) != triangleCount)
+        return nullptr;
 
-    for (quint32 i = 0; i < triangleCount; ++i) {
-        // Get the indices for the triangle
-        const quint32 triangleIndex = i * 3 + indexOffset;
+    QVector<QSSGMeshBVHTriangle> triangles;
+    triangles.resize(triangleCount);
+    for (quint32 i = 0; i < triangleCount; ++i)
+        triangles[i] = getTriangle(bvhData.triangleOrder.at(i) * 3);
 
-        quint32 index1 = triangleIndex + 0;
-        quint32 index2 = triangleIndex + 1;
-        quint32 index3 = triangleIndex + 2;
+    // The node data is shared with the mesh, it is not copied
+    return new QSSGMeshBVH(QVector<QSSGMeshBVHNode>(bvhData.nodes),
+                           QVector<int>(bvhData.roots),
+                           std::move(triangles));
+}
 
-        if (m_hasIndexBuffer) {
-            index1 = getIndexBufferValue(triangleIndex + 0);
-            index2 = getIndexBufferValue(triangleIndex + 1);
-            index3 = getIndexBufferValue(triangleIndex + 2);
-        }
+QSSGMeshBVHTriangle QSSGMeshBVHBuilder::getTriangle(quint32 triangleIndex) const
+{
+    quint32 index1 = triangleIndex + 0;
+    quint32 index2 = triangleIndex + 1;
+    quint32 index3 = triangleIndex + 2;
+
+    if (m_hasIndexBuffer) {
+        index1 = getIndexBufferValue(triangleIndex + 0);
+        index2 = getIndexBufferValue(triangleIndex + 1);
+        index3 = getIndexBufferValue(triangleIndex + 2);
+    }
 
-        QSSGMeshBVHTriangle *triangle = new QSSGMeshBVHTriangle();
+    QSSGMeshBVHTriangle triangle;
+    triangle.vertex1 = getVertexBufferValuePosition(index1);
+    triangle.vertex2 = getVertexBufferValuePosition(index2);
+    triangle.vertex3 = getVertexBufferValuePosition(index3);
+    triangle.uvCoord1 = getVertexBufferValueUV(index1);
+    triangle.uvCoord2 = getVertexBufferValueUV(index2);
+    triangle.uvCoord3 = getVertexBufferValueUV(index3);
+    return triangle;
+}
 
-        triangle->vertex1 = getVertexBufferValuePosition(index1);
-        triangle->vertex2 = getVertexBufferValuePosition(index2);
-        triangle->vertex3 = getVertexBufferValuePosition(index3);
-        triangle->uvCoord1 = getVertexBufferValueUV(index1);
-        triangle->uvCoord2 = getVertexBufferValueUV(index2);
-        triangle->uvCoord3 = getVertexBufferValueUV(index3);
+void QSSGMeshBVHBuilder::calculateTriangleBounds(quint32 indexOffset, quint32 indexCount)
+{
+    const quint32 triangleCount = indexCount / 3;
+    m_triangles.resize(triangleCount);
+    m_triangleBounds.resize(triangleCount);
+    m_triangleCenters.resize(triangleCount);
+    m_triangleIndices.resize(triangleCount);
 
-        triangle->bounds.include(triangle->vertex1);
-        triangle->bounds.include(triangle->vertex2);
-        triangle->bounds.include(triangle->vertex3);
-        triangleBounds.append(triangle);
+    for (quint32 i = 0; i < triangleCount; ++i) {
+        const QSSGMeshBVHTriangle triangle = getTriangle(i * 3 + indexOffset);
+        m_triangles[i] = triangle;
+
+        QSSGBounds3 &bounds = m_triangleBounds[i];
+        bounds.include(triangle.vertex1);
+        bounds.include(triangle.vertex2);
+        bounds.include(triangle.vertex3);
+        m_triangleCenters[i] = bounds.center();
+        m_triangleIndices[i] = i;
     }
-    return triangleBounds;
 }
 
 quint32 QSSGMeshBVHBuilder::getIndexBufferValue(quint32 index) const
@@ -205,27 +256,39 @@ QVector2D QSSGMeshBVHBuilder::getVertexBufferValueUV(quint32 index) const
     return *uv;
 }
 
-QSSGMeshBVHNode *QSSGMeshBVHBuilder::splitNode(QSSGMeshBVHNode *node, quint32 offset, quint32 count, quint32 depth)
+int QSSGMeshBVHBuilder::createNode(QVector<QSSGMeshBVHNode> &nodes, quint32 offset, quint32 count) const
+{
+    QSSGMeshBVHNode node;
+    node.boundingData = getBounds(offset, count);
+    nodes.append(node);
+    return int(nodes.size() - 1);
+}
+
+void QSSGMeshBVHBuilder::splitNode(QVector<QSSGMeshBVHNode> &nodes, int nodeIndex, quint32 offset, quint32 count, quint32 depth)
 {
+    // Note: nodes may grow while splitting, so nodes are only ever accessed by index
+
     // Force a leaf node if the there are too few triangles or the tree depth
     // has exceeded the maximum depth
-    if (count < m_maxLeafTriangles || depth >= m_maxTreeDepth) {
-        node->offset = offset;
-        node->count = count;
-        return node;
+    const quint32 minTriangles = (m_splitMethod == SplitMethod::SAH) ? m_minSAHLeafTriangles + 1
+                                                                       : m_maxLeafTriangles;
+    if (count < minTriangles || depth >= m_maxTreeDepth) {
+        nodes[nodeIndex].offset = offset;
+        nodes[nodeIndex].count = count;
+        return;
     }
 
     // Determine where to split the current bounds
-    const QSSGMeshBVHBuilder::Split split = getOptimalSplit(node->boundingData, offset, count);
-    // Really this shouldn't happen unless there is invalid bounding data, but if that
-    // that does happen make this a leaf node.
+    const QSSGMeshBVHBuilder::Split split = getOptimalSplit(nodes.at(nodeIndex).boundingData, offset, count);
+    // Really this shouldn't happen unless there is invalid bounding data (or the
+    // SAH decided a leaf is cheaper), but if that does happen make this a leaf node.
     if (split.axis == QSSGMeshBVHBuilder::Axis::None) {
-        node->offset = offset;
-        node->count = count;
-        return node;
+        nodes[nodeIndex].offset = offset;
+        nodes[nodeIndex].count = count;
+        return;
     }
 
-    // Create the split by sorting the values in m_triangleBounds between
+    // Create the split by sorting the values in m_triangleIndices between
     // offset - count based on the split axis and position. The returned offset
     // will determine which values go into the left and right nodes.
     const quint32 splitOffset = partition(offset, count, split);
@@ -234,25 +297,67 @@ QSSGMeshBVHNode *QSSGMeshBVHBuilder::splitNode(QSSGMeshBVHNode *node, quint32 of
     if (splitOffset == offset || splitOffset == (offset + count)) {
         // If the split is at the start or end, this is a leaf node now
         // because there is no further branches necessary.
-        node->offset = offset;
-        node->count = count;
-    } else {
-        // Create the Left Node
-        node->left = new QSSGMeshBVHNode();
-        const quint32 leftOffset = offset;
-        const quint32 leftCount = splitOffset - offset;
-        node->left->boundingData = getBounds(leftOffset, leftCount);
-        node->left = splitNode(node->left, leftOffset, leftCount, depth + 1);
-
-        // Create the Right Node
-        node->right = new QSSGMeshBVHNode();
-        const quint32 rightOffset = splitOffset;
-        const quint32 rightCount = count - leftCount;
-        node->right->boundingData = getBounds(rightOffset, rightCount);
-        node->right = splitNode(node->right, rightOffset, rightCount, depth + 1);
+        nodes[nodeIndex].offset = offset;
+        nodes[nodeIndex].count = count;
+        return;
+    }
+
+    // The children are allocated next to each other, the right node
+    // is always found at left + 1.
+    const quint32 leftOffset = offset;
+    const quint32 leftCount = splitOffset - offset;
+    const quint32 rightOffset = splitOffset;
+    const quint32 rightCount = count - leftCount;
+    const int left = createNode(nodes, leftOffset, leftCount);
+    const int right = createNode(nodes, rightOffset, rightCount);
+    Q_ASSERT(right == left + 1);
+    nodes[nodeIndex].left = left;
+
+    if (!m_threadPool || rightCount < ParallelSubtreeTriangles) {
+        splitNode(nodes, left, leftOffset, leftCount, depth + 1);
+        splitNode(nodes, right, rightOffset, rightCount, depth + 1);
+        return;
     }
 
-    return node;
+    // Large subtree: build the right side on the thread pool into its own node
+    // list while this thread handles the left side. The two sides work on
+    // disjoint ranges of m_triangleIndices, so they don't need to synchronize.
+    QVector<QSSGMeshBVHNode> rightNodes;
+    rightNodes.append(nodes.at(right));
+    QSemaphore done;
+    std::unique_ptr<QRunnable> job(QRunnable::create([&]() {
+        splitNode(rightNodes, 0, rightOffset, rightCount, depth + 1);
+        done.release();
+    }));
+    job->setAutoDelete(false);
+    m_threadPool->start(job.get());
+
+    splitNode(nodes, left, leftOffset, leftCount, depth + 1);
+
+    // If the pool did not get to it yet (it may be busy with the very job that
+    // is running this build), do it here rather than wait.
+    if (m_threadPool->tryTake(job.get()))
+        job->run();
+    done.acquire();
+
+    appendSubtree(nodes, right, rightNodes);
+}
+
+void QSSGMeshBVHBuilder::appendSubtree(QVector<QSSGMeshBVHNode> &nodes, int slot, const QVector<QSSGMeshBVHNode> &subtree)
+{
+    // The subtree root goes into the reserved slot, the remaining nodes are
+    // appended and their child indices are rebased accordingly.
+    const int base = int(nodes.size()) - 1;
+    const auto rebase = [base](QSSGMeshBVHNode node) {
+        if (!node.isLeaf())
+            node.left += base;
+        return node;
+    };
+
+    nodes[slot] = rebase(subtree.at(0));
+    nodes.reserve(nodes.size() + subtree.size() - 1);
+    for (qsizetype i = 1, end = subtree.size(); i < end; ++i)
+        nodes.append(rebase(subtree.at(i)));
 }
 
 QSSGBounds3 QSSGMeshBVHBuilder::getBounds(quint32 offset, quint32 count) const
@@ -260,7 +365,7 @@ QSSGBounds3 QSSGMeshBVHBuilder::getBounds(quint32 offset, quint32 count) const
     QSSGBounds3 totalBounds;
 
     for (quint32 i = 0; i < count; ++i) {
-        QSSGBounds3 bounds = m_triangleBounds[i + offset]->bounds;
+        const QSSGBounds3 &bounds = m_triangleBounds[m_triangleIndices[i + offset]];
         totalBounds.include(bounds);
     }
     return totalBounds;
@@ -268,6 +373,9 @@ QSSGBounds3 QSSGMeshBVHBuilder::getBounds(quint32 offset, quint32 count) const
 
 QSSGMeshBVHBuilder::Split QSSGMeshBVHBuilder::getOptimalSplit(const QSSGBounds3 &nodeBounds, quint32 offset, quint32 count) const
 {
+    if (m_splitMethod == SplitMethod::SAH)
+        return getSAHSplit(nodeBounds, offset, count);
+
     QSSGMeshBVHBuilder::Split split;
     split.axis = getLongestDimension(nodeBounds);
     split.pos = 0.f;
@@ -278,6 +386,93 @@ QSSGMeshBVHBuilder::Split QSSGMeshBVHBuilder::getOptimalSplit(const QSSGBounds3
     return split;
 }
 
+// Evaluates SAHBinCount - 1 candidate planes on each axis, with the triangles
+// binned by their center, and picks the cheapest one. Returns Axis::None when
+// turning the node into a leaf is cheaper than any split.
+QSSGMeshBVHBuilder::Split QSSGMeshBVHBuilder::getSAHSplit(const QSSGBounds3 &nodeBounds, quint32 offset, quint32 count) const
+{
+    QSSGMeshBVHBuilder::Split split { Axis::None, 0.f };
+
+    if (!nodeBounds.isFinite() || nodeBounds.isEmpty())
+        return split;
+
+    // The bins are spread over the bounds of the triangle centers, not of the
+    // triangles, otherwise large triangles would leave most bins empty.
+    QSSGBounds3 centerBounds;
+    for (quint32 i = 0; i < count; ++i)
+        centerBounds.include(m_triangleCenters[m_triangleIndices[i + offset]]);
+
+    struct Bin {
+        QSSGBounds3 bounds;
+        quint32 count = 0;
+    };
+
+    const float nodeArea = QSSGMeshBVH::surfaceArea(nodeBounds);
+    if (nodeArea <= 0.f) {
+        // Degenerate node (a line or a point), the heuristic is meaningless here
+        split.axis = getLongestDimension(nodeBounds);
+        if (split.axis != Axis::None)
+            split.pos = getAverageValue(offset, count, split.axis);
+        return split;
+    }
+
+    const float leafCost = count * QSSGMeshBVH::IntersectionCost;
+    float bestCost = std::numeric_limits<float>::max();
+
+    for (int axis = 0; axis != 3; ++axis) {
+        const float minCenter = centerBounds.minimum[axis];
+        const float extent = centerBounds.maximum[axis] - minCenter;
+        if (extent <= 0.f)
+            continue;
+
+        const float scale = SAHBinCount / extent;
+        Bin bins[SAHBinCount];
+        for (quint32 i = 0; i < count; ++i) {
+            const quint32 triangle = m_triangleIndices[i + offset];
+            const int bin = qMin(int((m_triangleCenters[triangle][axis] - minCenter) * scale), SAHBinCount - 1);
+            bins[bin].bounds.include(m_triangleBounds[triangle]);
+            ++bins[bin].count;
+        }
+
+        // Sweep from the right to get the area and count on the right side of
+        // each plane, then from the left to evaluate the cost.
+        float rightArea[SAHBinCount - 1];
+        quint32 rightCount[SAHBinCount - 1];
+        QSSGBounds3 accumulated;
+        quint32 accumulatedCount = 0;
+        for (int plane = SAHBinCount - 1; plane > 0; --plane) {
+            accumulated.include(bins[plane].bounds);
+            accumulatedCount += bins[plane].count;
+            rightArea[plane - 1] = QSSGMeshBVH::surfaceArea(accumulated);
+            rightCount[plane - 1] = accumulatedCount;
+        }
+
+        accumulated.setEmpty();
+        accumulatedCount = 0;
+        for (int plane = 0; plane < SAHBinCount - 1; ++plane) {
+            accumulated.include(bins[plane].bounds);
+            accumulatedCount += bins[plane].count;
+            if (accumulatedCount == 0 || rightCount[plane] == 0)
+                continue;
+            const float cost = QSSGMeshBVH::TraversalCost
+                    + QSSGMeshBVH::IntersectionCost
+                    * (QSSGMeshBVH::surfaceArea(accumulated) * accumulatedCount
+                       + rightArea[plane] * rightCount[plane]) / nodeArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                split.axis = Axis(axis);
+                split.pos = minCenter + (plane + 1) / scale;
+            }
+        }
+    }
+
+    // Splitting is not worth it, unless the node is too large to be a leaf
+    if (split.axis != Axis::None && bestCost >= leafCost && count <= m_maxLeafTriangles)
+        split.axis = Axis::None;
+
+    return split;
+}
+
 QSSGMeshBVHBuilder::Axis QSSGMeshBVHBuilder::getLongestDimension(const QSSGBounds3 &nodeBounds)
 {
     QSSGMeshBVHBuilder::Axis axis = Axis::None;
@@ -311,7 +506,7 @@ float QSSGMeshBVHBuilder::getAverageValue(quint32 offset, quint32 count, QSSGMes
     Q_ASSERT(count != 0);
 
     for (quint32 i = 0; i < count; ++i)
-        average += m_triangleBounds[i + offset]->bounds.center(int(axis));
+        average += m_triangleCenters[m_triangleIndices[i + offset]][int(axis)];
 
     return average / count;
 }
@@ -324,17 +519,15 @@ quint32 QSSGMeshBVHBuilder::partition(quint32 offset, quint32 count, const QSSGM
     const int axis = int(split.axis);
 
     while (true) {
-        while (left <= right && m_triangleBounds[left]->bounds.center()[axis] < pos)
+        while (left <= right && m_triangleCenters[m_triangleIndices[left]][axis] < pos)
             left++;
 
-        while (left <= right && m_triangleBounds[right]->bounds.center()[axis] >= pos)
+        while (left <= right && m_triangleCenters[m_triangleIndices[right]][axis] >= pos)
             right--;
 
         if (left < right) {
-            // Swap triangleBounds at left and right
-            auto temp = m_triangleBounds[left];
-            m_triangleBounds[left] = m_triangleBounds[right];
-            m_triangleBounds[right] = temp;
+            // Swap triangle indices at left and right
+            std::swap(m_triangleIndices[left], m_triangleIndices[right]);
 
             left++;
             right--;
@@ -46,6 +46,8 @@
 
 QT_BEGIN_NAMESPACE
 
+class QThreadPool;
+
 class Q_QUICK3DUTILS_EXPORT QSSGMeshBVHBuilder
 {
 public:
@@ -59,8 +61,24 @@ public:
                        const QByteArray &indexBuffer = QByteArray(),
                        QSSGRenderComponentType indexBufferType = QSSGRenderComponentType::Integer32);
 
+    enum class SplitMethod
+    {
+        AverageCentroid, // Split the longest axis at the average triangle center
+        SAH // Binned surface area heuristic
+    };
+
+    void setSplitMethod(SplitMethod method) { m_splitMethod = method; }
+    SplitMethod splitMethod() const { return m_splitMethod; }
+
+    // When a thread pool is set, large subtrees are built in parallel on it.
+    // The pool may be the one running buildTree() itself.
+    void setThreadPool(QThreadPool *pool) { m_threadPool = pool; }
+
     QSSGMeshBVH* buildTree();
 
+    // Original index of each triangle of the last built tree, in leaf order
+    QVector<quint32> triangleOrder() const { return m_triangleIndices; }
+
 private:
     enum class Axis
     {
@@ -74,14 +92,19 @@ private:
         float pos;
     };
 
-    QVector<QSSGMeshBVHTriangle*> calculateTriangleBounds(quint32 indexOffset, quint32 indexCount) const;
+    QSSGMeshBVH *createTreeFromMeshBVH(quint32 triangleCount) const;
+    QSSGMeshBVHTriangle getTriangle(quint32 triangleIndex) const;
+    void calculateTriangleBounds(quint32 indexOffset, quint32 indexCount);
     quint32 getIndexBufferValue(quint32 index) const;
     QVector3D getVertexBufferValuePosition(quint32 index) const;
     QVector2D getVertexBufferValueUV(quint32 index) const;
 
-    QSSGMeshBVHNode *splitNode(QSSGMeshBVHNode *node, quint32 offset, quint32 count, quint32 depth = 0);
+    int createNode(QVector<QSSGMeshBVHNode> &nodes, quint32 offset, quint32 count) const;
+    void splitNode(QVector<QSSGMeshBVHNode> &nodes, int nodeIndex, quint32 offset, quint32 count, quint32 depth = 0);
+    static void appendSubtree(QVector<QSSGMeshBVHNode> &nodes, int slot, const QVector<QSSGMeshBVHNode> &subtree);
     QSSGBounds3 getBounds(quint32 offset, quint32 count) const;
     Split getOptimalSplit(const QSSGBounds3 &nodeBounds, quint32 offset, quint32 count) const;
+    Split getSAHSplit(const QSSGBounds3 &nodeBounds, quint32 offset, quint32 count) const;
     static Axis getLongestDimension(const QSSGBounds3 &nodeBounds);
     float getAverageValue(quint32 offset, quint32 count, Axis axis) const;
     quint32 partition(quint32 offset, quint32 count, const Split &split);
@@ -97,11 +120,25 @@ private:
     quint32 m_vertexUVOffset;
     bool m_hasIndexBuffer = true;
 
+    // Build time data, indexed by the original triangle index. Splitting only
+    // reorders m_triangleIndices, the triangles themselves are moved into leaf
+    // order once the tree is complete.
+    QVector<QSSGMeshBVHTriangle> m_triangles;
+    QVector<QSSGBounds3> m_triangleBounds;
+    QVector<QVector3D> m_triangleCenters;
+    QVector<quint32> m_triangleIndices;
 
-    QVector<QSSGMeshBVHTriangle *> m_triangleBounds;
-    QVector<QSSGMeshBVHNode *> m_roots;
+    QVector<QSSGMeshBVHNode> m_nodes;
+    QVector<int> m_roots;
+    SplitMethod m_splitMethod = SplitMethod::AverageCentroid;
     quint32 m_maxTreeDepth = 40;
     quint32 m_maxLeafTriangles = 10;
+    // With SAH the leaf size is decided by the cost function, only very
+    // small nodes are forced to become leaves.
+    quint32 m_minSAHLeafTriangles = 2;
+    static constexpr int SAHBinCount = 16;
+    QThreadPool *m_threadPool = nullptr;
+    static constexpr quint32 ParallelSubtreeTriangles = 32768;
 };
 
 QT_END_NAMESPACE
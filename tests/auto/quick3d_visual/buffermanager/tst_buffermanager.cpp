@@ -159,6 +159,11 @@ void tst_BufferManager::staticScene()
     QCOMPARE(bufferManager->getCustomTextureMap().count(), customTextureCount);
     QCOMPARE(bufferManager->getMeshMap().count(), meshCount);
     QCOMPARE(bufferManager->getCustomMeshMap().count(), customMeshCount);
+
+    // Picking sees the same meshes once the frame is done
+    QSSGRenderPickingSnapshots::ReadLocker pickingSnapshot(bufferManager->pickingSnapshots());
+    QCOMPARE(pickingSnapshot->meshes.count(), meshCount);
+    QCOMPARE(pickingSnapshot->customMeshes.count(), customMeshCount);
 }
 
 void tst_BufferManager::dynamicScene()
@@ -250,6 +255,10 @@ void tst_BufferManager::dynamicScene()
     delete model;
     renderNextFrame(&renderer, &readCompleted, &readResult, &result);
     QCOMPARE(bufferManager->getMeshMap().count(), 1);
+    {
+        QSSGRenderPickingSnapshots::ReadLocker pickingSnapshot(bufferManager->pickingSnapshots());
+        QCOMPARE(pickingSnapshot->meshes.count(), 1);
+    }
     QMetaObject::invokeMethod(controller, "removeModel");
     delete sphereModel;
     renderNextFrame(&renderer, &readCompleted, &readResult, &result);
@@ -272,6 +281,12 @@ void tst_BufferManager::dynamicScene()
     delete dynamicModel;
     renderNextFrame(&renderer, &readCompleted, &readResult, &result);
     QCOMPARE(bufferManager->getCustomMeshMap().count(), 0);
+    {
+        QSSGRenderPickingSnapshots::ReadLocker pickingSnapshot(bufferManager->pickingSnapshots());
+        QCOMPARE(pickingSnapshot->customMeshes.count(), 0);
+    }
+    // Nothing reads the replaced snapshots anymore, so they are all gone
+    QCOMPARE(bufferManager->pickingSnapshots().retiredCount(), 0);
 
 
     // textures (path)
@@ -0,0 +1,43 @@
+import QtQuick
+import QtQuick3D
+
+View3D {
+    id: view
+    objectName: "view"
+    anchors.fill: parent
+    environment: SceneEnvironment {
+        backgroundMode: SceneEnvironment.Color
+        clearColor: "black"
+    }
+    OrthographicCamera { z: 600 }
+    DirectionalLight { }
+    Model {
+        id: instancedModel
+        objectName: "instancedModel"
+        source: "#Cube"
+        pickable: true
+        instancing: InstanceList {
+            instances: [
+                InstanceListEntry { position: Qt.vector3d(-120.0, 0.0, 0.0) },
+                InstanceListEntry { position: Qt.vector3d(120.0, 0.0, 0.0) },
+                InstanceListEntry {
+                    position: Qt.vector3d(0.0, 120.0, 0.0)
+                    scale: Qt.vector3d(0.5, 0.5, 0.5)
+                }
+            ]
+        }
+        materials: PrincipledMaterial {
+            baseColor: "red"
+        }
+    }
+    Model {
+        id: model
+        objectName: "model"
+        source: "#Cube"
+        pickable: true
+        position: Qt.vector3d(0.0, -120.0, 0.0)
+        materials: PrincipledMaterial {
+            baseColor: "green"
+        }
+    }
+}
@@ -42,6 +42,8 @@ class tst_Picking : public QQuick3DDataTest
 private Q_SLOTS:
     void initTestCase() override;
     void test_object_picking();
+    void test_instanced_picking();
+    void test_ray_pick_many();
 
 private:
     QQuickItem *find2DChildIn3DNode(QQuickView *view, const QString &objectName, const QString &itemName);
@@ -194,5 +196,112 @@ void tst_Picking::test_object_picking()
     QVERIFY(resultList.isEmpty());
 }
 
+void tst_Picking::test_instanced_picking()
+{
+    QScopedPointer<QQuickView> view(createView(QLatin1String("instancedpicking.qml"), QSize(400, 400)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+
+    QQuick3DViewport *view3d = view->findChild<QQuick3DViewport *>(QStringLiteral("view"));
+    QVERIFY(view3d);
+    QQuick3DModel *instancedModel = view3d->findChild<QQuick3DModel *>(QStringLiteral("instancedModel"));
+    QVERIFY(instancedModel);
+    QQuick3DModel *model = view3d->findChild<QQuick3DModel *>(QStringLiteral("model"));
+    QVERIFY(model);
+
+    // Center of the first instance
+    auto result = view3d->pick(80, 200);
+    QCOMPARE(result.objectHit(), instancedModel);
+    QCOMPARE(result.instanceIndex(), 0);
+
+    // Center of the second instance
+    result = view3d->pick(320, 200);
+    QCOMPARE(result.objectHit(), instancedModel);
+    QCOMPARE(result.instanceIndex(), 1);
+
+    // Between the instances, where the model itself would be without instancing
+    result = view3d->pick(200, 200);
+    QCOMPARE(result.objectHit(), nullptr);
+
+    // Upper right corner of the scaled third instance
+    result = view3d->pick(225, 55);
+    QCOMPARE(result.objectHit(), instancedModel);
+    QCOMPARE(result.instanceIndex(), 2);
+
+    // Just outside of it, but inside of its unscaled bounds
+    result = view3d->pick(226, 54);
+    QCOMPARE(result.objectHit(), nullptr);
+
+    // Models without instancing have no instance index
+    result = view3d->pick(200, 320);
+    QCOMPARE(result.objectHit(), model);
+    QCOMPARE(result.instanceIndex(), -1);
+
+    // Positions and normals are those of the instance that was hit
+    result = view3d->rayPick(QVector3D(120.0f, 0.0f, 100.0f), QVector3D(0.0f, 0.0f, -1.0f));
+    QCOMPARE(result.objectHit(), instancedModel);
+    QCOMPARE(result.instanceIndex(), 1);
+    QVERIFY(result.scenePosition().distanceToPoint(QVector3D(120.0f, 0.0f, 50.0f)) < 0.01f);
+    QVERIFY(result.position().distanceToPoint(QVector3D(0.0f, 0.0f, 50.0f)) < 0.01f);
+    // The instance is not rotated or scaled
+    QVERIFY(result.sceneNormal().normalized().distanceToPoint(result.normal().normalized()) < 0.01f);
+
+    // The closest instance is reported for the model
+    auto resultList = view3d->rayPickAll(QVector3D(-300.0f, 0.0f, 0.0f), QVector3D(1.0f, 0.0f, 0.0f));
+    QCOMPARE(resultList.count(), 1);
+    QCOMPARE(resultList[0].objectHit(), instancedModel);
+    QCOMPARE(resultList[0].instanceIndex(), 0);
+    resultList = view3d->rayPickAll(QVector3D(300.0f, 0.0f, 0.0f), QVector3D(-1.0f, 0.0f, 0.0f));
+    QCOMPARE(resultList.count(), 1);
+    QCOMPARE(resultList[0].instanceIndex(), 1);
+}
+
+void tst_Picking::test_ray_pick_many()
+{
+    QScopedPointer<QQuickView> view(createView(QLatin1String("picking.qml"), QSize(400, 400)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+
+    QQuick3DViewport *view3d = view->findChild<QQuick3DViewport *>(QStringLiteral("view"));
+    QVERIFY(view3d);
+
+    // A grid of rays down the z axis covering both models and the empty space
+    // around them, followed by rays that are not parallel to each other. The
+    // rays are offset so that none of them hits an edge of a triangle.
+    QList<QVector3D> origins;
+    QList<QVector3D> directions;
+    for (int y = -100; y <= 150; y += 10) {
+        for (int x = -100; x <= 150; x += 10) {
+            origins.append(QVector3D(x + 0.5f, y + 0.3f, 100.0f));
+            directions.append(QVector3D(0.0f, 0.0f, -1.0f));
+        }
+    }
+    for (int i = 0; i != 7; ++i) {
+        origins.append(QVector3D(3.7f, 1.9f, 150.0f));
+        directions.append(QVector3D(i * 0.05f, i * 0.03f, -1.0f).normalized());
+    }
+
+    const auto results = view3d->rayPickMany(origins, directions);
+    QCOMPARE(results.count(), origins.count());
+
+    int hitCount = 0;
+    for (qsizetype i = 0; i < origins.count(); ++i) {
+        // Same as picking each ray on its own
+        const auto expected = view3d->rayPick(origins.at(i), directions.at(i));
+        QCOMPARE(results.at(i).objectHit(), expected.objectHit());
+        if (!expected.objectHit())
+            continue;
+        ++hitCount;
+        QVERIFY(qAbs(results.at(i).distance() - expected.distance()) < 0.01f);
+        QVERIFY(results.at(i).scenePosition().distanceToPoint(expected.scenePosition()) < 0.01f);
+    }
+    QVERIFY(hitCount > 0);
+    QVERIFY(hitCount < origins.count());
+
+    QVERIFY(view3d->rayPickMany({}, {}).isEmpty());
+    QTest::ignoreMessage(QtWarningMsg, "View3D::rayPickMany: The number of origins and directions do not match");
+    QVERIFY(view3d->rayPickMany(origins, {}).isEmpty());
+}
+
 QTEST_MAIN(tst_Picking)
 #include "tst_picking.moc"
@@ -0,0 +1,56 @@
+import QtQuick
+import QtQuick3D
+
+View3D {
+    anchors.fill: parent
+    camera: camera
+    environment: SceneEnvironment {
+        backgroundMode: SceneEnvironment.Color
+        clearColor: "black"
+    }
+    PerspectiveCamera {
+        id: camera
+        z: 600
+    }
+    DirectionalLight { }
+    PrincipledMaterial {
+        id: sharedMaterial
+        baseColor: "red"
+    }
+    // Identical apart from the transform, merged into one instanced draw
+    Model {
+        source: "#Cube"
+        x: -250
+        y: 100
+        materials: sharedMaterial
+    }
+    Model {
+        source: "#Cube"
+        y: 100
+        eulerRotation.y: 30
+        materials: sharedMaterial
+    }
+    Model {
+        source: "#Cube"
+        x: 250
+        y: 100
+        scale: Qt.vector3d(0.5, 0.5, 0.5)
+        materials: sharedMaterial
+    }
+    // Another material and another opacity, both drawn on their own
+    Model {
+        source: "#Cube"
+        x: -150
+        y: -100
+        materials: PrincipledMaterial {
+            baseColor: "green"
+        }
+    }
+    Model {
+        source: "#Cube"
+        x: 150
+        y: -100
+        opacity: 0.5
+        materials: sharedMaterial
+    }
+}
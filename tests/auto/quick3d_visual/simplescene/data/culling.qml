@@ -0,0 +1,47 @@
+import QtQuick
+import QtQuick3D
+
+View3D {
+    anchors.fill: parent
+    camera: camera
+    environment: SceneEnvironment {
+        backgroundMode: SceneEnvironment.Color
+        clearColor: "black"
+    }
+    PerspectiveCamera {
+        id: camera
+        z: 600
+        frustumCullingEnabled: true
+    }
+    DirectionalLight { }
+    Model {
+        source: "#Cube"
+        materials: PrincipledMaterial { }
+    }
+    // Behind the camera and far off to the side, both culled
+    Model {
+        source: "#Cube"
+        z: 1000
+        materials: PrincipledMaterial { }
+    }
+    Model {
+        source: "#Cube"
+        x: 5000
+        materials: PrincipledMaterial { }
+    }
+    // A whole subtree off to the other side
+    Node {
+        x: -5000
+        Model {
+            source: "#Cube"
+            materials: PrincipledMaterial { }
+        }
+        Node {
+            y: 200
+            Model {
+                source: "#Cube"
+                materials: PrincipledMaterial { }
+            }
+        }
+    }
+}
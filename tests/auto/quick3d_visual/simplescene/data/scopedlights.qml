@@ -0,0 +1,65 @@
+import QtQuick
+import QtQuick3D
+
+View3D {
+    anchors.fill: parent
+    camera: camera
+    environment: SceneEnvironment {
+        backgroundMode: SceneEnvironment.Color
+        clearColor: "black"
+    }
+    PerspectiveCamera {
+        id: camera
+        z: 600
+    }
+    PrincipledMaterial {
+        id: white
+        baseColor: "white"
+    }
+    DirectionalLight {
+        objectName: "redLight"
+        color: "red"
+        scope: groupA
+    }
+    DirectionalLight {
+        objectName: "blueLight"
+        color: "blue"
+        scope: groupB
+    }
+    // Both models of a group are lit by the same lights
+    Node {
+        id: groupA
+        x: -250
+        Model {
+            source: "#Cube"
+            y: 100
+            materials: white
+        }
+        Model {
+            source: "#Cube"
+            y: -100
+            materials: white
+        }
+    }
+    Node {
+        id: groupB
+        Node {
+            Model {
+                source: "#Cube"
+                y: 100
+                materials: white
+            }
+        }
+        Model {
+            source: "#Cube"
+            y: -100
+            materials: white
+        }
+    }
+    // Outside of both scopes, not lit at all
+    Model {
+        source: "#Cube"
+        x: 250
+        materials: white
+    }
+}
@@ -0,0 +1,39 @@
+import QtQuick
+import QtQuick3D
+
+View3D {
+    anchors.fill: parent
+    camera: camera
+    environment: SceneEnvironment {
+        backgroundMode: SceneEnvironment.Color
+        clearColor: "black"
+    }
+    PerspectiveCamera {
+        id: camera
+        z: 600
+    }
+    // Different materials with the same shader, each with its own uniforms
+    Model {
+        source: "#Cube"
+        x: -250
+        materials: PrincipledMaterial {
+            lighting: PrincipledMaterial.NoLighting
+            baseColor: "red"
+        }
+    }
+    Model {
+        source: "#Cube"
+        materials: PrincipledMaterial {
+            lighting: PrincipledMaterial.NoLighting
+            baseColor: "lime"
+        }
+    }
+    Model {
+        source: "#Cube"
+        x: 250
+        materials: PrincipledMaterial {
+            lighting: PrincipledMaterial.NoLighting
+            baseColor: "blue"
+        }
+    }
+}
@@ -28,6 +28,11 @@
 
 #include <QTest>
 #include <QQuickView>
+#include <QtCore/qscopeguard.h>
+#include <QtCore/qmath.h>
+
+#include <QtQuick3D/private/qquick3dviewport_p.h>
+#include <QtQuick3D/private/qquick3drenderstats_p.h>
 
 #include "../shared/util.h"
 
@@ -38,6 +43,10 @@ class tst_SimpleScene : public QQuick3DDataTest
 private slots:
     void initTestCase() override;
     void cube();
+    void culling();
+    void autoInstancing();
+    void scopedLights();
+    void sharedShader();
 };
 
 void tst_SimpleScene::initTestCase()
@@ -70,5 +79,146 @@ void tst_SimpleScene::cube()
     QVERIFY(comparePixelNormPos(result, 0.5, 0.375, QColor::fromRgb(181, 181, 181), FUZZ));
 }
 
+void tst_SimpleScene::culling()
+{
+    QScopedPointer<QQuickView> view(createView(QLatin1String("culling.qml"), QSize(640, 480)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+
+    const QImage result = grab(view.data());
+    if (result.isNull())
+        return; // was QFAIL'ed already
+
+    // Only the cube in the middle gets rendered
+    QVERIFY(!comparePixelNormPos(result, 0.5, 0.5, Qt::black, FUZZ));
+
+    QQuick3DViewport *view3D = qobject_cast<QQuick3DViewport *>(view->rootObject());
+    QVERIFY(view3D);
+    QCOMPARE(view3D->renderStats()->visibleObjectCount(), 1);
+    QCOMPARE(view3D->renderStats()->culledObjectCount(), 4);
+
+    // Once the subtree bounds are known, the culled subtrees are skipped as a
+    // whole, which must not change the result
+    const QImage secondResult = grab(view.data());
+    if (secondResult.isNull())
+        return;
+    QVERIFY(!comparePixelNormPos(secondResult, 0.5, 0.5, Qt::black, FUZZ));
+    QCOMPARE(view3D->renderStats()->visibleObjectCount(), 1);
+    QCOMPARE(view3D->renderStats()->culledObjectCount(), 4);
+}
+
+void tst_SimpleScene::autoInstancing()
+{
+    // The centers of the models in autoinstancing.qml
+    const QPointF positions[] = {
+        { 0.229, 0.355 }, { 0.5, 0.355 }, { 0.771, 0.355 },
+        { 0.338, 0.645 }, { 0.662, 0.645 }
+    };
+
+    QImage expected;
+    {
+        QScopedPointer<QQuickView> view(createView(QLatin1String("autoinstancing.qml"), QSize(640, 480)));
+        QVERIFY(view);
+        QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+        expected = grab(view.data());
+        if (expected.isNull())
+            return;
+        QQuick3DViewport *view3D = qobject_cast<QQuick3DViewport *>(view->rootObject());
+        QVERIFY(view3D);
+        QCOMPARE(view3D->renderStats()->autoInstancedObjectCount(), 0);
+    }
+
+    qputenv("QT_QUICK3D_AUTO_INSTANCING", "1");
+    auto cleanup = qScopeGuard([] { qunsetenv("QT_QUICK3D_AUTO_INSTANCING"); });
+
+    QScopedPointer<QQuickView> view(createView(QLatin1String("autoinstancing.qml"), QSize(640, 480)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+    const QImage result = grab(view.data());
+    if (result.isNull())
+        return;
+
+    // Only the three models sharing the material and the opacity are merged
+    QQuick3DViewport *view3D = qobject_cast<QQuick3DViewport *>(view->rootObject());
+    QVERIFY(view3D);
+    QCOMPARE(view3D->renderStats()->autoInstancedObjectCount(), 3);
+
+    // Each model is still drawn with its own transform and material
+    for (const QPointF &pos : positions) {
+        const QColor color = expected.pixelColor(qCeil(expected.width() * pos.x()),
+                                                 qCeil(expected.height() * pos.y()));
+        QVERIFY(color != QColor(Qt::black));
+        QVERIFY(comparePixelNormPos(result, pos.x(), pos.y(), color, FUZZ));
+    }
+}
+
+void tst_SimpleScene::scopedLights()
+{
+    QScopedPointer<QQuickView> view(createView(QLatin1String("scopedlights.qml"), QSize(640, 480)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+
+    enum Light { Unlit, Red, Blue, RedAndBlue };
+    const auto isLitBy = [](const QImage &image, qreal x, qreal y, Light light) {
+        const QColor color = image.pixelColor(qCeil(image.width() * x), qCeil(image.height() * y));
+        const bool red = color.red() > 100;
+        const bool blue = color.blue() > 100;
+        return red == (light == Red || light == RedAndBlue)
+                && blue == (light == Blue || light == RedAndBlue)
+                && color.green() < 50;
+    };
+
+    // The models of the two groups and the one outside of both
+    const QPointF groupA[] = { { 0.229, 0.355 }, { 0.229, 0.645 } };
+    const QPointF groupB[] = { { 0.5, 0.355 }, { 0.5, 0.645 } };
+    const QPointF outside(0.771, 0.5);
+
+    // The second frame reuses the light lists of the first one
+    for (int frame = 0; frame < 2; ++frame) {
+        const QImage result = grab(view.data());
+        if (result.isNull())
+            return;
+        for (const QPointF &pos : groupA)
+            QVERIFY(isLitBy(result, pos.x(), pos.y(), Red));
+        for (const QPointF &pos : groupB)
+            QVERIFY(isLitBy(result, pos.x(), pos.y(), Blue));
+        QVERIFY(isLitBy(result, outside.x(), outside.y(), Unlit));
+    }
+
+    // Moving a light to another scope updates the lists of both groups
+    QObject *redLight = view->rootObject()->findChild<QObject *>(QStringLiteral("redLight"));
+    QObject *blueLight = view->rootObject()->findChild<QObject *>(QStringLiteral("blueLight"));
+    QVERIFY(redLight && blueLight);
+    QVERIFY(redLight->setProperty("scope", blueLight->property("scope")));
+
+    const QImage result = grab(view.data());
+    if (result.isNull())
+        return;
+    for (const QPointF &pos : groupA)
+        QVERIFY(isLitBy(result, pos.x(), pos.y(), Unlit));
+    for (const QPointF &pos : groupB)
+        QVERIFY(isLitBy(result, pos.x(), pos.y(), RedAndBlue));
+    QVERIFY(isLitBy(result, outside.x(), outside.y(), Unlit));
+}
+
+void tst_SimpleScene::sharedShader()
+{
+    QScopedPointer<QQuickView> view(createView(QLatin1String("sharedshader.qml"), QSize(640, 480)));
+    QVERIFY(view);
+    QVERIFY(QTest::qWaitForWindowExposed(view.data()));
+
+    // The uniform offsets are resolved for the first material and reused for
+    // the others, which must still get their own values. Also on the second
+    // frame, when the pipeline comes from the cache.
+    for (int frame = 0; frame < 2; ++frame) {
+        const QImage result = grab(view.data());
+        if (result.isNull())
+            return;
+        QVERIFY(comparePixelNormPos(result, 0.229, 0.5, Qt::red, FUZZ));
+        QVERIFY(comparePixelNormPos(result, 0.5, 0.5, Qt::green, FUZZ));
+        QVERIFY(comparePixelNormPos(result, 0.771, 0.5, Qt::blue, FUZZ));
+    }
+}
+
 QTEST_MAIN(tst_SimpleScene)
 #include "tst_simplescene.moc"
@@ -0,0 +1,267 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtQuick3DRuntimeRender/private/qssgrendercontextcore_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendererimpllayerrenderdata_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderlayer_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendermodel_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendercamera_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderdefaultmaterial_p.h>
+
+#include <functional>
+
+// The same scene is built twice. Both get the same changes between frames,
+// one is prepared with retained renderables and the other without, and the
+// results of preparing them must be the same.
+struct Scene
+{
+    QSSGRenderLayer layer;
+    QSSGRenderCamera camera { QSSGRenderGraphObject::Type::PerspectiveCamera };
+    QSSGRenderNode group;
+    QSSGRenderDefaultMaterial opaqueMaterial;
+    QSSGRenderDefaultMaterial transparentMaterial;
+    // Removed models stay in here, last in the list
+    QVector<QSSGRenderModel *> models;
+
+    Scene()
+    {
+        camera.position = QVector3D(0.0f, 0.0f, 600.0f);
+        layer.addChild(camera);
+        group.position = QVector3D(0.0f, 100.0f, 0.0f);
+        layer.addChild(group);
+        opaqueMaterial.lighting = QSSGRenderDefaultMaterial::MaterialLighting::NoLighting;
+        transparentMaterial.lighting = QSSGRenderDefaultMaterial::MaterialLighting::NoLighting;
+        transparentMaterial.opacity = 0.5f;
+        for (int i = 0; i < 6; ++i)
+            addModel(layer);
+    }
+
+    ~Scene()
+    {
+        qDeleteAll(models);
+    }
+
+    QSSGRenderModel *addModel(QSSGRenderNode &parent)
+    {
+        QSSGRenderModel *model = new QSSGRenderModel;
+        model->meshPath = QSSGRenderPath("#Cube");
+        model->scale = QVector3D(0.5f, 0.5f, 0.5f);
+        model->position = QVector3D(float(models.count() % 6) * 100.0f - 250.0f, -100.0f, 0.0f);
+        model->materials.push_back(&opaqueMaterial);
+        parent.addChild(*model);
+        models.append(model);
+        return model;
+    }
+};
+
+// What preparing a frame came up with, the models as their indices in the
+// scene, so that the scenes can be compared
+struct Frame
+{
+    QVector<int> opaqueModels;
+    QVector<int> transparentModels;
+    int renderableNodeCount = 0;
+    int visibleObjectCount = 0;
+    int culledObjectCount = 0;
+};
+
+class retainedrenderables : public QObject
+{
+    Q_OBJECT
+
+public:
+    retainedrenderables() = default;
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void test_graphChanges();
+
+private:
+    Frame prepare(Scene &scene, bool retained);
+
+    QRhi *rhi = nullptr;
+    QSSGRef<QSSGRenderContextInterface> renderContext;
+};
+
+void retainedrenderables::initTestCase()
+{
+    rhi = QRhi::create(QRhi::Null, nullptr);
+    QVERIFY(rhi);
+    QRhiCommandBuffer *cb;
+    rhi->beginOffscreenFrame(&cb);
+
+    const auto rhiContext = QSSGRef<QSSGRhiContext>(new QSSGRhiContext);
+    rhiContext->initialize(rhi);
+    rhiContext->setCommandBuffer(cb);
+
+    renderContext = QSSGRef<QSSGRenderContextInterface>(new QSSGRenderContextInterface(rhiContext,
+                                                                                       new QSSGBufferManager,
+                                                                                       new QSSGRenderer,
+                                                                                       new QSSGShaderLibraryManager,
+                                                                                       new QSSGShaderCache(rhiContext),
+                                                                                       new QSSGCustomMaterialSystem,
+                                                                                       new QSSGProgramGenerator));
+    const QRect viewport(QPoint(), QSize(400, 400));
+    renderContext->setViewport(viewport);
+    renderContext->setScissorRect(viewport);
+}
+
+void retainedrenderables::cleanupTestCase()
+{
+    renderContext = nullptr;
+    rhi->endOffscreenFrame();
+    delete rhi;
+}
+
+Frame retainedrenderables::prepare(Scene &scene, bool retained)
+{
+    const QSSGRef<QSSGRenderer> &renderer = renderContext->renderer();
+    renderer->setRetainedRenderables(retained);
+    renderContext->beginFrame(&scene.layer);
+    renderContext->prepareLayerForRender(scene.layer);
+
+    // The renderables are gone with the next frame
+    Frame frame;
+    const QSSGLayerRenderData &data = *scene.layer.renderData;
+    const auto modelIndices = [&scene](const QVector<QSSGRenderableObjectHandle> &handles) {
+        QVector<int> indices;
+        for (const QSSGRenderableObjectHandle &handle : handles) {
+            if (handle.obj->renderableFlags.isDefaultMaterialMeshSubset()) {
+                const QSSGRenderModel &model = static_cast<QSSGSubsetRenderable *>(handle.obj)->modelContext.model;
+                indices.append(int(scene.models.indexOf(const_cast<QSSGRenderModel *>(&model))));
+            }
+        }
+        return indices;
+    };
+    frame.opaqueModels = modelIndices(data.opaqueObjects);
+    frame.transparentModels = modelIndices(data.transparentObjects);
+    frame.renderableNodeCount = int(data.renderableNodes.count());
+    frame.visibleObjectCount = data.visibleObjectCount;
+    frame.culledObjectCount = data.culledObjectCount;
+
+    renderContext->endFrame(&scene.layer);
+    renderer->setRetainedRenderables(false);
+    return frame;
+}
+
+void retainedrenderables::test_graphChanges()
+{
+    Scene retainedScene;
+    Scene scene;
+
+    // Each change is made to both scenes, then a frame is prepared twice, the
+    // second one with nothing changed in between
+    const auto compareFrames = [&](const char *step) {
+        for (int i = 0; i < 2; ++i) {
+            const Frame retainedFrame = prepare(retainedScene, true);
+            const Frame frame = prepare(scene, false);
+            if (retainedFrame.opaqueModels != frame.opaqueModels
+                    || retainedFrame.transparentModels != frame.transparentModels
+                    || retainedFrame.renderableNodeCount != frame.renderableNodeCount
+                    || retainedFrame.visibleObjectCount != frame.visibleObjectCount
+                    || retainedFrame.culledObjectCount != frame.culledObjectCount) {
+                qWarning() << step << "frame" << i << "retained:" << retainedFrame.opaqueModels << retainedFrame.transparentModels
+                           << retainedFrame.visibleObjectCount << "expected:" << frame.opaqueModels << frame.transparentModels
+                           << frame.visibleObjectCount;
+                return false;
+            }
+        }
+        return retainedScene.layer.renderData->retainedNodesValid;
+    };
+    const auto change = [&](const std::function<void(Scene &)> &function) {
+        function(retainedScene);
+        function(scene);
+    };
+
+    QVERIFY(compareFrames("initial"));
+    QCOMPARE(prepare(scene, false).opaqueModels, QVector<int>({ 0, 1, 2, 3, 4, 5 }));
+
+    change([](Scene &s) { s.addModel(s.layer); });
+    QVERIFY(compareFrames("added to the layer"));
+    change([](Scene &s) { s.addModel(s.group); });
+    QVERIFY(compareFrames("added to a node"));
+    QCOMPARE(prepare(scene, false).opaqueModels.count(), 8);
+
+    change([](Scene &s) {
+        s.layer.removeChild(*s.models.at(1));
+        s.models.move(1, s.models.count() - 1);
+    });
+    QVERIFY(compareFrames("removed"));
+    QCOMPARE(prepare(scene, false).opaqueModels.count(), 7);
+
+    change([](Scene &s) {
+        s.models.at(2)->flags.setFlag(QSSGRenderNode::Flag::Active, false);
+        s.models.at(2)->markDirty();
+    });
+    QVERIFY(compareFrames("model hidden"));
+    change([](Scene &s) {
+        s.group.flags.setFlag(QSSGRenderNode::Flag::Active, false);
+        s.group.markDirty();
+    });
+    QVERIFY(compareFrames("parent hidden"));
+    QCOMPARE(prepare(scene, false).opaqueModels.count(), 5);
+    change([](Scene &s) {
+        s.models.at(2)->flags.setFlag(QSSGRenderNode::Flag::Active, true);
+        s.models.at(2)->markDirty();
+        s.group.flags.setFlag(QSSGRenderNode::Flag::Active, true);
+        s.group.markDirty();
+    });
+    QVERIFY(compareFrames("shown"));
+    QCOMPARE(prepare(scene, false).opaqueModels.count(), 7);
+
+    change([](Scene &s) {
+        QSSGRenderModel *model = s.models.at(3);
+        s.layer.removeChild(*model);
+        s.group.addChild(*model);
+        model->markDirty(QSSGRenderNode::TransformDirtyFlag::TransformIsDirty);
+    });
+    QVERIFY(compareFrames("re-parented"));
+
+    change([](Scene &s) {
+        s.models.at(4)->materials[0] = &s.transparentMaterial;
+        s.models.at(4)->markDirty();
+    });
+    QVERIFY(compareFrames("material changed"));
+    QCOMPARE(prepare(scene, false).transparentModels, QVector<int>({ 4 }));
+
+    change([](Scene &s) {
+        s.layer.removeChild(*s.models.at(4));
+        s.models.move(4, s.models.count() - 1);
+    });
+    QVERIFY(compareFrames("transparent model removed"));
+    QVERIFY(prepare(scene, false).transparentModels.isEmpty());
+}
+
+QTEST_MAIN(retainedrenderables)
+
+#include "tst_retainedrenderables.moc"
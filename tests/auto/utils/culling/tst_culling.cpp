@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtQuick3DRuntimeRender/private/qssgrenderfrustumculler_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderclippingfrustum_p.h>
+
+class culling : public QObject
+{
+    Q_OBJECT
+
+public:
+    culling();
+
+private slots:
+    void test_frustumCuller_data();
+    void test_frustumCuller();
+    void test_frustumCullerEmptyBounds();
+
+private:
+    QSSGClippingFrustum m_frustum;
+};
+
+culling::culling()
+{
+    // A camera at (0, 0, 100) looking down the negative z axis
+    const float clipNear = 1.0f;
+    QMatrix4x4 projection;
+    projection.perspective(60.0f, 1.5f, clipNear, 1000.0f);
+    QMatrix4x4 view;
+    view.lookAt(QVector3D(0, 0, 100), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+
+    QSSGClipPlane nearPlane;
+    nearPlane.normal = QVector3D(0, 0, -1);
+    nearPlane.d = -QVector3D::dotProduct(nearPlane.normal, QVector3D(0, 0, 100 - clipNear));
+    m_frustum = QSSGClippingFrustum(projection * view, nearPlane);
+}
+
+void culling::test_frustumCuller_data()
+{
+    QTest::addColumn<int>("count");
+
+    // Full batches and the ones with padding
+    QTest::newRow("1") << 1;
+    QTest::newRow("4") << 4;
+    QTest::newRow("63") << 63;
+    QTest::newRow("64") << 64;
+    QTest::newRow("1001") << 1001;
+}
+
+void culling::test_frustumCuller()
+{
+    QFETCH(int, count);
+
+    QRandomGenerator generator(count);
+    auto random = [&generator](float min, float max) {
+        return min + float(generator.generateDouble()) * (max - min);
+    };
+
+    QSSGRenderFrustumCuller culler;
+    QVector<bool> expected;
+    for (int i = 0; i < count; ++i) {
+        const QVector3D center(random(-5, 5), random(-5, 5), random(-5, 5));
+        const QVector3D extents(random(0.1f, 5), random(0.1f, 5), random(0.1f, 5));
+        const QSSGBounds3 bounds(center - extents, center + extents);
+
+        QMatrix4x4 transform;
+        transform.translate(random(-1500, 1500), random(-1000, 1000), random(-1000, 200));
+        transform.rotate(random(0, 360), QVector3D(random(-1, 1), random(-1, 1), 1).normalized());
+        transform.scale(random(0.5f, 20), random(0.5f, 20), random(0.5f, 20));
+
+        QSSGBounds3 globalBounds = bounds;
+        globalBounds.transform(transform);
+        expected.append(m_frustum.intersectsWith(globalBounds));
+
+        QCOMPARE(culler.addBounds(bounds, transform), qsizetype(i));
+    }
+    QCOMPARE(culler.size(), qsizetype(count));
+
+    culler.cull(m_frustum);
+
+    int visibleCount = 0;
+    for (int i = 0; i < count; ++i) {
+        QCOMPARE(culler.isVisible(i), expected.at(i));
+        visibleCount += expected.at(i) ? 1 : 0;
+    }
+
+    // The padding lanes are never visible
+    int bitCount = 0;
+    for (quint64 bits : culler.visibility())
+        bitCount += qPopulationCount(bits);
+    QCOMPARE(bitCount, visibleCount);
+
+    culler.clear();
+    QCOMPARE(culler.size(), qsizetype(0));
+}
+
+void culling::test_frustumCullerEmptyBounds()
+{
+    QSSGRenderFrustumCuller culler;
+    culler.addBounds(QSSGBounds3(QVector3D(-1, -1, -1), QVector3D(1, 1, 1)), QMatrix4x4());
+    culler.addBounds(QSSGBounds3(), QMatrix4x4());
+    culler.addBounds(QSSGBounds3(QVector3D(-1, -1, -1), QVector3D(1, 1, 1)), QMatrix4x4());
+    culler.cull(m_frustum);
+
+    QVERIFY(culler.isVisible(0));
+    QVERIFY(!culler.isVisible(1));
+    QVERIFY(culler.isVisible(2));
+}
+
+QTEST_APPLESS_MAIN(culling)
+
+#include "tst_culling.moc"
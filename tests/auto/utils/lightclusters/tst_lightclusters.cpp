@@ -0,0 +1,229 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QThreadPool>
+
+#include <QtQuick3DRuntimeRender/private/qssglightclusters_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendercamera_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderlight_p.h>
+#include <QtQuick3DUtils/private/qssgutils_p.h>
+
+#include <memory>
+#include <vector>
+
+class lightclusters : public QObject
+{
+    Q_OBJECT
+
+public:
+    lightclusters() = default;
+
+private slots:
+    void test_lightRange();
+    void test_binning_data();
+    void test_binning();
+    void test_threaded();
+
+private:
+    static std::unique_ptr<QSSGRenderCamera> createCamera(bool perspective);
+    static std::unique_ptr<QSSGRenderLight> createLight(QSSGRenderLight::Type type, const QVector3D &position,
+                                                        float quadraticFade);
+    // Looks up the lights of the cell containing worldPos, like lightClusters.glsllib
+    static QVector<int> lightsAt(const QSSGLightClusters &clusters, const QVector3D &worldPos);
+};
+
+std::unique_ptr<QSSGRenderCamera> lightclusters::createCamera(bool perspective)
+{
+    auto camera = std::make_unique<QSSGRenderCamera>(perspective ? QSSGRenderGraphObject::Type::PerspectiveCamera
+                                                                 : QSSGRenderGraphObject::Type::OrthographicCamera);
+    camera->clipNear = 10.0f;
+    camera->clipFar = 10000.0f;
+    // Looking down -z from the origin
+    camera->globalTransform = QMatrix4x4();
+    if (perspective)
+        camera->projection.perspective(60.0f, 16.0f / 9.0f, camera->clipNear, camera->clipFar);
+    else
+        camera->projection.ortho(-800.0f, 800.0f, -450.0f, 450.0f, camera->clipNear, camera->clipFar);
+    return camera;
+}
+
+std::unique_ptr<QSSGRenderLight> lightclusters::createLight(QSSGRenderLight::Type type, const QVector3D &position,
+                                                            float quadraticFade)
+{
+    auto light = std::make_unique<QSSGRenderLight>(type);
+    light->m_quadraticFade = quadraticFade;
+    light->globalTransform = QMatrix4x4();
+    light->globalTransform.translate(position);
+    return light;
+}
+
+QVector<int> lightclusters::lightsAt(const QSSGLightClusters &clusters, const QVector3D &worldPos)
+{
+    const QVector<QVector4D> &texels = clusters.texels();
+    const QVector4D clipPos = clusters.viewProjection() * QVector4D(worldPos, 1.0f);
+    const float depth = QVector4D::dotProduct(clusters.viewDepth(), QVector4D(worldPos, 1.0f));
+    const QVector4D &params = clusters.depthParams();
+    const float slice = (params.z() > 0.5f ? qLn(depth) : depth) * params.x() + params.y();
+    const int x = qBound(0, int(qFloor((clipPos.x() / clipPos.w() * 0.5f + 0.5f) * QSSGLightClusters::GridWidth)),
+                         QSSGLightClusters::GridWidth - 1);
+    const int y = qBound(0, int(qFloor((clipPos.y() / clipPos.w() * 0.5f + 0.5f) * QSSGLightClusters::GridHeight)),
+                         QSSGLightClusters::GridHeight - 1);
+    const int z = qBound(0, int(qFloor(slice)), QSSGLightClusters::GridDepth - 1);
+    const QVector4D cell = texels.at(x + (y + z * QSSGLightClusters::GridHeight) * QSSGLightClusters::GridWidth);
+
+    QVector<int> lights;
+    const int indexBase = int(clusters.offsets().y());
+    for (int i = int(cell.x()), end = int(cell.x() + cell.y()); i < end; ++i)
+        lights.append(int(texels.at(indexBase + i / 4)[i % 4]));
+    return lights;
+}
+
+void lightclusters::test_lightRange()
+{
+    auto light = createLight(QSSGRenderLight::Type::PointLight, QVector3D(), 1.0f);
+    const float range = QSSGLightClusters::lightRange(*light);
+    const float attenuation = aux::translateConstantAttenuation(light->m_constantFade)
+            + aux::translateLinearAttenuation(light->m_linearFade) * range
+            + aux::translateQuadraticAttenuation(light->m_quadraticFade) * range * range;
+    QVERIFY(qAbs(light->m_brightness / attenuation - 1.0f / 256.0f) < 1e-5f);
+
+    // Brighter lights reach further
+    light->m_brightness = 4.0f;
+    QVERIFY(QSSGLightClusters::lightRange(*light) > range);
+
+    // Only linear falloff
+    light->m_quadraticFade = 0.0f;
+    light->m_linearFade = 10.0f;
+    QVERIFY(QSSGLightClusters::lightRange(*light) > 0.0f);
+    QVERIFY(!qIsInf(QSSGLightClusters::lightRange(*light)));
+
+    // No falloff at all
+    light->m_linearFade = 0.0f;
+    QVERIFY(qIsInf(QSSGLightClusters::lightRange(*light)));
+
+    // Too dim to ever reach the cutoff
+    light->m_brightness = 0.001f;
+    light->m_quadraticFade = 1.0f;
+    QCOMPARE(QSSGLightClusters::lightRange(*light), 0.0f);
+}
+
+void lightclusters::test_binning_data()
+{
+    QTest::addColumn<bool>("perspective");
+    QTest::newRow("perspective") << true;
+    QTest::newRow("orthographic") << false;
+}
+
+void lightclusters::test_binning()
+{
+    QFETCH(bool, perspective);
+    auto camera = createCamera(perspective);
+
+    // Short range lights near and far from the camera, and one without
+    // falloff
+    auto nearLight = createLight(QSSGRenderLight::Type::PointLight, QVector3D(0.0f, 0.0f, -100.0f), 1000.0f);
+    auto farLight = createLight(QSSGRenderLight::Type::SpotLight, QVector3D(200.0f, -100.0f, -5000.0f), 1000.0f);
+    auto globalLight = createLight(QSSGRenderLight::Type::PointLight, QVector3D(0.0f, 0.0f, -1000.0f), 0.0f);
+    globalLight->m_ambientColor = QVector3D(0.1f, 0.2f, 0.3f);
+    QVERIFY(QSSGLightClusters::lightRange(*nearLight) < 100.0f);
+
+    QSSGShaderLightList lights;
+    for (QSSGRenderLight *light : { nearLight.get(), farLight.get(), globalLight.get() }) {
+        QSSGShaderLight shaderLight;
+        shaderLight.light = light;
+        shaderLight.direction = QVector3D(0.0f, 0.0f, -1.0f);
+        lights.append(shaderLight);
+    }
+
+    QSSGLightClusters clusters;
+    QVERIFY(clusters.isEmpty());
+    clusters.update(lights, *camera);
+    QCOMPARE(clusters.lightCount(), 3);
+    QCOMPARE(clusters.ambientTotal(), globalLight->m_ambientColor);
+    QCOMPARE(int(clusters.offsets().x()), QSSGLightClusters::ClusterCount);
+    QCOMPARE(int(clusters.offsets().y()), QSSGLightClusters::ClusterCount + 3 * QSSGLightClusters::TexelsPerLight);
+    QCOMPARE(clusters.texels().size() % QSSGLightClusters::TextureWidth, 0);
+
+    // The light without falloff is in every cell
+    QVERIFY(clusters.indexCount() >= QSSGLightClusters::ClusterCount);
+
+    QCOMPARE(lightsAt(clusters, QVector3D(0.0f, 0.0f, -100.0f)), QVector<int>({ 0, 2 }));
+    QCOMPARE(lightsAt(clusters, QVector3D(0.0f, 0.0f, -120.0f)), QVector<int>({ 0, 2 }));
+    QCOMPARE(lightsAt(clusters, QVector3D(200.0f, -100.0f, -5000.0f)), QVector<int>({ 1, 2 }));
+    QCOMPARE(lightsAt(clusters, QVector3D(0.0f, 0.0f, -9000.0f)), QVector<int>({ 2 }));
+
+    // The light data
+    const QVector4D *farLightData = clusters.texels().constData() + QSSGLightClusters::ClusterCount
+            + QSSGLightClusters::TexelsPerLight;
+    QCOMPARE(farLightData[0], QVector4D(200.0f, -100.0f, -5000.0f, 1.0f));
+    QCOMPARE(farLightData[1].toVector3D(), QVector3D(0.0f, 0.0f, -1.0f));
+    QVERIFY(qFuzzyCompare(farLightData[1].w(), qCos(qDegreesToRadians(farLight->m_coneAngle))));
+    QCOMPARE(farLightData[4].z(), aux::translateQuadraticAttenuation(farLight->m_quadraticFade));
+
+    clusters.clear();
+    QVERIFY(clusters.isEmpty());
+}
+
+void lightclusters::test_threaded()
+{
+    auto camera = createCamera(true);
+
+    QRandomGenerator random(42);
+    std::vector<std::unique_ptr<QSSGRenderLight>> lightNodes;
+    QSSGShaderLightList lights;
+    for (int i = 0; i < 512; ++i) {
+        const QVector3D position(float(random.bounded(-2000, 2000)), float(random.bounded(-1000, 1000)),
+                                 -float(random.bounded(0, 9000)));
+        lightNodes.push_back(createLight(i % 2 ? QSSGRenderLight::Type::SpotLight : QSSGRenderLight::Type::PointLight,
+                                         position, float(random.bounded(10, 1000))));
+        QSSGShaderLight shaderLight;
+        shaderLight.light = lightNodes.back().get();
+        shaderLight.direction = QVector3D(0.0f, 0.0f, -1.0f);
+        lights.append(shaderLight);
+    }
+
+    QSSGLightClusters serial;
+    serial.update(lights, *camera);
+    QVERIFY(serial.indexCount() > 0);
+
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(3);
+    QSSGLightClusters threaded;
+    threaded.update(lights, *camera, &threadPool);
+
+    QCOMPARE(threaded.indexCount(), serial.indexCount());
+    QCOMPARE(threaded.texels(), serial.texels());
+}
+
+QTEST_APPLESS_MAIN(lightclusters)
+
+#include "tst_lightclusters.moc"
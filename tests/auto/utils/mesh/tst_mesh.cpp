@@ -0,0 +1,243 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtCore/qbuffer.h>
+#include <QtCore/qendian.h>
+
+#include <QtQuick3DUtils/private/qssgmesh_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvhbuilder_p.h>
+
+class mesh : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_saveLoad();
+    void test_saveLoadBVH();
+    void test_invalidBVH_data();
+    void test_invalidBVH();
+
+private:
+    enum BVHCorruption {
+        RootOutOfRange,
+        Cycle,
+        LeafOutsideSubset
+    };
+
+    static QSSGMesh::Mesh createGridMesh(int gridSize);
+    static QByteArray saveMesh(const QSSGMesh::Mesh &mesh);
+    static QSSGMesh::Mesh loadMesh(QByteArray data);
+};
+
+QSSGMesh::Mesh mesh::createGridMesh(int gridSize)
+{
+    QSSGMesh::RuntimeMeshData data;
+    data.m_stride = 3 * sizeof(float);
+    data.m_attributes[0].semantic = QSSGMesh::RuntimeMeshData::Attribute::PositionSemantic;
+    data.m_attributes[0].componentType = QSSGMesh::Mesh::ComponentType::Float32;
+    data.m_attributes[1].semantic = QSSGMesh::RuntimeMeshData::Attribute::IndexSemantic;
+    data.m_attributes[1].componentType = QSSGMesh::Mesh::ComponentType::UnsignedInt32;
+    data.m_attributeCount = 2;
+
+    const int vertexCount = gridSize + 1;
+    data.m_vertexBuffer.resize(vertexCount * vertexCount * data.m_stride);
+    float *v = reinterpret_cast<float *>(data.m_vertexBuffer.data());
+    for (int y = 0; y < vertexCount; ++y) {
+        for (int x = 0; x < vertexCount; ++x) {
+            *v++ = float(x);
+            *v++ = float((x * 7 + y * 13) % 5);
+            *v++ = float(y);
+        }
+    }
+
+    QVector<quint32> indices;
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            const quint32 i = y * vertexCount + x;
+            indices << i << i + vertexCount << i + 1;
+            indices << i + 1 << i + vertexCount << i + vertexCount + 1;
+        }
+    }
+    data.m_indexBuffer = QByteArray(reinterpret_cast<const char *>(indices.constData()),
+                                    indices.size() * sizeof(quint32));
+
+    // Two subsets, so there is more than one BVH root
+    QSSGMesh::Mesh::Subset first;
+    first.name = QStringLiteral("first");
+    first.count = (indices.size() / 6) * 3;
+    first.offset = 0;
+    first.bounds.min = QVector3D(0, 0, 0);
+    first.bounds.max = QVector3D(gridSize, 4, gridSize);
+    QSSGMesh::Mesh::Subset second = first;
+    second.name = QStringLiteral("second");
+    second.offset = first.count;
+    second.count = indices.size() - first.count;
+    data.m_subsets << first << second;
+
+    QString error;
+    return QSSGMesh::Mesh::fromRuntimeData(data, &error);
+}
+
+QByteArray mesh::saveMesh(const QSSGMesh::Mesh &mesh)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    mesh.save(&buffer);
+    return buffer.data();
+}
+
+QSSGMesh::Mesh mesh::loadMesh(QByteArray data)
+{
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    return QSSGMesh::Mesh::loadMesh(&buffer);
+}
+
+void mesh::test_saveLoad()
+{
+    const QSSGMesh::Mesh source = createGridMesh(8);
+    QVERIFY(source.isValid());
+    QVERIFY(!source.hasBVH());
+
+    const QSSGMesh::Mesh loaded = loadMesh(saveMesh(source));
+    QVERIFY(loaded.isValid());
+    QVERIFY(!loaded.hasBVH());
+    QCOMPARE(loaded.subsets().count(), 2);
+    QCOMPARE(loaded.vertexBuffer().data, source.vertexBuffer().data);
+    QCOMPARE(loaded.indexBuffer().data, source.indexBuffer().data);
+}
+
+void mesh::test_saveLoadBVH()
+{
+    QSSGMesh::Mesh source = createGridMesh(32);
+    QVERIFY(source.generateBVH());
+    QVERIFY(source.hasBVH());
+
+    const QSSGMesh::Mesh loaded = loadMesh(saveMesh(source));
+    QVERIFY(loaded.isValid());
+    QVERIFY(loaded.hasBVH());
+    QCOMPARE(loaded.vertexBuffer().data, source.vertexBuffer().data);
+
+    const QSSGMesh::Mesh::BVHData sourceBVH = source.bvhData();
+    const QSSGMesh::Mesh::BVHData loadedBVH = loaded.bvhData();
+    QCOMPARE(loadedBVH.roots, sourceBVH.roots);
+    QCOMPARE(loadedBVH.triangleOrder, sourceBVH.triangleOrder);
+    QCOMPARE(loadedBVH.nodes.count(), sourceBVH.nodes.count());
+    for (int i = 0; i < sourceBVH.nodes.count(); ++i) {
+        const QSSGMeshBVHNode &a = sourceBVH.nodes.at(i);
+        const QSSGMeshBVHNode &b = loadedBVH.nodes.at(i);
+        QCOMPARE(b.boundingData.minimum, a.boundingData.minimum);
+        QCOMPARE(b.boundingData.maximum, a.boundingData.maximum);
+        QCOMPARE(b.left, a.left);
+        QCOMPARE(b.offset, a.offset);
+        QCOMPARE(b.count, a.count);
+    }
+
+    // The tree built from the stored data must match a freshly built one
+    QSSGMeshBVHBuilder fromStored(loaded);
+    QScopedPointer<QSSGMeshBVH> storedTree(fromStored.buildTree());
+    QSSGMeshBVHBuilder fromScratch(createGridMesh(32));
+    fromScratch.setSplitMethod(QSSGMeshBVHBuilder::SplitMethod::SAH);
+    QScopedPointer<QSSGMeshBVH> builtTree(fromScratch.buildTree());
+    QVERIFY(storedTree);
+    QVERIFY(builtTree);
+    QCOMPARE(storedTree->roots, builtTree->roots);
+    QCOMPARE(storedTree->nodes.count(), builtTree->nodes.count());
+    QCOMPARE(storedTree->triangles.count(), builtTree->triangles.count());
+    for (int i = 0; i < builtTree->triangles.count(); ++i) {
+        QCOMPARE(storedTree->triangles.at(i).vertex1, builtTree->triangles.at(i).vertex1);
+        QCOMPARE(storedTree->triangles.at(i).vertex2, builtTree->triangles.at(i).vertex2);
+        QCOMPARE(storedTree->triangles.at(i).vertex3, builtTree->triangles.at(i).vertex3);
+    }
+}
+
+void mesh::test_invalidBVH_data()
+{
+    QTest::addColumn<int>("corruption");
+    QTest::newRow("rootOutOfRange") << int(RootOutOfRange);
+    QTest::newRow("cycle") << int(Cycle);
+    QTest::newRow("leafOutsideSubset") << int(LeafOutsideSubset);
+}
+
+void mesh::test_invalidBVH()
+{
+    QFETCH(int, corruption);
+
+    QSSGMesh::Mesh source = createGridMesh(8);
+    QVERIFY(source.generateBVH());
+    QByteArray data = saveMesh(source);
+
+    // The BVH chunk ends with the nodes, the roots and the triangle order,
+    // followed by the single mesh entry and the file header, 16 bytes each.
+    // A node is 6 floats for the bounds, then left, offset and count.
+    const QSSGMesh::Mesh::BVHData bvhData = source.bvhData();
+    QCOMPARE(bvhData.roots.count(), 2);
+    const int rootsPos = data.size() - 32
+            - int((bvhData.triangleOrder.count() + bvhData.roots.count()) * sizeof(quint32));
+    const int nodeSize = 9 * 4;
+    const int nodesPos = rootsPos - bvhData.nodes.count() * nodeSize;
+    QVERIFY(nodesPos > 0);
+    QCOMPARE(qFromLittleEndian<qint32>(data.constData() + rootsPos), bvhData.roots.first());
+
+    switch (corruption) {
+    case RootOutOfRange:
+        qToLittleEndian<qint32>(bvhData.nodes.count(), data.data() + rootsPos);
+        break;
+    case Cycle: {
+        // Make the root of the first subset its own child
+        const int root = bvhData.roots.first();
+        QVERIFY(!bvhData.nodes.at(root).isLeaf());
+        qToLittleEndian<qint32>(root, data.data() + nodesPos + root * nodeSize + 24);
+        break;
+    }
+    case LeafOutsideSubset: {
+        // Make a leaf of the first subset refer to the triangles of the second
+        const int secondRoot = bvhData.roots.at(1);
+        int leaf = bvhData.roots.first();
+        while (leaf < secondRoot && !bvhData.nodes.at(leaf).isLeaf())
+            ++leaf;
+        QVERIFY(leaf < secondRoot);
+        const qint32 secondSubsetTriangle = qint32(source.subsets().at(1).offset / 3);
+        QVERIFY(bvhData.nodes.at(leaf).offset < secondSubsetTriangle);
+        qToLittleEndian<qint32>(secondSubsetTriangle, data.data() + nodesPos + leaf * nodeSize + 28);
+        break;
+    }
+    }
+
+    QTest::ignoreMessage(QtWarningMsg, "Mesh BVH data invalid, ignoring it");
+    const QSSGMesh::Mesh loaded = loadMesh(data);
+    QVERIFY(loaded.isValid());
+    QVERIFY(!loaded.hasBVH());
+}
+
+QTEST_APPLESS_MAIN(mesh)
+
+#include "tst_mesh.moc"
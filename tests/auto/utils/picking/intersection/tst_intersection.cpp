@@ -30,6 +30,8 @@
 #include <QtTest>
 
 #include <QtQuick3DRuntimeRender/private/qssgrenderray_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvh_p.h>
+#include <QtQuick3DUtils/private/qssgutils_p.h>
 
 class intersection : public QObject
 {
@@ -44,6 +46,7 @@ private slots:
     void test_aabbIntersectionScaledv2();
     void test_aabbIntersectionTranslatedv2();
     void test_aabbIntersectionRotatedv2();
+    void test_packetIntersection();
 
 private:
     static QSSGRenderRay::IntersectionResult intersectWithAABBv2_proxy(const QMatrix4x4 &inGlobalTransform,
@@ -323,6 +326,88 @@ void intersection::aabbIntersectionRotated(const IntersectionFunc &intersectFunc
     }
 }
 
+static void appendQuad(QVector<QSSGMeshBVHTriangle> &triangles, const QVector3D &minimum, const QVector3D &maximum, float z)
+{
+    const QVector3D v0(minimum.x(), minimum.y(), z);
+    const QVector3D v1(maximum.x(), minimum.y(), z);
+    const QVector3D v2(maximum.x(), maximum.y(), z);
+    const QVector3D v3(minimum.x(), maximum.y(), z);
+    triangles.append({ v0, v1, v2, { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } });
+    triangles.append({ v0, v2, v3, { 0.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } });
+}
+
+void intersection::test_packetIntersection()
+{
+    // Two leaves: a large quad at z = 0, and a smaller one in front of it
+    QVector<QSSGMeshBVHTriangle> triangles;
+    appendQuad(triangles, { -1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, 0.0f);
+    appendQuad(triangles, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, 0.0f }, 0.5f);
+
+    QVector<QSSGMeshBVHNode> nodes(3);
+    nodes[0].boundingData = QSSGBounds3({ -1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.5f });
+    nodes[0].left = 1;
+    nodes[1].boundingData = QSSGBounds3({ -1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f });
+    nodes[1].offset = 0;
+    nodes[1].count = 2;
+    nodes[2].boundingData = QSSGBounds3({ 0.0f, 0.0f, 0.5f }, { 0.5f, 0.5f, 0.5f });
+    nodes[2].offset = 2;
+    nodes[2].count = 2;
+    const QSSGMeshBVH bvh(std::move(nodes), { 0 }, std::move(triangles));
+
+    QMatrix4x4 globalTransform;
+    globalTransform.translate(10.0f, 0.0f, 0.0f);
+    globalTransform.rotate(30.0f, { 0.0f, 1.0f, 0.0f });
+    globalTransform.scale(2.0f);
+
+    // A grid of rays around the quads, including ones that miss, one
+    // parallel to the axes and a partial packet at the end. The grid is
+    // offset so that no ray hits an edge, where the results may differ.
+    QVector<QSSGRenderRay> rays;
+    for (int y = -6; y <= 6; ++y) {
+        for (int x = -6; x <= 6; ++x) {
+            const QVector3D target = mat44::transform(globalTransform, QVector3D(x * 0.2f + 0.03f, y * 0.2f + 0.07f, 0.0f));
+            const QVector3D origin = mat44::transform(globalTransform, QVector3D(0.0f, 0.0f, 10.0f));
+            rays.append(QSSGRenderRay(origin, (target - origin).normalized()));
+        }
+    }
+    rays.append(QSSGRenderRay(mat44::transform(globalTransform, QVector3D(0.25f, 0.1f, 10.0f)),
+                              mat44::rotate(globalTransform, QVector3D(0.0f, 0.0f, -1.0f)).normalized()));
+    QVERIFY(rays.size() % QSSGRenderRay::RayPacket::Size != 0);
+
+    int hitCount = 0;
+    for (int first = 0; first < rays.size(); first += QSSGRenderRay::RayPacket::Size) {
+        const int count = qMin(QSSGRenderRay::RayPacket::Size, int(rays.size()) - first);
+        const QSSGRenderRay *packetRays[QSSGRenderRay::RayPacket::Size];
+        for (int lane = 0; lane != count; ++lane)
+            packetRays[lane] = &rays[first + lane];
+        const auto packet = QSSGRenderRay::createRayPacket(globalTransform, packetRays, count);
+        QSSGRenderRay::IntersectionResult results[QSSGRenderRay::RayPacket::Size];
+        QSSGRenderRay::intersectWithBVH(packet, bvh, 0, results);
+
+        for (int lane = 0; lane != count; ++lane) {
+            // Compare with the closest hit of the single ray traversal
+            const auto rayData = QSSGRenderRay::createRayData(globalTransform, rays.at(first + lane));
+            QVector<QSSGRenderRay::IntersectionResult> intersections;
+            QSSGRenderRay::intersectWithBVH(rayData, bvh, 0, intersections);
+            QSSGRenderRay::IntersectionResult expected;
+            for (const auto &intersection : qAsConst(intersections)) {
+                if (!expected.intersects || intersection.rayLengthSquared < expected.rayLengthSquared)
+                    expected = intersection;
+            }
+
+            QCOMPARE(results[lane].intersects, expected.intersects);
+            if (!expected.intersects)
+                continue;
+            ++hitCount;
+            QVERIFY(qAbs(results[lane].rayLengthSquared - expected.rayLengthSquared) < 0.001f);
+            QVERIFY(results[lane].scenePosition.distanceToPoint(expected.scenePosition) < 0.001f);
+            QVERIFY(results[lane].localPosition.distanceToPoint(expected.localPosition) < 0.001f);
+        }
+    }
+    QVERIFY(hitCount > 0);
+    QVERIFY(hitCount < rays.size());
+}
+
 QTEST_APPLESS_MAIN(intersection)
 
 #include "tst_intersection.moc"
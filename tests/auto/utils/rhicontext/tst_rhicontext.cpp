@@ -0,0 +1,434 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtQuick3DRuntimeRender/private/qssgrhicontext_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendershadercache_p.h>
+
+#include <algorithm>
+
+class rhicontext : public QObject
+{
+    Q_OBJECT
+
+public:
+    rhicontext() = default;
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+    void test_uniformRingAlignment();
+    void test_uniformRingGrowth();
+    void test_uniformRingWraparound();
+
+    void test_cacheEvictionUnused();
+    void test_cacheEvictionLeastRecentlyUsed();
+    void test_cacheEvictionInUse();
+    void test_cacheEvictionPipelineAndSrb();
+
+    void test_readyShadersFallback();
+    void test_asyncCompilation();
+
+private:
+    QSSGRhiContext::CacheStats stats(QSSGRhiContext::CacheType type) const
+    {
+        return rhiContext->cacheStats(type);
+    }
+    QRhiShaderResourceBindings *srb(int index);
+    QRhiGraphicsPipeline *pipeline(int index, QRhiShaderResourceBindings *srb);
+
+    QRhi *rhi = nullptr;
+
+    // Created for each test in init()
+    QSSGRef<QSSGRhiContext> rhiContext;
+    QScopedPointer<QSSGRhiShaderPipeline> shaderPipeline;
+    QScopedPointer<QRhiBuffer> buffer;
+    QScopedPointer<QRhiTexture> texture;
+    QScopedPointer<QRhiTextureRenderTarget> renderTarget;
+    QScopedPointer<QRhiRenderPassDescriptor> rpDesc;
+};
+
+void rhicontext::initTestCase()
+{
+    rhi = QRhi::create(QRhi::Null, nullptr);
+    QVERIFY(rhi);
+}
+
+void rhicontext::cleanupTestCase()
+{
+    delete rhi;
+}
+
+void rhicontext::test_uniformRingAlignment()
+{
+    QSSGRhiUniformRing ring;
+    ring.reset(rhiContext.data());
+
+    // Every allocation starts at a multiple of the alignment, right after
+    // the aligned size of the previous one
+    const quint32 alignment = quint32(rhi->ubufAlignment());
+    quint32 expectedOffset = 0;
+    for (int size : { 1, 64, int(alignment), int(alignment) + 1, 1000 }) {
+        const QSSGRhiUniformRing::Allocation allocation = ring.allocate(size);
+        QVERIFY(allocation.buffer);
+        QVERIFY(allocation.data);
+        QCOMPARE(allocation.offset, expectedOffset);
+        QCOMPARE(allocation.offset % alignment, 0u);
+        expectedOffset += quint32(rhi->ubufAligned(size));
+    }
+    QCOMPARE(ring.bufferCount(), 1);
+    ring.commit();
+}
+
+void rhicontext::test_uniformRingGrowth()
+{
+    QSSGRhiUniformRing ring;
+    ring.reset(rhiContext.data());
+
+    const int size = 64 * 1024;
+    const int allocationsPerBlock = QSSGRhiUniformRing::BlockSize / size;
+    QSSGRhiUniformRing::Allocation first = ring.allocate(size);
+    QVERIFY(first.buffer);
+    for (int i = 1; i < allocationsPerBlock; ++i) {
+        const QSSGRhiUniformRing::Allocation allocation = ring.allocate(size);
+        QCOMPARE(allocation.buffer, first.buffer);
+        QCOMPARE(allocation.offset, quint32(i * size));
+    }
+    QCOMPARE(ring.bufferCount(), 1);
+
+    // A full block makes the ring grow in the middle of the frame. The data
+    // of the earlier allocations stays writable until commit().
+    const QSSGRhiUniformRing::Allocation second = ring.allocate(size);
+    QVERIFY(second.buffer);
+    QVERIFY(second.buffer != first.buffer);
+    QCOMPARE(second.offset, 0u);
+    QCOMPARE(ring.bufferCount(), 2);
+    QCOMPARE(ring.usedBufferCount(), 2);
+    memset(first.data, 0, size);
+
+    // Allocations larger than a block get a buffer of their own
+    const QSSGRhiUniformRing::Allocation large = ring.allocate(QSSGRhiUniformRing::BlockSize + 1);
+    QVERIFY(large.buffer);
+    QVERIFY(large.buffer != second.buffer);
+    QCOMPARE(large.offset, 0u);
+    QVERIFY(large.buffer->size() > QSSGRhiUniformRing::BlockSize);
+    QCOMPARE(ring.bufferCount(), 3);
+    ring.commit();
+}
+
+void rhicontext::test_uniformRingWraparound()
+{
+    QSSGRhiUniformRing ring;
+    const int size = 64 * 1024;
+    const int allocationsPerFrame = QSSGRhiUniformRing::BlockSize / size + 1;
+
+    // Each frame starts over at the beginning of the first buffer, reusing
+    // the buffers created in the previous frames
+    QRhiBuffer *firstBuffer = nullptr;
+    for (int frame = 0; frame < 3; ++frame) {
+        ring.reset(rhiContext.data());
+        QCOMPARE(ring.usedBufferCount(), frame == 0 ? 0 : 1);
+        const QSSGRhiUniformRing::Allocation allocation = ring.allocate(size);
+        QCOMPARE(allocation.offset, 0u);
+        if (frame == 0)
+            firstBuffer = allocation.buffer;
+        QCOMPARE(allocation.buffer, firstBuffer);
+        for (int i = 1; i < allocationsPerFrame; ++i)
+            ring.allocate(size);
+        QCOMPARE(ring.bufferCount(), 2);
+        QCOMPARE(ring.usedBufferCount(), 2);
+        ring.commit();
+    }
+
+    ring.releaseResources();
+    QCOMPARE(ring.bufferCount(), 0);
+}
+
+void rhicontext::init()
+{
+    rhiContext = QSSGRef<QSSGRhiContext>(new QSSGRhiContext);
+    rhiContext->initialize(rhi);
+    // The Null backend does not look at the shader code, but it wants some
+    QShader vertexShader;
+    vertexShader.setStage(QShader::VertexStage);
+    vertexShader.setShader(QShaderKey(QShader::SpirvShader, QShaderVersion(100)), QShaderCode("dummy"));
+    shaderPipeline.reset(new QSSGRhiShaderPipeline(*rhiContext));
+    shaderPipeline->addStage(QRhiShaderStage(QRhiShaderStage::Vertex, vertexShader));
+    buffer.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 256));
+    QVERIFY(buffer->create());
+    texture.reset(rhi->newTexture(QRhiTexture::RGBA8, QSize(64, 64), 1, QRhiTexture::RenderTarget));
+    QVERIFY(texture->create());
+    renderTarget.reset(rhi->newTextureRenderTarget({ texture.data() }));
+    rpDesc.reset(renderTarget->newCompatibleRenderPassDescriptor());
+    renderTarget->setRenderPassDescriptor(rpDesc.data());
+    QVERIFY(renderTarget->create());
+}
+
+void rhicontext::cleanup()
+{
+    shaderPipeline.reset();
+    rhiContext = nullptr;
+    renderTarget.reset();
+    rpDesc.reset();
+    texture.reset();
+    buffer.reset();
+}
+
+// A different srb for each index
+QRhiShaderResourceBindings *rhicontext::srb(int index)
+{
+    QSSGRhiShaderResourceBindingList bindings;
+    bindings.addUniformBuffer(index, QRhiShaderResourceBinding::VertexStage, buffer.data(), 0, 256);
+    return rhiContext->srb(bindings);
+}
+
+// A different pipeline for each index
+QRhiGraphicsPipeline *rhicontext::pipeline(int index, QRhiShaderResourceBindings *srb)
+{
+    QSSGRhiGraphicsPipelineState ps;
+    ps.shaderPipeline = shaderPipeline.data();
+    ps.ia.inputLayout.setBindings({ 3 * sizeof(float) });
+    ps.ia.inputLayout.setAttributes({ { 0, 0, QRhiVertexInputAttribute::Float3, 0 } });
+    ps.depthBias = index;
+    return rhiContext->pipeline(QSSGGraphicsPipelineStateKey::create(ps, rpDesc.data(), srb), rpDesc.data(), srb);
+}
+
+void rhicontext::test_cacheEvictionUnused()
+{
+    QSSGRhiContext::CacheLimits limits;
+    limits.maxUnusedFrames = 2;
+    std::fill(std::begin(limits.maxEntries), std::end(limits.maxEntries), 0);
+    rhiContext->setCacheLimits(limits);
+
+    QVERIFY(srb(0));
+    QVERIFY(srb(1));
+    rhiContext->trimCaches();
+    // Only the first one stays in use
+    for (int frame = 1; frame <= 2; ++frame) {
+        QVERIFY(srb(0));
+        rhiContext->trimCaches();
+        QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).entryCount, 2);
+    }
+    QVERIFY(srb(0));
+    rhiContext->trimCaches();
+    const QSSGRhiContext::CacheStats srbStats = stats(QSSGRhiContext::CacheType::ShaderResourceBindings);
+    QCOMPARE(srbStats.entryCount, 1);
+    QCOMPARE(srbStats.evictions, 1u);
+    QCOMPARE(srbStats.misses, 2u);
+
+    QVERIFY(srb(0));
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).misses, 2u);
+}
+
+void rhicontext::test_cacheEvictionLeastRecentlyUsed()
+{
+    QSSGRhiContext::CacheLimits limits;
+    limits.maxUnusedFrames = 0;
+    std::fill(std::begin(limits.maxEntries), std::end(limits.maxEntries), 0);
+    limits.maxEntries[int(QSSGRhiContext::CacheType::ShaderResourceBindings)] = 2;
+    rhiContext->setCacheLimits(limits);
+
+    // One new srb per frame, the oldest one goes when there are three
+    for (int i = 0; i < 3; ++i) {
+        QVERIFY(srb(i));
+        rhiContext->trimCaches();
+    }
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).entryCount, 2);
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).evictions, 1u);
+
+    // Using 1 makes 2 the least recently used one
+    QVERIFY(srb(1));
+    QVERIFY(srb(3));
+    rhiContext->trimCaches();
+    QSSGRhiContext::CacheStats srbStats = stats(QSSGRhiContext::CacheType::ShaderResourceBindings);
+    QCOMPARE(srbStats.entryCount, 2);
+    QCOMPARE(srbStats.evictions, 2u);
+    QCOMPARE(srbStats.hits, 1u);
+
+    QVERIFY(srb(1));
+    QVERIFY(srb(3));
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).hits, 3u);
+    QVERIFY(srb(2));
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).misses, srbStats.misses + 1);
+}
+
+void rhicontext::test_cacheEvictionInUse()
+{
+    QSSGRhiContext::CacheLimits limits;
+    limits.maxUnusedFrames = 0;
+    std::fill(std::begin(limits.maxEntries), std::end(limits.maxEntries), 2);
+    rhiContext->setCacheLimits(limits);
+
+    // Nothing used in the frame is released, whatever the limit
+    for (int frame = 0; frame < 2; ++frame) {
+        for (int i = 0; i < 4; ++i)
+            QVERIFY(srb(i));
+        rhiContext->trimCaches();
+        QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).entryCount, 4);
+        QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).evictions, 0u);
+    }
+
+    // Once the cache grows, the srbs unused in this frame are released down
+    // to the limit
+    const QSSGRhiDrawCallDataKey dcdKey = { nullptr, nullptr, nullptr, 0, QSSGRhiDrawCallDataKey::Main };
+    QRhiShaderResourceBindings *dcdSrb = srb(10);
+    QSSGRhiDrawCallData &dcd = rhiContext->drawCallData(dcdKey);
+    dcd.srb = dcdSrb;
+    dcd.pipeline = pipeline(10, dcdSrb);
+    QVERIFY(dcd.pipeline);
+    rhiContext->trimCaches();
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).entryCount, 2);
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).evictions, 3u);
+
+    // Draw call data keeps its srb and pipeline in use without them being
+    // looked up
+    for (int frame = 0; frame < 2; ++frame) {
+        rhiContext->drawCallData(dcdKey);
+        rhiContext->trimCaches();
+    }
+    QVERIFY(srb(11));
+    rhiContext->drawCallData(dcdKey);
+    rhiContext->trimCaches();
+    const QSSGRhiContext::CacheStats srbStats = stats(QSSGRhiContext::CacheType::ShaderResourceBindings);
+    QCOMPARE(srbStats.entryCount, 2);
+    QCOMPARE(srbStats.evictions, 4u);
+    QCOMPARE(stats(QSSGRhiContext::CacheType::GraphicsPipelines).entryCount, 1);
+    QCOMPARE(dcd.srb, dcdSrb);
+    QVERIFY(dcd.pipeline);
+    QCOMPARE(srb(10), dcdSrb);
+    QCOMPARE(stats(QSSGRhiContext::CacheType::ShaderResourceBindings).hits, srbStats.hits + 1);
+}
+
+void rhicontext::test_cacheEvictionPipelineAndSrb()
+{
+    QSSGRhiContext::CacheLimits limits;
+    limits.maxUnusedFrames = 0;
+    std::fill(std::begin(limits.maxEntries), std::end(limits.maxEntries), 0);
+    limits.maxEntries[int(QSSGRhiContext::CacheType::ShaderResourceBindings)] = 1;
+    limits.maxEntries[int(QSSGRhiContext::CacheType::GraphicsPipelines)] = 1;
+    rhiContext->setCacheLimits(limits);
+
+    QRhiShaderResourceBindings *firstSrb = srb(0);
+    QVERIFY(pipeline(0, firstSrb));
+    rhiContext->trimCaches();
+
+    // The first pipeline goes, and with it the last reference to its srb
+    QRhiShaderResourceBindings *secondSrb = srb(1);
+    QVERIFY(pipeline(1, secondSrb));
+    rhiContext->trimCaches();
+    const QSSGRhiContext::CacheStats pipelineStats = stats(QSSGRhiContext::CacheType::GraphicsPipelines);
+    const QSSGRhiContext::CacheStats srbStats = stats(QSSGRhiContext::CacheType::ShaderResourceBindings);
+    QCOMPARE(pipelineStats.entryCount, 1);
+    QCOMPARE(pipelineStats.evictions, 1u);
+    QCOMPARE(srbStats.entryCount, 1);
+    QCOMPARE(srbStats.evictions, 1u);
+
+    // What is left is the second pair
+    QCOMPARE(srb(1), secondSrb);
+    QVERIFY(pipeline(1, secondSrb));
+    QCOMPARE(stats(QSSGRhiContext::CacheType::GraphicsPipelines).hits, pipelineStats.hits + 1);
+}
+
+void rhicontext::test_readyShadersFallback()
+{
+    QShader vertexShader;
+    vertexShader.setStage(QShader::VertexStage);
+    vertexShader.setShader(QShaderKey(QShader::SpirvShader, QShaderVersion(100)), QShaderCode("dummy"));
+    QSSGRef<QSSGRhiShaderPipeline> ready(new QSSGRhiShaderPipeline(*rhiContext));
+    ready->addStage(QRhiShaderStage(QRhiShaderStage::Vertex, vertexShader));
+    QSSGRef<QSSGRhiShaderPipeline> pending(new QSSGRhiShaderPipeline(*rhiContext));
+    pending->setCompilationPending(true);
+
+    // Nothing to fall back to before the draw call was prepared once
+    QSSGRhiDrawCallData dcd;
+    QVERIFY(!dcd.readyShaders(pending, true));
+
+    QCOMPARE(dcd.readyShaders(ready, true).data(), ready.data());
+    QCOMPARE(dcd.lastReadyShaders.data(), ready.data());
+
+    // While pending, the previous shaders are used, or none without fallback
+    QCOMPARE(dcd.readyShaders(pending, true).data(), ready.data());
+    QVERIFY(!dcd.readyShaders(pending, false));
+    QCOMPARE(dcd.lastReadyShaders.data(), ready.data());
+
+    // A compilation that finished without stages failed
+    pending->setCompilationPending(false);
+    QVERIFY(!dcd.readyShaders(pending, true));
+
+    dcd.reset();
+    QVERIFY(!dcd.lastReadyShaders);
+}
+
+void rhicontext::test_asyncCompilation()
+{
+    QSSGShaderCache shaderCache(rhiContext);
+    shaderCache.setPersistentCacheDirectory(QString());
+    shaderCache.setAsyncCompilation(QSSGShaderCache::AsyncCompilation::Fallback);
+
+    const QByteArray vert = "layout(location = 0) in vec3 attr_pos;\n"
+                            "void main() { gl_Position = vec4(attr_pos, 1.0); }\n";
+    const QByteArray frag = "void main() { fragOutput = vec4(1.0); }\n";
+    const QSSGRef<QSSGRhiShaderPipeline> shaders = shaderCache.compileForRhi("tst_rhicontext", vert, frag, QSSGShaderFeatures(),
+                                                                            QSSGRhiShaderPipeline::AsyncCompilation);
+    if (!shaders)
+        QSKIP("This build cannot compile shaders at runtime");
+    QVERIFY(shaders->isNull());
+    QVERIFY(shaders->isCompilationPending());
+    QCOMPARE(shaderCache.pendingCompilationCount(), 1);
+
+    // The same key gives the same pending pipeline
+    QCOMPARE(shaderCache.compileForRhi("tst_rhicontext", vert, frag, QSSGShaderFeatures(),
+                                       QSSGRhiShaderPipeline::AsyncCompilation).data(), shaders.data());
+
+    // Draw calls keep using their previous shaders meanwhile
+    QSSGRef<QSSGRhiShaderPipeline> previous(new QSSGRhiShaderPipeline(*rhiContext));
+    previous->addStage(*shaderPipeline->cbeginStages());
+    QSSGRhiDrawCallData dcd;
+    QCOMPARE(dcd.readyShaders(previous, true).data(), previous.data());
+    QCOMPARE(dcd.readyShaders(shaders, true).data(), previous.data());
+
+    // Once baked, the stages are swapped into the pipeline handed out before
+    QTRY_COMPARE(shaderCache.processCompletedCompilations(), 1);
+    QCOMPARE(shaderCache.pendingCompilationCount(), 0);
+    QVERIFY(!shaders->isCompilationPending());
+    QCOMPARE(int(shaders->cendStages() - shaders->cbeginStages()), 2);
+    QVERIFY(shaders->vertexStage());
+    QVERIFY(shaders->fragmentStage());
+    QCOMPARE(dcd.readyShaders(shaders, true).data(), shaders.data());
+    QCOMPARE(dcd.lastReadyShaders.data(), shaders.data());
+    QCOMPARE(shaderCache.processCompletedCompilations(), 0);
+}
+
+QTEST_MAIN(rhicontext)
+
+#include "tst_rhicontext.moc"
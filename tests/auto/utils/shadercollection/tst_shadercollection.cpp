@@ -75,6 +75,7 @@ private Q_SLOTS:
     void test_readWriteToBuffer();
     void test_readWriteOpenDevice();
     void test_mapModes();
+    void test_corruptData();
 
 private:
     QShader vert;
@@ -278,6 +279,44 @@ void ShaderCollection::test_mapModes()
 
 }
 
+void ShaderCollection::test_corruptData()
+{
+    QBuffer buffer;
+    const size_t hkey = 99;
+    QQsbCollection::Entry entry;
+    {
+        QQsbCollection qsbc(buffer);
+        QVERIFY(qsbc.map(QQsbCollection::Write));
+        entry = qsbc.addQsbEntry(QByteArray(shaderDescription()), featureSet, vert, frag, hkey);
+        QVERIFY(entry.isValid());
+        qsbc.unmap();
+    }
+    const QByteArray data = buffer.buffer();
+
+    { // Truncated, the trailer is gone
+        QBuffer truncated;
+        truncated.setData(data.left(data.size() - 1));
+        QQsbCollection qsbc(truncated);
+        QCOMPARE(qsbc.map(QQsbCollection::Read), false);
+    }
+
+    { // Garbage in the entry, its description claims to be larger than the file
+        QByteArray corruptData = data;
+        for (int i = 0; i < 4; ++i)
+            corruptData[int(entry.offset) + i] = char(0x7f);
+        QBuffer corrupt;
+        corrupt.setData(corruptData);
+        QQsbCollection qsbc(corrupt);
+        QVERIFY(qsbc.map(QQsbCollection::Read));
+        QShader vertShader;
+        QShader fragShader;
+        QCOMPARE(qsbc.extractQsbEntry(entry, nullptr, nullptr, &vertShader, &fragShader), false);
+        QVERIFY(!vertShader.isValid());
+        QVERIFY(!fragShader.isValid());
+        qsbc.unmap();
+    }
+}
+
 QTEST_APPLESS_MAIN(ShaderCollection)
 
 #include "tst_shadercollection.moc"
@@ -0,0 +1,178 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QThreadPool>
+
+#include <QtQuick3DRuntimeRender/private/qssgrenderablesorter_p.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class sorting : public QObject
+{
+    Q_OBJECT
+
+public:
+    sorting() = default;
+
+private slots:
+    void test_depthBits();
+    void test_sortKey();
+    void test_radixSort_data();
+    void test_radixSort();
+    void test_sort_data();
+    void test_sort();
+
+private:
+    QMatrix4x4 m_transform;
+    QSSGBounds3 m_bounds;
+};
+
+void sorting::test_depthBits()
+{
+    const float values[] = { -std::numeric_limits<float>::max(), -1000.0f, -1.0f, -0.5f, 0.0f,
+                             0.5f, 1.0f, 1000.0f, std::numeric_limits<float>::max() };
+    for (size_t i = 1; i < sizeof(values) / sizeof(values[0]); ++i)
+        QVERIFY(QSSGRenderableSorter::depthBits(values[i - 1]) < QSSGRenderableSorter::depthBits(values[i]));
+}
+
+void sorting::test_sortKey()
+{
+    using Order = QSSGRenderableSorter::Order;
+    // Distance first, the state key only breaks ties
+    QVERIFY(QSSGRenderableSorter::sortKey(1.0f, 2, Order::FrontToBack) < QSSGRenderableSorter::sortKey(2.0f, 1, Order::FrontToBack));
+    QVERIFY(QSSGRenderableSorter::sortKey(1.0f, 1, Order::FrontToBack) < QSSGRenderableSorter::sortKey(1.0f, 2, Order::FrontToBack));
+    QVERIFY(QSSGRenderableSorter::sortKey(2.0f, 2, Order::BackToFront) < QSSGRenderableSorter::sortKey(1.0f, 1, Order::BackToFront));
+    // State first, the distance only breaks ties
+    QVERIFY(QSSGRenderableSorter::sortKey(2.0f, 1, Order::StateFrontToBack) < QSSGRenderableSorter::sortKey(1.0f, 2, Order::StateFrontToBack));
+    QVERIFY(QSSGRenderableSorter::sortKey(1.0f, 1, Order::StateFrontToBack) < QSSGRenderableSorter::sortKey(2.0f, 1, Order::StateFrontToBack));
+}
+
+void sorting::test_radixSort_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("threaded");
+
+    QTest::newRow("0") << 0 << false;
+    QTest::newRow("1") << 1 << false;
+    QTest::newRow("1000") << 1000 << false;
+    QTest::newRow("100000") << 100000 << false;
+    QTest::newRow("100000 threaded") << 100000 << true;
+}
+
+void sorting::test_radixSort()
+{
+    QFETCH(int, count);
+    QFETCH(bool, threaded);
+
+    // Few distinct keys, so that the stability shows
+    QRandomGenerator rng(count);
+    QVector<QSSGRenderableSorter::Entry> entries(count);
+    for (int i = 0; i < count; ++i)
+        entries[i] = { (quint64(rng.bounded(64)) << 40) | rng.bounded(4), quint32(i) };
+
+    QVector<QSSGRenderableSorter::Entry> expected = entries;
+    std::stable_sort(expected.begin(), expected.end(), [](const QSSGRenderableSorter::Entry &lhs,
+                                                          const QSSGRenderableSorter::Entry &rhs) {
+        return lhs.key < rhs.key;
+    });
+
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(3);
+    QVector<QSSGRenderableSorter::Entry> scratch(count);
+    QSSGRenderableSorter::radixSort(entries.data(), scratch.data(), count, threaded ? &threadPool : nullptr);
+
+    for (int i = 0; i < count; ++i) {
+        QCOMPARE(entries.at(i).key, expected.at(i).key);
+        QCOMPARE(entries.at(i).index, expected.at(i).index);
+    }
+}
+
+void sorting::test_sort_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("backToFront");
+
+    QTest::newRow("front to back") << 5000 << false;
+    QTest::newRow("back to front") << 5000 << true;
+}
+
+void sorting::test_sort()
+{
+    QFETCH(int, count);
+    QFETCH(bool, backToFront);
+
+    QRandomGenerator rng(count);
+    std::vector<std::unique_ptr<QSSGRenderableObject>> objects;
+    QVector<QSSGRenderableObjectHandle> handles;
+    for (int i = 0; i < count; ++i) {
+        objects.emplace_back(new QSSGRenderableObject(QSSGRenderableObjectFlags(), QVector3D(),
+                                                      m_transform, m_bounds, m_bounds, 0.0f));
+        objects.back()->stateSortKey = rng.bounded(8);
+        handles.append(QSSGRenderableObjectHandle::create(objects.back().get(), float(rng.bounded(2000)) - 1000.0f));
+    }
+
+    const auto isOrdered = [backToFront](const QSSGRenderableObjectHandle &lhs, const QSSGRenderableObjectHandle &rhs) {
+        if (lhs.cameraDistanceSq != rhs.cameraDistanceSq)
+            return backToFront ? lhs.cameraDistanceSq > rhs.cameraDistanceSq : lhs.cameraDistanceSq < rhs.cameraDistanceSq;
+        return lhs.obj->stateSortKey <= rhs.obj->stateSortKey;
+    };
+
+    QSSGRenderableSorter sorter;
+    const QSSGRenderableSorter::Order order = backToFront ? QSSGRenderableSorter::Order::BackToFront
+                                                          : QSSGRenderableSorter::Order::FrontToBack;
+    // The first frame is radix sorted, the next ones start from its order,
+    // with some of the distances changed in the last one
+    for (int frame = 0; frame < 3; ++frame) {
+        QVector<QSSGRenderableObjectHandle> sorted = handles;
+        sorter.sort(sorted, order);
+        QCOMPARE(sorted.size(), handles.size());
+        for (int i = 1; i < count; ++i)
+            QVERIFY(isOrdered(sorted.at(i - 1), sorted.at(i)));
+
+        std::vector<QSSGRenderableObject *> sortedObjects;
+        for (const QSSGRenderableObjectHandle &handle : qAsConst(sorted))
+            sortedObjects.push_back(handle.obj);
+        std::sort(sortedObjects.begin(), sortedObjects.end());
+        QVERIFY(std::adjacent_find(sortedObjects.begin(), sortedObjects.end()) == sortedObjects.end());
+
+        if (frame == 1) {
+            for (int i = 0; i < count; i += 10)
+                handles[i].cameraDistanceSq += 5.0f;
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(sorting)
+
+#include "tst_sorting.moc"
@@ -0,0 +1,427 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtQuick3DRuntimeRender/private/qssgrenderray_p.h>
+#include <QtQuick3DUtils/private/qssgmeshbvhbuilder_p.h>
+
+#include <memory>
+
+Q_DECLARE_METATYPE(QSSGMeshBVHBuilder::SplitMethod)
+
+// Compares BVH construction time, memory footprint and ray throughput on a
+// generated height field. The grid size can be set with the tst_bvh_grid
+// environment variable (triangles = 2 * grid^2).
+
+// The layout used before the nodes and triangles were stored in flat arrays:
+// one allocation per node and per triangle, children linked by pointers, and
+// a recursive traversal that returns a new list for every leaf that is hit.
+// It is built from a flat tree, so both have the same topology and only the
+// memory layout and the traversal differ.
+namespace PointerTree {
+
+struct Node
+{
+    ~Node()
+    {
+        delete left;
+        delete right;
+    }
+
+    Node *left = nullptr;
+    Node *right = nullptr;
+    QSSGBounds3 boundingData;
+    int offset = 0;
+    int count = 0;
+};
+
+struct Triangle
+{
+    QSSGBounds3 bounds;
+    QVector3D vertex1;
+    QVector3D vertex2;
+    QVector3D vertex3;
+    QVector2D uvCoord1;
+    QVector2D uvCoord2;
+    QVector2D uvCoord3;
+};
+
+struct Tree
+{
+    ~Tree()
+    {
+        delete root;
+        qDeleteAll(triangles);
+    }
+
+    Node *root = nullptr;
+    QVector<Triangle *> triangles;
+};
+
+static Node *copyNode(const QSSGMeshBVH &flat, int index)
+{
+    const QSSGMeshBVHNode &flatNode = flat.nodes.at(index);
+    Node *node = new Node;
+    node->boundingData = flatNode.boundingData;
+    if (flatNode.isLeaf()) {
+        node->offset = flatNode.offset;
+        node->count = flatNode.count;
+    } else {
+        node->left = copyNode(flat, flatNode.left);
+        node->right = copyNode(flat, flatNode.right());
+    }
+    return node;
+}
+
+static Tree *fromFlat(const QSSGMeshBVH &flat)
+{
+    Tree *tree = new Tree;
+    tree->triangles.reserve(flat.triangles.size());
+    for (const QSSGMeshBVHTriangle &flatTriangle : flat.triangles) {
+        Triangle *triangle = new Triangle;
+        triangle->vertex1 = flatTriangle.vertex1;
+        triangle->vertex2 = flatTriangle.vertex2;
+        triangle->vertex3 = flatTriangle.vertex3;
+        triangle->uvCoord1 = flatTriangle.uvCoord1;
+        triangle->uvCoord2 = flatTriangle.uvCoord2;
+        triangle->uvCoord3 = flatTriangle.uvCoord3;
+        triangle->bounds.include(triangle->vertex1);
+        triangle->bounds.include(triangle->vertex2);
+        triangle->bounds.include(triangle->vertex3);
+        tree->triangles.append(triangle);
+    }
+    tree->root = copyNode(flat, flat.roots.first());
+    return tree;
+}
+
+static QVector<QSSGRenderRay::IntersectionResult> intersectTriangles(const QSSGRenderRay::RayData &data,
+                                                                     const QVector<Triangle *> &triangles,
+                                                                     int offset,
+                                                                     int count)
+{
+    QVector<QSSGRenderRay::IntersectionResult> results;
+    for (int i = offset; i < offset + count; ++i) {
+        const Triangle *triangle = triangles[i];
+        QSSGRenderRay relativeRay(data.origin, data.direction);
+        float u = 0.f;
+        float v = 0.f;
+        QVector3D normal;
+        if (QSSGRenderRay::triangleIntersect(relativeRay, triangle->vertex1, triangle->vertex2, triangle->vertex3, u, v, normal)) {
+            const float w = 1.0f - u - v;
+            const QVector3D localIntersectionPoint = u * triangle->vertex1 + v * triangle->vertex2 + w * triangle->vertex3;
+            const QVector2D uvCoordinate = u * triangle->uvCoord1 + v * triangle->uvCoord2 + w * triangle->uvCoord3;
+            const QVector3D sceneIntersectionPos = data.globalTransform.map(localIntersectionPoint);
+            const float rayLengthSquared = (data.ray.origin - sceneIntersectionPos).lengthSquared();
+            results.append(QSSGRenderRay::IntersectionResult(rayLengthSquared, uvCoordinate, sceneIntersectionPos,
+                                                             localIntersectionPoint, normal));
+        }
+    }
+    return results;
+}
+
+static void intersect(const QSSGRenderRay::RayData &data,
+                      const Node *node,
+                      const Tree &tree,
+                      QVector<QSSGRenderRay::IntersectionResult> &intersections)
+{
+    if (!node->left) {
+        const auto results = intersectTriangles(data, tree.triangles, node->offset, node->count);
+        if (!results.isEmpty())
+            intersections.append(results);
+        return;
+    }
+
+    if (QSSGRenderRay::intersectWithAABBv2(data, node->left->boundingData).intersects())
+        intersect(data, node->left, tree, intersections);
+    if (QSSGRenderRay::intersectWithAABBv2(data, node->right->boundingData).intersects())
+        intersect(data, node->right, tree, intersections);
+}
+
+} // namespace PointerTree
+
+class bvh : public QObject
+{
+    Q_OBJECT
+
+public:
+    bvh() = default;
+    ~bvh() = default;
+
+private Q_SLOTS:
+    void initTestCase();
+    void bench_build_data();
+    void bench_build();
+    void bench_buildParallel_data();
+    void bench_buildParallel();
+    void bench_rayCast1k_data();
+    void bench_rayCast1k();
+    void bench_rayCast1kMiss_data();
+    void bench_rayCast1kMiss();
+    void bench_rayCast1kPointerTree_data();
+    void bench_rayCast1kPointerTree();
+    void bench_rayCastCoherent1k_data();
+    void bench_rayCastCoherent1k();
+
+private:
+    void splitMethodData();
+    QSSGMeshBVH *buildTree(QSSGMeshBVHBuilder::SplitMethod method, QThreadPool *pool = nullptr) const;
+    void rayCastImpl(bool hit, bool pointerTree = false);
+
+    QByteArray vertexBuffer;
+    QByteArray indexBuffer;
+    QVector<QSSGRenderRay> hitRays;
+    QVector<QSSGRenderRay> missRays;
+    QVector<QSSGRenderRay> coherentRays;
+    int gridSize = 0;
+    static constexpr int stride = 5 * sizeof(float); // position + uv
+};
+
+void bvh::initTestCase()
+{
+    bool ok = true;
+    gridSize = qEnvironmentVariableIntValue("tst_bvh_grid", &ok);
+    if (!ok || gridSize <= 0)
+        gridSize = 512; // ~500k triangles
+
+    const int vertexCount = (gridSize + 1) * (gridSize + 1);
+    vertexBuffer.resize(vertexCount * stride);
+    float *v = reinterpret_cast<float *>(vertexBuffer.data());
+    for (int y = 0; y <= gridSize; ++y) {
+        for (int x = 0; x <= gridSize; ++x) {
+            *v++ = float(x);
+            *v++ = float(y);
+            *v++ = std::sin(float(x) * 0.1f) * std::cos(float(y) * 0.1f) * 4.0f;
+            *v++ = float(x) / float(gridSize);
+            *v++ = float(y) / float(gridSize);
+        }
+    }
+
+    indexBuffer.resize(gridSize * gridSize * 6 * sizeof(quint32));
+    quint32 *i = reinterpret_cast<quint32 *>(indexBuffer.data());
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            const quint32 a = y * (gridSize + 1) + x;
+            const quint32 b = a + 1;
+            const quint32 c = a + gridSize + 1;
+            const quint32 d = c + 1;
+            *i++ = a; *i++ = b; *i++ = c;
+            *i++ = b; *i++ = d; *i++ = c;
+        }
+    }
+
+    // Deterministic set of rays shooting down onto the height field
+    QRandomGenerator rng(1234);
+    for (int r = 0; r != 1000; ++r) {
+        const float x = float(rng.bounded(double(gridSize)));
+        const float y = float(rng.bounded(double(gridSize)));
+        hitRays.append(QSSGRenderRay({ x, y, 100.0f }, { 0.0f, 0.0f, -1.0f }));
+        missRays.append(QSSGRenderRay({ x, y, 100.0f }, { 0.0f, 0.0f, 1.0f }));
+    }
+
+    // Neighboring rays from a common origin, like the ones of a sensor
+    const float center = gridSize * 0.5f;
+    for (int y = 0; y != 25; ++y) {
+        for (int x = 0; x != 40; ++x) {
+            const QVector3D target(center + (x - 20) * 0.25f, center + (y - 12) * 0.25f, 0.0f);
+            const QVector3D origin(center, center, 100.0f);
+            coherentRays.append(QSSGRenderRay(origin, (target - origin).normalized()));
+        }
+    }
+}
+
+void bvh::splitMethodData()
+{
+    QTest::addColumn<QSSGMeshBVHBuilder::SplitMethod>("method");
+    QTest::newRow("averageCentroid") << QSSGMeshBVHBuilder::SplitMethod::AverageCentroid;
+    QTest::newRow("sah") << QSSGMeshBVHBuilder::SplitMethod::SAH;
+}
+
+QSSGMeshBVH *bvh::buildTree(QSSGMeshBVHBuilder::SplitMethod method, QThreadPool *pool) const
+{
+    QSSGMeshBVHBuilder builder(vertexBuffer, stride, 0, true, 3 * sizeof(float), true, indexBuffer,
+                               QSSGRenderComponentType::UnsignedInteger32);
+    builder.setSplitMethod(method);
+    builder.setThreadPool(pool);
+    return builder.buildTree();
+}
+
+void bvh::bench_build_data()
+{
+    splitMethodData();
+}
+
+void bvh::bench_build()
+{
+    QFETCH(QSSGMeshBVHBuilder::SplitMethod, method);
+
+    QBENCHMARK {
+        std::unique_ptr<QSSGMeshBVH> tree(buildTree(method));
+        QVERIFY(tree);
+    }
+
+    std::unique_ptr<QSSGMeshBVH> tree(buildTree(method));
+    const QSSGMeshBVH::Statistics stats = tree->statistics();
+    qInfo("triangles: %lld, nodes: %d, leaves: %d, depth: %d, leaf triangles avg: %.2f max: %d, "
+          "SAH cost: %.2f, memory: %lld KiB",
+          qlonglong(tree->triangles.size()), stats.nodeCount, stats.leafCount, stats.maxDepth,
+          stats.averageLeafTriangles, stats.maxLeafTriangles, stats.sahCost,
+          qlonglong(tree->memoryUsage() / 1024));
+}
+
+void bvh::bench_buildParallel_data()
+{
+    splitMethodData();
+}
+
+void bvh::bench_buildParallel()
+{
+    QFETCH(QSSGMeshBVHBuilder::SplitMethod, method);
+
+    QThreadPool pool;
+    QBENCHMARK {
+        std::unique_ptr<QSSGMeshBVH> tree(buildTree(method, &pool));
+        QVERIFY(tree);
+    }
+
+    // Must be identical to the serial build
+    std::unique_ptr<QSSGMeshBVH> serial(buildTree(method));
+    std::unique_ptr<QSSGMeshBVH> parallel(buildTree(method, &pool));
+    QCOMPARE(parallel->nodes.size(), serial->nodes.size());
+    QCOMPARE(parallel->statistics().sahCost, serial->statistics().sahCost);
+}
+
+void bvh::bench_rayCast1k_data()
+{
+    splitMethodData();
+}
+
+void bvh::bench_rayCast1k()
+{
+    rayCastImpl(true);
+}
+
+void bvh::bench_rayCast1kMiss_data()
+{
+    splitMethodData();
+}
+
+void bvh::bench_rayCast1kMiss()
+{
+    rayCastImpl(false);
+}
+
+void bvh::bench_rayCast1kPointerTree_data()
+{
+    splitMethodData();
+}
+
+void bvh::bench_rayCast1kPointerTree()
+{
+    // Baseline for bench_rayCast1k
+    rayCastImpl(true, true);
+}
+
+void bvh::rayCastImpl(bool hit, bool pointerTree)
+{
+    QFETCH(QSSGMeshBVHBuilder::SplitMethod, method);
+    std::unique_ptr<QSSGMeshBVH> tree(buildTree(method));
+    QVERIFY(tree && !tree->roots.isEmpty());
+    std::unique_ptr<PointerTree::Tree> baseline(pointerTree ? PointerTree::fromFlat(*tree) : nullptr);
+
+    const QMatrix4x4 globalTransform;
+    const auto &rays = hit ? hitRays : missRays;
+    QVector<QSSGRenderRay::IntersectionResult> results;
+    qsizetype hits = 0;
+
+    // Each iteration casts 1000 rays, so rays/sec = 1000 / (time per iteration)
+    QBENCHMARK {
+        hits = 0;
+        for (const auto &ray : rays) {
+            const auto rayData = QSSGRenderRay::createRayData(globalTransform, ray);
+            results.clear();
+            if (baseline)
+                PointerTree::intersect(rayData, baseline->root, *baseline, results);
+            else
+                QSSGRenderRay::intersectWithBVH(rayData, *tree, tree->roots.first(), results);
+            hits += results.isEmpty() ? 0 : 1;
+        }
+    }
+
+    QCOMPARE(hits != 0, hit);
+}
+
+void bvh::bench_rayCastCoherent1k_data()
+{
+    QTest::addColumn<bool>("packets");
+    QTest::newRow("single") << false;
+    QTest::newRow("packets") << true;
+}
+
+void bvh::bench_rayCastCoherent1k()
+{
+    QFETCH(bool, packets);
+    std::unique_ptr<QSSGMeshBVH> tree(buildTree(QSSGMeshBVHBuilder::SplitMethod::SAH));
+    QVERIFY(tree && !tree->roots.isEmpty());
+
+    const QMatrix4x4 globalTransform;
+    QVector<QSSGRenderRay::IntersectionResult> results;
+    qsizetype hits = 0;
+
+    QBENCHMARK {
+        hits = 0;
+        if (packets) {
+            constexpr int Size = QSSGRenderRay::RayPacket::Size;
+            for (int first = 0; first < coherentRays.size(); first += Size) {
+                const int count = qMin(Size, int(coherentRays.size()) - first);
+                const QSSGRenderRay *rays[Size];
+                for (int lane = 0; lane != count; ++lane)
+                    rays[lane] = &coherentRays[first + lane];
+                const auto packet = QSSGRenderRay::createRayPacket(globalTransform, rays, count);
+                QSSGRenderRay::IntersectionResult packetResults[Size];
+                QSSGRenderRay::intersectWithBVH(packet, *tree, tree->roots.first(), packetResults);
+                for (int lane = 0; lane != count; ++lane)
+                    hits += packetResults[lane].intersects ? 1 : 0;
+            }
+        } else {
+            for (const auto &ray : coherentRays) {
+                const auto rayData = QSSGRenderRay::createRayData(globalTransform, ray);
+                results.clear();
+                QSSGRenderRay::intersectWithBVH(rayData, *tree, tree->roots.first(), results);
+                hits += results.isEmpty() ? 0 : 1;
+            }
+        }
+    }
+
+    QCOMPARE(hits, coherentRays.size());
+}
+
+QTEST_APPLESS_MAIN(bvh)
+
+#include "tst_bvh.moc"
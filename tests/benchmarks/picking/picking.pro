@@ -1,7 +1,9 @@
 TEMPLATE = subdirs
 
 qtConfig(private_tests) {
-    SUBDIRS += intersection
+    SUBDIRS += intersection \
+               bvh \
+               scene
 }
 
 SUBDIRS += \
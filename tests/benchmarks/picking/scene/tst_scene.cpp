@@ -0,0 +1,232 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Quick 3D.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest>
+
+#include <QtQuick3DRuntimeRender/private/qssgrenderray_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderlayer_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendermodel_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrenderpickingbvh_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgrendererimpllayerrenderpreparationdata_p.h>
+
+#include <QtCore/QRandomGenerator>
+
+// Compares finding the pick candidates of a layer with the picking BVH against
+// visiting every model, and measures keeping the tree up to date when models
+// move. The models are unit cubes scattered in a volume.
+
+class scene : public QObject
+{
+    Q_OBJECT
+
+public:
+    scene() = default;
+    ~scene() = default;
+
+private Q_SLOTS:
+    void bench_fullTraversal_data();
+    void bench_fullTraversal();
+    void bench_findCandidates_data();
+    void bench_findCandidates();
+    void bench_rebuild_data();
+    void bench_rebuild();
+    void bench_refit_data();
+    void bench_refit();
+
+private:
+    struct Scene
+    {
+        QSSGRenderLayer layer;
+        QVector<QSSGRenderModel *> models;
+        QVector<QSSGRenderableNodeEntry> renderables;
+        QVector<QSSGRenderRay> rays;
+
+        ~Scene() { qDeleteAll(models); }
+    };
+
+    static void modelCountData();
+    static void createScene(Scene &scene, int modelCount);
+    static void moveModel(QSSGRenderModel &model, const QVector3D &position);
+    static QSSGBounds3 localBounds(const QSSGRenderNode &node);
+    static void updateBVH(Scene &scene);
+};
+
+void scene::modelCountData()
+{
+    QTest::addColumn<int>("modelCount");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("20k") << 20000;
+}
+
+void scene::moveModel(QSSGRenderModel &model, const QVector3D &position)
+{
+    model.position = position;
+    model.markDirty(QSSGRenderNode::TransformDirtyFlag::TransformIsDirty);
+    model.calculateGlobalVariables();
+}
+
+QSSGBounds3 scene::localBounds(const QSSGRenderNode &)
+{
+    return QSSGBounds3(QVector3D(-0.5f, -0.5f, -0.5f), QVector3D(0.5f, 0.5f, 0.5f));
+}
+
+void scene::createScene(Scene &scene, int modelCount)
+{
+    // A fixed seed so every run picks in the same scene
+    QRandomGenerator random(1234);
+    const auto randomPosition = [&random]() {
+        return QVector3D(random.bounded(1000.0), random.bounded(1000.0), random.bounded(1000.0));
+    };
+
+    scene.models.reserve(modelCount);
+    for (int i = 0; i < modelCount; ++i) {
+        auto *model = new QSSGRenderModel;
+        model->flags.setFlag(QSSGRenderNode::Flag::LocallyPickable, true);
+        scene.layer.addChild(*model);
+        moveModel(*model, randomPosition());
+        scene.models.append(model);
+        scene.renderables.append(QSSGRenderableNodeEntry(*model));
+    }
+
+    // Rays through the volume along z, about half of them hit a model
+    for (int i = 0; i < 1000; ++i) {
+        const QVector3D target = randomPosition();
+        scene.rays.append(QSSGRenderRay(QVector3D(target.x(), target.y(), -10.0f), QVector3D(0.0f, 0.0f, 1.0f)));
+    }
+}
+
+void scene::updateBVH(Scene &scene)
+{
+    scene.layer.pickingBVH->update(scene.renderables, false, localBounds);
+}
+
+void scene::bench_fullTraversal_data()
+{
+    modelCountData();
+}
+
+void scene::bench_fullTraversal()
+{
+    QFETCH(int, modelCount);
+    Scene s;
+    createScene(s, modelCount);
+
+    // What picking did without the tree: visit every node of the layer and
+    // test the ray against its bounds
+    qsizetype candidateCount = 0;
+    QBENCHMARK {
+        candidateCount = 0;
+        for (const QSSGRenderRay &ray : qAsConst(s.rays)) {
+            for (const QSSGRenderNode &node : s.layer.children) {
+                if (!node.flags.testFlag(QSSGRenderNode::Flag::LocallyPickable))
+                    continue;
+                const auto rayData = QSSGRenderRay::createRayData(node.globalTransform, ray);
+                const QSSGBounds3 bounds = localBounds(node);
+                if (QSSGRenderRay::intersectWithAABBv2(rayData, bounds).intersects())
+                    ++candidateCount;
+            }
+        }
+    }
+    QVERIFY(candidateCount > 0);
+}
+
+void scene::bench_findCandidates_data()
+{
+    modelCountData();
+}
+
+void scene::bench_findCandidates()
+{
+    QFETCH(int, modelCount);
+    Scene s;
+    createScene(s, modelCount);
+    updateBVH(s);
+
+    qsizetype candidateCount = 0;
+    QBENCHMARK {
+        candidateCount = 0;
+        for (const QSSGRenderRay &ray : qAsConst(s.rays)) {
+            QSSGRenderPickingBVH::NodeList candidates;
+            QVERIFY(s.layer.pickingBVH->findCandidates(ray, false, candidates));
+            candidateCount += candidates.size();
+        }
+    }
+    QVERIFY(candidateCount > 0);
+}
+
+void scene::bench_rebuild_data()
+{
+    modelCountData();
+}
+
+void scene::bench_rebuild()
+{
+    QFETCH(int, modelCount);
+    Scene s;
+    createScene(s, modelCount);
+
+    QBENCHMARK {
+        s.layer.pickingBVH->invalidate();
+        updateBVH(s);
+    }
+    QCOMPARE(s.layer.pickingBVH->entryCount(), qsizetype(modelCount));
+}
+
+void scene::bench_refit_data()
+{
+    modelCountData();
+}
+
+void scene::bench_refit()
+{
+    QFETCH(int, modelCount);
+    Scene s;
+    createScene(s, modelCount);
+    updateBVH(s);
+
+    // Move one percent of the models a little every frame
+    const int movingCount = qMax(1, modelCount / 100);
+    int frame = 0;
+    const int rebuildCount = s.layer.pickingBVH->rebuildCount();
+    QBENCHMARK {
+        const float offset = (frame++ % 2) ? 1.0f : -1.0f;
+        for (int i = 0; i < movingCount; ++i) {
+            QSSGRenderModel &model = *s.models.at(i);
+            moveModel(model, model.position + QVector3D(offset, 0.0f, 0.0f));
+        }
+        updateBVH(s);
+    }
+    // Small moves must not cause rebuilds
+    QCOMPARE(s.layer.pickingBVH->rebuildCount(), rebuildCount);
+}
+
+QTEST_APPLESS_MAIN(scene)
+
+#include "tst_scene.moc"
@@ -30,9 +30,11 @@
 #include <QtTest>
 
 #include <QtCore/qvector.h>
+#include <QtCore/qthread.h>
 
 #include <QtQuick3DRuntimeRender/private/qssgrenderer_p.h>
 #include <QtQuick3DRuntimeRender/private/qssgrendernode_p.h>
+#include <QtQuick3DRuntimeRender/private/qssgperframeallocator_p.h>
 #include <QtQuick3D/private/qquick3dscenemanager_p.h>
 
 class tst_renderer : public QObject
@@ -46,6 +48,10 @@ public:
 private Q_SLOTS:
     void initTestCase();
     void bench_prep();
+    void bench_prepThreads_data();
+    void bench_prepThreads();
+    void bench_prepRetained_data();
+    void bench_prepRetained();
 
 private:
     QRhi *rhi = nullptr;
@@ -139,6 +145,67 @@ void tst_renderer::bench_prep()
         renderContext->prepareLayerForRender(layer);
         renderContext->endFrame();
     }
+
+    // What a frame needs from the per-frame allocator, for sizing its slabs
+    const QSSGPerFrameAllocator::Stats stats = renderContext->perFrameAllocator().stats();
+    qDebug("Per-frame allocator: %llu bytes in %llu allocations, %d slabs, %llu large allocations",
+           stats.allocatedBytes, stats.allocationCount, stats.slabsInUse, stats.largeAllocationCount);
+}
+
+void tst_renderer::bench_prepThreads_data()
+{
+    QTest::addColumn<int>("threadCount");
+
+    const int idealThreadCount = QThread::idealThreadCount();
+    for (int threadCount = 1; threadCount < idealThreadCount; threadCount *= 2)
+        QTest::addRow("%d threads", threadCount) << threadCount;
+    QTest::addRow("%d threads", idealThreadCount) << idealThreadCount;
+}
+
+void tst_renderer::bench_prepThreads()
+{
+    QFETCH(int, threadCount);
+    QVERIFY(!layer.children.isEmpty());
+
+    const QSSGRef<QSSGRenderer> &renderer = renderContext->renderer();
+    const int oldThreadCount = renderer->prepareThreadCount();
+    renderer->setPrepareThreadCount(threadCount);
+    QBENCHMARK {
+        renderContext->beginFrame();
+        renderContext->prepareLayerForRender(layer);
+        renderContext->endFrame();
+    }
+    renderer->setPrepareThreadCount(oldThreadCount);
+}
+
+void tst_renderer::bench_prepRetained_data()
+{
+    QTest::addColumn<bool>("retained");
+
+    QTest::addRow("immediate") << false;
+    QTest::addRow("retained") << true;
+}
+
+void tst_renderer::bench_prepRetained()
+{
+    QFETCH(bool, retained);
+    QVERIFY(!layer.children.isEmpty());
+
+    // A static scene with a moving camera
+    const QSSGRef<QSSGRenderer> &renderer = renderContext->renderer();
+    const bool oldRetained = renderer->retainedRenderables();
+    renderer->setRetainedRenderables(retained);
+    const QVector3D cameraPosition = camera.position;
+    QBENCHMARK {
+        camera.position += QVector3D(0.0f, 0.0f, 1.0f);
+        camera.markDirty(QSSGRenderNode::TransformDirtyFlag::TransformIsDirty);
+        renderContext->beginFrame();
+        renderContext->prepareLayerForRender(layer);
+        renderContext->endFrame();
+    }
+    camera.position = cameraPosition;
+    camera.markDirty(QSSGRenderNode::TransformDirtyFlag::TransformIsDirty);
+    renderer->setRetainedRenderables(oldRetained);
 }
 
 QTEST_APPLESS_MAIN(tst_renderer)